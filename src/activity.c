@@ -0,0 +1,363 @@
+/**
+ * activity.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#include "activity.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+#define NAME_MAX_LEN 64
+#define WIDTH_MAX 18
+
+enum signal {
+	SIG_ADDRESS,
+	SIG_INSTRUCTION,
+	SIG_REG,
+	SIG_ZERO = SIG_REG + SIM_REGS,
+	SIG_CARRY,
+	SIG_IE,
+	SIG_PORT_ID,
+	SIG_IN_PORT,
+	SIG_OUT_PORT,
+	SIG_READ_STROBE,
+	SIG_WRITE_STROBE,
+	SIG_INTERRUPT,
+	SIG_INTERRUPT_ACK,
+	SIG_ALU_RESULT,
+	SIG_COUNT
+};
+
+static const char *names[SIG_COUNT] = {
+	[SIG_ADDRESS] = "address",
+	[SIG_INSTRUCTION] = "instruction",
+	[SIG_ZERO] = "zero",
+	[SIG_CARRY] = "carry",
+	[SIG_IE] = "ie",
+	[SIG_PORT_ID] = "port_id",
+	[SIG_IN_PORT] = "in_port",
+	[SIG_OUT_PORT] = "out_port",
+	[SIG_READ_STROBE] = "read_strobe",
+	[SIG_WRITE_STROBE] = "write_strobe",
+	[SIG_INTERRUPT] = "interrupt",
+	[SIG_INTERRUPT_ACK] = "interrupt_ack",
+	[SIG_ALU_RESULT] = "alu_result"
+};
+
+static unsigned width(int sig)
+{
+	if(sig == SIG_ADDRESS)
+		return 10;
+	if(sig == SIG_INSTRUCTION)
+		return 18;
+	if(sig < SIG_ZERO || sig == SIG_PORT_ID || sig == SIG_IN_PORT || sig == SIG_OUT_PORT
+			|| sig == SIG_ALU_RESULT)
+		return 8;
+	return 1;
+}
+
+static const char *name_of(int sig, char buf[NAME_MAX_LEN])
+{
+	if(sig >= SIG_REG && sig < SIG_ZERO) {
+		snprintf(buf, NAME_MAX_LEN, "s%X", sig - SIG_REG);
+		return buf;
+	}
+	return names[sig];
+}
+
+struct bit {
+	uint64_t toggles;
+	uint64_t high;	// cycles until since
+	uint64_t since;	// cycle of the last toggle
+};
+
+struct activity {
+	struct sim *sim;
+	struct profile *prof;
+	uint64_t start;
+	uint16_t current;	// subroutine of the profile running the instruction
+	uint32_t value[SIG_COUNT];
+	struct bit bits[SIG_COUNT][WIDTH_MAX];
+	uint64_t toggles;
+	uint64_t address[SIM_PROGRAM_LEN];
+	uint64_t routine[SIM_PROGRAM_LEN];	// by entries
+};
+
+struct activity *activity_init(struct sim *s, struct profile *p)
+{
+	struct activity *a = (struct activity *) calloc(1, sizeof(struct activity));
+	if(a == NULL)
+		return NULL;
+
+	a->sim = s;
+	a->prof = p;
+	a->start = s->cycles;
+
+	// the ports and strobes start low
+	a->value[SIG_ADDRESS] = s->pc;
+	a->value[SIG_INSTRUCTION] = s->code[s->pc];
+	for(int i = 0; i < SIM_REGS; i++)
+		a->value[SIG_REG + i] = s->reg[i];
+	a->value[SIG_ZERO] = sim_zero(s);
+	a->value[SIG_CARRY] = sim_carry(s);
+	a->value[SIG_IE] = s->ie;
+	a->value[SIG_INTERRUPT] = s->irq;
+	for(int sig = 0; sig < SIG_COUNT; sig++) {
+		for(unsigned i = 0; i < WIDTH_MAX; i++)
+			a->bits[sig][i].since = s->cycles;
+	}
+	return a;
+}
+
+void activity_destroy(struct activity *a)
+{
+	free(a);
+}
+
+uint64_t activity_toggles(const struct activity *a)
+{
+	return a->toggles;
+}
+
+uint64_t activity_address(const struct activity *a, uint16_t addr)
+{
+	return a->address[addr & PC_MASK];
+}
+
+// =================================== //
+// ------------- counting ------------ //
+// =================================== //
+
+/**
+ * @return toggles of the bits
+ */
+static unsigned change(struct activity *a, uint64_t cycle, int sig, uint32_t value)
+{
+	const uint32_t old = a->value[sig];
+	const uint32_t diff = old ^ value;
+	unsigned toggles = 0;
+
+	for(unsigned i = 0; diff >> i != 0; i++) {
+		if(!(diff >> i & 1))
+			continue;
+
+		struct bit *b = &a->bits[sig][i];
+		if(old >> i & 1)
+			b->high += cycle - b->since;
+		b->since = cycle;
+		b->toggles += 1;
+		toggles += 1;
+	}
+
+	a->value[sig] = value;
+	return toggles;
+}
+
+static unsigned pulse(struct activity *a, uint64_t rise, uint64_t fall, int sig)
+{
+	return change(a, rise, sig, 1) + change(a, fall, sig, 0);
+}
+
+static void count(struct activity *a, uint16_t address, uint16_t routine, unsigned toggles)
+{
+	a->toggles += toggles;
+	a->address[address] += toggles;
+	a->routine[routine] += toggles;
+}
+
+/**
+ * The interrupt was raised after the last instruction, the acknowledge
+ * belongs to the handler.
+ */
+static void acknowledged(struct sim *s, uint64_t end, void *ctx)
+{
+	struct activity *a = (struct activity *) ctx;
+	count(a, SIM_VECTOR, SIM_VECTOR, change(a, end, SIG_INTERRUPT, 1)
+			+ pulse(a, end + 1, s->cycles, SIG_INTERRUPT_ACK)
+			+ change(a, s->cycles, SIG_IE, s->ie));
+}
+
+static void before(struct sim *s, const struct step *st, void *ctx)
+{
+	(void) s;
+	(void) st;
+	struct activity *a = (struct activity *) ctx;
+	a->current = a->prof != NULL? profile_current(a->prof) : 0;
+}
+
+static void after(struct sim *s, const struct step *st, void *ctx)
+{
+	struct activity *a = (struct activity *) ctx;
+	const uint64_t cycle = st->cycle;
+	const uint64_t begin = st->begin;
+	const struct sim_instr *ins = &s->rom[st->address];
+	const bool rr = ins->op == S_INPUT_RR || ins->op == S_OUTPUT_RR;
+	const uint8_t port = rr? st->reg[ins->y] : ins->y;
+	const bool input = ins->op == S_INPUT_RR || ins->op == S_INPUT_RK;
+	const bool output = ins->op == S_OUTPUT_RR || ins->op == S_OUTPUT_RK;
+
+	// the result of the ALU, not written by COMPARE and TEST
+	const uint8_t operand = ins->op == S_COMPARE_RR || ins->op == S_TEST_RR? st->reg[ins->y] : ins->y;
+	int result = -1;
+	if(ins->op == S_COMPARE_RR || ins->op == S_COMPARE_RK)
+		result = (uint8_t) (st->reg[ins->x] - operand);
+	else if(ins->op == S_TEST_RR || ins->op == S_TEST_RK)
+		result = st->reg[ins->x] & operand;
+
+	unsigned toggles = change(a, cycle, SIG_INTERRUPT, st->irq);
+	if(st->ack) {
+		toggles += pulse(a, cycle + 1, begin, SIG_INTERRUPT_ACK);
+		toggles += change(a, begin, SIG_IE, 0);
+	}
+
+	toggles += change(a, begin, SIG_ADDRESS, st->address);
+	toggles += change(a, begin, SIG_INSTRUCTION, s->code[st->address]);
+	if(input || output) {
+		toggles += change(a, begin, SIG_PORT_ID, port);
+		if(output)
+			toggles += change(a, begin, SIG_OUT_PORT, st->reg[ins->x]);
+		else
+			toggles += change(a, begin + 1, SIG_IN_PORT, s->reg[ins->x]);
+		toggles += pulse(a, begin + 1, begin + 2, input? SIG_READ_STROBE : SIG_WRITE_STROBE);
+	}
+
+	if(result < 0 && ((ins->op <= S_INPUT_RK && ins->op != S_STORE_RR && ins->op != S_STORE_RK)
+				|| (ins->op >= S_SL0 && ins->op <= S_RR)))
+		result = s->reg[ins->x];
+	if(result >= 0)
+		toggles += change(a, s->cycles, SIG_ALU_RESULT, result);
+
+	for(int i = 0; i < SIM_REGS; i++)
+		toggles += change(a, s->cycles, SIG_REG + i, s->reg[i]);
+	toggles += change(a, s->cycles, SIG_ZERO, sim_zero(s));
+	toggles += change(a, s->cycles, SIG_CARRY, sim_carry(s));
+	toggles += change(a, s->cycles, SIG_IE, s->ie);
+
+	count(a, st->address, st->ack? SIM_VECTOR : a->current, toggles);
+}
+
+bool activity_observe(struct activity *a, struct stepper *st)
+{
+	const struct step_observer o = {.acknowledged = &acknowledged, .before = &before,
+		.after = &after, .ctx = a};
+	return step_observe(st, &o);
+}
+
+// =================================== //
+// ------------- output -------------- //
+// =================================== //
+
+void activity_print_saif(const struct activity *a, unsigned period, FILE *f)
+{
+	const uint64_t now = a->sim->cycles;
+	const unsigned long long duration = (now - a->start) * period;
+
+	fprintf(f, "(SAIFILE\n(SAIFVERSION \"2.0\")\n(DIRECTION \"backward\")\n(DESIGN )\n"
+			"(VENDOR \"Pico Simulator\")\n(PROGRAM_NAME \"picosim\")\n(VERSION \"0.1\")\n"
+			"(DIVIDER / )\n(TIMESCALE 1 ns)\n(DURATION %llu)\n", duration);
+	fprintf(f, "(INSTANCE kcpsm3\n  (NET\n");
+
+	for(int sig = 0; sig < SIG_COUNT; sig++) {
+		char name[NAME_MAX_LEN];
+		for(unsigned i = 0; i < width(sig); i++) {
+			const struct bit *b = &a->bits[sig][i];
+			const uint64_t high = b->high + (a->value[sig] >> i & 1? now - b->since : 0);
+			if(width(sig) == 1)
+				fprintf(f, "    (%s\n", name_of(sig, name));
+			else
+				fprintf(f, "    (%s\\[%u\\]\n", name_of(sig, name), i);
+			fprintf(f, "      (T0 %llu) (T1 %llu) (TX 0)\n      (TC %llu) (IG 0)\n    )\n",
+					duration - high * period, (unsigned long long) high * period,
+					(unsigned long long) b->toggles);
+		}
+	}
+
+	fprintf(f, "  )\n)\n)\n");
+}
+
+struct routine {
+	uint16_t entry;
+	uint64_t toggles;
+	uint64_t cycles;
+};
+
+static int cmp_toggles(const void *a, const void *b)
+{
+	const struct routine *x = (const struct routine *) a;
+	const struct routine *y = (const struct routine *) b;
+	if(x->toggles != y->toggles)
+		return x->toggles < y->toggles? 1 : -1;
+	return x->entry - y->entry;
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+	return total == 0? 0 : 100.0 * part / total;
+}
+
+static double ratio(uint64_t toggles, uint64_t cycles)
+{
+	return cycles == 0? 0 : (double) toggles / cycles;
+}
+
+void activity_print_energy(const struct activity *a, FILE *f)
+{
+	const uint64_t cycles = a->sim->cycles - a->start;
+	fprintf(f, "# %llu toggles in %llu cycles, %.2f per cycle\n",
+			(unsigned long long) a->toggles, (unsigned long long) cycles,
+			ratio(a->toggles, cycles));
+
+	if(a->prof != NULL) {
+		struct routine routines[SIM_PROGRAM_LEN];
+		size_t len = 0;
+		for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+			struct profile_routine r;
+			if(!profile_routine(a->prof, i, &r))
+				continue;
+			routines[len].entry = i;
+			routines[len].toggles = a->routine[i];
+			routines[len++].cycles = r.exclusive;
+		}
+		qsort(routines, len, sizeof(routines[0]), &cmp_toggles);
+
+		fprintf(f, "#   toggles       %%       cycles  per cycle  routine\n");
+		for(size_t i = 0; i < len; i++) {
+			const struct routine *r = &routines[i];
+			const char *label = profile_label(a->prof, r->entry);
+			char name[NAME_MAX_LEN];
+			if(label == NULL)
+				snprintf(name, sizeof(name), "%.3X", r->entry);
+			fprintf(f, "%11llu %6.2f%% %12llu %10.2f  %s\n", (unsigned long long) r->toggles,
+					percent(r->toggles, a->toggles), (unsigned long long) r->cycles,
+					ratio(r->toggles, r->cycles), label != NULL? label : name);
+		}
+		fputc('\n', f);
+	}
+
+	fprintf(f, "#   toggles       %%  signal\n");
+	for(int sig = 0; sig < SIG_COUNT; sig++) {
+		uint64_t toggles = 0;
+		for(unsigned i = 0; i < width(sig); i++)
+			toggles += a->bits[sig][i].toggles;
+
+		char name[NAME_MAX_LEN];
+		fprintf(f, "%11llu %6.2f%%  %s\n", (unsigned long long) toggles,
+				percent(toggles, a->toggles), name_of(sig, name));
+	}
+}
@@ -0,0 +1,91 @@
+/**
+ * activity.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#ifndef _ACTIVITY_H
+#define _ACTIVITY_H
+
+#include "sim.h"
+#include "profile.h"
+#include "step.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Switching activity of the processor for the power estimation. The toggles
+ * of every bit of the signals of the KCPSM3 macro (see vcd.h), of the registers,
+ * the flags and of the ALU result (the value written to the register, or the
+ * one of COMPARE and TEST) are counted with the time each bit spent high,
+ * nothing is written during the simulation. The timing of the signals within
+ * an instruction is that of the waveforms.
+ *
+ * The activity is written in SAIF (Switching Activity Interchange Format)
+ * read by the power estimation of the FPGA tools, the nets of the instance
+ * kcpsm3 are the bits of the signals, eg. address\[0\].
+ *
+ * With a profile the toggles are attributed to the subroutines like its
+ * exclusive cycles, the toggles are the proxy of the dynamic energy (every
+ * net is taken with the same capacitance). The profile observes the same
+ * stepper (see step.h).
+ */
+
+struct activity;
+
+/**
+ * Starts counting at the current state of the simulator.
+ * @param p profile of the subroutines, or NULL
+ * @return NULL on allocation error
+ */
+struct activity *activity_init(struct sim *s, struct profile *p);
+
+void activity_destroy(struct activity *a);
+
+/**
+ * Counts the toggles of the instructions executed by the stepper. An interrupt
+ * acknowledged by the host (see sched_run) is counted before the next
+ * instruction.
+ * @return false when it has too many observers
+ */
+bool activity_observe(struct activity *a, struct stepper *st);
+
+/**
+ * Toggles of all bits.
+ */
+uint64_t activity_toggles(const struct activity *a);
+
+/**
+ * Toggles during the instructions at the address (and the acknowledge
+ * of the interrupt for the vector).
+ */
+uint64_t activity_address(const struct activity *a, uint16_t addr);
+
+/**
+ * Writes the SAIF file with the durations in nanoseconds.
+ * @param period of the clock in nanoseconds
+ */
+void activity_print_saif(const struct activity *a, unsigned period, FILE *f);
+
+/**
+ * Prints the subroutines of the profile ordered by their toggles, with their
+ * exclusive cycles and toggles per cycle, and the toggles of the signals.
+ */
+void activity_print_energy(const struct activity *a, FILE *f);
+
+#endif
@@ -23,27 +23,25 @@
 #include "assembler.h"
 #include "output.h"
 #include "wait_queue.h"
+#include "xref.h"
+#include <stdio.h>
+#include <strings.h>
 #include <assert.h>
 
-/**
- * Pushedback token
- */
-static struct token *pushback = NULL;
-
-#define PUSHBACK_TOKEN(t) {pushback = t; debug("pushback");};
+#define PUSHBACK_TOKEN(p, t) {p->pushback = t; debug("pushback");};
 
 #define GET_TOKEN(p) {\
-	if(pushback != NULL) {\
-		p->tok = pushback;\
-		pushback = NULL;\
+	if(p->pushback != NULL) {\
+		p->tok = p->pushback;\
+		p->pushback = NULL;\
 	}\
 	else if(!scanner_next(p))\
 		return false;}
 
 #define GET_TOKEN_AND_MATCH(p, t, m) {\
-	if(pushback != NULL) {\
-		p->tok = pushback;\
-		pushback = NULL;\
+	if(p->pushback != NULL) {\
+		p->tok = p->pushback;\
+		p->pushback = NULL;\
 	}\
 	else if(!scanner_next(p))\
 		return false;\
@@ -62,6 +60,10 @@ static struct token *pushback = NULL;
 	if(p->tok->type != T_LITERAL || p->tok->value.l->lit != k)\
 		return error(p, msg);
 
+#define XREF(p, d, kind) \
+	if(!xref_record(p, d, kind))\
+		return false;
+
 static bool finish_wait_instr(struct pico *pico, struct stab_data *data)
 {
 	debug_here();
@@ -82,7 +84,7 @@ static bool finish_wait_instr(struct pico *pico, struct stab_data *data)
 			return error(pico, "Fatal error: register must be set at time");
 			break;
 		case L_LABEL:
-			code = instr_encode_paddr(code, data->value.a);
+			code = instr_encode_paddr(pico->isa, code, data->value.a);
 			break;
 		default:
 			return error(pico, "Fatal error: can not finish instruction");
@@ -125,6 +127,7 @@ static bool set_constant(struct pico *pico)
 
 	name->lit = L_CONSTANT;
 	name->value.n = number;
+	XREF(pico, name, X_DEFINE);
 	return finish_wait_instr(pico, name);
 }
 
@@ -148,6 +151,8 @@ static bool set_register(struct pico *pico)
 	regnew->lit = L_REGISTER; // create new
 	regnew->value.reg = regold->value.reg;
 	regold->lit = L_UNKNOWN; // delete old
+	XREF(pico, regold, X_RENAME);
+	XREF(pico, regnew, X_DEFINE);
 	return true;
 }
 
@@ -156,7 +161,7 @@ static bool ins_interrupt(struct pico *pico, enum instr opcode)
 	debug_here();
 	GET_TOKEN_AND_MATCH(pico, T_LITERAL, "Expected the keyword 'INTERRUPT' here");
 	MATCH_KEYWORD(pico, K_INTERRUPT, "Expected the keyword 'INTERRUPT' here");
-	return output_code(pico, pico->address++, (code_t) opcode);
+	return output_code(pico, pico->address++, isa_opcode(pico->isa, opcode));
 }
 
 static bool ins_returni(struct pico *pico)
@@ -165,11 +170,13 @@ static bool ins_returni(struct pico *pico)
 	GET_TOKEN(pico);
 
 	if(pico->tok->type == T_LITERAL && pico->tok->value.l->kw == K_ENABLE) {
-		return output_code(pico, pico->address++, (code_t) I_RETURNI_ENABLE);
+		return output_code(pico, pico->address++,
+				isa_opcode(pico->isa, I_RETURNI_ENABLE));
 	}
 
 	if(pico->tok->type == T_LITERAL && pico->tok->value.l->kw == K_DISABLE) {
-		return output_code(pico, pico->address++, (code_t) I_RETURNI_DISABLE);
+		return output_code(pico, pico->address++,
+				isa_opcode(pico->isa, I_RETURNI_DISABLE));
 	}
 
 	return error(pico, "Expected keyword ENABLE or DISABLE here");
@@ -178,17 +185,21 @@ static bool ins_returni(struct pico *pico)
 /**
  * Creates instruction of the given opcode with operands REGISTER, REGISTER.
  */
-static code_t assemble_instr_rr(enum instr opcode, int reg1, int reg2)
+static code_t assemble_instr_rr(struct pico *pico, enum instr opcode,
+		int reg1, int reg2)
 {
-	return instr_encode_regY(instr_encode_regX(opcode, reg1), reg2);
+	const code_t code = isa_opcode(pico->isa, opcode);
+	return instr_encode_regY(instr_encode_regX(code, reg1), reg2);
 }
 
 /**
  * Creates instruction of the given opcode with operands REGISTER, DIRECT VALUE.
  */
-static code_t assemble_instr_rk(enum instr opcode, int reg1, int number)
+static code_t assemble_instr_rk(struct pico *pico, enum instr opcode,
+		int reg1, int number)
 {
-	return instr_encode_const(instr_encode_regX(opcode, reg1), number);
+	const code_t code = isa_opcode(pico->isa, opcode);
+	return instr_encode_const(instr_encode_regX(code, reg1), number);
 }
 
 static bool ins_arithmetic(struct pico *pico, enum instr rr, enum instr rk)
@@ -197,6 +208,7 @@ static bool ins_arithmetic(struct pico *pico, enum instr rr, enum instr rk)
 	GET_TOKEN_AND_MATCH(pico, T_LITERAL, "Expected a LITERAL that donates a register");
 	MATCH_LITERAL(pico, L_REGISTER, "Expected a LITERAL that donates a register");
 	struct stab_data *dst = pico->tok->value.l;
+	XREF(pico, dst, X_USE);
 
 	GET_TOKEN_AND_MATCH(pico, T_COMMA, "Expected a COMMA here");
 	GET_TOKEN(pico);
@@ -205,17 +217,18 @@ static bool ins_arithmetic(struct pico *pico, enum instr rr, enum instr rk)
 	if(pico->tok->type == T_LITERAL) {
 		debug_here();
 		struct stab_data *src = pico->tok->value.l;
+		XREF(pico, src, X_USE);
 
-		if(src->lit == L_REGISTER)
+		if(src->lit == L_REGISTER && isa_has(pico->isa, rr))
 			return output_code(pico, pico->address++, 
-				assemble_instr_rr(rr, dst->value.reg, src->value.reg));
+				assemble_instr_rr(pico, rr, dst->value.reg, src->value.reg));
 
-		if(src->lit == L_CONSTANT) 
+		if(src->lit == L_CONSTANT && isa_has(pico->isa, rk)) 
 			return output_code(pico, pico->address++,
-				assemble_instr_rk(rk, dst->value.reg, src->value.n));	
+				assemble_instr_rk(pico, rk, dst->value.reg, src->value.n));	
 	
-		if(src->lit == L_UNKNOWN) {
-			enum instr opcode = assemble_instr_rk(rk, dst->value.reg, 0);
+		if(src->lit == L_UNKNOWN && isa_has(pico->isa, rk)) {
+			code_t opcode = assemble_instr_rk(pico, rk, dst->value.reg, 0);
 			return wait_queue_append(pico, &src->wait_queue, 
 					pico->address++, opcode, L_CONSTANT);
 		}
@@ -224,11 +237,11 @@ static bool ins_arithmetic(struct pico *pico, enum instr rr, enum instr rk)
 			return error(pico, "Unexpected symbol for source");
 	}
 
-	if(pico->tok->type == T_NUMBER) {
+	if(pico->tok->type == T_NUMBER && isa_has(pico->isa, rk)) {
 		debug_here();
 		int number = pico->tok->value.n;
 		return output_code(pico, pico->address++, 
-			assemble_instr_rk(rk, dst->value.reg, number));
+			assemble_instr_rk(pico, rk, dst->value.reg, number));
 	}
 
 	return error(pico, "Unexpected token to specify source of the operation");
@@ -241,6 +254,7 @@ static bool ins_indirect_access(struct pico *p, enum instr rr, enum instr rk,
 	GET_TOKEN_AND_MATCH(p, T_LITERAL, "Expected a LITERAL that donates a register");
 	MATCH_LITERAL(p, L_REGISTER, "Expected a register for scratchpad manipulation or I/O");
 	struct stab_data *data = p->tok->value.l;
+	XREF(p, data, X_USE);
 
 	GET_TOKEN_AND_MATCH(p, T_COMMA, "Expected a COMMA here");
 	GET_TOKEN(p);
@@ -248,33 +262,35 @@ static bool ins_indirect_access(struct pico *p, enum instr rr, enum instr rk,
 	if(p->tok->type == T_LBRACKET) {
 		GET_TOKEN_AND_MATCH(p, T_LITERAL, "Expected a LITERAL here");
 		struct stab_data *spec = p->tok->value.l;
+		XREF(p, spec, X_USE);
 		GET_TOKEN_AND_MATCH(p, T_RBRACKET, "Expected the RIGHT BRACKET here");
 
 		if(spec->lit != L_REGISTER)
 			return error(p, "Expected a register to specify scratchpad address or I/O port");
 
 		return output_code(p, p->address++, 
-			assemble_instr_rr(rr, data->value.reg, spec->value.reg));
+			assemble_instr_rr(p, rr, data->value.reg, spec->value.reg));
 	}
 	else if(p->tok->type == T_LITERAL) {
 		struct stab_data *spec = p->tok->value.l;
+		XREF(p, spec, X_USE);
 		
 		if(spec->lit == L_CONSTANT) {
 			const int specval = spec->value.n;
 			*specvalue = specval;
 
 			return output_code(p, p->address++, 
-				assemble_instr_rk(rk, data->value.reg, specval));
+				assemble_instr_rk(p, rk, data->value.reg, specval));
 		}
 		if(spec->lit == L_UNKNOWN) {
-			enum instr opcode = assemble_instr_rk(rk, data->value.reg, 0);
+			code_t opcode = assemble_instr_rk(p, rk, data->value.reg, 0);
 			return wait_queue_append(p, &spec->wait_queue, 
 					p->address++, opcode, L_CONSTANT);
 		}
 #if SHORTCUTS_EXTENSION
 		if(spec->lit == L_REGISTER) {
 			struct stab_data *spec = p->tok->value.l;
-			return output_code(p, p->address++, assemble_instr_rr(rr, data->value.reg, spec->value.reg));
+			return output_code(p, p->address++, assemble_instr_rr(p, rr, data->value.reg, spec->value.reg));
 		}
 #endif
 	}	
@@ -283,7 +299,7 @@ static bool ins_indirect_access(struct pico *p, enum instr rr, enum instr rk,
 		*specvalue = spec;	
 
 		return output_code(p, p->address++, 
-			assemble_instr_rk(rk, data->value.reg, spec));
+			assemble_instr_rk(p, rk, data->value.reg, spec));
 	}
 	
 	return error(p, "Unexpected token to specify scratchpad address or I/O port");
@@ -301,8 +317,12 @@ static bool ins_scratchpad(struct pico *pico, enum instr rr, enum instr rs)
 	if(!ins_indirect_access(pico, rr, rs, &specval))
 		return false;
 
-	if(specval > SCRATCHPAD_MAX)
-		return error(pico, "Invalid scratchpad address, must be in range <0; 3F>");
+	if(specval > (int) pico->isa->scratchpad_max) {
+		char msg[64];
+		snprintf(msg, sizeof(msg), "Invalid scratchpad address, "
+				"must be in range <0; %X>", pico->isa->scratchpad_max);
+		return error(pico, msg);
+	}
 
 	return true;
 }
@@ -310,13 +330,14 @@ static bool ins_scratchpad(struct pico *pico, enum instr rr, enum instr rs)
 static bool ins_jump(struct pico *pico, enum instr icond, enum instr ins)
 {
 	debug_here();
-	enum instr opcode = ins;
+	const struct isa *isa = pico->isa;
+	code_t opcode = isa_opcode(isa, ins);
 
 	GET_TOKEN(pico);
 	if(pico->tok->type == T_LITERAL && pico->tok->value.l->flg != F_UNKNOWN) {
 		debug_here();
 		const int flag = pico->tok->value.l->flg;
-		opcode = instr_encode_cond(icond, flag);
+		opcode = instr_encode_cond(isa, isa_opcode(isa, icond), flag);
 
 		GET_TOKEN_AND_MATCH(pico, T_COMMA, "Expected a COMMA here");
 		GET_TOKEN(pico);
@@ -326,11 +347,12 @@ static bool ins_jump(struct pico *pico, enum instr icond, enum instr ins)
 	if(pico->tok->type == T_LITERAL) {
 		debug_here();
 		struct stab_data *paddr = pico->tok->value.l;
+		XREF(pico, paddr, X_USE);
 		
 		if(paddr->lit == L_LABEL) {
 			debug_here();
 			return output_code(pico, pico->address++,
-				instr_encode_paddr(opcode, paddr->value.a));
+				instr_encode_paddr(isa, opcode, paddr->value.a));
 		}
 		else if(paddr->lit != L_UNKNOWN)
 			return error(pico, "Illegal target of jump, must be a "
@@ -343,7 +365,7 @@ static bool ins_jump(struct pico *pico, enum instr icond, enum instr ins)
 	else if(pico->tok->type == T_PROGADDR) {
 		debug_here();
 		return output_code(pico, pico->address++,
-			instr_encode_paddr(opcode, pico->tok->value.a));
+			instr_encode_paddr(isa, opcode, pico->tok->value.a));
 	}
 
 	return error(pico, "Unexpected token, don't know where to jump");
@@ -356,12 +378,13 @@ static bool ins_return(struct pico *pico, enum instr icond, enum instr ins)
 
 	if(pico->tok->type == T_LITERAL && pico->tok->value.l->flg != F_UNKNOWN) {
 		int flag = pico->tok->value.l->flg;
-		return output_code(pico, pico->address++, instr_encode_cond(icond, flag));
+		return output_code(pico, pico->address++, instr_encode_cond(pico->isa,
+					isa_opcode(pico->isa, icond), flag));
 	}
 	else
-		PUSHBACK_TOKEN(pico->tok);
+		PUSHBACK_TOKEN(pico, pico->tok);
 
-	return output_code(pico, pico->address++, ins);
+	return output_code(pico, pico->address++, isa_opcode(pico->isa, ins));
 }
 
 static bool ins_shift(struct pico *pico, enum instr opcode)
@@ -370,10 +393,53 @@ static bool ins_shift(struct pico *pico, enum instr opcode)
 	GET_TOKEN_AND_MATCH(pico, T_LITERAL, "Expected a LITERAL that donates a register");
 	MATCH_LITERAL(pico, L_REGISTER, "Unexpected token LITERAL, want to shift a register");
 	struct stab_data *reg = pico->tok->value.l;
+	XREF(pico, reg, X_USE);
 
 
 	return output_code(pico, pico->address++, 
-		instr_encode_regX(opcode, reg->value.reg));
+		instr_encode_regX(isa_opcode(pico->isa, opcode), reg->value.reg));
+}
+
+/**
+ * Implementation of JUMP@ and CALL@ (kcpsm6).
+ */
+static bool ins_computed_jump(struct pico *pico, enum instr opcode)
+{
+	debug_here();
+	GET_TOKEN_AND_MATCH(pico, T_LBRACKET, "Expected the LEFT BRACKET here");
+	GET_TOKEN_AND_MATCH(pico, T_LITERAL, "Expected a LITERAL that donates a register");
+	MATCH_LITERAL(pico, L_REGISTER, "Expected a register with high part of the address");
+	struct stab_data *high = pico->tok->value.l;
+	XREF(pico, high, X_USE);
+
+	GET_TOKEN_AND_MATCH(pico, T_COMMA, "Expected a COMMA here");
+	GET_TOKEN_AND_MATCH(pico, T_LITERAL, "Expected a LITERAL that donates a register");
+	MATCH_LITERAL(pico, L_REGISTER, "Expected a register with low part of the address");
+	struct stab_data *low = pico->tok->value.l;
+	XREF(pico, low, X_USE);
+	GET_TOKEN_AND_MATCH(pico, T_RBRACKET, "Expected the RIGHT BRACKET here");
+
+	return output_code(pico, pico->address++,
+		assemble_instr_rr(pico, opcode, high->value.reg, low->value.reg));
+}
+
+/**
+ * Implementation of REGBANK A|B (kcpsm6).
+ */
+static bool ins_regbank(struct pico *pico)
+{
+	debug_here();
+	GET_TOKEN_AND_MATCH(pico, T_LITERAL, "Expected the register bank A or B here");
+	const char *bank = pico->tok->value.l->key;
+
+	if(!strcasecmp(bank, "A"))
+		return output_code(pico, pico->address++,
+				isa_opcode(pico->isa, I_REGBANK_A));
+	if(!strcasecmp(bank, "B"))
+		return output_code(pico, pico->address++,
+				isa_opcode(pico->isa, I_REGBANK_B));
+
+	return error(pico, "Expected the register bank A or B here");
 }
 
 static bool operation(struct pico *pico, struct token *tok)
@@ -400,9 +466,11 @@ static bool operation(struct pico *pico, struct token *tok)
 
 		#ifdef SHORTCUTS_EXTENSION
 		case K_EINT:
-			return output_code(pico, pico->address++, (code_t) I_ENABLE_INTERRUPT);
+			return output_code(pico, pico->address++,
+					isa_opcode(pico->isa, I_ENABLE_INTERRUPT));
 		case K_DINT:
-			return output_code(pico, pico->address++, (code_t) I_DISABLE_INTERRUPT);
+			return output_code(pico, pico->address++,
+					isa_opcode(pico->isa, I_DISABLE_INTERRUPT));
 		#endif
 
 		case K_INPUT:
@@ -465,6 +533,21 @@ static bool operation(struct pico *pico, struct token *tok)
 		case K_RL:
 			return ins_shift(pico, I_RL);
 
+		case K_TESTCY:
+			return ins_arithmetic(pico, I_TESTCY_RR, I_TESTCY_RK);
+		case K_COMPARECY:
+			return ins_arithmetic(pico, I_COMPARECY_RR, I_COMPARECY_RK);
+		case K_STAR:
+			return ins_arithmetic(pico, I_STAR_RR, I_NONE);
+		case K_LOAD_RETURN:
+			return ins_arithmetic(pico, I_NONE, I_LOAD_RETURN);
+		case K_JUMP_AT:
+			return ins_computed_jump(pico, I_JUMP_AT);
+		case K_CALL_AT:
+			return ins_computed_jump(pico, I_CALL_AT);
+		case K_REGBANK:
+			return ins_regbank(pico);
+
 		default:
 			return error(pico, "Unknown keyword detected, maybe an internal error");
 	}
@@ -487,6 +570,7 @@ static bool label(struct pico *pico, struct token *tok)
 
 	data->lit = L_LABEL;
 	data->value.a = pico->address;
+	XREF(pico, data, X_DEFINE);
 
 	// output the incomplete jumps dependent on this label
 	return finish_wait_instr(pico, data);
@@ -506,8 +590,14 @@ static bool operation_list(struct pico *pico)
 		}
 		else if(tok->type == T_LITERAL) {
 			debug_here();
+			// the line of an instruction, even when it waits for a label
+			const progaddr_t address = pico->address;
+			const int lineno = pico->lineno;
+			const bool directive = tok->value.l->kw == K_ADDRESS;
 			if(!operation(pico, tok))
 				return false;
+			if(!directive && pico->address == address + 1)
+				output_line(pico, address, lineno);
 		}
 		else if(tok->type != T_END)	
 			return error(pico, "Unexpected token detected");
@@ -525,7 +615,7 @@ bool assembler_run(struct pico *pico)
 	return operation_list(pico);
 }
 
-bool kcpsm3_setup(struct pico *pico)
+bool assembler_setup(struct pico *pico, const struct isa *isa)
 {
 	static char *regs[] = {
 			"s0", "s1", "s2", "s3",
@@ -535,6 +625,7 @@ bool kcpsm3_setup(struct pico *pico)
 		};
 	#define REG_COUNT (sizeof(regs)/sizeof(char *))
 	struct stab_data *data = NULL;
+	pico->isa = isa;
 
 	for(unsigned i = 0; i < REG_COUNT; i++) {
 		data = stab_insert(pico->stab, regs[i]);
@@ -0,0 +1,686 @@
+/**
+ * batch.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "batch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+#define SCRATCHPAD_MASK (SIM_SCRATCHPAD - 1)
+
+/**
+ * The lane loops are compiled for AVX2 and for the baseline,
+ * the variant is selected at load time.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+	#define BATCH_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+	#define BATCH_CLONES
+#endif
+
+// arrays of the lane state, permuted together when regrouping
+#define BATCH_ARRAYS (SIM_REGS + SIM_SCRATCHPAD + SIM_STACK + 15)
+
+struct group {
+	unsigned lo;
+	unsigned hi;
+};
+
+struct batch {
+	unsigned lanes;
+	struct sim_instr rom[SIM_PROGRAM_LEN];
+	struct batch_io io;
+	struct batch_stats stats;
+	uint32_t chunk;	// budget of the current run
+
+	// state of lanes indexed by column
+	uint8_t *reg[SIM_REGS];
+	uint8_t *scratchpad[SIM_SCRATCHPAD];
+	uint16_t *stack[SIM_STACK];
+	uint16_t *pc;
+	uint16_t *flags;
+	uint16_t *saved_flags;
+	uint8_t *ie;
+	uint8_t *irq;
+	uint8_t *sp;
+	uint8_t *depth;
+	uint8_t *faults;
+	uint8_t *status;
+	uint32_t *left;	// instructions of the current run
+	uint64_t *instructions;
+	uint64_t *slots;	// acknowledged interrupts
+	unsigned *id;	// lane in the column
+	uint8_t *mask;	// lanes executing the current step
+
+	unsigned *col;	// column of the lane
+	unsigned *order;
+	unsigned count[SIM_PROGRAM_LEN + 2];	// counting sort of regroup
+	uint8_t *tmp;
+	struct group *group;
+	unsigned groups;
+	unsigned irqs;	// lanes with the interrupt input set
+
+	void *array[BATCH_ARRAYS];
+	size_t size[BATCH_ARRAYS];
+	unsigned arrays;
+	void *memory;
+};
+
+// =================================== //
+// ------------ allocation ----------- //
+// =================================== //
+
+/**
+ * Memory of lane arrays is allocated at once, each array is aligned
+ * to the vector size.
+ */
+static void *carve(struct batch *b, size_t *offset, size_t size, bool lane_array)
+{
+	void *p = b->memory == NULL? NULL : (uint8_t *) b->memory + *offset;
+	*offset += (size * b->lanes + 31) & ~(size_t) 31;
+
+	if(lane_array && b->memory != NULL) {
+		b->array[b->arrays] = p;
+		b->size[b->arrays] = size;
+		b->arrays += 1;
+	}
+
+	return p;
+}
+
+static size_t layout(struct batch *b)
+{
+	size_t off = 0;
+	b->arrays = 0;
+
+	for(int i = 0; i < SIM_REGS; i++)
+		b->reg[i] = carve(b, &off, sizeof(uint8_t), true);
+	for(int i = 0; i < SIM_SCRATCHPAD; i++)
+		b->scratchpad[i] = carve(b, &off, sizeof(uint8_t), true);
+	for(int i = 0; i < SIM_STACK; i++)
+		b->stack[i] = carve(b, &off, sizeof(uint16_t), true);
+
+	b->pc = carve(b, &off, sizeof(uint16_t), true);
+	b->flags = carve(b, &off, sizeof(uint16_t), true);
+	b->saved_flags = carve(b, &off, sizeof(uint16_t), true);
+	b->ie = carve(b, &off, sizeof(uint8_t), true);
+	b->irq = carve(b, &off, sizeof(uint8_t), true);
+	b->sp = carve(b, &off, sizeof(uint8_t), true);
+	b->depth = carve(b, &off, sizeof(uint8_t), true);
+	b->faults = carve(b, &off, sizeof(uint8_t), true);
+	b->status = carve(b, &off, sizeof(uint8_t), true);
+	b->left = carve(b, &off, sizeof(uint32_t), true);
+	b->instructions = carve(b, &off, sizeof(uint64_t), true);
+	b->slots = carve(b, &off, sizeof(uint64_t), true);
+	b->id = carve(b, &off, sizeof(unsigned), true);
+	b->mask = carve(b, &off, sizeof(uint8_t), true);
+
+	b->col = carve(b, &off, sizeof(unsigned), false);
+	b->order = carve(b, &off, sizeof(unsigned), false);
+	b->tmp = carve(b, &off, sizeof(uint64_t), false);
+	b->group = carve(b, &off, sizeof(struct group), false);
+	return off + 32;
+}
+
+static void reset(struct batch *b)
+{
+	for(unsigned i = 0; i < b->arrays; i++)
+		memset(b->array[i], 0, b->size[i] * b->lanes);
+
+	for(unsigned c = 0; c < b->lanes; c++) {
+		b->flags[c] = 1;	// Z = 0, C = 0 like sim_reset
+		b->saved_flags[c] = 1;
+		b->status[c] = SIM_RUNNING;
+		b->id[c] = c;
+		b->col[c] = c;
+	}
+
+	b->irqs = 0;
+}
+
+struct batch *batch_init(const code_t *code, progaddr_t len, unsigned lanes)
+{
+	if(len > SIM_PROGRAM_LEN || lanes == 0)
+		return NULL;
+
+	struct batch *b = (struct batch *) calloc(1, sizeof(struct batch));
+	if(b == NULL)
+		return NULL;
+
+	b->lanes = lanes;
+	b->memory = calloc(1, layout(b));
+	if(b->memory == NULL) {
+		free(b);
+		return NULL;
+	}
+
+	// aligns the memory, carve uses the offsets
+	const uintptr_t base = ((uintptr_t) b->memory + 31) & ~(uintptr_t) 31;
+	void *memory = b->memory;
+	b->memory = (void *) base;
+	layout(b);
+	b->memory = memory;
+
+	// padded by zero words like sim_load
+	for(unsigned i = 0; i < SIM_PROGRAM_LEN; i++)
+		b->rom[i] = sim_decode(i < len? code[i] : 0);
+
+	reset(b);
+	return b;
+}
+
+void batch_destroy(struct batch *b)
+{
+	if(b == NULL)
+		return;
+
+	free(b->memory);
+	free(b);
+}
+
+void batch_set_io(struct batch *b, const struct batch_io *io)
+{
+	b->io = *io;
+}
+
+unsigned batch_lanes(const struct batch *b)
+{
+	return b->lanes;
+}
+
+void batch_interrupt(struct batch *b, unsigned lane, bool level)
+{
+	const unsigned c = b->col[lane];
+	if(b->irq[c] != level)
+		b->irqs += level? 1 : -1;
+	b->irq[c] = level;
+}
+
+void batch_stop(struct batch *b, unsigned lane)
+{
+	b->status[b->col[lane]] = SIM_STOPPED;
+}
+
+uint64_t batch_cycles(const struct batch *b, unsigned lane)
+{
+	const unsigned c = b->col[lane];
+	const uint64_t n = b->instructions[c] + (b->chunk - b->left[c]);
+	return SIM_CYCLES_PER_INSTR * (n + b->slots[c]);
+}
+
+const struct batch_stats *batch_stats(const struct batch *b)
+{
+	return &b->stats;
+}
+
+void batch_state(const struct batch *b, unsigned lane, struct sim *s)
+{
+	const unsigned c = b->col[lane];
+
+	for(int i = 0; i < SIM_REGS; i++)
+		s->reg[i] = b->reg[i][c];
+	for(int i = 0; i < SIM_SCRATCHPAD; i++)
+		s->scratchpad[i] = b->scratchpad[i][c];
+	for(int i = 0; i < SIM_STACK; i++)
+		s->stack[i] = b->stack[i][c];
+
+	s->pc = b->pc[c];
+	s->flags = b->flags[c];
+	s->saved_flags = b->saved_flags[c];
+	s->ie = b->ie[c];
+	s->irq = b->irq[c];
+	s->sp = b->sp[c];
+	s->depth = b->depth[c];
+	s->faults = b->faults[c];
+	s->status = b->status[c];
+	s->instructions = b->instructions[c] + (b->chunk - b->left[c]);
+	s->cycles = batch_cycles(b, lane);
+}
+
+// =================================== //
+// ------------ execution ------------ //
+// =================================== //
+
+static void push(struct batch *b, unsigned c, uint16_t addr)
+{
+	b->sp[c] = b->sp[c] == SIM_STACK - 1? 0 : b->sp[c] + 1;
+	b->stack[b->sp[c]][c] = addr;
+
+	if(b->depth[c] == SIM_STACK)
+		b->faults[c] |= SIM_FAULT_OVERFLOW;
+	else
+		b->depth[c] += 1;
+}
+
+static uint16_t pop(struct batch *b, unsigned c)
+{
+	const uint16_t addr = b->stack[b->sp[c]][c];
+	b->sp[c] = b->sp[c] == 0? SIM_STACK - 1 : b->sp[c] - 1;
+
+	if(b->depth[c] == 0)
+		b->faults[c] |= SIM_FAULT_UNDERFLOW;
+	else
+		b->depth[c] -= 1;
+
+	return addr;
+}
+
+static inline bool running(const struct batch *b, unsigned c)
+{
+	return (b->status[c] == SIM_RUNNING) & (b->left[c] != 0);
+}
+
+/**
+ * Branch-free sim_flags_carry, both variants are computed in vectors.
+ */
+static inline unsigned carry(unsigned flags)
+{
+	unsigned p = flags ^ (flags >> 4);
+	p ^= p >> 2;
+	p ^= p >> 1;
+	return (flags & SIM_FLAGS_PARITY)? p & 1 : (flags >> 8) & 1;
+}
+
+/**
+ * Acknowledges pending interrupts of the group like the interpreter
+ * does before fetching the next instruction.
+ */
+static void interrupts(struct batch *b, unsigned lo, unsigned hi)
+{
+	for(unsigned c = lo; c < hi; c++) {
+		if(!running(b, c) || !b->ie[c] || !b->irq[c])
+			continue;
+
+		push(b, c, b->pc[c]);
+		b->saved_flags[c] = b->flags[c];
+		b->irq[c] = false;
+		b->irqs -= 1;
+		b->ie[c] = false;
+		b->pc[c] = SIM_VECTOR;
+		b->slots[c] += 1;
+	}
+}
+
+#define LANES for(unsigned c = lo; c < hi; c++)
+
+/**
+ * Operation on the destination register, r is the 9-bit result.
+ * Variables: x destination, y operand, cy carry.
+ */
+#define ALU(expr, store, extra) \
+	LANES {\
+		const unsigned x = xr[c];\
+		const unsigned y = rr? yr[c] : k;\
+		const unsigned cy = carry(f[c]);\
+		const unsigned r = (expr);\
+		(void) y; (void) cy;\
+		if(store)\
+			xr[c] = m[c]? (uint8_t) r : xr[c];\
+		f[c] = m[c]? (uint16_t) (r | (extra)) : f[c];\
+	}\
+	break;
+
+#define SL(in) ALU((x << 1) | (in), true, 0)
+#define SR(in) ALU((x >> 1) | ((in) << 7) | ((x & 1) << 8), true, 0)
+
+#define ZERO(c) ((f[c] & 0xFF) == 0)
+#define CARRY(c) carry(f[c])
+
+#define BRANCH(cond) \
+	LANES {\
+		const uint16_t to = (cond)? target : next;\
+		pc[c] = m[c]? to : pc[c];\
+		left[c] -= m[c];\
+	}\
+	return;
+
+static inline bool condition(uint8_t op, uint8_t first, uint16_t flags)
+{
+	switch(op - first) {
+	case 1:
+		return (flags & 0xFF) == 0;
+	case 2:
+		return (flags & 0xFF) != 0;
+	case 3:
+		return sim_flags_carry(flags);
+	case 4:
+		return !sim_flags_carry(flags);
+	default:
+		return true;
+	}
+}
+
+/**
+ * Executes the instruction at address a in the masked lanes.
+ */
+BATCH_CLONES
+static void execute(struct batch *b, unsigned lo, unsigned hi, uint16_t a)
+{
+	const struct sim_instr *ins = &b->rom[a];
+	const uint8_t *m = b->mask;
+	uint8_t *xr = b->reg[ins->x];
+	const uint8_t *yr = b->reg[ins->y & 0x0F];
+	const uint8_t k = ins->y;
+	uint16_t *f = b->flags;
+	uint16_t *pc = b->pc;
+	uint32_t *left = b->left;
+	const uint16_t next = (a + 1) & PC_MASK;
+	const uint16_t target = ins->target;
+	const uint8_t op = ins->op;
+	const bool rr = op <= S_OUTPUT_RK && (op - S_LOAD_RR) % 2 == 0;
+
+	// operations with data in lanes, the program counter follows
+	switch(op) {
+	case S_LOAD_RR: case S_LOAD_RK:
+		LANES {
+			xr[c] = m[c]? (rr? yr[c] : k) : xr[c];
+		}
+		break;
+	case S_AND_RR: case S_AND_RK:
+		ALU(x & y, true, 0)
+	case S_OR_RR: case S_OR_RK:
+		ALU(x | y, true, 0)
+	case S_XOR_RR: case S_XOR_RK:
+		ALU(x ^ y, true, 0)
+	case S_TEST_RR: case S_TEST_RK:
+		ALU(x & y, false, SIM_FLAGS_PARITY)
+	case S_ADD_RR: case S_ADD_RK:
+		ALU((x + y) & 0x1FF, true, 0)
+	case S_ADDCY_RR: case S_ADDCY_RK:
+		ALU((x + y + cy) & 0x1FF, true, 0)
+	case S_SUB_RR: case S_SUB_RK:
+		ALU((x - y) & 0x1FF, true, 0)
+	case S_SUBCY_RR: case S_SUBCY_RK:
+		ALU((x - y - cy) & 0x1FF, true, 0)
+	case S_COMPARE_RR: case S_COMPARE_RK:
+		ALU((x - y) & 0x1FF, false, 0)
+	case S_SL0:
+		SL(0u)
+	case S_SL1:
+		SL(1u)
+	case S_SLX:
+		SL(x & 1)
+	case S_SLA:
+		SL(cy)
+	case S_RL:
+		SL(x >> 7)
+	case S_SR0:
+		SR(0u)
+	case S_SR1:
+		SR(1u)
+	case S_SRX:
+		SR(x >> 7)
+	case S_SRA:
+		SR(cy)
+	case S_RR:
+		SR(x & 1)
+	case S_FETCH_RR:
+		LANES {
+			if(m[c])
+				xr[c] = b->scratchpad[yr[c] & SCRATCHPAD_MASK][c];
+		}
+		break;
+	case S_FETCH_RK: {
+		const uint8_t *s = b->scratchpad[k & SCRATCHPAD_MASK];
+		LANES {
+			xr[c] = m[c]? s[c] : xr[c];
+		}
+		break;
+	}
+	case S_STORE_RR:
+		LANES {
+			if(m[c])
+				b->scratchpad[yr[c] & SCRATCHPAD_MASK][c] = xr[c];
+		}
+		break;
+	case S_STORE_RK: {
+		uint8_t *s = b->scratchpad[k & SCRATCHPAD_MASK];
+		LANES {
+			s[c] = m[c]? xr[c] : s[c];
+		}
+		break;
+	}
+	default:
+		goto control;
+	}
+
+	LANES {
+		pc[c] = m[c]? next : pc[c];
+		left[c] -= m[c];
+	}
+	return;
+
+control:
+	switch(op) {
+	case S_JUMP:
+		BRANCH(true)
+	case S_JUMP_Z:
+		BRANCH(ZERO(c))
+	case S_JUMP_NZ:
+		BRANCH(!ZERO(c))
+	case S_JUMP_C:
+		BRANCH(CARRY(c))
+	case S_JUMP_NC:
+		BRANCH(!CARRY(c))
+	case S_INVALID:
+		LANES {
+			if(m[c])
+				b->status[c] = SIM_INVALID;
+		}
+		return;
+	default:
+		break;
+	}
+
+	// the rest is executed lane by lane
+	LANES {
+		if(!m[c])
+			continue;
+
+		left[c] -= 1;
+		pc[c] = next;
+
+		switch(op) {
+		case S_CALL: case S_CALL_Z: case S_CALL_NZ: case S_CALL_C: case S_CALL_NC:
+			if(condition(op, S_CALL, f[c])) {
+				push(b, c, a);
+				pc[c] = ins->target;
+			}
+			break;
+		case S_RETURN: case S_RETURN_Z: case S_RETURN_NZ: case S_RETURN_C: case S_RETURN_NC:
+			if(condition(op, S_RETURN, f[c]))
+				pc[c] = (pop(b, c) + 1) & PC_MASK;
+			break;
+		case S_RETURNI_DISABLE: case S_RETURNI_ENABLE:
+			pc[c] = pop(b, c);
+			f[c] = b->saved_flags[c];
+			b->ie[c] = op == S_RETURNI_ENABLE;
+			break;
+		case S_DISABLE_INTERRUPT: case S_ENABLE_INTERRUPT:
+			b->ie[c] = op == S_ENABLE_INTERRUPT;
+			break;
+		case S_INPUT_RR: case S_INPUT_RK:
+			xr[c] = b->io.input == NULL? 0 :
+				b->io.input(b, b->id[c], rr? yr[c] : k, b->io.ctx);
+			break;
+		case S_OUTPUT_RR: case S_OUTPUT_RK:
+			if(b->io.output != NULL)
+				b->io.output(b, b->id[c], rr? yr[c] : k, xr[c], b->io.ctx);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/**
+ * Executes one instruction of the group, the lowest address
+ * of its running lanes.
+ * @return number of lanes that executed it, 0 when the group finished
+ */
+BATCH_CLONES
+static unsigned group_step(struct batch *b, unsigned lo, unsigned hi)
+{
+	if(b->irqs > 0)
+		interrupts(b, lo, hi);
+
+	const uint16_t *pc = b->pc;
+	const uint8_t *status = b->status;
+	const uint32_t *left = b->left;
+	uint8_t *mask = b->mask;
+
+	// finished lanes are above the program
+	unsigned a = SIM_PROGRAM_LEN;
+	LANES {
+		const unsigned done = (status[c] != SIM_RUNNING) | (left[c] == 0);
+		const unsigned p = pc[c] | done * SIM_PROGRAM_LEN;
+		a = p < a? p : a;
+	}
+
+	if(a >= SIM_PROGRAM_LEN)
+		return 0;
+
+	unsigned n = 0;
+	LANES {
+		mask[c] = (pc[c] == a) & (status[c] == SIM_RUNNING) & (left[c] != 0);
+		n += mask[c];
+	}
+
+	execute(b, lo, hi, a);
+	return n;
+}
+
+// =================================== //
+// ------------ grouping ------------- //
+// =================================== //
+
+static void permute(struct batch *b, unsigned len)
+{
+	for(unsigned i = 0; i < b->arrays; i++) {
+		const size_t size = b->size[i];
+		uint8_t *array = (uint8_t *) b->array[i];
+
+		for(unsigned c = 0; c < len; c++)
+			memcpy(b->tmp + c * size, array + b->order[c] * size, size);
+		memcpy(array, b->tmp, len * size);
+	}
+
+	for(unsigned c = 0; c < b->lanes; c++)
+		b->col[b->id[c]] = c;
+}
+
+/**
+ * Sorts the lanes by their address (finished lanes last) and splits
+ * the running ones into groups of at least BATCH_WIDTH lanes, lanes
+ * of the same address are never split.
+ */
+static void regroup(struct batch *b)
+{
+	unsigned *count = b->count;
+	memset(b->count, 0, sizeof(b->count));
+
+	for(unsigned c = 0; c < b->lanes; c++)
+		count[(running(b, c)? b->pc[c] : SIM_PROGRAM_LEN) + 1] += 1;
+	for(unsigned i = 1; i < SIM_PROGRAM_LEN + 2; i++)
+		count[i] += count[i - 1];
+
+	const unsigned run = count[SIM_PROGRAM_LEN];
+	for(unsigned c = 0; c < b->lanes; c++)
+		b->order[count[running(b, c)? b->pc[c] : SIM_PROGRAM_LEN]++] = c;
+
+	permute(b, b->lanes);
+
+	b->groups = 0;
+	for(unsigned c = 0; c < run; c++) {
+		struct group *g = b->groups > 0? &b->group[b->groups - 1] : NULL;
+		if(g == NULL || (g->hi - g->lo >= BATCH_WIDTH && b->pc[c] != b->pc[c - 1])) {
+			g = &b->group[b->groups++];
+			g->lo = c;
+		}
+		g->hi = c + 1;
+	}
+
+	b->stats.regroups += 1;
+}
+
+/**
+ * All lanes execute at most chunk instructions.
+ */
+static void run_chunk(struct batch *b, uint32_t chunk)
+{
+	b->chunk = chunk;
+	for(unsigned c = 0; c < b->lanes; c++)
+		b->left[c] = chunk;
+
+	regroup(b);
+
+	bool again = true;
+	while(again) {
+		bool diverged = false;
+		again = false;
+
+		for(unsigned i = 0; i < b->groups; i++) {
+			const struct group *g = &b->group[i];
+			uint64_t active = 0;
+			unsigned steps = 0;
+			unsigned n;
+
+			while(steps < BATCH_SLICE && (n = group_step(b, g->lo, g->hi)) > 0) {
+				active += n;
+				steps += 1;
+			}
+
+			b->stats.steps += steps;
+			if(steps == BATCH_SLICE)
+				again = true;
+			// less than a half of the lanes works
+			if(2 * active < (uint64_t) steps * (g->hi - g->lo))
+				diverged = true;
+		}
+
+		if(again && diverged)
+			regroup(b);
+	}
+
+	for(unsigned c = 0; c < b->lanes; c++) {
+		const uint64_t n = chunk - b->left[c];
+		b->instructions[c] += n;
+		b->stats.instructions += n;
+		b->left[c] = 0;
+	}
+
+	b->chunk = 0;
+}
+
+void batch_run(struct batch *b, uint64_t instructions)
+{
+	for(unsigned c = 0; c < b->lanes; c++)
+		b->status[c] = SIM_RUNNING;
+
+	while(instructions > 0) {
+		const uint32_t chunk = instructions > UINT32_MAX? UINT32_MAX : instructions;
+		run_chunk(b, chunk);
+		instructions -= chunk;
+	}
+
+	for(unsigned c = 0; c < b->lanes; c++) {
+		if(b->status[c] == SIM_RUNNING)
+			b->status[c] = SIM_BUDGET;
+	}
+}
@@ -0,0 +1,95 @@
+/**
+ * batch.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Simulation of many instances (lanes) of the same program. The state
+ * is kept in structure-of-arrays form and lanes at the same address
+ * execute the instruction together, the loops over lanes are vectorized
+ * (AVX2 on x86-64). Lanes are split into groups, each group runs the
+ * lowest address of its lanes with the others masked out. When lanes of
+ * a group diverge, all lanes are sorted by the address and grouped again.
+ *
+ * Every lane behaves exactly like sim_run with the same inputs.
+ */
+
+#define BATCH_WIDTH 32	// lanes of one AVX2 register of bytes
+#define BATCH_SLICE 256	// steps of a group between regroupings
+
+struct batch;
+
+/**
+ * Host side of INPUT and OUTPUT, lane is the index of the instance.
+ */
+struct batch_io {
+	uint8_t (*input)(struct batch *b, unsigned lane, uint8_t port, void *ctx);
+	void (*output)(struct batch *b, unsigned lane, uint8_t port, uint8_t value, void *ctx);
+	void *ctx;
+};
+
+struct batch_stats {
+	uint64_t steps;	// executed instructions of groups
+	uint64_t instructions;	// executed instructions of lanes
+	uint64_t regroups;
+};
+
+/**
+ * Creates lanes running the program, they are reset.
+ * @return NULL on error
+ */
+struct batch *batch_init(const code_t *code, progaddr_t len, unsigned lanes);
+
+void batch_destroy(struct batch *b);
+
+void batch_set_io(struct batch *b, const struct batch_io *io);
+
+unsigned batch_lanes(const struct batch *b);
+
+/**
+ * Sets the interrupt input of the lane, see sim_interrupt.
+ */
+void batch_interrupt(struct batch *b, unsigned lane, bool level);
+
+/**
+ * Stops the lane after the current instruction, see sim_stop.
+ */
+void batch_stop(struct batch *b, unsigned lane);
+
+uint64_t batch_cycles(const struct batch *b, unsigned lane);
+
+/**
+ * Executes at most the given number of instructions in every lane.
+ */
+void batch_run(struct batch *b, uint64_t instructions);
+
+/**
+ * Copies the state of the lane to s (the program and the I/O are kept),
+ * eg. to inspect it or to continue by sim_run.
+ */
+void batch_state(const struct batch *b, unsigned lane, struct sim *s);
+
+const struct batch_stats *batch_stats(const struct batch *b);
+
+#endif
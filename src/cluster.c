@@ -0,0 +1,466 @@
+/**
+ * cluster.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cluster.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define CACHE_LINE 64
+
+struct slot {
+	uint64_t cycle;	// since when the value can be read
+	uint8_t value;
+};
+
+/**
+ * The producer and the consumer own their halves on separate cache lines,
+ * the other side reads tail by an acquire load. The head is read by the
+ * producer only between the windows.
+ */
+struct channel {
+	// producer:
+	uint32_t tail;	// free running indexes
+	uint32_t acked;	// head at the end of the last window
+	uint32_t depth;
+	uint64_t latency;
+	char pad[CACHE_LINE];
+	// consumer:
+	uint32_t head;
+	uint8_t value;	// the last one read
+	struct slot *slot;
+	uint32_t mask;
+};
+
+struct core {
+	struct sim sim;
+	struct ports *ports;
+	struct sched *sched;
+	struct channel *in[PORTS];
+	struct channel *status[PORTS];
+	struct channel *out[PORTS];
+	uint64_t lost;
+	bool done;
+	// outputs of the window
+	struct port_log *log;
+	size_t log_len;
+	size_t log_size;
+	size_t next;	// merged
+	struct cluster *cluster;
+};
+
+struct cluster {
+	struct core **core;
+	unsigned cores;
+	struct channel **channel;
+	unsigned channels;
+	uint64_t latency;
+	uint64_t now;	// start of the window
+	uint64_t end;	// of the simulation
+	bool finished;
+	bool nomem;
+
+	cluster_output_t output;
+	void *ctx;
+
+	// barrier of the threads
+	unsigned threads;
+	unsigned waiting;
+	bool sense;
+};
+
+// =================================== //
+// ------------- channels ------------ //
+// =================================== //
+
+static uint8_t channel_input(struct sim *s, uint8_t port, void *ctx)
+{
+	struct core *core = (struct core *) ctx;
+	const uint64_t cycle = s->cycles - SIM_CYCLES_PER_INSTR;	// start of INPUT
+	struct channel *ch = core->status[port];
+
+	if(ch != NULL) {
+		const uint32_t tail = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+		return ch->head != tail && ch->slot[ch->head & ch->mask].cycle <= cycle;
+	}
+
+	ch = core->in[port];
+	if(ch == NULL)
+		return 0;
+
+	const uint32_t tail = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+	if(ch->head != tail && ch->slot[ch->head & ch->mask].cycle <= cycle)
+		ch->value = ch->slot[ch->head++ & ch->mask].value;
+	return ch->value;
+}
+
+static void channel_output(struct sim *s, uint8_t port, uint8_t value, void *ctx)
+{
+	struct core *core = (struct core *) ctx;
+	struct channel *ch = core->out[port];
+	if(ch == NULL)
+		return;
+
+	if(ch->tail - ch->acked >= ch->depth) {
+		core->lost += 1;
+		return;
+	}
+
+	struct slot *slot = &ch->slot[ch->tail & ch->mask];
+	// the start of OUTPUT plus the latency
+	slot->cycle = s->cycles - SIM_CYCLES_PER_INSTR + ch->latency;
+	slot->value = value;
+	__atomic_store_n(&ch->tail, ch->tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Keeps the log of the window, the ports deliver it when it is full
+ * and at the end of the window.
+ */
+static void collect(struct sim *s, struct ports *p, enum port_dir dir,
+		uint8_t port, enum port_event event, void *ctx)
+{
+	(void) dir;
+	(void) port;
+	struct core *core = (struct core *) ctx;
+	if(event != PORT_LOG_FULL)
+		return;
+
+	if(core->log_len + p->log_len > core->log_size) {
+		const size_t size = 2 * core->log_size + p->log_len;
+		struct port_log *log = (struct port_log *)
+			realloc(core->log, size * sizeof(struct port_log));
+		if(log == NULL) {
+			core->cluster->nomem = true;
+			sim_stop(s);
+			return;
+		}
+
+		core->log = log;
+		core->log_size = size;
+	}
+
+	memcpy(core->log + core->log_len, p->log, p->log_len * sizeof(struct port_log));
+	core->log_len += p->log_len;
+}
+
+// =================================== //
+// ------------- topology ------------ //
+// =================================== //
+
+static void destroy_core(struct core *core)
+{
+	if(core == NULL)
+		return;
+
+	sched_destroy(core->sched);
+	ports_destroy(core->ports);
+	free(core->log);
+	free(core);
+}
+
+static struct core *create_core(struct cluster *c)
+{
+	struct core *core = (struct core *) calloc(1, sizeof(struct core));
+	if(core == NULL)
+		return NULL;
+
+	core->cluster = c;
+	core->ports = ports_init(&collect, core);
+	core->sched = sched_init(&core->sim, core->ports);
+	if(core->ports == NULL || core->sched == NULL) {
+		destroy_core(core);
+		return NULL;
+	}
+
+	core->sim.io.input = &channel_input;
+	core->sim.io.output = &channel_output;
+	core->sim.io.ctx = core;
+	for(int port = 0; port < PORTS; port++) {
+		ports_register(core->ports, PORT_IN, port, 0);
+		ports_log(core->ports, port);
+	}
+
+	ports_attach(core->ports, &core->sim);
+	return core;
+}
+
+struct cluster *cluster_init(unsigned cores, uint64_t latency)
+{
+	if(cores == 0 || cores > CLUSTER_CORES || latency == 0)
+		return NULL;
+
+	struct cluster *c = (struct cluster *) calloc(1, sizeof(struct cluster));
+	if(c == NULL)
+		return NULL;
+
+	c->latency = latency;
+	c->core = (struct core **) calloc(cores, sizeof(struct core *));
+	if(c->core == NULL) {
+		free(c);
+		return NULL;
+	}
+
+	for(; c->cores < cores; c->cores++) {
+		c->core[c->cores] = create_core(c);
+		if(c->core[c->cores] == NULL) {
+			cluster_destroy(c);
+			return NULL;
+		}
+	}
+
+	return c;
+}
+
+void cluster_destroy(struct cluster *c)
+{
+	if(c == NULL)
+		return;
+
+	for(unsigned i = 0; i < c->cores; i++)
+		destroy_core(c->core[i]);
+	for(unsigned i = 0; i < c->channels; i++) {
+		free(c->channel[i]->slot);
+		free(c->channel[i]);
+	}
+
+	free(c->core);
+	free(c->channel);
+	free(c);
+}
+
+struct sim *cluster_sim(struct cluster *c, unsigned core)
+{
+	return &c->core[core]->sim;
+}
+
+struct sched *cluster_sched(struct cluster *c, unsigned core)
+{
+	return c->core[core]->sched;
+}
+
+uint64_t cluster_lost(const struct cluster *c, unsigned core)
+{
+	return c->core[core]->lost;
+}
+
+unsigned cluster_threads(const struct cluster *c)
+{
+	return c->threads;
+}
+
+bool cluster_channel(struct cluster *c, unsigned from, uint8_t out, unsigned to,
+		uint8_t in, uint32_t depth)
+{
+	struct core *src = c->core[from];
+	struct core *dst = c->core[to];
+	if(depth == 0 || (depth & (depth - 1)) != 0)
+		return false;
+	if(src->out[out] != NULL || dst->in[in] != NULL || dst->status[in] != NULL)
+		return false;
+
+	struct channel **more = (struct channel **)
+		realloc(c->channel, (c->channels + 1) * sizeof(struct channel *));
+	if(more == NULL)
+		return false;
+	c->channel = more;
+
+	struct channel *ch = (struct channel *) calloc(1, sizeof(struct channel));
+	if(ch != NULL)
+		ch->slot = (struct slot *) calloc(depth, sizeof(struct slot));
+	if(ch == NULL || ch->slot == NULL) {
+		free(ch);
+		return false;
+	}
+
+	ch->depth = depth;
+	ch->mask = depth - 1;
+	ch->latency = c->latency;
+	c->channel[c->channels++] = ch;
+
+	// the ports call the channels back
+	src->ports->out[out].kind = PORT_HOST;
+	dst->ports->in[in].kind = PORT_HOST;
+	src->out[out] = ch;
+	dst->in[in] = ch;
+	return true;
+}
+
+bool cluster_status(struct cluster *c, unsigned core, uint8_t port, uint8_t in)
+{
+	struct core *dst = c->core[core];
+	if(dst->in[in] == NULL || dst->in[port] != NULL || dst->status[port] != NULL)
+		return false;
+
+	dst->ports->in[port].kind = PORT_HOST;
+	dst->status[port] = dst->in[in];
+	return true;
+}
+
+// =================================== //
+// ------------- windows ------------- //
+// =================================== //
+
+/**
+ * Delivers the outputs of the window ordered by cycles and cores. Outputs
+ * of a window end before the instructions of the next one.
+ */
+static void deliver(struct cluster *c)
+{
+	for(unsigned i = 0; i < c->cores; i++) {
+		struct core *core = c->core[i];
+		ports_flush(&core->sim, core->ports);
+		core->next = 0;
+	}
+
+	for(;;) {
+		struct core *first = NULL;
+		unsigned index = 0;
+		for(unsigned i = 0; i < c->cores; i++) {
+			struct core *core = c->core[i];
+			if(core->next < core->log_len && (first == NULL
+					|| core->log[core->next].cycle < first->log[first->next].cycle)) {
+				first = core;
+				index = i;
+			}
+		}
+
+		if(first == NULL)
+			break;
+		if(c->output != NULL)
+			c->output(index, &first->log[first->next], c->ctx);
+		first->next += 1;
+	}
+
+	for(unsigned i = 0; i < c->cores; i++)
+		c->core[i]->log_len = 0;
+}
+
+/**
+ * The serial part between the windows, run by the last thread.
+ */
+static void end_window(struct cluster *c)
+{
+	deliver(c);
+	for(unsigned i = 0; i < c->channels; i++)
+		c->channel[i]->acked = c->channel[i]->head;
+
+	bool done = true;
+	for(unsigned i = 0; i < c->cores; i++)
+		done = done && c->core[i]->done;
+
+	c->now += c->latency;
+	c->finished = done || c->nomem || c->now >= c->end;
+}
+
+/**
+ * Sense-reversing barrier, the last thread ends the window.
+ */
+static void barrier(struct cluster *c, bool *sense)
+{
+	*sense = !*sense;
+	if(__atomic_sub_fetch(&c->waiting, 1, __ATOMIC_ACQ_REL) == 0) {
+		end_window(c);
+		c->waiting = c->threads;
+		__atomic_store_n(&c->sense, *sense, __ATOMIC_RELEASE);
+		return;
+	}
+
+	for(unsigned spin = 0; __atomic_load_n(&c->sense, __ATOMIC_ACQUIRE) != *sense; spin++) {
+		if(spin >= CLUSTER_SPIN)
+			sched_yield();
+	}
+}
+
+struct worker {
+	struct cluster *cluster;
+	unsigned id;
+	pthread_t tid;
+};
+
+static void *worker(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct cluster *c = w->cluster;
+	while(__atomic_load_n(&c->threads, __ATOMIC_ACQUIRE) == 0)
+		sched_yield();
+
+	const unsigned first = c->cores * w->id / c->threads;
+	const unsigned last = c->cores * (w->id + 1) / c->threads;
+	bool sense = c->sense;
+
+	while(!c->finished) {
+		uint64_t until = c->now + c->latency;
+		if(until > c->end)
+			until = c->end;
+
+		for(unsigned i = first; i < last; i++) {
+			struct core *core = c->core[i];
+			if(!core->done && sched_run(core->sched, until) != SIM_BUDGET)
+				core->done = true;
+		}
+
+		barrier(c, &sense);
+	}
+
+	return NULL;
+}
+
+bool cluster_run(struct cluster *c, uint64_t cycles, unsigned threads,
+		cluster_output_t output, void *ctx)
+{
+	if(threads < 1)
+		threads = 1;
+	if(threads > c->cores)
+		threads = c->cores;
+
+	struct worker *w = (struct worker *) calloc(threads, sizeof(struct worker));
+	if(w == NULL)
+		return false;
+
+	c->output = output;
+	c->ctx = ctx;
+	c->end = cycles;
+	c->finished = c->now >= cycles;
+	for(unsigned i = 0; i < c->cores; i++)
+		c->core[i]->done = false;
+
+	// the cores are split among the threads that were created
+	c->threads = 0;
+	unsigned started = 1;
+	for(; started < threads; started++) {
+		w[started].cluster = c;
+		w[started].id = started;
+		if(pthread_create(&w[started].tid, NULL, &worker, &w[started]))
+			break;
+	}
+
+	c->waiting = started;
+	__atomic_store_n(&c->threads, started, __ATOMIC_RELEASE);
+	w[0].cluster = c;
+	worker(&w[0]);
+	for(unsigned i = 1; i < started; i++)
+		pthread_join(w[i].tid, NULL);
+
+	free(w);
+	return !c->nomem;
+}
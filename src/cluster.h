@@ -0,0 +1,113 @@
+/**
+ * cluster.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _CLUSTER_H
+#define _CLUSTER_H
+
+#include "sim.h"
+#include "ports.h"
+#include "scheduler.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * System of processors connected by channels. A channel is a FIFO from
+ * an OUTPUT port of one core to an INPUT port of another one, the value
+ * written at a cycle can be read the given latency later. Every thread
+ * runs its own cores one window of cycles long, then all threads wait for
+ * each other (conservative synchronization). The window is the latency,
+ * so nothing written in a window can be read in the same window and
+ * the results do not depend on the number of threads or their timing.
+ *
+ * Channels are lock-free single-producer single-consumer rings of values
+ * stamped by the cycle since when they can be read. INPUT from an empty
+ * channel reads the last value again, a status port reads 1 when a value
+ * can be read. The producer sees the values read by the consumer at the
+ * end of the window, a value written to a full channel is lost.
+ *
+ * Other INPUT ports are registers set by the events of each core
+ * (see sched_read), events of the channel and status ports are rejected,
+ * or ignored when the port is connected later. Other OUTPUT ports are logged. The logs of all cores
+ * are delivered ordered by cycles and cores at the end of each window.
+ * Polling loops are not skipped (see sim_run), the channels are not stable.
+ */
+
+#define CLUSTER_CORES 256
+#define CLUSTER_DEPTH 16	// of channels by default
+#define CLUSTER_SPIN 1000	// threads spin before yielding at the end of the window
+
+typedef void (*cluster_output_t)(unsigned core, const struct port_log *e, void *ctx);
+
+struct cluster;
+
+/**
+ * @param latency of channels in cycles, at least 1
+ * @return NULL on allocation error
+ */
+struct cluster *cluster_init(unsigned cores, uint64_t latency);
+
+void cluster_destroy(struct cluster *c);
+
+/**
+ * The simulator of the core for sim_load (or snapshot_restore).
+ */
+struct sim *cluster_sim(struct cluster *c, unsigned core);
+
+/**
+ * Events of the core, eg. for sched_read.
+ */
+struct sched *cluster_sched(struct cluster *c, unsigned core);
+
+/**
+ * Connects the OUTPUT port of one core to the INPUT port of another one
+ * (or the same one).
+ * @param depth power of 2
+ * @return false on allocation error or when either port is connected
+ */
+bool cluster_channel(struct cluster *c, unsigned from, uint8_t out, unsigned to,
+		uint8_t in, uint32_t depth);
+
+/**
+ * INPUT from the port of the receiving core reads 1 when a value
+ * of the channel to the given port can be read, 0 otherwise.
+ * @return false when the channel does not exist or the port is used
+ */
+bool cluster_status(struct cluster *c, unsigned core, uint8_t port, uint8_t in);
+
+/**
+ * Values lost by writes to the full channels of the core.
+ */
+uint64_t cluster_lost(const struct cluster *c, unsigned core);
+
+/**
+ * Threads started by the last cluster_run, 0 before it.
+ */
+unsigned cluster_threads(const struct cluster *c);
+
+/**
+ * Runs all cores until the cycle or until all of them stopped. The outputs
+ * are delivered by the last thread ending the window, one window at a time.
+ * @param threads at most the number of cores, fewer are used when they can
+ * not be created
+ * @return false on allocation error
+ */
+bool cluster_run(struct cluster *c, uint64_t cycles, unsigned threads,
+		cluster_output_t output, void *ctx);
+
+#endif
@@ -0,0 +1,325 @@
+/**
+ * cosim.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cosim.h"
+#include "ports.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define COSIM_MAGIC 0x50434F53	// "PCOS"
+#define COSIM_VERSION 1
+#define COSIM_NAME_MAX 256
+#define CACHE_LINE 64
+#define SPIN 1000	// polls before sleeping
+#define SLEEP_NS 10000
+
+/**
+ * The consumer writes only head, the producer only tail,
+ * each on its own cache line.
+ */
+struct ring {
+	uint32_t head;
+	uint8_t pad_head[CACHE_LINE - sizeof(uint32_t)];
+	uint32_t tail;
+	uint8_t pad_tail[CACHE_LINE - sizeof(uint32_t)];
+	struct cosim_msg msg[COSIM_RING];
+};
+
+enum side {
+	HDL,
+	MODEL
+};
+
+struct shared {
+	uint32_t magic;	// written last by the creator
+	uint32_t version;
+	int32_t pid[2];	// of the sides, 0 until attached
+	uint32_t closed[2];
+	uint8_t pad[CACHE_LINE - 6 * sizeof(uint32_t)];
+	struct ring ring[2];	// to the side
+};
+
+struct cosim {
+	struct shared *shm;
+	enum side side;
+	char name[COSIM_NAME_MAX];
+};
+
+static void pause_ns(long ns)
+{
+	struct timespec ts = {.tv_sec = 0, .tv_nsec = ns};
+	nanosleep(&ts, NULL);
+}
+
+/**
+ * @return false when the peer closed the shared memory or died
+ */
+static bool peer_alive(const struct cosim *c)
+{
+	const enum side peer = c->side == HDL? MODEL : HDL;
+	if(__atomic_load_n(&c->shm->closed[peer], __ATOMIC_ACQUIRE))
+		return false;
+
+	const pid_t pid = __atomic_load_n(&c->shm->pid[peer], __ATOMIC_ACQUIRE);
+	return pid == 0 || kill(pid, 0) == 0;
+}
+
+/**
+ * Maps the shared memory, the descriptor is closed.
+ */
+static struct shared *map(int fd)
+{
+	struct stat st;
+	void *shm = MAP_FAILED;
+	if(fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(struct shared))
+		shm = mmap(NULL, sizeof(struct shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	return shm == MAP_FAILED? NULL : (struct shared *) shm;
+}
+
+static struct cosim *alloc(const char *name, enum side side)
+{
+	if(strlen(name) >= COSIM_NAME_MAX)
+		return NULL;
+
+	struct cosim *c = (struct cosim *) calloc(1, sizeof(struct cosim));
+	if(c == NULL)
+		return NULL;
+
+	c->side = side;
+	strcpy(c->name, name);
+	return c;
+}
+
+struct cosim *cosim_create(const char *name)
+{
+	struct cosim *c = alloc(name, HDL);
+	if(c == NULL)
+		return NULL;
+
+	shm_unlink(name);
+	const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+	if(fd < 0) {
+		free(c);
+		return NULL;
+	}
+	if(ftruncate(fd, sizeof(struct shared)) != 0)
+		close(fd);
+	else
+		c->shm = map(fd);
+	if(c->shm == NULL) {
+		shm_unlink(name);
+		free(c);
+		return NULL;
+	}
+
+	// the memory is zeroed by ftruncate
+	c->shm->version = COSIM_VERSION;
+	c->shm->pid[HDL] = getpid();
+	__atomic_store_n(&c->shm->magic, COSIM_MAGIC, __ATOMIC_RELEASE);
+	return c;
+}
+
+struct cosim *cosim_attach(const char *name)
+{
+	struct cosim *c = alloc(name, MODEL);
+	if(c == NULL)
+		return NULL;
+
+	for(unsigned ms = 0; ms < COSIM_ATTACH_MS; ms++) {
+		const int fd = shm_open(name, O_RDWR, 0);
+		if(fd >= 0 && (c->shm = map(fd)) != NULL) {
+			// an old memory of a testbench that ended is not used
+			if(__atomic_load_n(&c->shm->magic, __ATOMIC_ACQUIRE) == COSIM_MAGIC
+					&& c->shm->version == COSIM_VERSION && c->shm->pid[MODEL] == 0
+					&& peer_alive(c)) {
+				__atomic_store_n(&c->shm->pid[MODEL], getpid(), __ATOMIC_RELEASE);
+				return c;
+			}
+			munmap(c->shm, sizeof(struct shared));
+			c->shm = NULL;
+		}
+		pause_ns(1000000);
+	}
+
+	free(c);
+	return NULL;
+}
+
+void cosim_close(struct cosim *c)
+{
+	if(c == NULL)
+		return;
+
+	__atomic_store_n(&c->shm->closed[c->side], 1, __ATOMIC_RELEASE);
+	munmap(c->shm, sizeof(struct shared));
+	if(c->side == HDL)
+		shm_unlink(c->name);
+	free(c);
+}
+
+bool cosim_send(struct cosim *c, const struct cosim_msg *m)
+{
+	struct ring *r = &c->shm->ring[c->side == HDL? MODEL : HDL];
+	const uint32_t tail = r->tail;
+
+	for(unsigned i = 0; tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == COSIM_RING; i++) {
+		if(i >= SPIN) {
+			if(!peer_alive(c))
+				return false;
+			pause_ns(SLEEP_NS);
+		}
+	}
+
+	r->msg[tail & (COSIM_RING - 1)] = *m;
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+bool cosim_recv(struct cosim *c, struct cosim_msg *m)
+{
+	struct ring *r = &c->shm->ring[c->side];
+	const uint32_t head = r->head;
+
+	for(unsigned i = 0; __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == head; i++) {
+		if(i >= SPIN) {
+			// the messages sent before closing are received
+			if(!peer_alive(c) && __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == head)
+				return false;
+			pause_ns(SLEEP_NS);
+		}
+	}
+
+	*m = r->msg[head & (COSIM_RING - 1)];
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+// =================================== //
+// -------------- model -------------- //
+// =================================== //
+
+struct serve {
+	struct cosim *c;
+	bool sent;	// false when the testbench ended
+};
+
+static void send(struct serve *v, uint8_t type, uint64_t cycle, uint8_t port, uint8_t value)
+{
+	const struct cosim_msg m = {.cycle = cycle, .type = type, .port = port, .value = value};
+	if(v->sent && !cosim_send(v->c, &m))
+		v->sent = false;
+}
+
+static void notify(struct sim *s, struct ports *p, enum port_dir dir,
+		uint8_t port, enum port_event event, void *ctx)
+{
+	struct serve *v = (struct serve *) ctx;
+
+	// the logged outputs are sent first to keep the order of cycles
+	if(event == PORT_WATCH && dir == PORT_IN) {
+		ports_flush(s, p);
+		send(v, COSIM_READ, s->cycles, port, p->in[port].value);
+	}
+	else if(event == PORT_LOG_FULL) {
+		for(uint32_t i = 0; i < p->log_len; i++)
+			send(v, COSIM_OUTPUT, p->log[i].cycle, p->log[i].port, p->log[i].value);
+	}
+	if(!v->sent)
+		sim_stop(s);
+}
+
+/**
+ * Runs the instructions starting before the cycle, the interrupt is
+ * acknowledged at the exact cycle like by sched_run.
+ */
+static enum sim_status advance(struct serve *v, struct sim *s, uint64_t until)
+{
+	s->stable_until = until;
+	enum sim_status status = SIM_BUDGET;
+
+	while(s->cycles < until && v->sent) {
+		if(sim_acknowledge(s)) {
+			ports_flush(s, s->ports);
+			send(v, COSIM_ACK, s->cycles - SIM_CYCLES_PER_INSTR, 0, 0);
+			continue;
+		}
+
+		uint64_t n = (until - s->cycles + SIM_CYCLES_PER_INSTR - 1) / SIM_CYCLES_PER_INSTR;
+		if(s->irq)
+			n = 1;
+		status = sim_run(s, n);
+		if(status != SIM_BUDGET)
+			break;
+	}
+
+	ports_flush(s, s->ports);
+	return status;
+}
+
+bool cosim_serve(struct cosim *c, struct sim *s)
+{
+	struct serve v = {.c = c, .sent = true};
+	struct ports *p = ports_init(&notify, &v);
+	if(p == NULL)
+		return false;
+
+	for(int i = 0; i < PORTS; i++) {
+		ports_register(p, PORT_IN, i, 0);
+		ports_log(p, i);
+	}
+	ports_attach(p, s);
+
+	struct cosim_msg m;
+	bool quit = false;
+	while(!quit && v.sent && cosim_recv(c, &m)) {
+		switch(m.type) {
+		case COSIM_ADVANCE:
+			m.value = advance(&v, s, m.cycle);
+			send(&v, COSIM_DONE, s->cycles, 0, m.value);
+			break;
+		case COSIM_INPUT:
+			p->in[m.port].value = m.value;
+			break;
+		case COSIM_IRQ:
+			sim_interrupt(s, m.value != 0);
+			break;
+		case COSIM_WATCH:
+			ports_watch(p, PORT_IN, m.port, m.value != 0);
+			break;
+		case COSIM_QUIT:
+			quit = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	ports_detach(p, s);
+	ports_destroy(p);
+	return quit;
+}
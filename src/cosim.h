@@ -0,0 +1,106 @@
+/**
+ * cosim.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _COSIM_H
+#define _COSIM_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Co-simulation with a HDL simulator. The processor runs in its own process
+ * (picosim -x) and the testbench (see cosim_shim.h) exchanges messages with
+ * it through two single-producer single-consumer rings in POSIX shared
+ * memory, one for each direction. The indexes are free running and published
+ * by release stores, the peer waits by spinning and then by short sleeps.
+ *
+ * The testbench owns the time: it sets the inputs and the interrupt, then
+ * sends COSIM_ADVANCE. The processor executes the instructions starting
+ * before that cycle (like sched_run), sends what it did and COSIM_DONE.
+ * The values of inputs change only between the advances, so the polling
+ * loops of the program are skipped (see sim_run).
+ */
+
+#define COSIM_RING 4096	// messages in each direction, power of 2
+#define COSIM_ATTACH_MS 5000	// the model waits for the testbench
+
+enum cosim_type {
+	// to the model:
+	COSIM_ADVANCE,	// runs until the cycle
+	COSIM_INPUT,	// the value read from the port from now on
+	COSIM_IRQ,	// sets the interrupt input to the value
+	COSIM_WATCH,	// reports (value 1) or not (0) INPUT from the port
+	COSIM_QUIT,
+	// to the testbench:
+	COSIM_OUTPUT,	// OUTPUT at the cycle (end of the instruction, like picosim)
+	COSIM_READ,	// INPUT from a watched port at the cycle
+	COSIM_ACK,	// the interrupt was acknowledged at the cycle
+	COSIM_DONE	// the advance is done, value is enum sim_status
+};
+
+struct cosim_msg {
+	uint64_t cycle;
+	uint8_t type;
+	uint8_t port;
+	uint8_t value;
+};
+
+struct cosim;
+
+/**
+ * Creates the shared memory of the given name (eg. "/pico0") for the
+ * testbench, an old one of the same name is removed.
+ * @return NULL on error
+ */
+struct cosim *cosim_create(const char *name);
+
+/**
+ * Opens the shared memory created by the testbench, waits for it
+ * at most COSIM_ATTACH_MS.
+ * @return NULL on error
+ */
+struct cosim *cosim_attach(const char *name);
+
+/**
+ * The peer sees the end, the creator removes the shared memory.
+ */
+void cosim_close(struct cosim *c);
+
+/**
+ * Waits while the ring is full.
+ * @return false when the peer ended
+ */
+bool cosim_send(struct cosim *c, const struct cosim_msg *m);
+
+/**
+ * Waits for the next message.
+ * @return false when the peer ended
+ */
+bool cosim_recv(struct cosim *c, struct cosim_msg *m);
+
+/**
+ * Serves the testbench by the simulator until COSIM_QUIT. It attaches its
+ * own port models to the simulator: INPUT reads registers set by COSIM_INPUT,
+ * OUTPUT is logged and sent at the end of the advance.
+ * @return false when the testbench ended without COSIM_QUIT or on error
+ */
+bool cosim_serve(struct cosim *c, struct sim *s);
+
+#endif
@@ -0,0 +1,130 @@
+/**
+ * cosim_shim.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "cosim_shim.h"
+#include <stdlib.h>
+
+#define EVENTS_MIN 64
+
+static struct {
+	struct cosim *c;
+	struct cosim_msg *event;	// of the last advance
+	size_t len;
+	size_t size;
+	size_t next;
+	int status;
+} shim;
+
+int pico_cosim_open(const char *name)
+{
+	if(shim.c != NULL)
+		pico_cosim_close();
+
+	shim.c = cosim_create(name);
+	shim.status = SIM_RUNNING;
+	return shim.c == NULL? -1 : 0;
+}
+
+void pico_cosim_close(void)
+{
+	if(shim.c == NULL)
+		return;
+
+	const struct cosim_msg m = {.type = COSIM_QUIT};
+	cosim_send(shim.c, &m);
+	cosim_close(shim.c);
+	free(shim.event);
+	shim.c = NULL;
+	shim.event = NULL;
+	shim.len = shim.size = shim.next = 0;
+}
+
+static int send(uint8_t type, uint64_t cycle, int port, int value)
+{
+	const struct cosim_msg m = {.cycle = cycle, .type = type, .port = port, .value = value};
+	return shim.c != NULL && cosim_send(shim.c, &m)? 0 : -1;
+}
+
+int pico_cosim_input(int port, int value)
+{
+	return send(COSIM_INPUT, 0, port, value);
+}
+
+int pico_cosim_interrupt(int level)
+{
+	return send(COSIM_IRQ, 0, 0, level != 0);
+}
+
+int pico_cosim_watch(int port, int on)
+{
+	return send(COSIM_WATCH, 0, port, on != 0);
+}
+
+static bool append(const struct cosim_msg *m)
+{
+	if(shim.len == shim.size) {
+		const size_t size = shim.size == 0? EVENTS_MIN : 2 * shim.size;
+		struct cosim_msg *more = (struct cosim_msg *)
+				realloc(shim.event, size * sizeof(struct cosim_msg));
+		if(more == NULL)
+			return false;
+		shim.event = more;
+		shim.size = size;
+	}
+
+	shim.event[shim.len++] = *m;
+	return true;
+}
+
+int pico_cosim_advance(long long cycle)
+{
+	shim.len = shim.next = 0;
+	if(cycle < 0 || send(COSIM_ADVANCE, cycle, 0, 0) != 0)
+		return -1;
+
+	struct cosim_msg m;
+	while(cosim_recv(shim.c, &m)) {
+		if(m.type == COSIM_DONE) {
+			shim.status = m.value;
+			return shim.len;
+		}
+		if(!append(&m))
+			return -1;
+	}
+
+	return -1;
+}
+
+int pico_cosim_event(int *type, int *port, int *value, long long *cycle)
+{
+	if(shim.next == shim.len)
+		return 0;
+
+	const struct cosim_msg *m = &shim.event[shim.next++];
+	*type = m->type;
+	*port = m->port;
+	*value = m->value;
+	*cycle = m->cycle;
+	return 1;
+}
+
+int pico_cosim_status(void)
+{
+	return shim.status;
+}
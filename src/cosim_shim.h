@@ -0,0 +1,74 @@
+/**
+ * cosim_shim.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _COSIM_SHIM_H
+#define _COSIM_SHIM_H
+
+#include "cosim.h"
+
+/**
+ * Testbench side of the co-simulation for HDL simulators, flat functions
+ * with integer arguments to be called through VHPIDIRECT (GHDL), DPI-C
+ * (Verilator) or a VPI system task. Compile cosim_shim.c and cosim.c with
+ * -fPIC into the simulator, there is one co-simulation per process.
+ *
+ * Typically on every rising edge of the clock (2 cycles per instruction):
+ * set the changed inputs and the interrupt, pico_cosim_advance to the current
+ * cycle and drive the strobes of the returned events.
+ */
+
+/**
+ * Creates the shared memory, start 'picosim -i prog.hex -x <name>' with
+ * the same name before or after.
+ * @return 0 or -1 on error
+ */
+int pico_cosim_open(const char *name);
+
+/**
+ * Stops the model.
+ */
+void pico_cosim_close(void);
+
+/**
+ * Changes apply to the instructions starting at the current cycle and later.
+ * @return 0 or -1 when the model ended
+ */
+int pico_cosim_input(int port, int value);
+int pico_cosim_interrupt(int level);
+int pico_cosim_watch(int port, int on);
+
+/**
+ * Runs the model until the cycle and waits for it.
+ * @return number of events to read by pico_cosim_event, -1 when the model ended
+ */
+int pico_cosim_advance(long long cycle);
+
+/**
+ * Takes the next event of the last advance in order of cycles.
+ * @param type COSIM_OUTPUT, COSIM_READ or COSIM_ACK
+ * @return 1 or 0 when there are no more events
+ */
+int pico_cosim_event(int *type, int *port, int *value, long long *cycle);
+
+/**
+ * @return enum sim_status after the last advance
+ */
+int pico_cosim_status(void);
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * coverage.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "coverage.h"
+#include <string.h>
+
+#define COVERAGE_MAGIC "PCOV"
+#define COVERAGE_VERSION 1
+#define COVERAGE_SIZE (5 + 4 + 3 * 8 * SIM_COVERAGE_WORDS)
+
+static uint8_t *put(uint8_t *p, uint64_t v, int bytes)
+{
+	for(int i = 0; i < bytes; i++)
+		*p++ = v >> (8 * i);
+	return p;
+}
+
+static const uint8_t *get(const uint8_t *p, uint64_t *v, int bytes)
+{
+	*v = 0;
+	for(int i = 0; i < bytes; i++)
+		*v |= (uint64_t) *p++ << (8 * i);
+	return p;
+}
+
+bool coverage_write(FILE *f, const struct sim_coverage *c, uint32_t checksum)
+{
+	uint8_t buf[COVERAGE_SIZE];
+	uint8_t *p = buf;
+
+	memcpy(p, COVERAGE_MAGIC, 4);
+	p = put(p + 4, COVERAGE_VERSION, 1);
+	p = put(p, checksum, 4);
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++)
+		p = put(p, c->executed[i], 8);
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++)
+		p = put(p, c->taken[i], 8);
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++)
+		p = put(p, c->not_taken[i], 8);
+
+	return fwrite(buf, 1, sizeof(buf), f) == sizeof(buf);
+}
+
+bool coverage_read(FILE *f, struct sim_coverage *c, uint32_t *checksum)
+{
+	uint8_t buf[COVERAGE_SIZE];
+	if(fread(buf, 1, sizeof(buf), f) != sizeof(buf))
+		return false;
+	if(memcmp(buf, COVERAGE_MAGIC, 4) || buf[4] != COVERAGE_VERSION)
+		return false;
+
+	const uint8_t *p = buf + 5;
+	uint64_t v;
+
+	p = get(p, &v, 4);
+	*checksum = v;
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++)
+		p = get(p, &c->executed[i], 8);
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++)
+		p = get(p, &c->taken[i], 8);
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++)
+		p = get(p, &c->not_taken[i], 8);
+	return true;
+}
+
+void coverage_merge(struct sim_coverage *dst, const struct sim_coverage *src)
+{
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++) {
+		dst->executed[i] |= src->executed[i];
+		dst->taken[i] |= src->taken[i];
+		dst->not_taken[i] |= src->not_taken[i];
+	}
+}
+
+unsigned coverage_count(const uint64_t bitmap[SIM_COVERAGE_WORDS])
+{
+	unsigned n = 0;
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++) {
+		for(uint64_t w = bitmap[i]; w != 0; w &= w - 1)
+			n += 1;
+	}
+	return n;
+}
+
+bool coverage_branch(const struct sim_instr *ins)
+{
+	switch(ins->op) {
+	case S_JUMP_Z: case S_JUMP_NZ: case S_JUMP_C: case S_JUMP_NC:
+	case S_CALL_Z: case S_CALL_NZ: case S_CALL_C: case S_CALL_NC:
+	case S_RETURN_Z: case S_RETURN_NZ: case S_RETURN_C: case S_RETURN_NC:
+		return true;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,62 @@
+/**
+ * coverage.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _COVERAGE_H
+#define _COVERAGE_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Coverage of the program, the bitmaps of struct sim_coverage are collected
+ * by sim_run when s->coverage is set: the executed addresses and both directions
+ * of the conditional jumps, calls and returns. The coverage of many runs
+ * of the same program is merged by OR.
+ *
+ * The file, little endian:
+ *   "PCOV" version:8 checksum:32 executed:64[16] taken:64[16] not_taken:64[16]
+ */
+
+bool coverage_write(FILE *f, const struct sim_coverage *c, uint32_t checksum);
+
+/**
+ * @param checksum of the program that was covered
+ */
+bool coverage_read(FILE *f, struct sim_coverage *c, uint32_t *checksum);
+
+void coverage_merge(struct sim_coverage *dst, const struct sim_coverage *src);
+
+static inline bool coverage_test(const uint64_t bitmap[SIM_COVERAGE_WORDS], uint16_t addr)
+{
+	return (bitmap[addr / 64] >> (addr % 64)) & 1;
+}
+
+/**
+ * @return number of addresses in the bitmap
+ */
+unsigned coverage_count(const uint64_t bitmap[SIM_COVERAGE_WORDS]);
+
+/**
+ * @return true for the conditional jumps, calls and returns
+ */
+bool coverage_branch(const struct sim_instr *ins);
+
+#endif
@@ -0,0 +1,375 @@
+/**
+ * emitc.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "emitc.h"
+#include "sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+
+/**
+ * The interrupt is polled at the start of every block only. It is exact
+ * because the interrupt can change only by I/O callbacks and by the
+ * interrupt control instructions, all of them end the block.
+ */
+static bool ends_block(uint8_t op)
+{
+	switch(op) {
+	case S_INPUT_RR: case S_INPUT_RK:
+	case S_OUTPUT_RR: case S_OUTPUT_RK:
+	case S_JUMP: case S_JUMP_Z: case S_JUMP_NZ: case S_JUMP_C: case S_JUMP_NC:
+	case S_CALL: case S_CALL_Z: case S_CALL_NZ: case S_CALL_C: case S_CALL_NC:
+	case S_RETURN: case S_RETURN_Z: case S_RETURN_NZ: case S_RETURN_C: case S_RETURN_NC:
+	case S_RETURNI_DISABLE: case S_RETURNI_ENABLE:
+	case S_DISABLE_INTERRUPT: case S_ENABLE_INTERRUPT:
+	case S_INVALID:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool has_target(uint8_t op)
+{
+	return (op >= S_JUMP && op <= S_JUMP_NC) || (op >= S_CALL && op <= S_CALL_NC);
+}
+
+/**
+ * Marks the first instructions of basic blocks. An invalid instruction
+ * is a block of its own as it is not counted.
+ */
+static void find_leaders(const struct sim_instr *rom, bool *leader)
+{
+	memset(leader, 0, SIM_PROGRAM_LEN * sizeof(bool));
+	leader[0] = true;
+	leader[SIM_VECTOR] = true;
+
+	for(unsigned addr = 0; addr < SIM_PROGRAM_LEN; addr++) {
+		const uint8_t op = rom[addr].op;
+		if(has_target(op))
+			leader[rom[addr].target] = true;
+		if(op == S_INVALID)
+			leader[addr] = true;
+		if(ends_block(op))
+			leader[(addr + 1) & PC_MASK] = true;
+	}
+}
+
+/**
+ * Emits the condition of the conditional operations, they follow
+ * the unconditional one in the order Z, NZ, C, NC.
+ * @return the indentation of the conditional statement
+ */
+static const char *condition(FILE *f, uint8_t op, uint8_t first)
+{
+	static const char *cond[] = {NULL, "ZERO()", "!ZERO()", "CARRY()", "!CARRY()"};
+	if(op == first)
+		return "\t";
+
+	fprintf(f, "\tif(%s)\n", cond[op - first]);
+	return "\t\t";
+}
+
+static void emit_prologue(FILE *f, const char *func)
+{
+	fprintf(f, "/**\n"
+			" * Machine generated by pico, do not edit.\n"
+			" * enum sim_status %s(struct sim *s, uint64_t instructions)\n"
+			" * executes the program like sim_run, link with libpicosim.a.\n"
+			" */\n\n", func);
+	fprintf(f, "#include \"sim.h\"\n\n");
+
+	fprintf(f, "#define SYNC() {\\\n");
+	for(int i = 0; i < SIM_REGS; i++)
+		fprintf(f, "\ts->reg[%d] = r%X;\\\n", i, i);
+	fprintf(f, "\ts->pc = pc;\\\n"
+			"\ts->flags = flags;\\\n"
+			"\ts->ie = ie;\\\n"
+			"\ts->cycles = cycles + SIM_CYCLES_PER_INSTR * (n + slots);\\\n"
+			"\ts->instructions = instrs + n;}\n\n");
+
+	fprintf(f, "#define LOAD() {\\\n");
+	for(int i = 0; i < SIM_REGS; i++)
+		fprintf(f, "\tr%X = s->reg[%d];%s\n", i, i, i == SIM_REGS - 1? "}" : "\\");
+	fprintf(f, "\n#define ZERO() ((flags & 0xFF) == 0)\n"
+			"#define CARRY() sim_flags_carry(flags)\n\n");
+
+	fprintf(f, "enum sim_status %s(struct sim *s, uint64_t instructions)\n{\n", func);
+	for(int i = 0; i < SIM_REGS; i++)
+		fprintf(f, "\tuint8_t r%X = s->reg[%d];\n", i, i);
+	fprintf(f, "\tuint16_t pc = s->pc;\n"
+			"\tunsigned flags = s->flags;\n"
+			"\tbool ie = s->ie;\n"
+			"\tbool pending = ie && s->irq;\n"
+			"\tconst uint64_t cycles = s->cycles;\n"
+			"\tconst uint64_t instrs = s->instructions;\n"
+			"\tuint64_t n = 0;\n"
+			"\tuint64_t slots = 0;\n\n"
+			"\ts->status = SIM_RUNNING;\n\n");
+}
+
+static void emit_dispatch(FILE *f, const bool *leader)
+{
+	fprintf(f, "dispatch:\n\tswitch(pc) {\n");
+	for(unsigned addr = 0; addr < SIM_PROGRAM_LEN; addr++) {
+		if(leader[addr])
+			fprintf(f, "\tcase 0x%.3X: goto L_%.3X;\n", addr, addr);
+	}
+	fprintf(f, "\tdefault: goto step;\n\t}\n\n");
+}
+
+/**
+ * Budget and interrupt checks at the start of a block of len instructions.
+ */
+static void emit_block(FILE *f, unsigned addr, unsigned len, bool invalid)
+{
+	fprintf(f, "L_%.3X:\n", addr);
+	fprintf(f, "\tif(instructions - n < %u) {pc = 0x%.3X; goto tail;}\n", len, addr);
+	fprintf(f, "\tif(pending) {pc = 0x%.3X; goto irq;}\n", addr);
+	if(!invalid)
+		fprintf(f, "\tn += %u;\n", len);
+}
+
+static void emit_io(FILE *f, const struct sim_instr *ins, unsigned next, bool rr, bool input)
+{
+	char port[16];
+	if(rr)
+		snprintf(port, sizeof(port), "r%X", ins->y);
+	else
+		snprintf(port, sizeof(port), "0x%.2X", ins->y);
+
+	fprintf(f, "\tpc = 0x%.3X;\n\tSYNC();\n", next);
+	if(input) {
+		fprintf(f, "\ts->reg[%d] = s->io.input == NULL? 0 : s->io.input(s, %s, s->io.ctx);\n",
+				ins->x, port);
+	}
+	else {
+		fprintf(f, "\tif(s->io.output != NULL)\n"
+				"\t\ts->io.output(s, %s, r%X, s->io.ctx);\n", port, ins->x);
+	}
+	fprintf(f, "\tLOAD();\n"
+			"\tpending = ie && s->irq;\n"
+			"\tif(s->status != SIM_RUNNING)\n"
+			"\t\tgoto stop;\n");
+}
+
+static void emit_instr(FILE *f, unsigned addr, const struct sim_instr *ins)
+{
+	static const char *logic[] = {
+		[S_AND_RR] = "&", [S_AND_RK] = "&",
+		[S_OR_RR] = "|", [S_OR_RK] = "|",
+		[S_XOR_RR] = "^", [S_XOR_RK] = "^",
+		[S_ADD_RR] = "+", [S_ADD_RK] = "+",
+		[S_ADDCY_RR] = "+", [S_ADDCY_RK] = "+",
+		[S_SUB_RR] = "-", [S_SUB_RK] = "-",
+		[S_SUBCY_RR] = "-", [S_SUBCY_RK] = "-"
+	};
+
+	const unsigned x = ins->x;
+	const unsigned next = (addr + 1) & PC_MASK;
+	const char *indent;
+	char y[16];
+
+	switch(ins->op) {
+	case S_LOAD_RR: case S_AND_RR: case S_OR_RR: case S_XOR_RR:
+	case S_TEST_RR: case S_ADD_RR: case S_ADDCY_RR: case S_SUB_RR:
+	case S_SUBCY_RR: case S_COMPARE_RR: case S_FETCH_RR: case S_STORE_RR:
+		snprintf(y, sizeof(y), "r%X", ins->y);
+		break;
+	default:
+		snprintf(y, sizeof(y), "0x%.2X", ins->y);
+		break;
+	}
+
+	fprintf(f, "\t// %.3X\n", addr);
+
+	switch(ins->op) {
+	case S_LOAD_RR: case S_LOAD_RK:
+		fprintf(f, "\tr%X = %s;\n", x, y);
+		break;
+	case S_AND_RR: case S_AND_RK:
+	case S_OR_RR: case S_OR_RK:
+	case S_XOR_RR: case S_XOR_RK:
+		fprintf(f, "\tr%X %s= %s;\n\tflags = r%X;\n", x, logic[ins->op], y, x);
+		break;
+	case S_TEST_RR: case S_TEST_RK:
+		fprintf(f, "\tflags = (r%X & %s) | SIM_FLAGS_PARITY;\n", x, y);
+		break;
+	case S_ADD_RR: case S_ADD_RK:
+	case S_SUB_RR: case S_SUB_RK:
+		fprintf(f, "\tflags = (r%X %s %s) & 0x1FF;\n\tr%X = flags;\n",
+				x, logic[ins->op], y, x);
+		break;
+	case S_ADDCY_RR: case S_ADDCY_RK:
+	case S_SUBCY_RR: case S_SUBCY_RK:
+		fprintf(f, "\tflags = (r%X %s %s %s CARRY()) & 0x1FF;\n\tr%X = flags;\n",
+				x, logic[ins->op], y, logic[ins->op], x);
+		break;
+	case S_COMPARE_RR: case S_COMPARE_RK:
+		fprintf(f, "\tflags = (r%X - %s) & 0x1FF;\n", x, y);
+		break;
+	case S_FETCH_RR: case S_FETCH_RK:
+		fprintf(f, "\tr%X = s->scratchpad[%s & 0x%.2X];\n", x, y, SIM_SCRATCHPAD - 1);
+		break;
+	case S_STORE_RR: case S_STORE_RK:
+		fprintf(f, "\ts->scratchpad[%s & 0x%.2X] = r%X;\n", y, SIM_SCRATCHPAD - 1, x);
+		break;
+	case S_INPUT_RR: case S_INPUT_RK:
+		emit_io(f, ins, next, ins->op == S_INPUT_RR, true);
+		break;
+	case S_OUTPUT_RR: case S_OUTPUT_RK:
+		emit_io(f, ins, next, ins->op == S_OUTPUT_RR, false);
+		break;
+
+	case S_SL0: case S_SL1: case S_SLX: case S_SLA: case S_RL: {
+		static const char *in[] = {
+			[S_SL0 - S_SL0] = "0", [S_SL1 - S_SL0] = "1", [S_SLX - S_SL0] = "(r%X & 1)",
+			[S_SLA - S_SL0] = "CARRY()", [S_RL - S_SL0] = "(r%X >> 7)"
+		};
+		fprintf(f, "\tflags = (r%X << 1) | ", x);
+		fprintf(f, in[ins->op - S_SL0], x);
+		fprintf(f, ";\n\tr%X = flags;\n", x);
+		break;
+	}
+	case S_SR0: case S_SR1: case S_SRX: case S_SRA: case S_RR: {
+		static const char *in[] = {
+			[S_SR0 - S_SR0] = "0", [S_SR1 - S_SR0] = "1", [S_SRX - S_SR0] = "(r%X >> 7)",
+			[S_SRA - S_SR0] = "CARRY()", [S_RR - S_SR0] = "(r%X & 1)"
+		};
+		fprintf(f, "\tflags = (r%X >> 1) | (", x);
+		fprintf(f, in[ins->op - S_SR0], x);
+		fprintf(f, " << 7) | ((r%X & 1) << 8);\n\tr%X = flags;\n", x, x);
+		break;
+	}
+
+	case S_JUMP: case S_JUMP_Z: case S_JUMP_NZ: case S_JUMP_C: case S_JUMP_NC:
+		indent = condition(f, ins->op, S_JUMP);
+		fprintf(f, "%sgoto L_%.3X;\n", indent, ins->target);
+		break;
+	case S_CALL: case S_CALL_Z: case S_CALL_NZ: case S_CALL_C: case S_CALL_NC:
+		indent = condition(f, ins->op, S_CALL);
+		fprintf(f, "%s{sim_push(s, 0x%.3X); goto L_%.3X;}\n", indent, addr, ins->target);
+		break;
+	case S_RETURN: case S_RETURN_Z: case S_RETURN_NZ: case S_RETURN_C: case S_RETURN_NC:
+		indent = condition(f, ins->op, S_RETURN);
+		fprintf(f, "%s{pc = (sim_pop(s) + 1) & 0x%.3X; goto dispatch;}\n", indent, PC_MASK);
+		break;
+	case S_RETURNI_DISABLE: case S_RETURNI_ENABLE:
+		fprintf(f, "\tpc = sim_pop(s);\n"
+				"\tflags = s->saved_flags;\n"
+				"\tie = %s;\n"
+				"\tpending = ie && s->irq;\n"
+				"\tgoto dispatch;\n", ins->op == S_RETURNI_ENABLE? "true" : "false");
+		break;
+	case S_DISABLE_INTERRUPT:
+		fprintf(f, "\tie = false;\n\tpending = false;\n");
+		break;
+	case S_ENABLE_INTERRUPT:
+		fprintf(f, "\tie = true;\n\tpending = s->irq;\n");
+		break;
+	case S_INVALID:
+		fprintf(f, "\tpc = 0x%.3X;\n\ts->status = SIM_INVALID;\n\tgoto stop;\n", addr);
+		break;
+	default:
+		break;
+	}
+}
+
+static void emit_epilogue(FILE *f)
+{
+	fprintf(f, "\tgoto L_000;\n\n"
+			"irq:\n"
+			"\tsim_push(s, pc);\n"
+			"\ts->saved_flags = flags;\n"
+			"\ts->irq = false;\n"
+			"\tie = false;\n"
+			"\tpending = false;\n"
+			"\tslots += 1;\n"
+			"\tgoto L_%.3X;\n\n", SIM_VECTOR);
+
+	fprintf(f, "step:\n"
+			"\t// not at the start of a block, one instruction by the interpreter\n"
+			"\tif(n == instructions)\n"
+			"\t\tgoto tail;\n"
+			"\tSYNC();\n"
+			"\tsim_run(s, 1);\n"
+			"\tLOAD();\n"
+			"\tpc = s->pc;\n"
+			"\tflags = s->flags;\n"
+			"\tie = s->ie;\n"
+			"\tpending = ie && s->irq;\n"
+			"\tn = s->instructions - instrs;\n"
+			"\tslots = (s->cycles - cycles) / SIM_CYCLES_PER_INSTR - n;\n"
+			"\tif(s->status != SIM_BUDGET)\n"
+			"\t\tgoto stop;\n"
+			"\ts->status = SIM_RUNNING;\n"
+			"\tgoto dispatch;\n\n");
+
+	fprintf(f, "tail:\n"
+			"\t// the budget ends inside the block\n"
+			"\tSYNC();\n"
+			"\treturn sim_run(s, instructions - n);\n\n"
+			"stop:\n"
+			"\tSYNC();\n"
+			"\treturn s->status;\n"
+			"}\n");
+}
+
+bool emitc_write(FILE *f, const code_t *code, progaddr_t len, const char *func)
+{
+	if(len > SIM_PROGRAM_LEN)
+		return false;
+
+	struct sim_instr *rom = (struct sim_instr *)
+			calloc(SIM_PROGRAM_LEN, sizeof(struct sim_instr));
+	bool *leader = (bool *) calloc(SIM_PROGRAM_LEN, sizeof(bool));
+	if(rom == NULL || leader == NULL) {
+		free(rom);
+		free(leader);
+		return false;
+	}
+
+	// padded by zero words like sim_load
+	for(unsigned addr = 0; addr < SIM_PROGRAM_LEN; addr++)
+		rom[addr] = sim_decode(addr < len? code[addr] : 0);
+
+	find_leaders(rom, leader);
+	emit_prologue(f, func);
+	emit_dispatch(f, leader);
+
+	for(unsigned addr = 0; addr < SIM_PROGRAM_LEN; addr++) {
+		if(leader[addr]) {
+			unsigned end = addr + 1;
+			while(end < SIM_PROGRAM_LEN && !leader[end])
+				end += 1;
+
+			const bool invalid = rom[addr].op == S_INVALID;
+			emit_block(f, addr, invalid? 1 : end - addr, invalid);
+		}
+
+		emit_instr(f, addr, &rom[addr]);
+	}
+
+	emit_epilogue(f);
+
+	free(rom);
+	free(leader);
+	return !ferror(f);
+}
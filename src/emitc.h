@@ -0,0 +1,40 @@
+/**
+ * emitc.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _EMITC_H
+#define _EMITC_H
+
+#include "pico.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Translates the KCPSM3 program to C. The generated function
+ *
+ *   enum sim_status <func>(struct sim *s, uint64_t instructions);
+ *
+ * is a drop-in replacement of sim_run for the given program: the state,
+ * the I/O callbacks (struct sim_io), the interrupt and the budget behave
+ * exactly the same. Each basic block becomes straight-line C with the
+ * registers in locals, the call stack is the one of struct sim.
+ * The generated file includes sim.h and is linked with libpicosim.a.
+ */
+bool emitc_write(FILE *f, const code_t *code, progaddr_t len, const char *func);
+
+#endif
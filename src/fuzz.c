@@ -0,0 +1,413 @@
+/**
+ * fuzz.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "fuzz.h"
+#include "snapshot.h"
+#include "xorshift.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+#define INVALID_WORD 0x02000	// opcode 02 is not defined
+#define DICTIONARY_MAX 256
+
+struct entry {
+	uint8_t *data;
+	size_t len;
+};
+
+struct fuzz {
+	struct sim sim;
+	struct snapshot boot;
+	bool programmed[SIM_PROGRAM_LEN];
+	uint64_t budget;
+	int assertion;
+	uint64_t random;
+
+	// the running case
+	const uint8_t *input;
+	size_t len;
+	size_t pos;
+	struct fuzz_result *result;
+	struct sim_coverage cov;
+	struct sim_coverage total;
+
+	struct entry *corpus;
+	size_t entries;
+	size_t size;
+	uint8_t dictionary[DICTIONARY_MAX];
+	unsigned words;
+	uint64_t reported[FUZZ_ASSERTION + 1][SIM_COVERAGE_WORDS];
+	uint8_t buffer[FUZZ_INPUT_MAX];
+};
+
+const char *fuzz_crash_name(enum fuzz_crash crash)
+{
+	static const char *names[] = {
+		[FUZZ_NONE] = "none",
+		[FUZZ_OVERFLOW] = "overflow",
+		[FUZZ_UNDERFLOW] = "underflow",
+		[FUZZ_UNPROGRAMMED] = "unprogrammed",
+		[FUZZ_INVALID] = "invalid",
+		[FUZZ_ASSERTION] = "assertion"
+	};
+	return names[crash];
+}
+
+static uint32_t next_random(struct fuzz *f)
+{
+	return xorshift_next(&f->random) >> 32;
+}
+
+static uint8_t input(struct sim *s, uint8_t port, void *ctx)
+{
+	(void) port;
+	struct fuzz *f = (struct fuzz *) ctx;
+	if(f->pos == f->len) {
+		sim_stop(s);
+		return 0;
+	}
+
+	return f->input[f->pos++];
+}
+
+static void output(struct sim *s, uint8_t port, uint8_t value, void *ctx)
+{
+	struct fuzz *f = (struct fuzz *) ctx;
+	if(port != f->assertion || f->result->crash != FUZZ_NONE)
+		return;
+
+	// the pc was incremented by the fetch
+	f->result->crash = FUZZ_ASSERTION;
+	f->result->pc = (s->pc - 1) & PC_MASK;
+	f->result->value = value;
+	sim_stop(s);
+}
+
+/**
+ * Constants of COMPARE and TEST, the values the program looks for.
+ */
+static void collect_dictionary(struct fuzz *f)
+{
+	bool seen[256] = {false};
+	for(unsigned i = 0; i < SIM_PROGRAM_LEN && f->words < DICTIONARY_MAX; i++) {
+		const struct sim_instr *ins = &f->sim.rom[i];
+		if((ins->op == S_COMPARE_RK || ins->op == S_TEST_RK) && f->programmed[i]
+				&& !seen[ins->y]) {
+			seen[ins->y] = true;
+			f->dictionary[f->words++] = ins->y;
+		}
+	}
+}
+
+struct fuzz *fuzz_init(const code_t *code, progaddr_t len, const bool *programmed,
+		uint64_t budget, int assertion, uint32_t seed)
+{
+	if(len > SIM_PROGRAM_LEN)
+		return NULL;
+
+	struct fuzz *f = (struct fuzz *) calloc(1, sizeof(struct fuzz));
+	if(f == NULL)
+		return NULL;
+
+	// addresses that were not programmed stop the simulation
+	code_t image[SIM_PROGRAM_LEN];
+	for(unsigned i = 0; i < SIM_PROGRAM_LEN; i++) {
+		f->programmed[i] = i < len && (programmed == NULL || programmed[i]);
+		image[i] = f->programmed[i]? code[i] : INVALID_WORD;
+	}
+
+	sim_load(&f->sim, image, SIM_PROGRAM_LEN);
+	f->sim.io.input = &input;
+	f->sim.io.output = &output;
+	f->sim.io.ctx = f;
+	f->budget = budget;
+	f->assertion = assertion;
+	f->random = seed * 2654435761ULL + 1;
+	collect_dictionary(f);
+	return f;
+}
+
+void fuzz_destroy(struct fuzz *f)
+{
+	if(f == NULL)
+		return;
+
+	for(size_t i = 0; i < f->entries; i++)
+		free(f->corpus[i].data);
+	free(f->corpus);
+	free(f);
+}
+
+size_t fuzz_corpus(const struct fuzz *f)
+{
+	return f->entries;
+}
+
+const struct sim_coverage *fuzz_coverage(const struct fuzz *f)
+{
+	return &f->total;
+}
+
+// =================================== //
+// ------------ execution ------------ //
+// =================================== //
+
+bool fuzz_boot(struct fuzz *f)
+{
+	struct sim *s = &f->sim;
+	struct fuzz_result r;
+	memset(&r, 0, sizeof(r));
+	f->result = &r;
+	s->coverage = NULL;
+	sim_reset(s);
+
+	while(s->instructions < f->budget) {
+		const uint8_t op = s->rom[s->pc].op;
+		if(op == S_INPUT_RR || op == S_INPUT_RK) {
+			snapshot_save(s, &f->boot);
+			return true;
+		}
+
+		if(sim_run(s, 1) != SIM_BUDGET || s->faults != 0 || r.crash != FUZZ_NONE)
+			return false;
+	}
+
+	return false;
+}
+
+/**
+ * Executes the case again by single instructions to find the first fault.
+ */
+static void locate_fault(struct fuzz *f, const uint8_t *data, size_t len,
+		struct fuzz_result *r)
+{
+	struct sim *s = &f->sim;
+	struct fuzz_result ignored;
+	memset(&ignored, 0, sizeof(ignored));
+	snapshot_restore(s, &f->boot);
+	s->coverage = NULL;
+	f->result = &ignored;
+	f->input = data;
+	f->len = len;
+	f->pos = 0;
+
+	for(uint64_t i = 0; i < f->budget && s->faults == 0; i++) {
+		r->pc = s->pc;
+		sim_run(s, 1);
+	}
+
+	r->crash = s->faults & SIM_FAULT_OVERFLOW? FUZZ_OVERFLOW : FUZZ_UNDERFLOW;
+}
+
+void fuzz_execute(struct fuzz *f, const uint8_t *data, size_t len, struct fuzz_result *r)
+{
+	struct sim *s = &f->sim;
+	memset(r, 0, sizeof(struct fuzz_result));
+	memset(&f->cov, 0, sizeof(f->cov));
+	snapshot_restore(s, &f->boot);
+	s->coverage = &f->cov;
+	f->result = r;
+	f->input = data;
+	f->len = len;
+	f->pos = 0;
+
+	const enum sim_status status = sim_run(s, f->budget);
+	r->consumed = f->pos;
+	r->instructions = s->instructions - f->boot.instructions;
+
+	if(s->faults != 0)
+		locate_fault(f, data, len, r);
+	else if(r->crash == FUZZ_NONE && status == SIM_INVALID) {
+		r->crash = f->programmed[s->pc]? FUZZ_INVALID : FUZZ_UNPROGRAMMED;
+		r->pc = s->pc;
+	}
+}
+
+/**
+ * Adds the coverage of the last case to the total.
+ * @return true when it covered a new edge
+ */
+static bool merge(struct fuzz *f)
+{
+	uint64_t new = 0;
+	for(int i = 0; i < SIM_COVERAGE_WORDS; i++) {
+		new |= f->cov.executed[i] & ~f->total.executed[i];
+		new |= f->cov.taken[i] & ~f->total.taken[i];
+		new |= f->cov.not_taken[i] & ~f->total.not_taken[i];
+		f->total.executed[i] |= f->cov.executed[i];
+		f->total.taken[i] |= f->cov.taken[i];
+		f->total.not_taken[i] |= f->cov.not_taken[i];
+	}
+
+	return new != 0;
+}
+
+static bool keep(struct fuzz *f, const uint8_t *data, size_t len)
+{
+	if(f->entries == f->size) {
+		const size_t size = f->size == 0? 64 : 2 * f->size;
+		struct entry *more = (struct entry *) realloc(f->corpus, size * sizeof(struct entry));
+		if(more == NULL)
+			return false;
+		f->corpus = more;
+		f->size = size;
+	}
+
+	struct entry *e = &f->corpus[f->entries];
+	e->data = (uint8_t *) malloc(len > 0? len : 1);
+	if(e->data == NULL)
+		return false;
+
+	memcpy(e->data, data, len);
+	e->len = len;
+	f->entries += 1;
+	return true;
+}
+
+bool fuzz_add(struct fuzz *f, const uint8_t *data, size_t len)
+{
+	struct fuzz_result r;
+	if(len > FUZZ_INPUT_MAX)
+		len = FUZZ_INPUT_MAX;
+
+	fuzz_execute(f, data, len, &r);
+	merge(f);
+	return keep(f, data, len);
+}
+
+// =================================== //
+// ------------ mutations ------------ //
+// =================================== //
+
+static const uint8_t interesting[] = {0x00, 0x01, 0x7F, 0x80, 0xFF};
+
+/**
+ * Applies a few random mutations to the case in f->buffer.
+ * @return the new length
+ */
+static size_t mutate(struct fuzz *f, size_t len, size_t max)
+{
+	uint8_t *buf = f->buffer;
+	const unsigned n = 1 + next_random(f) % FUZZ_STACKING;
+
+	for(unsigned i = 0; i < n; i++) {
+		const size_t pos = len > 0? next_random(f) % len : 0;
+		switch(next_random(f) % 8) {
+		case 0:
+			if(len > 0)
+				buf[pos] ^= 1 << next_random(f) % 8;
+			break;
+		case 1:
+			if(len > 0)
+				buf[pos] = next_random(f);
+			break;
+		case 2:
+			if(len > 0)
+				buf[pos] = interesting[next_random(f) % sizeof(interesting)];
+			break;
+		case 3:
+			if(len > 0) {
+				const int delta = 1 + next_random(f) % 16;
+				buf[pos] += next_random(f) % 2? delta : -delta;
+			}
+			break;
+		case 4:
+			if(len > 0 && f->words > 0)
+				buf[pos] = f->dictionary[next_random(f) % f->words];
+			break;
+		case 5: {
+			// inserts random values or a word of the dictionary
+			size_t count = 1 + next_random(f) % 4;
+			const size_t at = next_random(f) % (len + 1);
+			if(count > max - len)
+				count = max - len;
+			memmove(buf + at + count, buf + at, len - at);
+			for(size_t j = 0; j < count; j++)
+				buf[at + j] = f->words > 0 && next_random(f) % 2?
+					f->dictionary[next_random(f) % f->words] : next_random(f);
+			len += count;
+			break;
+		}
+		case 6: {
+			size_t count = 1 + next_random(f) % 4;
+			if(count > len - pos)
+				count = len - pos;
+			memmove(buf + pos, buf + pos + count, len - pos - count);
+			len -= count;
+			break;
+		}
+		case 7: {
+			// splices a part of another case
+			const struct entry *e = &f->corpus[next_random(f) % f->entries];
+			if(e->len == 0)
+				break;
+			const size_t from = next_random(f) % e->len;
+			size_t count = 1 + next_random(f) % (e->len - from);
+			if(count > max - pos)
+				count = max - pos;
+			memcpy(buf + pos, e->data + from, count);
+			if(pos + count > len)
+				len = pos + count;
+			break;
+		}
+		}
+	}
+
+	return len;
+}
+
+static bool reported(struct fuzz *f, const struct fuzz_result *r)
+{
+	uint64_t *word = &f->reported[r->crash][r->pc / 64];
+	const uint64_t bit = 1ULL << (r->pc % 64);
+	const bool seen = *word & bit;
+	*word |= bit;
+	return seen;
+}
+
+bool fuzz_run(struct fuzz *f, uint64_t executions, size_t max_len,
+		fuzz_report_t report, void *ctx)
+{
+	if(max_len > FUZZ_INPUT_MAX)
+		max_len = FUZZ_INPUT_MAX;
+	static const uint8_t empty[1];
+	if(f->entries == 0 && !fuzz_add(f, empty, 0))
+		return false;
+
+	for(uint64_t i = 0; i < executions; i++) {
+		const struct entry *e = &f->corpus[next_random(f) % f->entries];
+		size_t len = e->len < max_len? e->len : max_len;
+		memcpy(f->buffer, e->data, len);
+		len = mutate(f, len, max_len);
+
+		struct fuzz_result r;
+		fuzz_execute(f, f->buffer, len, &r);
+		const bool new = merge(f);
+
+		if(r.crash != FUZZ_NONE) {
+			if(!reported(f, &r) && report != NULL)
+				report(&r, f->buffer, len, ctx);
+		}
+		else if(new && !keep(f, f->buffer, len))
+			return false;
+	}
+
+	return true;
+}
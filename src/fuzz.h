@@ -0,0 +1,118 @@
+/**
+ * fuzz.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _FUZZ_H
+#define _FUZZ_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Coverage-guided fuzzer of the firmware. A test case is the sequence
+ * of values read by INPUT (from any port), the case ends when the values
+ * are exhausted or after the budget of instructions. The program boots
+ * once until its first INPUT, every case continues from the snapshot taken
+ * there, so it is a copy of the state instead of a fork.
+ *
+ * The coverage is the edges of the jump and call graph of the program:
+ * the executed instructions and both directions of branches (struct
+ * sim_coverage, collected by sim_run). A case reaching a new edge is kept
+ * in the corpus, new cases are mutated from the corpus. The constants
+ * compared by the program are used as a dictionary of the mutations.
+ *
+ * A case crashes on a call stack overflow or underflow, on reaching
+ * an address that was not programmed (or an invalid instruction) and
+ * on OUTPUT to the assertion port. Crashes are reported once for each
+ * kind and address. The interrupt is not raised.
+ */
+
+#define FUZZ_INPUT_MAX 4096	// values of a case
+#define FUZZ_STACKING 8	// mutations of a new case at most
+
+enum fuzz_crash {
+	FUZZ_NONE,
+	FUZZ_OVERFLOW,
+	FUZZ_UNDERFLOW,
+	FUZZ_UNPROGRAMMED,
+	FUZZ_INVALID,
+	FUZZ_ASSERTION
+};
+
+struct fuzz_result {
+	uint8_t crash;
+	uint16_t pc;	// of the crashing instruction
+	uint8_t value;	// written to the assertion port
+	size_t consumed;	// values read by INPUT
+	uint64_t instructions;
+};
+
+typedef void (*fuzz_report_t)(const struct fuzz_result *r, const uint8_t *data,
+		size_t len, void *ctx);
+
+struct fuzz;
+
+/**
+ * @param programmed addresses of the program, an instruction elsewhere
+ * is a crash (zero words of a HEX file can be taken as not programmed)
+ * @param budget instructions of a case
+ * @param assertion port, -1 for none
+ * @return NULL on allocation error
+ */
+struct fuzz *fuzz_init(const code_t *code, progaddr_t len, const bool *programmed,
+		uint64_t budget, int assertion, uint32_t seed);
+
+void fuzz_destroy(struct fuzz *f);
+
+/**
+ * Runs the program from the reset until its first INPUT.
+ * @return false when it did not read within the budget or it crashed
+ */
+bool fuzz_boot(struct fuzz *f);
+
+/**
+ * Runs the case from the snapshot.
+ */
+void fuzz_execute(struct fuzz *f, const uint8_t *data, size_t len, struct fuzz_result *r);
+
+/**
+ * Runs the case and adds it to the corpus, eg. a seed.
+ * @return false on allocation error
+ */
+bool fuzz_add(struct fuzz *f, const uint8_t *data, size_t len);
+
+/**
+ * Executes the given number of mutated cases, new crashes are reported.
+ * @param max_len of the cases, at most FUZZ_INPUT_MAX
+ * @return false on allocation error
+ */
+bool fuzz_run(struct fuzz *f, uint64_t executions, size_t max_len,
+		fuzz_report_t report, void *ctx);
+
+size_t fuzz_corpus(const struct fuzz *f);
+
+/**
+ * Edges covered by all executed cases.
+ */
+const struct sim_coverage *fuzz_coverage(const struct fuzz *f);
+
+const char *fuzz_crash_name(enum fuzz_crash crash);
+
+#endif
@@ -0,0 +1,730 @@
+/**
+ * gdb.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "gdb.h"
+#include "history.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+#define REG_PC SIM_REGS
+#define REG_FLAGS (SIM_REGS + 1)
+#define REGS_LEN (SIM_REGS + 3)	// bytes of the g packet
+
+#define SIGINT_STOP 2
+#define SIGILL_STOP 4
+#define SIGTRAP_STOP 5
+
+#define BIT(map, i) ((map)[(i) >> 6] >> ((i) & 63) & 1)
+
+struct label {
+	uint16_t addr;
+	char *name;
+};
+
+struct gdb {
+	struct sim *s;
+	struct sim_breakpoints bp;
+	uint64_t access[SIM_WATCH_WORDS];	// Z4, also in read and write
+	unsigned count;	// breakpoints and watchpoints set
+	struct history *h;	// for the reverse execution, may be NULL
+	uint64_t end;	// s->instructions when the budget is exhausted
+	bool killed;
+	struct label *labels;
+	size_t nlabels;
+	int in;
+	int out;
+	bool ack;	// until QStartNoAckMode
+	bool interrupted;	// Ctrl-C came while running
+	char stop[32];	// the last stop reply
+	char buf[GDB_PACKET];	// received, not processed
+	size_t len;
+	size_t pos;
+	char sent[GDB_PACKET + 4];	// for a retransmission
+	size_t sent_len;
+};
+
+struct gdb *gdb_init(struct sim *s, uint64_t budget)
+{
+	struct gdb *g = (struct gdb *) calloc(1, sizeof(struct gdb));
+	if(g == NULL)
+		return NULL;
+
+	g->s = s;
+	g->end = s->instructions + budget;
+	g->ack = true;
+	snprintf(g->stop, sizeof(g->stop), "S%.2X", SIGTRAP_STOP);
+	return g;
+}
+
+void gdb_destroy(struct gdb *g)
+{
+	if(g == NULL)
+		return;
+
+	if(g->s->breakpoints == &g->bp)
+		g->s->breakpoints = NULL;
+	for(size_t i = 0; i < g->nlabels; i++)
+		free(g->labels[i].name);
+	free(g->labels);
+	free(g);
+}
+
+bool gdb_name(struct gdb *g, uint16_t addr, const char *name)
+{
+	struct label *labels = (struct label *) realloc(g->labels,
+			(g->nlabels + 1) * sizeof(struct label));
+	if(labels == NULL)
+		return false;
+	g->labels = labels;
+
+	char *copy = (char *) malloc(strlen(name) + 1);
+	if(copy == NULL)
+		return false;
+	strcpy(copy, name);
+
+	labels[g->nlabels].addr = addr & PC_MASK;
+	labels[g->nlabels].name = copy;
+	g->nlabels += 1;
+	return true;
+}
+
+void gdb_set_history(struct gdb *g, struct history *h)
+{
+	g->h = h;
+}
+
+uint64_t gdb_left(const struct gdb *g)
+{
+	return g->killed || g->s->instructions >= g->end? 0 : g->end - g->s->instructions;
+}
+
+// =================================== //
+// ------------ transport ------------ //
+// =================================== //
+
+static bool listen_tcp(const char *address, int *fd)
+{
+	const char *colon = strrchr(address, ':');
+	struct sockaddr_in sa = {.sin_family = AF_INET};
+	sa.sin_port = htons((uint16_t) strtoul(colon + 1, NULL, 10));
+
+	char host[64] = "127.0.0.1";
+	if(colon > address) {
+		if((size_t) (colon - address) >= sizeof(host))
+			return false;
+		memcpy(host, address, colon - address);
+		host[colon - address] = '\0';
+	}
+	if(inet_pton(AF_INET, strcmp(host, "localhost")? host : "127.0.0.1", &sa.sin_addr) != 1)
+		return false;
+
+	*fd = socket(AF_INET, SOCK_STREAM, 0);
+	if(*fd < 0)
+		return false;
+	const int on = 1;
+	setsockopt(*fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	return bind(*fd, (struct sockaddr *) &sa, sizeof(sa)) == 0;
+}
+
+static bool listen_unix(const char *path, int *fd)
+{
+	struct sockaddr_un sa = {.sun_family = AF_UNIX};
+	if(strlen(path) >= sizeof(sa.sun_path))
+		return false;
+	strcpy(sa.sun_path, path);
+
+	*fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(*fd < 0)
+		return false;
+	unlink(path);
+	return bind(*fd, (struct sockaddr *) &sa, sizeof(sa)) == 0;
+}
+
+bool gdb_accept(const char *address, int *in, int *out)
+{
+	if(!strcmp(address, "-")) {
+		*in = STDIN_FILENO;
+		*out = STDOUT_FILENO;
+		return true;
+	}
+
+	const bool tcp = strchr(address, ':') != NULL;
+	int fd = -1;
+	if(!(tcp? listen_tcp(address, &fd) : listen_unix(address, &fd)) || listen(fd, 1) != 0) {
+		if(fd >= 0)
+			close(fd);
+		return false;
+	}
+
+	fprintf(stderr, "Waiting for the debugger at %s\n", address);
+	int conn;
+	while((conn = accept(fd, NULL, NULL)) < 0 && errno == EINTR)
+		;
+	close(fd);
+	if(!tcp)
+		unlink(address);
+
+	*in = *out = conn;
+	return conn >= 0;
+}
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+	while(len > 0) {
+		const ssize_t n = write(fd, data, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+/**
+ * Reads a byte, waits at most timeout ms (-1 forever).
+ * @return the byte, -1 at the end, -2 after the timeout
+ */
+static int read_byte(struct gdb *g, int timeout)
+{
+	if(g->pos == g->len) {
+		struct pollfd pfd = {.fd = g->in, .events = POLLIN};
+		int ready;
+		while((ready = poll(&pfd, 1, timeout)) < 0 && errno == EINTR)
+			;
+		if(ready == 0)
+			return -2;
+
+		ssize_t n;
+		while((n = read(g->in, g->buf, sizeof(g->buf))) < 0 && errno == EINTR)
+			;
+		if(n <= 0)
+			return -1;
+		g->pos = 0;
+		g->len = n;
+	}
+	return (unsigned char) g->buf[g->pos++];
+}
+
+static bool send_packet(struct gdb *g, const char *data)
+{
+	static const char hex[] = "0123456789abcdef";
+	const size_t len = strlen(data);
+	if(len > GDB_PACKET)
+		return false;
+
+	uint8_t sum = 0;
+	for(size_t i = 0; i < len; i++)
+		sum += (uint8_t) data[i];
+
+	g->sent[0] = '$';
+	memcpy(g->sent + 1, data, len);
+	g->sent[len + 1] = '#';
+	g->sent[len + 2] = hex[sum >> 4];
+	g->sent[len + 3] = hex[sum & 15];
+	g->sent_len = len + 4;
+	return write_all(g->out, g->sent, g->sent_len);
+}
+
+static int hex_digit(int c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * Receives the next packet, acknowledges it and resends
+ * the last packet when the debugger asks for it.
+ * @return false at the end of the connection
+ */
+static bool recv_packet(struct gdb *g, char *data)
+{
+	for(;;) {
+		int c = read_byte(g, -1);
+		if(c < 0)
+			return false;
+		if(c == '-' && g->sent_len > 0 && !write_all(g->out, g->sent, g->sent_len))
+			return false;
+		if(c != '$')
+			continue;	// acks and Ctrl-C when stopped
+
+		size_t len = 0;
+		uint8_t sum = 0;
+		while((c = read_byte(g, -1)) >= 0 && c != '#') {
+			sum += (uint8_t) c;
+			if(len < GDB_PACKET)
+				data[len++] = c;
+		}
+		const int hi = c < 0? -1 : read_byte(g, -1);
+		const int lo = hi < 0? -1 : read_byte(g, -1);
+		if(lo < 0)
+			return false;
+		data[len] = '\0';
+
+		const bool valid = len < GDB_PACKET && hex_digit(hi) >= 0 && hex_digit(lo) >= 0
+				&& (hex_digit(hi) << 4 | hex_digit(lo)) == sum;
+		if(g->ack && !write_all(g->out, valid? "+" : "-", 1))
+			return false;
+		if(valid)
+			return true;
+	}
+}
+
+// =================================== //
+// ------------- commands ------------ //
+// =================================== //
+
+static void put_hex(char *p, const uint8_t *bytes, size_t len)
+{
+	for(size_t i = 0; i < len; i++)
+		sprintf(p + 2 * i, "%.2x", bytes[i]);
+}
+
+static bool get_hex(const char *p, uint8_t *bytes, size_t len)
+{
+	for(size_t i = 0; i < len; i++) {
+		const int hi = hex_digit(p[2 * i]);
+		const int lo = hi < 0? -1 : hex_digit(p[2 * i + 1]);
+		if(lo < 0)
+			return false;
+		bytes[i] = hi << 4 | lo;
+	}
+	return true;
+}
+
+static void get_regs(const struct sim *s, uint8_t *regs)
+{
+	memcpy(regs, s->reg, SIM_REGS);
+	regs[REG_PC] = s->pc & 0xFF;
+	regs[REG_PC + 1] = s->pc >> 8;
+	regs[REG_FLAGS + 1] = sim_zero(s) | sim_carry(s) << 1 | s->ie << 2;
+}
+
+static void set_regs(struct sim *s, const uint8_t *regs)
+{
+	memcpy(s->reg, regs, SIM_REGS);
+	s->pc = (regs[REG_PC] | regs[REG_PC + 1] << 8) & PC_MASK;
+	sim_set_flags(s, regs[REG_FLAGS + 1] & 1, regs[REG_FLAGS + 1] & 2);
+	s->ie = regs[REG_FLAGS + 1] & 4;
+}
+
+/**
+ * Offset of the register in the g packet, -1 when there is none.
+ */
+static int reg_offset(unsigned long n)
+{
+	if(n < SIM_REGS)
+		return n;
+	if(n == REG_PC)
+		return REG_PC;
+	return n == REG_FLAGS? REG_FLAGS + 1 : -1;
+}
+
+static int reg_size(unsigned long n)
+{
+	return n == REG_PC? 2 : 1;
+}
+
+/**
+ * Parses <addr>,<len> of the packet, the rest follows.
+ */
+static bool parse_range(const char *p, unsigned long *addr, unsigned long *len, const char **rest)
+{
+	char *end;
+	*addr = strtoul(p, &end, 16);
+	if(end == p || *end != ',')
+		return false;
+	p = end + 1;
+	*len = strtoul(p, &end, 16);
+	if(end == p)
+		return false;
+	*rest = end;
+	return true;
+}
+
+static void update(struct gdb *g)
+{
+	g->s->breakpoints = g->count > 0? &g->bp : NULL;
+}
+
+static void set_bit(struct gdb *g, uint64_t *map, unsigned i, bool set)
+{
+	const uint64_t bit = (uint64_t) 1 << (i & 63);
+	if(set && !(map[i >> 6] & bit))
+		g->count += 1;
+	else if(!set && (map[i >> 6] & bit))
+		g->count -= 1;
+	map[i >> 6] = set? map[i >> 6] | bit : map[i >> 6] & ~bit;
+}
+
+/**
+ * Z and z packets: <type>,<addr>,<kind or length>.
+ */
+static const char *breakpoint(struct gdb *g, const char *p, bool set)
+{
+	const int type = p[0] - '0';
+	unsigned long addr, len;
+	const char *rest;
+	if(type < 0 || type > 4 || p[1] != ',' || !parse_range(p + 2, &addr, &len, &rest))
+		return "E01";
+
+	if(type <= 1) {
+		if(addr >= SIM_PROGRAM_LEN)
+			return "E02";
+		set_bit(g, g->bp.code, addr, set);
+	}
+	else {
+		if(len == 0 || addr >= SIM_SCRATCHPAD || len > SIM_SCRATCHPAD - addr)
+			return "E02";
+		for(unsigned long a = addr; a < addr + len; a++) {
+			if(type != 3)
+				set_bit(g, g->bp.write, a, set);
+			if(type != 2)
+				set_bit(g, g->bp.read, a, set);
+			if(type == 4)
+				g->access[a >> 6] = set? g->access[a >> 6] | (uint64_t) 1 << (a & 63)
+						: g->access[a >> 6] & ~((uint64_t) 1 << (a & 63));
+		}
+	}
+
+	update(g);
+	return "OK";
+}
+
+static const struct label *find_label(const struct gdb *g, const char *name)
+{
+	for(size_t i = 0; i < g->nlabels; i++) {
+		if(!strcmp(g->labels[i].name, name))
+			return &g->labels[i];
+	}
+	return NULL;
+}
+
+/**
+ * The label or the hexadecimal address.
+ */
+static bool parse_location(const struct gdb *g, const char *arg, unsigned long *addr)
+{
+	const struct label *l = find_label(g, arg);
+	if(l != NULL) {
+		*addr = l->addr;
+		return true;
+	}
+
+	char *end;
+	*addr = strtoul(arg, &end, 16);
+	return end != arg && *end == '\0' && *addr < SIM_PROGRAM_LEN;
+}
+
+/**
+ * Prints <addr> <label>[+<offset>] by the nearest label before.
+ */
+static void locate(const struct gdb *g, unsigned long addr, char *out, size_t size)
+{
+	const struct label *best = NULL;
+	for(size_t i = 0; i < g->nlabels; i++) {
+		if(g->labels[i].addr <= addr && (best == NULL || g->labels[i].addr > best->addr))
+			best = &g->labels[i];
+	}
+
+	if(best == NULL)
+		snprintf(out, size, "%.3lX\n", addr);
+	else if(best->addr == addr)
+		snprintf(out, size, "%.3lX %s\n", addr, best->name);
+	else
+		snprintf(out, size, "%.3lX %s+%lX\n", addr, best->name, addr - best->addr);
+}
+
+/**
+ * qRcmd, the hex encoded command of 'monitor'.
+ */
+static void monitor(struct gdb *g, const char *p, char *reply)
+{
+	char cmd[GDB_PACKET / 2 + 1];
+	const size_t len = strlen(p) / 2;
+	if(!get_hex(p, (uint8_t *) cmd, len)) {
+		strcpy(reply, "E01");
+		return;
+	}
+	cmd[len] = '\0';
+
+	char verb[16] = "";
+	char arg[GDB_PACKET / 2] = "";
+	sscanf(cmd, "%15s %511s", verb, arg);
+
+	char text[GDB_PACKET / 2];
+	unsigned long addr = g->s->pc;
+	const bool located = arg[0] == '\0'? !strcmp(verb, "where") : parse_location(g, arg, &addr);
+
+	if(strcmp(verb, "break") && strcmp(verb, "delete") && strcmp(verb, "where"))
+		snprintf(text, sizeof(text), "Commands: break, delete, where\n");
+	else if(!located)
+		snprintf(text, sizeof(text), "Unknown location: %s\n", arg);
+	else {
+		if(strcmp(verb, "where")) {
+			set_bit(g, g->bp.code, addr, verb[0] == 'b');
+			update(g);
+		}
+		locate(g, addr, text, sizeof(text));
+	}
+
+	put_hex(reply, (const uint8_t *) text, strlen(text));
+}
+
+static void stop_reply(struct gdb *g, enum sim_status status, int signal)
+{
+	if(status == SIM_INVALID)
+		signal = SIGILL_STOP;
+
+	if(status == SIM_BREAK && g->bp.hit != SIM_BREAK_CODE) {
+		const unsigned a = g->bp.address;
+		const char *kind = BIT(g->access, a)? "awatch" : g->bp.hit == SIM_BREAK_WRITE? "watch" : "rwatch";
+		snprintf(g->stop, sizeof(g->stop), "T%.2X%s:%.2X;", signal, kind, a);
+	}
+	else
+		snprintf(g->stop, sizeof(g->stop), "S%.2X", signal);
+}
+
+/**
+ * Runs until a breakpoint, an invalid instruction, Ctrl-C
+ * or the end of the budget. The history records the execution.
+ */
+static void resume(struct gdb *g, bool step)
+{
+	struct sim *s = g->s;
+	enum sim_status status = SIM_BUDGET;
+	int signal = SIGTRAP_STOP;
+
+	for(bool first = true; gdb_left(g) > 0; first = false) {
+		if(!first && sim_at_breakpoint(s)) {
+			g->bp.hit = SIM_BREAK_CODE;
+			status = SIM_BREAK;
+			break;
+		}
+
+		const uint64_t left = gdb_left(g);
+		const uint64_t chunk = step? 1 : left < GDB_CHUNK? left : GDB_CHUNK;
+		status = g->h != NULL? history_run(g->h, chunk) : sim_run(s, chunk);
+		if(status != SIM_BUDGET || step)
+			break;
+
+		const int c = read_byte(g, 0);
+		if(c == 0x03) {
+			signal = SIGINT_STOP;
+			break;
+		}
+		if(c == -1)
+			break;
+		if(c >= 0)
+			g->pos -= 1;	// kept for the next packet
+	}
+
+	if(status == SIM_BUDGET && gdb_left(g) == 0 && signal != SIGINT_STOP)
+		strcpy(g->stop, "W00");
+	else
+		stop_reply(g, status, signal);
+}
+
+/**
+ * Steps back or continues back to the last breakpoint (bs and bc),
+ * stops at the beginning of the history.
+ */
+static void reverse(struct gdb *g, bool step)
+{
+	struct sim *s = g->s;
+	const bool back = s->instructions > history_begin(g->h) && (step?
+			history_seek(g->h, s->instructions - 1) : history_reverse(g->h));
+
+	if(back)
+		stop_reply(g, step? SIM_BUDGET : SIM_BREAK, SIGTRAP_STOP);
+	else {
+		history_seek(g->h, history_begin(g->h));
+		snprintf(g->stop, sizeof(g->stop), "T%.2Xreplaylog:begin;", SIGTRAP_STOP);
+	}
+}
+
+/**
+ * The debugger changed the state, the history after it is discarded.
+ */
+static void changed(struct gdb *g)
+{
+	if(g->h != NULL)
+		history_truncate(g->h);
+}
+
+/**
+ * Executes the packet.
+ * @return false when the session ends
+ */
+static bool execute(struct gdb *g, const char *p, char *reply, bool *done)
+{
+	struct sim *s = g->s;
+	uint8_t regs[REGS_LEN];
+	unsigned long addr, len;
+	const char *rest;
+
+	reply[0] = '\0';
+	switch(p[0]) {
+	case '?':
+		strcpy(reply, g->stop);
+		break;
+	case 'g':
+		get_regs(s, regs);
+		put_hex(reply, regs, REGS_LEN);
+		break;
+	case 'G':
+		get_regs(s, regs);
+		if(strlen(p + 1) != 2 * REGS_LEN || !get_hex(p + 1, regs, REGS_LEN)) {
+			strcpy(reply, "E01");
+			break;
+		}
+		set_regs(s, regs);
+		changed(g);
+		strcpy(reply, "OK");
+		break;
+	case 'p':
+	case 'P': {
+		char *end;
+		const unsigned long n = strtoul(p + 1, &end, 16);
+		const int off = reg_offset(n);
+		if(off < 0 || (p[0] == 'P' && *end != '=')) {
+			strcpy(reply, "E01");
+			break;
+		}
+		get_regs(s, regs);
+		if(p[0] == 'p') {
+			put_hex(reply, regs + off, reg_size(n));
+			break;
+		}
+		if(strlen(end + 1) != 2u * reg_size(n) || !get_hex(end + 1, regs + off, reg_size(n))) {
+			strcpy(reply, "E01");
+			break;
+		}
+		set_regs(s, regs);
+		changed(g);
+		strcpy(reply, "OK");
+		break;
+	}
+	case 'm':
+	case 'M':
+		if(!parse_range(p + 1, &addr, &len, &rest) || addr >= SIM_SCRATCHPAD
+				|| len > SIM_SCRATCHPAD - addr || (p[0] == 'M' && *rest != ':'))
+			strcpy(reply, "E01");
+		else if(p[0] == 'm')
+			put_hex(reply, s->scratchpad + addr, len);
+		else if(strlen(rest + 1) != 2 * len || !get_hex(rest + 1, s->scratchpad + addr, len))
+			strcpy(reply, "E01");
+		else {
+			changed(g);
+			strcpy(reply, "OK");
+		}
+		break;
+	case 'c':
+	case 's':
+		if(p[1] != '\0') {
+			s->pc = strtoul(p + 1, NULL, 16) & PC_MASK;
+			changed(g);
+		}
+		resume(g, p[0] == 's');
+		strcpy(reply, g->stop);
+		*done = g->stop[0] == 'W';
+		break;
+	case 'b':
+		if(g->h != NULL && (p[1] == 's' || p[1] == 'c') && p[2] == '\0') {
+			reverse(g, p[1] == 's');
+			strcpy(reply, g->stop);
+		}
+		break;
+	case 'Z':
+	case 'z':
+		strcpy(reply, breakpoint(g, p + 1, p[0] == 'Z'));
+		break;
+	case 'H':
+	case 'T':
+		strcpy(reply, "OK");
+		break;
+	case 'D':
+		memset(&g->bp, 0, sizeof(g->bp));
+		g->count = 0;
+		update(g);
+		strcpy(reply, "OK");
+		*done = true;
+		break;
+	case 'k':
+		g->killed = true;
+		*done = true;
+		return false;	// no reply
+	case 'q':
+		if(!strncmp(p, "qSupported", 10))
+			sprintf(reply, "PacketSize=%x;QStartNoAckMode+%s", GDB_PACKET,
+					g->h != NULL? ";ReverseStep+;ReverseContinue+" : "");
+		else if(!strcmp(p, "qAttached"))
+			strcpy(reply, "1");
+		else if(!strncmp(p, "qRcmd,", 6))
+			monitor(g, p + 6, reply);
+		break;
+	case 'Q':
+		if(!strcmp(p, "QStartNoAckMode"))
+			strcpy(reply, "OK");
+		break;
+	}
+	return true;
+}
+
+bool gdb_serve(struct gdb *g, int in, int out)
+{
+	char packet[GDB_PACKET + 1];
+	char reply[2 * GDB_PACKET + 1];
+	g->in = in;
+	g->out = out;
+
+	bool done = false;
+	while(!done) {
+		if(!recv_packet(g, packet)) {
+			// disconnected, the program is not left running
+			g->killed = true;
+			return true;
+		}
+		if(!execute(g, packet, reply, &done))
+			break;
+		if(!send_packet(g, reply))
+			return false;
+		if(!strcmp(packet, "QStartNoAckMode"))
+			g->ack = false;
+	}
+	return true;
+}
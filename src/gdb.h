@@ -0,0 +1,100 @@
+/**
+ * gdb.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#ifndef _GDB_H
+#define _GDB_H
+
+#include "sim.h"
+#include "history.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Stub of the GDB remote serial protocol. The debugger reads and writes
+ * the registers and the scratchpad, steps, continues and sets breakpoints
+ * (Z0, Z1) and watchpoints of the scratchpad (Z2 write, Z3 read, Z4 access).
+ * They are kept in the bitmaps of struct sim_breakpoints, attached to the
+ * simulator only while any is set, so sim_run is not slowed down otherwise.
+ *
+ * Registers (g, p): s0 to sF, pc (16 bits, little endian) and the flags
+ * (bit 0 zero, bit 1 carry, bit 2 interrupt enable). Memory (m, M) is the
+ * scratchpad at addresses 00 to 3F, breakpoints are at program addresses.
+ *
+ * GDB knows no PicoBlaze, so the labels of the program are resolved
+ * by the stub, commands of 'monitor':
+ *   break <label|address>   sets a breakpoint
+ *   delete <label|address>  removes it
+ *   where [label|address]   prints the address with the nearest label,
+ *                           the pc by default
+ *
+ * With the history (see history.h) the debugger can also step back (bs)
+ * and continue back (bc) to the last breakpoint or to the beginning
+ * of the history. Changing the state discards the history after it.
+ */
+
+#define GDB_PACKET 1024	// the longest packet
+#define GDB_CHUNK (1 << 20)	// instructions between the checks of Ctrl-C
+
+struct gdb;
+
+/**
+ * The session may execute at most the given number of instructions,
+ * then the program exits for the debugger.
+ * @return NULL on allocation error
+ */
+struct gdb *gdb_init(struct sim *s, uint64_t budget);
+
+/**
+ * Removes the breakpoints from the simulator.
+ */
+void gdb_destroy(struct gdb *g);
+
+/**
+ * Names the address, eg. by a label of the symbol table.
+ * @return false on allocation error
+ */
+bool gdb_name(struct gdb *g, uint16_t addr, const char *name);
+
+/**
+ * Records the execution by the history for the reverse execution.
+ */
+void gdb_set_history(struct gdb *g, struct history *h);
+
+/**
+ * Waits for the debugger at the address: "-" for the standard input and
+ * output (target remote | picosim -d- ...), [<host>]:<port> for TCP, the
+ * host is 127.0.0.1 by default, or the path of a Unix socket.
+ * @return false on error
+ */
+bool gdb_accept(const char *address, int *in, int *out);
+
+/**
+ * Serves the debugger until it detaches, kills the program or disconnects.
+ * @return false on an I/O error
+ */
+bool gdb_serve(struct gdb *g, int in, int out);
+
+/**
+ * Instructions of the budget not executed, after detaching the program
+ * may run on without the debugger, 0 when it was killed.
+ */
+uint64_t gdb_left(const struct gdb *g);
+
+#endif
@@ -0,0 +1,450 @@
+/**
+ * history.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#include "history.h"
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Reads of the same value from the port.
+ */
+struct input {
+	uint8_t port;
+	uint8_t value;
+	uint32_t count;
+};
+
+/**
+ * The host set the interrupt input after the number of instructions.
+ */
+struct change {
+	uint64_t at;
+	bool irq;
+};
+
+/**
+ * The state and the position in the logs: the next change and the input
+ * entry with the number of its reads done before.
+ */
+struct checkpoint {
+	struct snapshot snap;
+	size_t input;
+	uint32_t used;
+	size_t change;
+};
+
+struct history {
+	struct sim *s;
+	struct sim_io host;	// while running
+	struct ports *ports;
+	uint64_t interval;
+	uint64_t end;	// s->instructions at the end
+	bool irq;	// as the recorded execution left it
+	struct checkpoint cps[HISTORY_CHECKPOINTS];
+	size_t ncps;
+	struct input *inputs;
+	size_t ninputs;
+	size_t inputs_cap;
+	struct change *changes;
+	size_t nchanges;
+	size_t changes_cap;
+	// position of the execution from the log
+	size_t input;
+	uint32_t used;
+	size_t change;
+};
+
+static void checkpoint(struct history *h)
+{
+	if(h->ncps == HISTORY_CHECKPOINTS) {
+		// the older half is thinned, the first one stays
+		size_t j = 1;
+		for(size_t i = 1; i < h->ncps; i++) {
+			if(i >= HISTORY_CHECKPOINTS / 2 || i % 2 == 0)
+				h->cps[j++] = h->cps[i];
+		}
+		h->ncps = j;
+	}
+
+	struct checkpoint *cp = &h->cps[h->ncps++];
+	snapshot_save(h->s, &cp->snap);
+	cp->input = h->ninputs > 0? h->ninputs - 1 : 0;
+	cp->used = h->ninputs > 0? h->inputs[h->ninputs - 1].count : 0;
+	cp->change = h->nchanges;
+}
+
+struct history *history_init(struct sim *s, uint64_t interval)
+{
+	struct history *h = (struct history *) calloc(1, sizeof(struct history));
+	if(h == NULL)
+		return NULL;
+
+	h->s = s;
+	// an interval fills at most a quarter of the log
+	h->interval = interval == 0? 1 : interval > HISTORY_LOG / 4? HISTORY_LOG / 4 : interval;
+	h->end = s->instructions;
+	h->irq = s->irq;
+	checkpoint(h);
+	return h;
+}
+
+void history_destroy(struct history *h)
+{
+	if(h == NULL)
+		return;
+
+	free(h->inputs);
+	free(h->changes);
+	free(h);
+}
+
+uint64_t history_begin(const struct history *h)
+{
+	return h->cps[0].snap.instructions;
+}
+
+uint64_t history_end(const struct history *h)
+{
+	return h->end;
+}
+
+/**
+ * Makes room for one more entry of the log.
+ * @return false when it can not grow
+ */
+static bool grow(void **log, size_t *cap, size_t len, size_t size)
+{
+	if(len < *cap)
+		return true;
+	if(*cap == HISTORY_LOG)
+		return false;
+
+	const size_t n = *cap == 0? 1024 : 2 * *cap;
+	void *p = realloc(*log, n * size);
+	if(p == NULL)
+		return false;
+	*log = p;
+	*cap = n;
+	return true;
+}
+
+/**
+ * Drops the older half of the history, at least up to now. Called
+ * at the end of the history when the log could overflow.
+ */
+static void drop(struct history *h)
+{
+	if(h->ncps < 2)
+		checkpoint(h);
+
+	const size_t keep = h->ncps / 2;
+	const struct checkpoint first = h->cps[h->ncps - keep];
+	memmove(h->cps, h->cps + h->ncps - keep, keep * sizeof(struct checkpoint));
+	h->ncps = keep;
+
+	memmove(h->inputs, h->inputs + first.input, (h->ninputs - first.input) * sizeof(struct input));
+	h->ninputs -= first.input;
+	memmove(h->changes, h->changes + first.change, (h->nchanges - first.change) * sizeof(struct change));
+	h->nchanges -= first.change;
+	for(size_t i = 0; i < h->ncps; i++) {
+		h->cps[i].input -= first.input;
+		h->cps[i].change -= first.change;
+	}
+	h->input -= first.input;
+	h->change -= first.change;
+}
+
+static void log_change(struct history *h)
+{
+	struct sim *s = h->s;
+	if(s->irq == h->irq)
+		return;
+
+	if(!grow((void **) &h->changes, &h->changes_cap, h->nchanges, sizeof(struct change))) {
+		sim_stop(s);
+		return;
+	}
+	h->changes[h->nchanges].at = s->instructions;
+	h->changes[h->nchanges].irq = s->irq;
+	h->nchanges += 1;
+	h->change = h->nchanges;
+	h->irq = s->irq;
+}
+
+static bool replaying(const struct history *h)
+{
+	// the instruction doing I/O is already counted
+	return h->s->instructions <= h->end;
+}
+
+static uint8_t input(struct sim *s, uint8_t port, void *ctx)
+{
+	struct history *h = (struct history *) ctx;
+
+	if(replaying(h)) {
+		while(h->input < h->ninputs && h->used == h->inputs[h->input].count) {
+			h->input += 1;
+			h->used = 0;
+		}
+		if(h->input == h->ninputs || h->inputs[h->input].port != port) {
+			sim_stop(s);	// the execution differs from the recorded one
+			return 0;
+		}
+		h->used += 1;
+		return h->inputs[h->input].value;
+	}
+
+	const uint8_t value = h->host.input != NULL? h->host.input(s, port, h->host.ctx) : 0;
+	struct input *last = h->ninputs > 0? &h->inputs[h->ninputs - 1] : NULL;
+	if(last != NULL && last->port == port && last->value == value && last->count < UINT32_MAX)
+		last->count += 1;
+	else if(grow((void **) &h->inputs, &h->inputs_cap, h->ninputs, sizeof(struct input))) {
+		h->inputs[h->ninputs].port = port;
+		h->inputs[h->ninputs].value = value;
+		h->inputs[h->ninputs].count = 1;
+		h->ninputs += 1;
+	}
+	else
+		sim_stop(s);
+
+	log_change(h);
+	return value;
+}
+
+static void output(struct sim *s, uint8_t port, uint8_t value, void *ctx)
+{
+	struct history *h = (struct history *) ctx;
+	if(replaying(h) || h->host.output == NULL)
+		return;
+
+	h->host.output(s, port, value, h->host.ctx);
+	log_change(h);
+}
+
+/**
+ * Runs the part of the execution, the breakpoint at its start
+ * stops it unless it is the first part.
+ */
+static enum sim_status run(struct history *h, uint64_t instructions, bool first)
+{
+	struct sim *s = h->s;
+	if(!first && sim_at_breakpoint(s)) {
+		s->breakpoints->hit = SIM_BREAK_CODE;
+		return s->status = SIM_BREAK;
+	}
+	return sim_run(s, instructions);
+}
+
+/**
+ * Executes from the log until the number of instructions,
+ * the changes of the interrupt input are applied between the parts.
+ */
+static enum sim_status replay(struct history *h, uint64_t until, bool *first)
+{
+	struct sim *s = h->s;
+	enum sim_status status = SIM_BUDGET;
+
+	while(s->instructions < until && status == SIM_BUDGET) {
+		if(h->change < h->nchanges && h->changes[h->change].at == s->instructions) {
+			s->irq = h->changes[h->change++].irq;
+			continue;
+		}
+
+		uint64_t to = until;
+		if(h->change < h->nchanges && h->changes[h->change].at < to)
+			to = h->changes[h->change].at;
+		status = run(h, to - s->instructions, *first);
+		*first = false;
+	}
+	return status;
+}
+
+/**
+ * Records the execution, a checkpoint is taken every interval.
+ */
+static enum sim_status record(struct history *h, uint64_t until, bool *first)
+{
+	struct sim *s = h->s;
+	enum sim_status status = SIM_BUDGET;
+
+	// the changes at the end of the history
+	while(h->change < h->nchanges)
+		s->irq = h->changes[h->change++].irq;
+	h->irq = s->irq;
+
+	while(s->instructions < until && status == SIM_BUDGET) {
+		const struct checkpoint *last = &h->cps[h->ncps - 1];
+		if(s->instructions - last->snap.instructions >= h->interval) {
+			if(h->ninputs + h->interval > HISTORY_LOG || h->nchanges + h->interval > HISTORY_LOG)
+				drop(h);
+			checkpoint(h);
+			last = &h->cps[h->ncps - 1];
+		}
+
+		uint64_t to = last->snap.instructions + h->interval;
+		if(to > until)
+			to = until;
+		// the host changed the interrupt input between the runs
+		if(s->irq != h->irq)
+			log_change(h);
+		status = run(h, to - s->instructions, *first);
+		*first = false;
+		h->irq = s->irq;
+		h->end = s->instructions;
+		h->input = h->ninputs > 0? h->ninputs - 1 : 0;
+		h->used = h->ninputs > 0? h->inputs[h->ninputs - 1].count : 0;
+		h->change = h->nchanges;
+	}
+	return status;
+}
+
+enum sim_status history_run(struct history *h, uint64_t instructions)
+{
+	struct sim *s = h->s;
+	h->host = s->io;
+	h->ports = s->ports;
+	s->io.input = &input;
+	s->io.output = &output;
+	s->io.ctx = h;
+	s->ports = NULL;
+	const uint64_t stable_until = s->stable_until;
+	s->stable_until = 0;
+
+	const uint64_t until = s->instructions + instructions;
+	enum sim_status status = SIM_BUDGET;
+	bool first = true;
+	while(s->instructions < until && status == SIM_BUDGET) {
+		if(s->instructions < h->end)
+			status = replay(h, until < h->end? until : h->end, &first);
+		else
+			status = record(h, until, &first);
+	}
+
+	s->io = h->host;
+	s->ports = h->ports;
+	s->stable_until = stable_until;
+	return status;
+}
+
+/**
+ * Returns to the checkpoint.
+ */
+static void restore(struct history *h, const struct checkpoint *cp)
+{
+	snapshot_restore(h->s, &cp->snap);
+	h->input = cp->input;
+	h->used = cp->used;
+	h->change = cp->change;
+}
+
+/**
+ * The last checkpoint at or before the number of instructions.
+ */
+static const struct checkpoint *find(const struct history *h, uint64_t instructions)
+{
+	size_t lo = 0, hi = h->ncps;
+	while(hi - lo > 1) {
+		const size_t mid = (lo + hi) / 2;
+		if(h->cps[mid].snap.instructions <= instructions)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return &h->cps[lo];
+}
+
+bool history_seek(struct history *h, uint64_t instructions)
+{
+	struct sim *s = h->s;
+	if(instructions < history_begin(h) || instructions > h->end)
+		return false;
+
+	const struct checkpoint *cp = find(h, instructions);
+	if(s->instructions > instructions || s->instructions < cp->snap.instructions)
+		restore(h, cp);
+
+	struct sim_breakpoints *bp = s->breakpoints;
+	s->breakpoints = NULL;
+	history_run(h, instructions - s->instructions);
+	s->breakpoints = bp;
+	s->status = SIM_BUDGET;
+	return s->instructions == instructions;
+}
+
+bool history_reverse(struct history *h)
+{
+	struct sim *s = h->s;
+	struct sim_breakpoints *bp = s->breakpoints;
+	uint64_t limit = s->instructions;
+
+	for(const struct checkpoint *cp = find(h, limit - (limit > 0)); bp != NULL; cp--) {
+		if(cp->snap.instructions < limit) {
+			restore(h, cp);
+
+			// the last stop before the limit, a watchpoint stops before the access
+			bool found = sim_at_breakpoint(s);
+			uint64_t at = s->instructions;
+			unsigned hit = SIM_BREAK_CODE;
+			uint8_t address = 0;
+			while(s->instructions < limit && history_run(h, limit - s->instructions) == SIM_BREAK) {
+				const uint64_t stop = bp->hit == SIM_BREAK_CODE? s->instructions : s->instructions - 1;
+				if(stop < limit) {
+					found = true;
+					at = stop;
+					hit = bp->hit;
+					address = bp->address;
+				}
+			}
+
+			if(found) {
+				history_seek(h, at);
+				bp->hit = hit;
+				bp->address = address;
+				s->status = SIM_BREAK;
+				return true;
+			}
+			limit = cp->snap.instructions;
+		}
+		if(cp == h->cps)
+			break;
+	}
+
+	history_seek(h, history_begin(h));
+	return false;
+}
+
+void history_truncate(struct history *h)
+{
+	struct sim *s = h->s;
+	while(h->ncps > 1 && h->cps[h->ncps - 1].snap.instructions > s->instructions)
+		h->ncps -= 1;
+	if(h->cps[h->ncps - 1].snap.instructions > s->instructions)
+		h->ncps = 0;
+
+	h->ninputs = h->input + (h->used > 0);
+	if(h->used > 0)
+		h->inputs[h->input].count = h->used;
+	h->nchanges = h->change;
+	h->end = s->instructions;
+	h->irq = s->irq;
+	if(h->ncps == 0)
+		checkpoint(h);
+}
@@ -0,0 +1,98 @@
+/**
+ * history.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#ifndef _HISTORY_H
+#define _HISTORY_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * History of the execution for the reverse execution (see gdb.h). While
+ * recording, the state is saved by snapshots (checkpoints) every interval
+ * of instructions and the log keeps what can not be executed again:
+ * the values read by INPUT (repeated reads of the same value take one
+ * entry) and the changes of the interrupt input made by the host.
+ * Going back restores the last checkpoint before the target and executes
+ * the rest again from the log, it costs at most the distance to the next
+ * checkpoint. Then the execution continues from the log until the end of
+ * the history, the host sees OUTPUT and INPUT only when it is recorded.
+ *
+ * The checkpoints are adaptive: when HISTORY_CHECKPOINTS are taken, every
+ * other one of the older half is dropped, so the recent history keeps
+ * the interval and the older one is thinned (each thinning doubles the
+ * distance there). When the log is full, the older half of the history
+ * is dropped.
+ *
+ * The host does all I/O through the callbacks of the simulator (ports
+ * are detached from the inline access while recording) and changes the
+ * interrupt input between the runs or in the callbacks. The idle loops
+ * are not skipped in the recorded runs.
+ */
+
+#define HISTORY_CHECKPOINTS 512
+#define HISTORY_LOG (1 << 22)	// entries of each log
+#define HISTORY_INTERVAL 65536	// default instructions between checkpoints
+
+struct history;
+
+/**
+ * Starts recording at the current state.
+ * @return NULL on allocation error
+ */
+struct history *history_init(struct sim *s, uint64_t interval);
+
+void history_destroy(struct history *h);
+
+/**
+ * Executes like sim_run, from the log until the end of the history,
+ * then records.
+ */
+enum sim_status history_run(struct history *h, uint64_t instructions);
+
+/**
+ * Instructions executed (s->instructions) at the beginning
+ * and at the end of the history.
+ */
+uint64_t history_begin(const struct history *h);
+uint64_t history_end(const struct history *h);
+
+/**
+ * Returns to the state after the given number of instructions
+ * (s->instructions) within the history.
+ * @return false when it is not in the history
+ */
+bool history_seek(struct history *h, uint64_t instructions);
+
+/**
+ * Finds the last stop at the breakpoints of the simulator before
+ * the current state and returns to it (the hit is in s->breakpoints).
+ * @return false when there is none, then it returns to the beginning
+ */
+bool history_reverse(struct history *h);
+
+/**
+ * The state was changed by the host (eg. the debugger wrote a register),
+ * the history after it is discarded and recording goes on from here.
+ */
+void history_truncate(struct history *h);
+
+#endif
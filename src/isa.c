@@ -0,0 +1,167 @@
+/**
+ * isa.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "isa.h"
+#include <string.h>
+#include <strings.h>
+
+/**
+ * Instruction opcodes for kcpsm3.
+ */
+static const struct isa kcpsm3 = {
+	.name = "kcpsm3",
+	.program_len = 1024,
+	.scratchpad_max = 0x3F,
+	.cond_shift = 10,
+	.opcode = {
+		// arithmetics:
+		[I_ADD_RR]		= 0x19000, [I_ADD_RK]		= 0x18000,
+		[I_ADDCY_RR]	= 0x1B000, [I_ADDCY_RK]		= 0x1A000,
+		[I_SUB_RR]		= 0x1D000, [I_SUB_RK]		= 0x1C000,
+		[I_SUBCY_RR]	= 0x1F000, [I_SUBCY_RK]		= 0x1E000,
+		[I_AND_RR]		= 0x0B000, [I_AND_RK]		= 0x0A000,
+		[I_OR_RR]		= 0x0D000, [I_OR_RK]		= 0x0C000,
+		[I_XOR_RR]		= 0x0F000, [I_XOR_RK]		= 0x0E000,
+		[I_TEST_RR]		= 0x13000, [I_TEST_RK]		= 0x12000,
+		[I_COMPARE_RR]	= 0x15000, [I_COMPARE_RK]	= 0x14000,
+		// jumps:
+		[I_JUMP_COND]	= 0x35000, [I_JUMP]		= 0x34000,
+		[I_CALL_COND]	= 0x31000, [I_CALL]		= 0x30000,
+		[I_RETURN_COND]	= 0x2B000, [I_RETURN]	= 0x2A000,
+		// interrupt control:
+		[I_ENABLE_INTERRUPT]	= 0x3C001,
+		[I_DISABLE_INTERRUPT]	= 0x3C000,
+		[I_RETURNI_ENABLE]		= 0x38001,
+		[I_RETURNI_DISABLE]		= 0x38000,
+		// shifts:
+		[I_SL0] = 0x20006, [I_SL1] = 0x20007,
+		[I_SLX] = 0x20004, [I_SLA] = 0x20000,
+		[I_RL]  = 0x20002,
+		[I_SR0] = 0x2000E, [I_SR1] = 0x2000F,
+		[I_SRX] = 0x2000A, [I_SRA] = 0x20008,
+		[I_RR]  = 0x2000C,
+		// others:
+		[I_LOAD_RR]		= 0x01000, [I_LOAD_RK]		= 0x00000,
+		[I_FETCH_RR]	= 0x07000, [I_FETCH_RS]		= 0x06000,
+		[I_STORE_RR]	= 0x2F000, [I_STORE_RS]		= 0x2E000,
+		[I_INPUT_RR]	= 0x05000, [I_INPUT_RP]		= 0x04000,
+		[I_OUTPUT_RR]	= 0x2D000, [I_OUTPUT_RP]	= 0x2C000,
+		// kcpsm6 only:
+		[I_TESTCY_RR]	= OPCODE_NONE, [I_TESTCY_RK]	= OPCODE_NONE,
+		[I_COMPARECY_RR] = OPCODE_NONE, [I_COMPARECY_RK] = OPCODE_NONE,
+		[I_STAR_RR]		= OPCODE_NONE,
+		[I_JUMP_AT]		= OPCODE_NONE, [I_CALL_AT]	= OPCODE_NONE,
+		[I_LOAD_RETURN]	= OPCODE_NONE,
+		[I_REGBANK_A]	= OPCODE_NONE, [I_REGBANK_B] = OPCODE_NONE
+	}
+};
+
+/**
+ * Instruction opcodes for kcpsm6.
+ */
+static const struct isa kcpsm6 = {
+	.name = "kcpsm6",
+	.program_len = 4096,
+	.scratchpad_max = 0xFF,
+	.cond_shift = 14,
+	.opcode = {
+		// arithmetics:
+		[I_ADD_RR]		= 0x10000, [I_ADD_RK]		= 0x11000,
+		[I_ADDCY_RR]	= 0x12000, [I_ADDCY_RK]		= 0x13000,
+		[I_SUB_RR]		= 0x18000, [I_SUB_RK]		= 0x19000,
+		[I_SUBCY_RR]	= 0x1A000, [I_SUBCY_RK]		= 0x1B000,
+		[I_AND_RR]		= 0x02000, [I_AND_RK]		= 0x03000,
+		[I_OR_RR]		= 0x04000, [I_OR_RK]		= 0x05000,
+		[I_XOR_RR]		= 0x06000, [I_XOR_RK]		= 0x07000,
+		[I_TEST_RR]		= 0x0C000, [I_TEST_RK]		= 0x0D000,
+		[I_COMPARE_RR]	= 0x1C000, [I_COMPARE_RK]	= 0x1D000,
+		// jumps:
+		[I_JUMP_COND]	= 0x32000, [I_JUMP]		= 0x22000,
+		[I_CALL_COND]	= 0x30000, [I_CALL]		= 0x20000,
+		[I_RETURN_COND]	= 0x31000, [I_RETURN]	= 0x25000,
+		// interrupt control:
+		[I_ENABLE_INTERRUPT]	= 0x28001,
+		[I_DISABLE_INTERRUPT]	= 0x28000,
+		[I_RETURNI_ENABLE]		= 0x29001,
+		[I_RETURNI_DISABLE]		= 0x29000,
+		// shifts:
+		[I_SL0] = 0x14006, [I_SL1] = 0x14007,
+		[I_SLX] = 0x14004, [I_SLA] = 0x14000,
+		[I_RL]  = 0x14002,
+		[I_SR0] = 0x1400E, [I_SR1] = 0x1400F,
+		[I_SRX] = 0x1400A, [I_SRA] = 0x14008,
+		[I_RR]  = 0x1400C,
+		// others:
+		[I_LOAD_RR]		= 0x00000, [I_LOAD_RK]		= 0x01000,
+		[I_FETCH_RR]	= 0x0A000, [I_FETCH_RS]		= 0x0B000,
+		[I_STORE_RR]	= 0x2E000, [I_STORE_RS]		= 0x2F000,
+		[I_INPUT_RR]	= 0x08000, [I_INPUT_RP]		= 0x09000,
+		[I_OUTPUT_RR]	= 0x2C000, [I_OUTPUT_RP]	= 0x2D000,
+		// kcpsm6 only:
+		[I_TESTCY_RR]	= 0x0E000, [I_TESTCY_RK]	= 0x0F000,
+		[I_COMPARECY_RR] = 0x1E000, [I_COMPARECY_RK] = 0x1F000,
+		[I_STAR_RR]		= 0x16000,
+		[I_JUMP_AT]		= 0x26000, [I_CALL_AT]	= 0x24000,
+		[I_LOAD_RETURN]	= 0x21000,
+		[I_REGBANK_A]	= 0x37000, [I_REGBANK_B] = 0x37001
+	}
+};
+
+static const struct isa *targets[] = {
+	&kcpsm3, &kcpsm6
+};
+
+#define TARGETS_LEN (sizeof(targets)/sizeof(struct isa *))
+
+const struct isa *isa_find(const char *name)
+{
+	for(unsigned i = 0; i < TARGETS_LEN; i++) {
+		if(!strcasecmp(targets[i]->name, name))
+			return targets[i];
+	}
+
+	return NULL;
+}
+
+const struct isa *isa_default(void)
+{
+	return &kcpsm3;
+}
+
+bool isa_keyword(const struct isa *isa, enum keyword_type kw)
+{
+	switch(kw) {
+	case K_TESTCY:
+		return isa_has(isa, I_TESTCY_RR);
+	case K_COMPARECY:
+		return isa_has(isa, I_COMPARECY_RR);
+	case K_STAR:
+		return isa_has(isa, I_STAR_RR);
+	case K_JUMP_AT:
+		return isa_has(isa, I_JUMP_AT);
+	case K_CALL_AT:
+		return isa_has(isa, I_CALL_AT);
+	case K_LOAD_RETURN:
+		return isa_has(isa, I_LOAD_RETURN);
+	case K_REGBANK:
+		return isa_has(isa, I_REGBANK_A);
+	default:
+		return true;
+	}
+}
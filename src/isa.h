@@ -0,0 +1,123 @@
+/**
+ * isa.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _ISA_H
+#define _ISA_H
+
+#include "pico.h"
+#include "scanner.h"
+#include <stdbool.h>
+
+/**
+ * Instructions known to the assembler. The concrete opcode
+ * is given by the target ISA table.
+ */
+enum instr {
+	// arithmetics:
+	I_ADD_RR, I_ADD_RK,
+	I_ADDCY_RR, I_ADDCY_RK,
+	I_SUB_RR, I_SUB_RK,
+	I_SUBCY_RR, I_SUBCY_RK,
+	I_AND_RR, I_AND_RK,
+	I_OR_RR, I_OR_RK,
+	I_XOR_RR, I_XOR_RK,
+	I_TEST_RR, I_TEST_RK,
+	I_COMPARE_RR, I_COMPARE_RK,
+	// jumps:
+	I_JUMP_COND, I_JUMP,
+	I_CALL_COND, I_CALL,
+	I_RETURN_COND, I_RETURN,
+	// interrupt control:
+	I_ENABLE_INTERRUPT,
+	I_DISABLE_INTERRUPT,
+	I_RETURNI_ENABLE,
+	I_RETURNI_DISABLE,
+	// shifts:
+	I_SL0, I_SL1,
+	I_SLX, I_SLA,
+	I_RL,
+	I_SR0, I_SR1,
+	I_SRX, I_SRA,
+	I_RR,
+	// others:
+	I_LOAD_RR, I_LOAD_RK,
+	I_FETCH_RR, I_FETCH_RS,
+	I_STORE_RR, I_STORE_RS,
+	I_INPUT_RR, I_INPUT_RP,
+	I_OUTPUT_RR, I_OUTPUT_RP,
+	// kcpsm6 only:
+	I_TESTCY_RR, I_TESTCY_RK,
+	I_COMPARECY_RR, I_COMPARECY_RK,
+	I_STAR_RR,
+	I_JUMP_AT, I_CALL_AT,
+	I_LOAD_RETURN,
+	I_REGBANK_A, I_REGBANK_B,
+	I_COUNT,
+	// the instruction has no such form
+	I_NONE = I_COUNT
+};
+
+/**
+ * Marks an instruction that the target does not implement.
+ */
+#define OPCODE_NONE ((code_t) -1)
+
+/**
+ * Description of a target processor.
+ */
+struct isa {
+	const char *name;
+	progaddr_t program_len;
+	number_t scratchpad_max;
+	// position of the condition flag in conditional jumps
+	int cond_shift;
+	code_t opcode[I_COUNT];
+};
+
+/**
+ * Looks up the target of the given name.
+ * @return the target description or NULL when unknown
+ */
+const struct isa *isa_find(const char *name);
+
+/**
+ * Default target.
+ */
+const struct isa *isa_default(void);
+
+/**
+ * @return opcode of the instruction or OPCODE_NONE
+ */
+static inline code_t isa_opcode(const struct isa *isa, enum instr i)
+{
+	return isa->opcode[i];
+}
+
+static inline bool isa_has(const struct isa *isa, enum instr i)
+{
+	return i < I_COUNT && isa->opcode[i] != OPCODE_NONE;
+}
+
+/**
+ * Tests whether the keyword is an instruction of the target.
+ * Keywords of other targets are usable as ordinary literals.
+ */
+bool isa_keyword(const struct isa *isa, enum keyword_type kw);
+
+#endif
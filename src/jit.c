@@ -0,0 +1,728 @@
+/**
+ * jit.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+	#define JIT_X86_64 1
+	#include <sys/mman.h>
+#endif
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+#define JIT_PATCHES 4096
+// upper bound of the code of one block
+#define JIT_BLOCK_CODE (JIT_BLOCK_MAX * 64 + 256)
+
+typedef uint64_t (*jit_enter_t)(struct sim *s, uint64_t budget, const uint8_t *code);
+
+/**
+ * Jump of a compiled block to a block that was not compiled yet,
+ * it is redirected when the target is compiled.
+ */
+struct jit_patch {
+	uint32_t site;	// offset of rel32 in the buffer
+	uint16_t target;
+};
+
+struct jit {
+	struct sim *s;
+	unsigned generation;	// of the translated program
+	uint8_t *code;	// executable buffer, NULL when not available
+	size_t pos;
+	size_t stubs;	// end of the common code
+	jit_enter_t enter;
+	const uint8_t *exit;
+	const uint8_t *dyn_exit;
+	// entries of compiled blocks, dyn_exit for the others
+	const uint8_t *entry[SIM_PROGRAM_LEN];
+	uint8_t len[SIM_PROGRAM_LEN];	// instructions of the block starting at the address
+	uint16_t hits[SIM_PROGRAM_LEN];
+	struct jit_patch patch[JIT_PATCHES];
+	size_t patches;
+};
+
+/**
+ * Operations translated to native code, the others (I/O and the interrupt
+ * control) are always interpreted, so the interrupt can not become pending
+ * while the native code runs.
+ */
+static bool native_op(uint8_t op)
+{
+	switch(op) {
+	case S_INPUT_RR: case S_INPUT_RK:
+	case S_OUTPUT_RR: case S_OUTPUT_RK:
+	case S_RETURNI_DISABLE: case S_RETURNI_ENABLE:
+	case S_DISABLE_INTERRUPT: case S_ENABLE_INTERRUPT:
+	case S_INVALID:
+		return false;
+	default:
+		return true;
+	}
+}
+
+static bool ends_block(uint8_t op)
+{
+	return op >= S_JUMP && op <= S_RETURN_NC;
+}
+
+/**
+ * Finds lengths of blocks starting at every address.
+ */
+static void scan(struct jit *j)
+{
+	const struct sim_instr *rom = j->s->rom;
+
+	for(unsigned pc = 0; pc < SIM_PROGRAM_LEN; pc++) {
+		unsigned n = 0;
+		unsigned addr = pc;
+
+		while(n < JIT_BLOCK_MAX && native_op(rom[addr].op)) {
+			n += 1;
+			if(ends_block(rom[addr].op) || addr == PC_MASK)
+				break;
+			addr += 1;
+		}
+
+		j->len[pc] = n;
+	}
+}
+
+#ifdef JIT_X86_64
+
+// =================================== //
+// ---------- code emission ---------- //
+// =================================== //
+
+/**
+ * Register usage of the translated code:
+ *   rbx   struct sim
+ *   r12   remaining instructions of the budget
+ *   r13d  lazy flags (see sim.h)
+ *   eax, ecx, edx  temporaries
+ */
+
+#define OFF_REG(x) ((int32_t) (offsetof(struct sim, reg) + (x)))
+#define OFF_SCRATCH(x) ((int32_t) (offsetof(struct sim, scratchpad) + (x)))
+#define OFF_PC ((int32_t) offsetof(struct sim, pc))
+#define OFF_FLAGS ((int32_t) offsetof(struct sim, flags))
+
+static void emit(struct jit *j, const uint8_t *bytes, size_t n)
+{
+	memcpy(j->code + j->pos, bytes, n);
+	j->pos += n;
+}
+
+#define EMIT(j, ...) do {\
+	const uint8_t bytes_[] = {__VA_ARGS__};\
+	emit(j, bytes_, sizeof(bytes_));\
+} while(0)
+
+static void emit32(struct jit *j, uint32_t v)
+{
+	for(int i = 0; i < 4; i++)
+		j->code[j->pos++] = v >> (8 * i);
+}
+
+static void emit64(struct jit *j, uint64_t v)
+{
+	for(int i = 0; i < 8; i++)
+		j->code[j->pos++] = v >> (8 * i);
+}
+
+static void patch32(struct jit *j, size_t site, size_t to)
+{
+	const uint32_t rel = (uint32_t) (to - (site + 4));
+	for(int i = 0; i < 4; i++)
+		j->code[site + i] = rel >> (8 * i);
+}
+
+/**
+ * Emits the opcode of a jump with rel32.
+ * @return offset of the rel32
+ */
+static size_t emit_jump(struct jit *j, uint8_t cc)
+{
+	if(cc == 0)
+		EMIT(j, 0xE9);
+	else
+		EMIT(j, 0x0F, cc);
+
+	const size_t site = j->pos;
+	emit32(j, 0);
+	return site;
+}
+
+#define JMP 0
+#define JZ 0x84
+#define JNZ 0x85
+#define JB 0x82
+
+// movzx eax (r = 0) or edx (r = 2), byte [rbx + disp]
+static void emit_load(struct jit *j, unsigned r, int32_t disp)
+{
+	EMIT(j, 0x0F, 0xB6, 0x83 | r << 3);
+	emit32(j, disp);
+}
+
+// mov byte [rbx + disp], al
+static void emit_store(struct jit *j, int32_t disp)
+{
+	EMIT(j, 0x88, 0x83);
+	emit32(j, disp);
+}
+
+// mov edx, second operand
+static void emit_operand(struct jit *j, const struct sim_instr *ins, bool rr)
+{
+	if(rr)
+		emit_load(j, 2, OFF_REG(ins->y));
+	else {
+		EMIT(j, 0xBA);
+		emit32(j, ins->y);
+	}
+}
+
+// mov r13d, eax
+static void emit_set_flags(struct jit *j)
+{
+	EMIT(j, 0x41, 0x89, 0xC5);
+}
+
+// mov rdi, rbx; mov rax, fn; call rax
+static void emit_call(struct jit *j, uintptr_t fn)
+{
+	EMIT(j, 0x48, 0x89, 0xDF);
+	EMIT(j, 0x48, 0xB8);
+	emit64(j, fn);
+	EMIT(j, 0xFF, 0xD0);
+}
+
+/**
+ * What is known about the lazy flags at compile time, the carry
+ * maps to a host flag directly when the last operation is known.
+ */
+enum flags_state {
+	F_UNKNOWN,
+	F_PLAIN,	// bit 8 is the carry
+	F_PARITY	// set by TEST, the carry is the parity
+};
+
+// ecx = carry
+static void emit_carry(struct jit *j, enum flags_state st)
+{
+	if(st != F_PARITY) {
+		EMIT(j, 0x44, 0x89, 0xE9);	// mov ecx, r13d
+		EMIT(j, 0xC1, 0xE9, 0x08);	// shr ecx, 8
+		EMIT(j, 0x83, 0xE1, 0x01);	// and ecx, 1
+	}
+	if(st == F_UNKNOWN) {
+		EMIT(j, 0x41, 0xF7, 0xC5, 0x00, 0x02, 0x00, 0x00);	// test r13d, SIM_FLAGS_PARITY
+		EMIT(j, 0x74, 0x08);	// jz over the parity
+	}
+	if(st != F_PLAIN) {
+		EMIT(j, 0x31, 0xC9);	// xor ecx, ecx
+		EMIT(j, 0x45, 0x84, 0xED);	// test r13b, r13b
+		EMIT(j, 0x0F, 0x9B, 0xC1);	// setnp cl
+	}
+}
+
+/**
+ * Tests the condition (1 Z, 2 NZ, 3 C, 4 NC).
+ * @return the jcc taken when the condition holds
+ */
+static uint8_t emit_cond(struct jit *j, unsigned cond, enum flags_state st)
+{
+	if(cond <= 2) {
+		EMIT(j, 0x41, 0xF7, 0xC5, 0xFF, 0x00, 0x00, 0x00);	// test r13d, 0xFF
+		return cond == 1? JZ : JNZ;
+	}
+
+	emit_carry(j, st);
+	EMIT(j, 0x85, 0xC9);	// test ecx, ecx
+	return cond == 3? JNZ : JZ;
+}
+
+/**
+ * Exits of the block being compiled.
+ */
+struct exits {
+	size_t site[8];
+	uint16_t target[8];
+	unsigned len;
+};
+
+static void emit_exit(struct jit *j, struct exits *ex, uint8_t cc, uint16_t target)
+{
+	const size_t site = emit_jump(j, cc);
+	if(j->entry[target] != j->dyn_exit)
+		patch32(j, site, j->entry[target] - j->code);
+	else {
+		ex->site[ex->len] = site;
+		ex->target[ex->len] = target;
+		ex->len += 1;
+	}
+}
+
+static void jit_push(struct sim *s, unsigned addr)
+{
+	sim_push(s, addr);
+}
+
+static unsigned jit_pop(struct sim *s)
+{
+	return (sim_pop(s) + 1) & PC_MASK;
+}
+
+static void emit_alu(struct jit *j, const struct sim_instr *ins, enum flags_state *st)
+{
+	// op eax, edx
+	static const uint8_t alu[] = {
+		[S_AND_RR] = 0x21, [S_AND_RK] = 0x21,
+		[S_OR_RR] = 0x09, [S_OR_RK] = 0x09,
+		[S_XOR_RR] = 0x31, [S_XOR_RK] = 0x31,
+		[S_TEST_RR] = 0x21, [S_TEST_RK] = 0x21,
+		[S_ADD_RR] = 0x01, [S_ADD_RK] = 0x01,
+		[S_ADDCY_RR] = 0x01, [S_ADDCY_RK] = 0x01,
+		[S_SUB_RR] = 0x29, [S_SUB_RK] = 0x29,
+		[S_SUBCY_RR] = 0x29, [S_SUBCY_RK] = 0x29,
+		[S_COMPARE_RR] = 0x29, [S_COMPARE_RK] = 0x29
+	};
+
+	const uint8_t op = ins->op;
+	const bool rr = (op - S_AND_RR) % 2 == 0;
+	const bool cy = op == S_ADDCY_RR || op == S_ADDCY_RK
+			|| op == S_SUBCY_RR || op == S_SUBCY_RK;
+	const bool arith = op >= S_ADD_RR;
+
+	if(cy)
+		emit_carry(j, *st);
+
+	emit_load(j, 0, OFF_REG(ins->x));
+	emit_operand(j, ins, rr);
+	EMIT(j, alu[op], 0xD0);
+	if(cy)
+		EMIT(j, alu[op], 0xC8);	// op eax, ecx
+	if(arith)
+		EMIT(j, 0x25, 0xFF, 0x01, 0x00, 0x00);	// and eax, 0x1FF
+	if(op != S_TEST_RR && op != S_TEST_RK && op != S_COMPARE_RR && op != S_COMPARE_RK)
+		emit_store(j, OFF_REG(ins->x));
+
+	emit_set_flags(j);
+	*st = F_PLAIN;
+	if(op == S_TEST_RR || op == S_TEST_RK) {
+		EMIT(j, 0x41, 0x81, 0xCD, 0x00, 0x02, 0x00, 0x00);	// or r13d, SIM_FLAGS_PARITY
+		*st = F_PARITY;
+	}
+}
+
+static void emit_shift(struct jit *j, const struct sim_instr *ins, enum flags_state *st)
+{
+	const uint8_t op = ins->op;
+	if(op == S_SLA || op == S_SRA)
+		emit_carry(j, *st);
+
+	emit_load(j, 0, OFF_REG(ins->x));
+
+	// edx = the bit shifted in
+	switch(op) {
+	case S_SL0: case S_SR0:
+		EMIT(j, 0x31, 0xD2);
+		break;
+	case S_SL1: case S_SR1:
+		EMIT(j, 0xBA, 0x01, 0x00, 0x00, 0x00);
+		break;
+	case S_SLX: case S_RR:
+		EMIT(j, 0x89, 0xC2, 0x83, 0xE2, 0x01);	// mov edx, eax; and edx, 1
+		break;
+	case S_RL: case S_SRX:
+		EMIT(j, 0x89, 0xC2, 0xC1, 0xEA, 0x07);	// mov edx, eax; shr edx, 7
+		break;
+	default:	// SLA, SRA
+		EMIT(j, 0x89, 0xCA);	// mov edx, ecx
+		break;
+	}
+
+	if(op <= S_RL) {
+		EMIT(j, 0xD1, 0xE0);	// shl eax, 1
+		EMIT(j, 0x09, 0xD0);	// or eax, edx
+	}
+	else {
+		EMIT(j, 0xC1, 0xE2, 0x07);	// shl edx, 7
+		EMIT(j, 0x89, 0xC1);	// mov ecx, eax
+		EMIT(j, 0x83, 0xE1, 0x01);	// and ecx, 1
+		EMIT(j, 0xC1, 0xE1, 0x08);	// shl ecx, 8
+		EMIT(j, 0xD1, 0xE8);	// shr eax, 1
+		EMIT(j, 0x09, 0xD0);	// or eax, edx
+		EMIT(j, 0x09, 0xC8);	// or eax, ecx
+	}
+
+	emit_store(j, OFF_REG(ins->x));
+	emit_set_flags(j);
+	*st = F_PLAIN;
+}
+
+/**
+ * Emits the jump, call or return ending the block.
+ */
+static void emit_branch(struct jit *j, struct exits *ex, const struct sim_instr *ins,
+		uint16_t addr, enum flags_state st)
+{
+	const uint16_t next = (addr + 1) & PC_MASK;
+	const uint8_t op = ins->op;
+	uint8_t first;
+
+	if(op <= S_JUMP_NC)
+		first = S_JUMP;
+	else if(op <= S_CALL_NC)
+		first = S_CALL;
+	else
+		first = S_RETURN;
+
+	if(first == S_JUMP) {
+		if(op != S_JUMP)
+			emit_exit(j, ex, emit_cond(j, op - first, st), ins->target);
+		else
+			emit_exit(j, ex, JMP, ins->target);
+		if(op != S_JUMP)
+			emit_exit(j, ex, JMP, next);
+		return;
+	}
+
+	size_t skip = 0;
+	if(op != first)
+		skip = emit_jump(j, emit_cond(j, op - first, st) ^ 1);
+
+	if(first == S_CALL) {
+		EMIT(j, 0xBE);	// mov esi, addr
+		emit32(j, addr);
+		emit_call(j, (uintptr_t) &jit_push);
+		emit_exit(j, ex, JMP, ins->target);
+	}
+	else {
+		emit_call(j, (uintptr_t) &jit_pop);
+		EMIT(j, 0x89, 0xC0);	// mov eax, eax
+		EMIT(j, 0x48, 0xBA);	// mov rdx, entry
+		emit64(j, (uintptr_t) j->entry);
+		EMIT(j, 0xFF, 0x24, 0xC2);	// jmp [rdx + rax * 8]
+	}
+
+	if(op != first) {
+		patch32(j, skip, j->pos);
+		emit_exit(j, ex, JMP, next);
+	}
+}
+
+// mov word [rbx + pc], target; jmp exit
+static void emit_pc_exit(struct jit *j, uint16_t target)
+{
+	EMIT(j, 0x66, 0xC7, 0x83);
+	emit32(j, OFF_PC);
+	EMIT(j, target & 0xFF, target >> 8);
+	patch32(j, emit_jump(j, JMP), j->exit - j->code);
+}
+
+static void emit_stubs(struct jit *j)
+{
+	j->pos = 0;
+
+	const uint8_t *enter = j->code + j->pos;
+	EMIT(j, 0x53, 0x41, 0x54, 0x41, 0x55);	// push rbx; push r12; push r13
+	EMIT(j, 0x48, 0x89, 0xFB);	// mov rbx, rdi
+	EMIT(j, 0x49, 0x89, 0xF4);	// mov r12, rsi
+	EMIT(j, 0x44, 0x0F, 0xB7, 0xAB);	// movzx r13d, word [rbx + flags]
+	emit32(j, OFF_FLAGS);
+	EMIT(j, 0xFF, 0xE2);	// jmp rdx
+	memcpy(&j->enter, &enter, sizeof(enter));
+
+	j->exit = j->code + j->pos;
+	EMIT(j, 0x66, 0x44, 0x89, 0xAB);	// mov word [rbx + flags], r13w
+	emit32(j, OFF_FLAGS);
+	EMIT(j, 0x4C, 0x89, 0xE0);	// mov rax, r12
+	EMIT(j, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3);	// pop r13; pop r12; pop rbx; ret
+
+	// the target address is in eax
+	j->dyn_exit = j->code + j->pos;
+	EMIT(j, 0x66, 0x89, 0x83);	// mov word [rbx + pc], ax
+	emit32(j, OFF_PC);
+	patch32(j, emit_jump(j, JMP), j->exit - j->code);
+
+	j->stubs = j->pos;
+}
+
+static void flush(struct jit *j)
+{
+	j->pos = j->stubs;
+	j->patches = 0;
+	for(unsigned i = 0; i < SIM_PROGRAM_LEN; i++) {
+		j->entry[i] = j->dyn_exit;
+		j->hits[i] = 0;
+	}
+
+	scan(j);
+	j->generation = j->s->generation;
+}
+
+static void compile(struct jit *j, uint16_t pc)
+{
+	if(j->pos + JIT_BLOCK_CODE > JIT_BUFFER)
+		flush(j);
+
+	const struct sim_instr *rom = j->s->rom;
+	const unsigned len = j->len[pc];
+	enum flags_state st = F_UNKNOWN;
+	struct exits ex = {.len = 0};
+
+	// jumps to itself are resolved directly
+	const size_t start = j->pos;
+	j->entry[pc] = j->code + start;
+
+	EMIT(j, 0x49, 0x81, 0xFC);	// cmp r12, len
+	emit32(j, len);
+	const size_t bail = emit_jump(j, JB);
+	EMIT(j, 0x49, 0x81, 0xEC);	// sub r12, len
+	emit32(j, len);
+
+	uint16_t addr = pc;
+	bool ended = false;
+	for(unsigned i = 0; i < len; i++, addr = (addr + 1) & PC_MASK) {
+		const struct sim_instr *ins = &rom[addr];
+
+		switch(ins->op) {
+		case S_LOAD_RR:
+			emit_load(j, 0, OFF_REG(ins->y));
+			emit_store(j, OFF_REG(ins->x));
+			break;
+		case S_LOAD_RK:
+			EMIT(j, 0xC6, 0x83);	// mov byte [rbx + x], y
+			emit32(j, OFF_REG(ins->x));
+			EMIT(j, ins->y);
+			break;
+		case S_FETCH_RR:
+			emit_load(j, 2, OFF_REG(ins->y));
+			EMIT(j, 0x83, 0xE2, SIM_SCRATCHPAD - 1);	// and edx, mask
+			EMIT(j, 0x0F, 0xB6, 0x84, 0x13);	// movzx eax, byte [rbx + rdx + scratchpad]
+			emit32(j, OFF_SCRATCH(0));
+			emit_store(j, OFF_REG(ins->x));
+			break;
+		case S_FETCH_RK:
+			emit_load(j, 0, OFF_SCRATCH(ins->y & (SIM_SCRATCHPAD - 1)));
+			emit_store(j, OFF_REG(ins->x));
+			break;
+		case S_STORE_RR:
+			emit_load(j, 2, OFF_REG(ins->y));
+			EMIT(j, 0x83, 0xE2, SIM_SCRATCHPAD - 1);
+			emit_load(j, 0, OFF_REG(ins->x));
+			EMIT(j, 0x88, 0x84, 0x13);	// mov byte [rbx + rdx + scratchpad], al
+			emit32(j, OFF_SCRATCH(0));
+			break;
+		case S_STORE_RK:
+			emit_load(j, 0, OFF_REG(ins->x));
+			emit_store(j, OFF_SCRATCH(ins->y & (SIM_SCRATCHPAD - 1)));
+			break;
+		case S_SL0: case S_SL1: case S_SLX: case S_SLA: case S_RL:
+		case S_SR0: case S_SR1: case S_SRX: case S_SRA: case S_RR:
+			emit_shift(j, ins, &st);
+			break;
+		default:
+			if(ends_block(ins->op)) {
+				emit_branch(j, &ex, ins, addr, st);
+				ended = true;
+			}
+			else
+				emit_alu(j, ins, &st);
+			break;
+		}
+	}
+
+	if(!ended)
+		emit_exit(j, &ex, JMP, addr);
+
+	// exits to blocks not compiled yet
+	patch32(j, bail, j->pos);
+	emit_pc_exit(j, pc);
+	for(unsigned i = 0; i < ex.len; i++) {
+		if(j->entry[ex.target[i]] != j->dyn_exit) {
+			patch32(j, ex.site[i], j->entry[ex.target[i]] - j->code);
+			continue;
+		}
+
+		patch32(j, ex.site[i], j->pos);
+		emit_pc_exit(j, ex.target[i]);
+		if(j->patches < JIT_PATCHES) {
+			j->patch[j->patches].site = ex.site[i];
+			j->patch[j->patches].target = ex.target[i];
+			j->patches += 1;
+		}
+	}
+
+	// chaining of the blocks waiting for this one
+	for(size_t i = 0; i < j->patches; ) {
+		if(j->patch[i].target == pc) {
+			patch32(j, j->patch[i].site, start);
+			j->patch[i] = j->patch[--j->patches];
+		}
+		else
+			i += 1;
+	}
+}
+
+/**
+ * Switches the buffer between writable and executable, it is never both.
+ * @return false when the protection can not be changed
+ */
+static bool protect(struct jit *j, bool writable)
+{
+	const int prot = writable? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+	return mprotect(j->code, JIT_BUFFER, prot) == 0;
+}
+
+/**
+ * Drops the native code, the rest is interpreted.
+ */
+static void drop(struct jit *j)
+{
+	munmap(j->code, JIT_BUFFER);
+	j->code = NULL;
+}
+
+/**
+ * Compiles the block with the buffer writable, chaining patches the blocks
+ * waiting for it there too.
+ * @return false when the buffer was dropped
+ */
+static bool translate(struct jit *j, uint16_t pc)
+{
+	if(!protect(j, true)) {
+		drop(j);
+		return false;
+	}
+
+	compile(j, pc);
+	if(!protect(j, false)) {
+		drop(j);
+		return false;
+	}
+
+	return true;
+}
+
+#endif
+
+// =================================== //
+// ----------- interface ------------- //
+// =================================== //
+
+struct jit *jit_init(struct sim *s)
+{
+	struct jit *j = (struct jit *) calloc(1, sizeof(struct jit));
+	if(j == NULL)
+		return NULL;
+
+	j->s = s;
+#ifdef JIT_X86_64
+	void *code = mmap(NULL, JIT_BUFFER, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(code != MAP_FAILED) {
+		j->code = (uint8_t *) code;
+		emit_stubs(j);
+		flush(j);
+		if(!protect(j, false))
+			drop(j);
+	}
+#endif
+	return j;
+}
+
+void jit_destroy(struct jit *j)
+{
+	if(j == NULL)
+		return;
+
+#ifdef JIT_X86_64
+	if(j->code != NULL)
+		munmap(j->code, JIT_BUFFER);
+#endif
+	free(j);
+}
+
+bool jit_native(const struct jit *j)
+{
+	return j->code != NULL;
+}
+
+/**
+ * Interprets at most n instructions.
+ * @return number of executed instructions
+ */
+static uint64_t interpret(struct sim *s, uint64_t n)
+{
+	const uint64_t before = s->instructions;
+	if(sim_run(s, n) == SIM_BUDGET)
+		s->status = SIM_RUNNING;
+	return s->instructions - before;
+}
+
+enum sim_status jit_run(struct jit *j, uint64_t instructions)
+{
+	struct sim *s = j->s;
+
+#ifdef JIT_X86_64
+	if(j->code == NULL)
+		return sim_run(s, instructions);
+
+	if(j->generation != s->generation)
+		flush(j);
+
+	uint64_t left = instructions;
+	s->status = SIM_RUNNING;
+
+	while(left > 0) {
+		const uint16_t pc = s->pc;
+		const unsigned len = j->len[pc];
+		uint64_t n;
+
+		if((s->ie && s->irq) || len == 0 || len > left)
+			n = interpret(s, 1);
+		else if(j->entry[pc] != j->dyn_exit || ++j->hits[pc] >= JIT_HOT) {
+			if(j->entry[pc] == j->dyn_exit && !translate(j, pc))
+				return sim_run(s, left);
+
+			n = left - j->enter(s, left, j->entry[pc]);
+			s->instructions += n;
+			s->cycles += SIM_CYCLES_PER_INSTR * n;
+		}
+		else
+			n = interpret(s, len);
+
+		left -= n;
+		if(s->status != SIM_RUNNING)
+			return s->status;
+	}
+
+	s->status = SIM_BUDGET;
+	return s->status;
+#else
+	return sim_run(s, instructions);
+#endif
+}
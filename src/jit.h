@@ -0,0 +1,65 @@
+/**
+ * jit.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _JIT_H
+#define _JIT_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Translates hot basic blocks of the simulated program to x86-64 code.
+ * Blocks executed JIT_HOT times are compiled into an executable buffer,
+ * the rest of the program is interpreted by sim_run. Compiled blocks
+ * jump to each other directly (chaining). The cache is dropped when
+ * the program is reloaded by sim_load or when the buffer is full.
+ * The buffer is never writable and executable at once, it is made
+ * writable only while a block is compiled and chained.
+ *
+ * On other hosts, or when the executable buffer can not be mapped
+ * or protected, jit_run is just sim_run.
+ */
+
+#define JIT_HOT 16
+#define JIT_BLOCK_MAX 64	// instructions
+#define JIT_BUFFER (1 << 20)	// bytes
+
+struct jit;
+
+/**
+ * Creates the translator for the simulator.
+ * @return NULL on allocation error
+ */
+struct jit *jit_init(struct sim *s);
+
+void jit_destroy(struct jit *j);
+
+/**
+ * Tests whether the code is translated, false means interpretation only.
+ */
+bool jit_native(const struct jit *j);
+
+/**
+ * Executes at most the given number of instructions like sim_run.
+ * @return reason of the stop
+ */
+enum sim_status jit_run(struct jit *j, uint64_t instructions);
+
+#endif
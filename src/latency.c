@@ -0,0 +1,279 @@
+/**
+ * latency.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "latency.h"
+#include "xorshift.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_BUCKETS 64
+
+struct histogram {
+	uint64_t exact[LATENCY_EXACT];
+	uint64_t log[LOG_BUCKETS];	// by the highest bit, from LATENCY_EXACT
+	uint64_t count;
+	uint64_t max;
+};
+
+struct latency {
+	struct sim *s;
+	struct sched *q;
+	struct latency_counts counts;
+	struct histogram hist[LATENCY_KINDS];
+	// the schedule
+	bool random;
+	uint64_t period;
+	uint64_t min;
+	uint64_t max;
+	uint64_t state;
+	uint64_t next;	// cycle of the next assertion
+	// the interrupt asserted and not acknowledged
+	bool pending;
+	struct latency_worst current;
+	uint64_t service[SIM_STACK];	// assertions of the interrupts in service
+	unsigned depth;
+	bool any;	// an interrupt entered the handler
+	struct latency_worst worst;
+	struct stepper steps;
+};
+
+static uint64_t unobserved(struct sim *s, void *ctx);
+static void acknowledged(struct sim *s, uint64_t end, void *ctx);
+static void after(struct sim *s, const struct step *st, void *ctx);
+
+struct latency *latency_init(struct sim *s, struct sched *q)
+{
+	struct latency *l = (struct latency *) calloc(1, sizeof(struct latency));
+	if(l == NULL)
+		return NULL;
+
+	l->s = s;
+	l->q = q;
+	step_init(&l->steps, s);
+	const struct step_observer o = {.unobserved = &unobserved, .acknowledged = &acknowledged,
+		.after = &after, .ctx = l};
+	step_observe(&l->steps, &o);
+	sched_set_runner(q, &step_runner, &l->steps);
+	return l;
+}
+
+void latency_destroy(struct latency *l)
+{
+	free(l);
+}
+
+static void assertion(struct sim *s, void *ctx)
+{
+	struct latency *l = (struct latency *) ctx;
+	l->counts.asserted += 1;
+
+	if(l->pending)
+		l->counts.merged += 1;
+	else {
+		s->irq = true;
+		l->pending = true;
+		l->current.asserted = l->next;
+		l->current.pc = s->pc;
+		l->current.enabled = false;
+		l->current.len = 0;
+	}
+
+	l->next += l->random? l->min + (xorshift_next(&l->state) >> 1) % (l->max - l->min + 1) : l->period;
+	if(!sched_call(l->q, l->next, &assertion, l))
+		sim_stop(s);
+}
+
+bool latency_periodic(struct latency *l, uint64_t first, uint64_t period)
+{
+	l->random = false;
+	l->period = period > 0? period : 1;
+	l->next = first;
+	return sched_call(l->q, first, &assertion, l);
+}
+
+bool latency_random(struct latency *l, uint64_t first, uint64_t min, uint64_t max, uint64_t seed)
+{
+	l->random = true;
+	l->min = min > 0? min : 1;
+	l->max = max > l->min? max : l->min;
+	l->state = seed * 2654435761ULL + 1;
+	l->next = first;
+	return sched_call(l->q, first, &assertion, l);
+}
+
+static void add(struct histogram *h, uint64_t cycles)
+{
+	if(cycles < LATENCY_EXACT)
+		h->exact[cycles] += 1;
+	else {
+		int bit = 63;
+		while(!(cycles >> bit))
+			bit -= 1;
+		h->log[bit] += 1;
+	}
+	h->count += 1;
+	if(cycles > h->max)
+		h->max = cycles;
+}
+
+/**
+ * The first instruction of the handler starts at the cycle.
+ */
+static void enter(struct latency *l, uint64_t start)
+{
+	const uint64_t cycles = start - l->current.asserted;
+	add(&l->hist[LATENCY_ENTRY], cycles);
+	l->counts.entered += 1;
+	l->pending = false;
+
+	if(!l->any || cycles > l->worst.cycles) {
+		l->current.cycles = cycles;
+		l->worst = l->current;
+		l->any = true;
+	}
+	if(l->depth < SIM_STACK)
+		l->service[l->depth++] = l->current.asserted;
+}
+
+/**
+ * RETURNI ended at the cycle.
+ */
+static void leave(struct latency *l, uint64_t end)
+{
+	if(l->depth == 0)
+		return;	// not an interrupt of the schedule
+
+	l->depth -= 1;
+	add(&l->hist[LATENCY_RETURN], end - l->service[l->depth]);
+	l->counts.returned += 1;
+}
+
+/**
+ * Runs freely without an interrupt pending or in service,
+ * otherwise by single instructions.
+ */
+static uint64_t unobserved(struct sim *s, void *ctx)
+{
+	(void) s;
+	const struct latency *l = (const struct latency *) ctx;
+	return !l->pending && l->depth == 0? UINT64_MAX : 0;
+}
+
+/**
+ * The scheduler acknowledged it after the last run.
+ */
+static void acknowledged(struct sim *s, uint64_t end, void *ctx)
+{
+	(void) end;
+	struct latency *l = (struct latency *) ctx;
+	if(l->pending)
+		enter(l, s->cycles);
+}
+
+static void after(struct sim *s, const struct step *st, void *ctx)
+{
+	struct latency *l = (struct latency *) ctx;
+
+	if(st->ack)
+		enter(l, st->begin);
+	else if(l->pending) {
+		struct latency_worst *w = &l->current;
+		if(w->len < LATENCY_BLOCKED) {
+			w->steps[w->len].pc = st->address;
+			w->steps[w->len].cycles = s->cycles - st->cycle;
+			w->len += 1;
+		}
+		if(!st->ie && s->ie) {
+			w->released = st->address;
+			w->enabled = true;
+		}
+	}
+
+	const uint8_t op = s->rom[st->address].op;
+	if(op == S_RETURNI_ENABLE || op == S_RETURNI_DISABLE)
+		leave(l, s->cycles);
+}
+
+const struct latency_counts *latency_counts(const struct latency *l)
+{
+	return &l->counts;
+}
+
+uint64_t latency_percentile(const struct latency *l, enum latency_kind kind, double fraction)
+{
+	const struct histogram *h = &l->hist[kind];
+	if(h->count == 0)
+		return 0;
+
+	// the smallest latency of at least the fraction of the interrupts
+	uint64_t need = (uint64_t) (fraction * h->count + 0.999999);
+	if(need == 0)
+		need = 1;
+	if(need > h->count)
+		need = h->count;
+
+	uint64_t sum = 0;
+	for(uint64_t i = 0; i < LATENCY_EXACT; i++) {
+		sum += h->exact[i];
+		if(sum >= need)
+			return i;
+	}
+	for(int bit = 0; bit < LOG_BUCKETS; bit++) {
+		sum += h->log[bit];
+		if(sum >= need) {
+			const uint64_t to = bit == 63? UINT64_MAX : ((uint64_t) 2 << bit) - 1;
+			return to < h->max? to : h->max;
+		}
+	}
+	return h->max;
+}
+
+uint64_t latency_max(const struct latency *l, enum latency_kind kind)
+{
+	return l->hist[kind].max;
+}
+
+const struct latency_worst *latency_worst(const struct latency *l)
+{
+	return l->any? &l->worst : NULL;
+}
+
+void latency_histogram(const struct latency *l, enum latency_kind kind, FILE *f)
+{
+	const struct histogram *h = &l->hist[kind];
+	uint64_t sum = 0;
+
+	// buckets 0, 1, 2-3, 4-7, ...
+	for(int bit = -1; bit < LOG_BUCKETS - 1 && sum < h->count; bit++) {
+		const uint64_t from = bit < 0? 0 : (uint64_t) 1 << bit;
+		const uint64_t to = bit < 0? 0 : ((uint64_t) 2 << bit) - 1;
+		uint64_t count = 0;
+		if(from >= LATENCY_EXACT)
+			count = h->log[bit];
+		else {
+			for(uint64_t i = from; i <= to && i < LATENCY_EXACT; i++)
+				count += h->exact[i];
+		}
+
+		sum += count;
+		if(count > 0)
+			fprintf(f, "%8llu-%-8llu %10llu %6.2f%%\n", (unsigned long long) from,
+					(unsigned long long) to, (unsigned long long) count, 100.0 * sum / h->count);
+	}
+}
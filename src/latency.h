@@ -0,0 +1,128 @@
+/**
+ * latency.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include "sim.h"
+#include "scheduler.h"
+#include "step.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Interrupt latency under a periodic or random schedule of interrupts.
+ * For each interrupt it measures the cycles from the assertion to the
+ * start of the first instruction of the handler (entry) and to the end
+ * of its RETURNI (return). The interrupt stays asserted until it is
+ * acknowledged, an assertion while it is still pending is merged with it.
+ *
+ * The program runs freely while no interrupt is pending or in service,
+ * otherwise by single instructions (see step.h), and the cycles
+ * of the instructions executed while the interrupt was pending are
+ * recorded for the worst entry latency: they show the regions with
+ * the interrupts disabled (or the handler of the previous interrupt)
+ * that blocked it.
+ *
+ * Latencies below LATENCY_EXACT cycles are counted exactly, the longer
+ * ones in buckets of powers of 2.
+ */
+
+#define LATENCY_EXACT 4096
+#define LATENCY_BLOCKED 4096	// instructions recorded for the worst case
+
+enum latency_kind {
+	LATENCY_ENTRY,
+	LATENCY_RETURN,
+	LATENCY_KINDS
+};
+
+struct latency_counts {
+	uint64_t asserted;
+	uint64_t merged;	// while the previous one was pending
+	uint64_t entered;
+	uint64_t returned;
+};
+
+/**
+ * The instruction executed while the worst interrupt was pending.
+ */
+struct latency_step {
+	uint16_t pc;
+	uint8_t cycles;
+};
+
+struct latency_worst {
+	uint64_t asserted;	// cycle
+	uint64_t cycles;	// entry latency
+	uint16_t pc;	// of the instruction running at the assertion
+	uint16_t released;	// the instruction that enabled the interrupt
+	bool enabled;	// released is valid (ENABLE INTERRUPT or RETURNI ENABLE)
+	size_t len;
+	struct latency_step steps[LATENCY_BLOCKED];	// the first ones
+};
+
+struct latency;
+
+/**
+ * Measures the simulation run by the scheduler, sets its runner.
+ * @return NULL on allocation error
+ */
+struct latency *latency_init(struct sim *s, struct sched *q);
+
+void latency_destroy(struct latency *l);
+
+/**
+ * Asserts the interrupt at the first cycle and then every period.
+ * @return false on allocation error
+ */
+bool latency_periodic(struct latency *l, uint64_t first, uint64_t period);
+
+/**
+ * Asserts the interrupt at the first cycle and then after uniformly
+ * random gaps from min to max cycles.
+ * @return false on allocation error
+ */
+bool latency_random(struct latency *l, uint64_t first, uint64_t min, uint64_t max, uint64_t seed);
+
+const struct latency_counts *latency_counts(const struct latency *l);
+
+/**
+ * Latency not exceeded by the fraction (0 to 1) of the interrupts,
+ * it is the upper bound of the bucket above LATENCY_EXACT.
+ */
+uint64_t latency_percentile(const struct latency *l, enum latency_kind kind, double fraction);
+
+uint64_t latency_max(const struct latency *l, enum latency_kind kind);
+
+/**
+ * The interrupt with the longest entry latency.
+ * @return NULL when none entered the handler
+ */
+const struct latency_worst *latency_worst(const struct latency *l);
+
+/**
+ * Prints the histogram: <from>-<to> <count> <cumulative %>,
+ * the cycles of the buckets are powers of 2.
+ */
+void latency_histogram(const struct latency *l, enum latency_kind kind, FILE *f);
+
+#endif
@@ -23,6 +23,11 @@
 #include "stab.h"
 #include "output.h"
 #include "assembler.h"
+#include "isa.h"
+#include "xref.h"
+#include "emitc.h"
+#include <ctype.h>
+#include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <getopt.h>
@@ -31,7 +36,7 @@
 #define AUTHOR "Jan Viktorin"
 #define YEAR "2010"
 #define VERSION "0.1"
-#define USAGE "[-i<srcfile>] [-o<hexfile>] [-l<listing>] [-qh]"
+#define USAGE "[-i<srcfile>] [-o<hexfile>] [-l<listing>] [-x<xref>] [-c<cfile>] [-t<target>] [-qh]"
 
 static void help(char *pname)
 {
@@ -43,6 +48,9 @@ static void help(char *pname)
 	printf(	"\t-i<srcfile> Source file\n"
 				"\t-o<hexfile> Output file, contains instructions in HEX form\n"
 				"\t-l<listing> Listing file\n"
+				"\t-x<xref>    Cross-reference index of symbols\n"
+				"\t-c<cfile>   Translates the program to C (kcpsm3 only)\n"
+				"\t-t<target>  Target processor: kcpsm3 (default) or kcpsm6\n"
 				"\t-q          Quite mode, no output messages\n"
 				"\t-h          Prints this help\n");
 	printf("This program is under GNU GPL license, please see www.gnu.org\n");
@@ -82,15 +90,110 @@ static void stab_listing(struct pico *p, char *listing)
 	fclose(f);
 }
 
+static void stab_xref_visit(struct stab_data *data, void *op)
+{
+	FILE *f = (FILE *) op;
+	if(data->xref == NULL)
+		return;
+
+	enum literal_type lit = data->lit;
+	for(size_t i = 0; i < data->xref->len; i++) {
+		if(data->xref->site[i].kind == X_RENAME)
+			lit = L_REGISTER;
+	}
+
+	char value[8] = "-";
+	const char *kind = "UNKNOWN";
+	switch(lit) {
+	case L_CONSTANT:
+		kind = "CONSTANT";
+		snprintf(value, sizeof(value), "%.2X", data->value.n);
+		break;
+	case L_LABEL:
+		kind = "LABEL";
+		snprintf(value, sizeof(value), "%.3X", data->value.a);
+		break;
+	case L_REGISTER:
+		kind = "REGISTER";
+		snprintf(value, sizeof(value), "s%X", data->value.reg);
+		break;
+	default:
+		break;
+	}
+
+	for(size_t i = 0; i < data->xref->len; i++) {
+		const struct xref_site *site = &data->xref->site[i];
+		fprintf(f, "%s\t%s\t%s\t%c\t%d\t%.3X\n", data->key, kind, value,
+				site->kind, site->lineno, site->addr);
+	}
+}
+
+static void stab_xref(struct pico *p, char *xref)
+{
+	if(xref == NULL)
+		return;
+
+	FILE *f = fopen(xref, "w");
+	if(f == NULL) {
+		error(p, "Can not open the cross-reference file");
+		return;
+	}
+
+	fprintf(f, "# Machine generated cross-reference index\n");
+	fprintf(f, "# Format: <name> <kind> <value> <site> <line> <address>\n");
+	fprintf(f, "# <site> is D (definition), U (use) or R (renamed by NAMEREG)\n");
+	stab_visit(p->stab, &stab_xref_visit, (void *) f);
+	fclose(f);
+}
+
+/**
+ * Writes the program as a C function named by the file, eg. prog.c
+ * defines prog_run.
+ */
+static bool emit_c(struct pico *p, char *cfile)
+{
+	if(cfile == NULL)
+		return true;
+
+	if(p->isa != isa_find("kcpsm3"))
+		return error(p, "Translation to C supports kcpsm3 only");
+
+	const char *base = strrchr(cfile, '/');
+	base = base == NULL? cfile : base + 1;
+
+	char func[64];
+	size_t len = 0;
+	if(!isalpha((unsigned char) *base))
+		func[len++] = '_';
+	for(; *base != '\0' && *base != '.' && len < sizeof(func) - 5; base++)
+		func[len++] = isalnum((unsigned char) *base)? *base : '_';
+	strcpy(func + len, "_run");
+
+	FILE *f = fopen(cfile, "w");
+	if(f == NULL)
+		return error(p, "Can not open the C file");
+
+	progaddr_t codelen;
+	const code_t *code = output_image(p, &codelen);
+	bool result = emitc_write(f, code, codelen, func);
+	if(fclose(f) != 0 || !result)
+		return error(p, "Can not write the C file");
+
+	return true;
+}
+
 int main(int argc, char *argv[argc])
 {
 	char *srcfile = NULL;
 	char *dstfile = NULL;
 	char *listing = NULL;
+	char *xref = NULL;
+	char *cfile = NULL;
+	const struct isa *isa = isa_default();
 	
 	opterr = 0;
 	int opt;
-	while((opt = getopt(argc, argv, "qhi:o:l:")) != -1) {
+	while((opt = getopt(argc, argv, "qhi:o:l:x:c:t:")) != -1) {
 		switch(opt) {
 		case 'q':
 			fclose(stderr);
@@ -107,6 +210,19 @@ int main(int argc, char *argv[argc])
 		case 'l':
 			listing = optarg;
 			break;
+		case 'x':
+			xref = optarg;
+			break;
+		case 'c':
+			cfile = optarg;
+			break;
+		case 't':
+			isa = isa_find(optarg);
+			if(isa == NULL) {
+				fprintf(stderr, "Unknown target '%s'\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		case '?':
 			return EXIT_FAILURE;
 		}
@@ -114,13 +230,13 @@ int main(int argc, char *argv[argc])
 
 	struct token tok = {.type = T_UNKNOWN, .lineno = -1};
 	struct pico p = {.tok = &tok, .stab = NULL, .address = 0,
-		.buff = NULL, .offset = NULL, .lineno = 1};
+		.buff = NULL, .offset = NULL, .lineno = 1, .xref = xref != NULL};
 
 	p.stab = stab_init();
 	if(p.stab == NULL)
 		return EXIT_FAILURE;
 	
-	if(!kcpsm3_setup(&p)) {
+	if(!assembler_setup(&p, isa)) {
 		stab_destroy(p.stab);
 		return EXIT_FAILURE;
 	}
@@ -130,7 +246,10 @@ int main(int argc, char *argv[argc])
 		return EXIT_FAILURE;
 	}
 
-	if(!output_init(&p, dstfile)) {
+	// only the C file is written when no HEX file is given
+	bool output = dstfile == NULL && cfile != NULL?
+			output_init_memory(&p) : output_init(&p, dstfile);
+	if(!output) {
 		stab_destroy(p.stab);
 		buffer_destroy(&p);
 		return EXIT_FAILURE;
@@ -138,12 +257,14 @@ int main(int argc, char *argv[argc])
 
 	int result = EXIT_FAILURE;
 	if(assembler_run(&p)) {
-		result = EXIT_SUCCESS;
 		output_flush(&p);
+		if(emit_c(&p, cfile))
+			result = EXIT_SUCCESS;
 	}
 
 	buffer_destroy(&p);
 	stab_listing(&p, listing);
+	stab_xref(&p, xref);
 	stab_destroy(p.stab);
 	output_destroy(&p);
 	return result;
@@ -20,6 +20,7 @@
 #include "pico.h"
 #include "output.h"
 #include "assembler.h"
+#include "isa.h"
 #include "stab.h"
 #include <string.h>
 #include <stdio.h>
@@ -27,9 +28,29 @@
 
 struct output {
 	FILE *file;
-	code_t code[PROGRAM_LEN];
+	progaddr_t len;
+	int *line;	// follows the code
+	code_t code[];
 };
 
+static bool output_alloc(struct pico *p, FILE *out)
+{
+	const progaddr_t len = p->isa->program_len;
+	struct output *ins = (struct output *) 
+			calloc(1, sizeof(struct output) + len * (sizeof(code_t) + sizeof(int)));
+	if(ins == NULL) {
+		if(out != NULL)
+			fclose(out);
+		return error(NULL, "Memory allocation error");
+	}
+
+	ins->file = out;
+	ins->len = len;
+	ins->line = (int *) (ins->code + len);
+	p->output = ins;
+	return true;
+}
+
 bool output_init(struct pico *p, char *filename)
 {
 	FILE *out = stdout;
@@ -40,15 +61,12 @@ bool output_init(struct pico *p, char *filename)
 			return error(NULL, "Can not open the output file");
 	}
 
-	struct output *ins = (struct output *) calloc(1, sizeof(struct output));
-	if(ins == NULL) {
-		fclose(out);
-		return error(NULL, "Memory allocation error");
-	}
+	return output_alloc(p, out);
+}
 
-	ins->file = out;
-	p->output = ins;
-	return true;
+bool output_init_memory(struct pico *p)
+{
+	return output_alloc(p, NULL);
 }
 
 void output_destroy(struct pico *p)
@@ -66,8 +84,12 @@ void output_destroy(struct pico *p)
 bool output_code(struct pico *p, progaddr_t address, code_t ins)
 {
 	debug_here();
-	if(address >= PROGRAM_LEN)
-		return error(p, "Unexpected program address, max 1023");
+	if(address >= p->output->len) {
+		char msg[64];
+		snprintf(msg, sizeof(msg), "Unexpected program address, max %u",
+				p->output->len - 1);
+		return error(p, msg);
+	}
 
 	p->output->code[address] = ins;
 	return true;
@@ -76,9 +98,28 @@ bool output_code(struct pico *p, progaddr_t address, code_t ins)
 void output_flush(struct pico *p)
 {
 	debug_here();
-	for(int i = 0; i < PROGRAM_LEN; i++) {
+	if(p->output->file == NULL)
+		return;
+
+	for(progaddr_t i = 0; i < p->output->len; i++) {
 		fprintf(p->output->file, "%.5X\n", p->output->code[i]);
 	}
 }
 
+const code_t *output_image(struct pico *p, progaddr_t *len)
+{
+	if(len != NULL)
+		*len = p->output->len;
+	return p->output->code;
+}
 
+void output_line(struct pico *p, progaddr_t address, int lineno)
+{
+	if(address < p->output->len)
+		p->output->line[address] = lineno;
+}
+
+const int *output_lines(struct pico *p)
+{
+	return p->output->line;
+}
@@ -38,5 +38,21 @@ bool output_code(struct pico *p, progaddr_t address, code_t ins);
  */
 void output_flush(struct pico *p);
 
+/**
+ * Assembled program, one instruction per program address.
+ * @param len length of the program (may be NULL)
+ */
+const code_t *output_image(struct pico *p, progaddr_t *len);
+
+/**
+ * Records the source line of the instruction at the address.
+ */
+void output_line(struct pico *p, progaddr_t address, int lineno);
+
+/**
+ * Source lines of the instructions of output_image, 0 where none.
+ */
+const int *output_lines(struct pico *p);
+
 #endif
 
@@ -0,0 +1,49 @@
+/**
+ * path.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "path.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+void path_dir(char *dir, size_t size, const char *file)
+{
+	snprintf(dir, size, "%s", file);
+	char *slash = strrchr(dir, '/');
+	if(slash == dir)
+		dir[1] = '\0';
+	else if(slash != NULL)
+		*slash = '\0';
+	else
+		dir[0] = '\0';
+}
+
+char *path_resolve(const char *dir, const char *path)
+{
+	const size_t len = strlen(dir) + strlen(path) + 2;
+	char *full = (char *) malloc(len);
+	if(full == NULL)
+		return NULL;
+
+	if(path[0] == '/' || dir[0] == '\0')
+		snprintf(full, len, "%s", path);
+	else
+		snprintf(full, len, "%s/%s", dir, path);
+	return full;
+}
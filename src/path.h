@@ -0,0 +1,41 @@
+/**
+ * path.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _PATH_H
+#define _PATH_H
+
+#include <stddef.h>
+
+/**
+ * Paths of the files listed in a file (the manifest of picorun, the system
+ * of picosys) are relative to the directory of that file.
+ */
+
+/**
+ * Writes the directory of the file to dir, "" for the current directory.
+ */
+void path_dir(char *dir, size_t size, const char *file);
+
+/**
+ * Joins the path with the directory, an absolute path is kept.
+ * @return NULL on allocation error, otherwise to be freed
+ */
+char *path_resolve(const char *dir, const char *path);
+
+#endif
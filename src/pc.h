@@ -30,3 +30,9 @@ bool buffer_init(struct pico *p, char *srcfile);
  */
 bool output_init(struct pico *p, char *filename);
 
+/**
+ * Initialization of the output module without any output file.
+ * The result is available by output_image only.
+ */
+bool output_init_memory(struct pico *p);
+
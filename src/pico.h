@@ -26,21 +26,25 @@
 struct token;
 struct buffer;
 struct output;
+struct isa;
 
 typedef unsigned int number_t;
 typedef unsigned int progaddr_t;
 typedef unsigned int code_t;
 
-#define PROGRAM_LEN 1024
-
 struct pico {
 	struct token *tok;
+	// pushedback token
+	struct token *pushback;
 	struct buffer *buff;
 	struct stab *stab;
 	struct output *output;
+	const struct isa *isa;
 	char *offset;
 	int lineno;
 	progaddr_t address;
+	// record sites of symbols for the cross-reference index
+	bool xref;
 };
 
 /**
@@ -0,0 +1,230 @@
+/**
+ * picocov.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pc.h"
+#include "sim.h"
+#include "source.h"
+#include "coverage.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico Coverage"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-a<srcfile>] [-o<merged>] [-qh] <coverage|@list>..."
+
+#define LINE_MAX_LEN 256
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-a<srcfile>      Source of the program, reports its uncovered lines\n"
+				"\t-o<merged>       Writes the merged coverage\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n");
+	printf("Merges the coverage files written by 'picosim -c' or 'picorun -c',\n"
+			"@list is a file with one coverage file per line.\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+bool error(struct pico *p, char *msg)
+{
+	if(p != NULL)
+		fprintf(stderr, "[l.%d] %s\n", p->lineno, msg);
+	else
+		fprintf(stderr, "%s\n", msg);
+	return false;
+}
+
+struct merged {
+	struct sim_coverage cov;
+	uint32_t checksum;
+	size_t files;
+};
+
+static bool merge_file(struct merged *m, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if(f == NULL) {
+		fprintf(stderr, "%s: Can not open the coverage\n", path);
+		return false;
+	}
+
+	struct sim_coverage cov;
+	uint32_t checksum;
+	const bool read = coverage_read(f, &cov, &checksum);
+	fclose(f);
+
+	if(!read) {
+		fprintf(stderr, "%s: Invalid coverage\n", path);
+		return false;
+	}
+	if(m->files > 0 && checksum != m->checksum) {
+		fprintf(stderr, "%s: Coverage of another program\n", path);
+		return false;
+	}
+
+	coverage_merge(&m->cov, &cov);
+	m->checksum = checksum;
+	m->files += 1;
+	return true;
+}
+
+static bool merge_list(struct merged *m, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL) {
+		fprintf(stderr, "%s: Can not open the list\n", path);
+		return false;
+	}
+
+	char line[LINE_MAX_LEN * 4];
+	bool result = true;
+	while(result && fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if(line[0] != '\0' && line[0] != '#')
+			result = merge_file(m, line);
+	}
+
+	fclose(f);
+	return result;
+}
+
+/**
+ * Prints the lines of instructions that were not executed and of
+ * branches that went only one way.
+ */
+static bool report(const struct merged *m, char *srcfile, bool quiet)
+{
+	struct sim *s = (struct sim *) calloc(1, sizeof(struct sim));
+	int lines[SIM_PROGRAM_LEN] = {0};
+	if(s == NULL)
+		return error(NULL, "Memory allocation error");
+	if(!source_assemble(s, lines, srcfile)) {
+		free(s);
+		return false;
+	}
+	if(m->checksum != s->checksum) {
+		free(s);
+		return error(NULL, "The coverage is of another program");
+	}
+
+	const char *msg[SIM_PROGRAM_LEN] = {NULL};
+	unsigned instrs = 0, executed = 0, branches = 0, directions = 0;
+
+	for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+		if(lines[i] == 0)
+			continue;
+
+		const bool exec = coverage_test(m->cov.executed, i);
+		const bool taken = coverage_test(m->cov.taken, i);
+		const bool not_taken = coverage_test(m->cov.not_taken, i);
+		instrs += 1;
+		executed += exec;
+
+		const char *what = exec? NULL : "never executed";
+		if(coverage_branch(&s->rom[i])) {
+			branches += 1;
+			directions += taken + not_taken;
+			if(exec && !taken)
+				what = "never taken";
+			else if(exec && !not_taken)
+				what = "always taken";
+		}
+
+		msg[i] = what;
+	}
+	free(s);
+
+	if(!source_print(msg, lines, srcfile))
+		return false;
+
+	if(!quiet)
+		fprintf(stderr, "Instructions: %u of %u executed (%.1f%%), "
+				"branches: %u of %u directions (%.1f%%), %zu files\n",
+				executed, instrs, instrs? 100.0 * executed / instrs : 0,
+				directions, 2 * branches, branches? 50.0 * directions / branches : 0,
+				m->files);
+	return true;
+}
+
+int main(int argc, char *argv[argc])
+{
+	char *srcfile = NULL;
+	char *merged_file = NULL;
+	bool quiet = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "qha:o:")) != -1) {
+		switch(opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'a':
+			srcfile = optarg;
+			break;
+		case 'o':
+			merged_file = optarg;
+			break;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(optind == argc) {
+		fprintf(stderr, "Give the coverage files\n");
+		return EXIT_FAILURE;
+	}
+
+	struct merged m;
+	memset(&m, 0, sizeof(m));
+	for(int i = optind; i < argc; i++) {
+		const bool merged = argv[i][0] == '@'?
+			merge_list(&m, argv[i] + 1) : merge_file(&m, argv[i]);
+		if(!merged)
+			return EXIT_FAILURE;
+	}
+
+	if(merged_file != NULL) {
+		FILE *f = fopen(merged_file, "wb");
+		if(f == NULL || !coverage_write(f, &m.cov, m.checksum) || fclose(f) != 0) {
+			fprintf(stderr, "%s: Can not write the coverage\n", merged_file);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(srcfile != NULL)
+		return report(&m, srcfile, quiet)? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if(!quiet)
+		fprintf(stderr, "Addresses: %u executed, branches: %u taken, %u not taken, %zu files\n",
+				coverage_count(m.cov.executed), coverage_count(m.cov.taken),
+				coverage_count(m.cov.not_taken), m.files);
+	return EXIT_SUCCESS;
+}
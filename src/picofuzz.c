@@ -0,0 +1,354 @@
+/**
+ * picofuzz.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+/**
+ * Fuzzes the firmware by the values read by INPUT (see fuzz.h). Every new
+ * crash is printed as <kind> at <address>: <values>, with -o its case is
+ * written to <dir>/<kind>-<address> to be run again by -r. The seeds are
+ * files of values, one byte each.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pc.h"
+#include "buffer.h"
+#include "scanner.h"
+#include "stab.h"
+#include "output.h"
+#include "assembler.h"
+#include "isa.h"
+#include "sim.h"
+#include "fuzz.h"
+#include "coverage.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico Fuzzer"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-i<hexfile>|-a<srcfile>] [-n<executions>] [-b<budget>] [-m<length>] [-p<port>] " \
+		"[-s<seed>] [-o<dir>] [-c<coverage>] [-r<case>] [-qh] [seed...]"
+
+#define DEFAULT_EXECUTIONS 100000
+#define DEFAULT_BUDGET 100000
+#define DEFAULT_LENGTH 64
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-i<hexfile>      Program assembled by pico, its zero words are taken as not programmed\n"
+				"\t-a<srcfile>      Source file, assembled before fuzzing\n"
+				"\t-n<executions>   Number of cases, default %d\n"
+				"\t-b<budget>       Instructions of the boot and of each case, default %d\n"
+				"\t-m<length>       Values of a case at most, default %d\n"
+				"\t-p<port>         OUTPUT to the port (hexadecimal) is a failed assertion\n"
+				"\t-s<seed>         Seed of the random numbers, default 1\n"
+				"\t-o<dir>          Writes the cases of crashes to <dir>/<kind>-<address>\n"
+				"\t-c<coverage>     Writes the coverage of all cases, see picocov\n"
+				"\t-r<case>         Runs the case once and prints the result\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n", DEFAULT_EXECUTIONS, DEFAULT_BUDGET,
+				DEFAULT_LENGTH);
+	printf("Crashes are stack overflows and underflows, instructions that were not programmed\n"
+			"or are invalid and failed assertions.\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+bool error(struct pico *p, char *msg)
+{
+	if(p != NULL)
+		fprintf(stderr, "[l.%d] %s\n", p->lineno, msg);
+	else
+		fprintf(stderr, "%s\n", msg);
+	return false;
+}
+
+/**
+ * Reads the HEX file produced by pico, the zero words are not programmed.
+ */
+static bool load_hex(struct sim *s, bool *programmed, const char *hexfile)
+{
+	code_t code[SIM_PROGRAM_LEN];
+	progaddr_t len;
+	if(!sim_read_hex(hexfile, code, &len))
+		return error(NULL, "Can not open the program file");
+
+	for(progaddr_t i = 0; i < len; i++)
+		programmed[i] = code[i] != 0;
+	return sim_load(s, code, len);
+}
+
+/**
+ * Assembles the source, the addresses of instructions are programmed.
+ */
+static bool assemble(struct sim *s, bool *programmed, char *srcfile)
+{
+	struct token tok = {.type = T_UNKNOWN, .lineno = -1};
+	struct pico p = {.tok = &tok, .stab = stab_init(), .address = 0,
+		.buff = NULL, .offset = NULL, .lineno = 1};
+	if(p.stab == NULL)
+		return error(NULL, "Memory allocation error");
+
+	bool result = assembler_setup(&p, isa_default())
+			&& buffer_init(&p, srcfile)
+			&& output_init_memory(&p)
+			&& assembler_run(&p);
+
+	if(result) {
+		progaddr_t len;
+		const code_t *code = output_image(&p, &len);
+		const int *lines = output_lines(&p);
+		for(progaddr_t i = 0; i < len; i++)
+			programmed[i] = lines[i] != 0;
+		result = sim_load(s, code, len);
+	}
+
+	buffer_destroy(&p);
+	output_destroy(&p);
+	stab_destroy(p.stab);
+	return result;
+}
+
+/**
+ * Reads a case or a seed.
+ * @return number of values, -1 on error
+ */
+static long read_case(const char *path, uint8_t *data)
+{
+	FILE *f = fopen(path, "rb");
+	if(f == NULL) {
+		fprintf(stderr, "%s: Can not open the case\n", path);
+		return -1;
+	}
+
+	const size_t len = fread(data, 1, FUZZ_INPUT_MAX, f);
+	const bool failed = ferror(f);
+	fclose(f);
+	if(failed) {
+		fprintf(stderr, "%s: Can not read the case\n", path);
+		return -1;
+	}
+	return len;
+}
+
+static void print_result(const struct fuzz_result *r, const uint8_t *data, size_t len)
+{
+	if(r->crash == FUZZ_NONE)
+		printf("no crash");
+	else
+		printf("%s at %.3X", fuzz_crash_name(r->crash), r->pc);
+	if(r->crash == FUZZ_ASSERTION)
+		printf(" (%.2X)", r->value);
+
+	printf(":");
+	for(size_t i = 0; i < len; i++)
+		printf(" %.2X", data[i]);
+	putchar('\n');
+}
+
+struct crashes {
+	const char *dir;
+	unsigned count;
+	bool failed;	// to write a case
+};
+
+static void report(const struct fuzz_result *r, const uint8_t *data, size_t len, void *ctx)
+{
+	struct crashes *c = (struct crashes *) ctx;
+	c->count += 1;
+	print_result(r, data, r->consumed < len? r->consumed : len);
+	fflush(stdout);
+	if(c->dir == NULL)
+		return;
+
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/%s-%.3X", c->dir, fuzz_crash_name(r->crash), r->pc);
+	FILE *f = fopen(path, "wb");
+	if(f == NULL || fwrite(data, 1, len, f) != len) {
+		fprintf(stderr, "%s: Can not write the case\n", path);
+		c->failed = true;
+	}
+	if(f != NULL && fclose(f) != 0)
+		c->failed = true;
+}
+
+static void summary(const struct fuzz *f, const struct sim *s, uint64_t executions,
+		unsigned crashes, double seconds)
+{
+	const struct sim_coverage *cov = fuzz_coverage(f);
+	unsigned branches = 0;
+	for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+		if(coverage_branch(&s->rom[i]))
+			branches += 1;
+	}
+
+	fprintf(stderr, "Executions: %llu", (unsigned long long) executions);
+	if(seconds > 0)
+		fprintf(stderr, ", %.0f per second", executions / seconds);
+	fprintf(stderr, ", corpus: %zu, crashes: %u\n", fuzz_corpus(f), crashes);
+	fprintf(stderr, "Executed addresses: %u, branches taken: %u, not taken: %u of %u\n",
+			coverage_count(cov->executed), coverage_count(cov->taken),
+			coverage_count(cov->not_taken), branches);
+}
+
+int main(int argc, char *argv[argc])
+{
+	char *hexfile = NULL;
+	char *srcfile = NULL;
+	char *replay = NULL;
+	char *coverage_file = NULL;
+	unsigned long long executions = DEFAULT_EXECUTIONS;
+	unsigned long long budget = DEFAULT_BUDGET;
+	unsigned long length = DEFAULT_LENGTH;
+	unsigned long seed = 1;
+	int assertion = -1;
+	struct crashes crashes = {.dir = NULL, .count = 0, .failed = false};
+	bool quiet = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "qhi:a:n:b:m:p:s:o:c:r:")) != -1) {
+		switch(opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'i':
+			hexfile = optarg;
+			break;
+		case 'a':
+			srcfile = optarg;
+			break;
+		case 'n':
+			executions = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			budget = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			length = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			assertion = strtol(optarg, NULL, 16) & 0xFF;
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			crashes.dir = optarg;
+			break;
+		case 'c':
+			coverage_file = optarg;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if((hexfile == NULL) == (srcfile == NULL)) {
+		fprintf(stderr, "Give either a program file (-i) or a source file (-a)\n");
+		return EXIT_FAILURE;
+	}
+	if(length > FUZZ_INPUT_MAX) {
+		fprintf(stderr, "The cases have at most %d values\n", FUZZ_INPUT_MAX);
+		return EXIT_FAILURE;
+	}
+
+	struct sim *s = (struct sim *) calloc(1, sizeof(struct sim));
+	bool programmed[SIM_PROGRAM_LEN] = {false};
+	if(s == NULL)
+		return EXIT_FAILURE;
+	if(!(hexfile != NULL? load_hex(s, programmed, hexfile) : assemble(s, programmed, srcfile))) {
+		free(s);
+		return EXIT_FAILURE;
+	}
+
+	struct fuzz *f = fuzz_init(s->code, SIM_PROGRAM_LEN, programmed, budget, assertion, seed);
+	if(f == NULL || !fuzz_boot(f)) {
+		error(NULL, f == NULL? "Memory allocation error"
+				: "The program did not reach INPUT or crashed while booting");
+		fuzz_destroy(f);
+		free(s);
+		return EXIT_FAILURE;
+	}
+
+	static uint8_t data[FUZZ_INPUT_MAX];
+	int result = EXIT_SUCCESS;
+
+	if(replay != NULL) {
+		const long len = read_case(replay, data);
+		struct fuzz_result r;
+		if(len >= 0) {
+			fuzz_execute(f, data, len, &r);
+			print_result(&r, data, len);
+			if(!quiet)
+				fprintf(stderr, "Values read: %zu, instructions: %llu\n", r.consumed,
+						(unsigned long long) r.instructions);
+		}
+		result = len < 0 || r.crash != FUZZ_NONE? EXIT_FAILURE : EXIT_SUCCESS;
+		fuzz_destroy(f);
+		free(s);
+		return result;
+	}
+
+	for(int i = optind; i < argc && result == EXIT_SUCCESS; i++) {
+		const long len = read_case(argv[i], data);
+		if(len < 0 || !fuzz_add(f, data, len))
+			result = EXIT_FAILURE;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if(result == EXIT_SUCCESS && !fuzz_run(f, executions, length, &report, &crashes)) {
+		error(NULL, "Memory allocation error");
+		result = EXIT_FAILURE;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if(!quiet)
+		summary(f, s, executions, crashes.count, (end.tv_sec - start.tv_sec)
+				+ (end.tv_nsec - start.tv_nsec) / 1e9);
+
+	if(coverage_file != NULL) {
+		FILE *out = fopen(coverage_file, "wb");
+		bool written = out != NULL && coverage_write(out, fuzz_coverage(f), s->checksum);
+		if(out != NULL && fclose(out) != 0)
+			written = false;
+		if(!written) {
+			error(NULL, "Can not write the coverage");
+			result = EXIT_FAILURE;
+		}
+	}
+	if(crashes.failed)
+		result = EXIT_FAILURE;
+
+	fuzz_destroy(f);
+	free(s);
+	return result;
+}
@@ -0,0 +1,202 @@
+/**
+ * picohdl.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+/**
+ * Stand-in for the HDL testbench of the co-simulation, it drives the model
+ * by the shim (cosim_shim.h) like a testbench would do. The stimulus has
+ * the format of the events of picosim -e, so the outputs can be compared
+ * with those of picosim.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cosim_shim.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico HDL Stand-in"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-x<name>] [-n<cycles>] [-s<step>] [-vqh] <events>"
+
+#define DEFAULT_NAME "/picocosim"
+#define DEFAULT_CYCLES 2000000
+#define LINE_MAX_LEN 128
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-x<name>         Name of the shared memory, default %s\n"
+				"\t-n<cycles>       Cycles to simulate, default %d\n"
+				"\t-s<step>         Advances by at most step cycles like a clocked testbench,\n"
+				"\t                 default only to the events\n"
+				"\t-v               Prints also the interrupt acknowledges\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n", DEFAULT_NAME, DEFAULT_CYCLES);
+	printf("Start 'picosim -i prog.hex -x <name>' as the model. Lines of the events:\n"
+			"<cycle> irq <0|1>, <cycle> in <port> <value> or <cycle> stop (hexadecimal\n"
+			"port and value). Values written by OUTPUT are printed like by picosim.\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+/**
+ * Prints the events of the last advance.
+ */
+static void print_events(bool verbose)
+{
+	int type, port, value;
+	long long cycle;
+
+	while(pico_cosim_event(&type, &port, &value, &cycle)) {
+		if(type == COSIM_OUTPUT)
+			printf("%llu %.2X %.2X\n", (unsigned long long) cycle, port, value);
+		else if(type == COSIM_ACK && verbose)
+			printf("%llu ack\n", (unsigned long long) cycle);
+	}
+}
+
+/**
+ * Advances the model in steps to the cycle.
+ * @return false when the model ended
+ */
+static bool advance(long long *now, long long cycle, long long step, bool verbose)
+{
+	while(*now < cycle) {
+		const long long next = step > 0 && cycle - *now > step? *now + step : cycle;
+		if(pico_cosim_advance(next) < 0)
+			return false;
+		print_events(verbose);
+		*now = next;
+	}
+
+	return true;
+}
+
+/**
+ * Applies the event of the line.
+ * @return false on an invalid line or when the model ended
+ */
+static bool apply(char *line, long long *now, long long step, bool verbose, bool *stop)
+{
+	unsigned long long cycle;
+	char kind[8];
+	unsigned port, value;
+	int len = 0;
+
+	if(sscanf(line, "%llu %7s %n", &cycle, kind, &len) != 2 || (long long) cycle < *now) {
+		fprintf(stderr, "Invalid or unsorted event: %s", line);
+		return false;
+	}
+	if(!advance(now, cycle, step, verbose))
+		return false;
+
+	if(!strcmp(kind, "irq") && sscanf(line + len, "%x", &value) == 1)
+		return pico_cosim_interrupt(value) == 0;
+	if(!strcmp(kind, "in") && sscanf(line + len, "%x %x", &port, &value) == 2)
+		return pico_cosim_input(port & 0xFF, value & 0xFF) == 0;
+	if(!strcmp(kind, "stop")) {
+		*stop = true;
+		return true;
+	}
+
+	fprintf(stderr, "Invalid event: %s", line);
+	return false;
+}
+
+int main(int argc, char *argv[argc])
+{
+	char *name = DEFAULT_NAME;
+	long long cycles = DEFAULT_CYCLES;
+	long long step = 0;
+	bool verbose = false;
+	bool quiet = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "vqhx:n:s:")) != -1) {
+		switch(opt) {
+		case 'x':
+			name = optarg;
+			break;
+		case 'n':
+			cycles = atoll(optarg);
+			break;
+		case 's':
+			step = atoll(optarg);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(optind + 1 != argc) {
+		fprintf(stderr, "Give the events\n");
+		return EXIT_FAILURE;
+	}
+
+	FILE *f = fopen(argv[optind], "r");
+	if(f == NULL) {
+		fprintf(stderr, "Can not open the events\n");
+		return EXIT_FAILURE;
+	}
+	if(pico_cosim_open(name) != 0) {
+		fprintf(stderr, "Can not create the shared memory '%s'\n", name);
+		fclose(f);
+		return EXIT_FAILURE;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	char line[LINE_MAX_LEN];
+	long long now = 0;
+	bool stop = false;
+	bool ok = true;
+	while(ok && !stop && fgets(line, sizeof(line), f) != NULL) {
+		if(line[0] != '#' && line[strspn(line, " \t\r\n")] != '\0')
+			ok = apply(line, &now, step, verbose, &stop);
+	}
+	if(ok && !stop)
+		ok = advance(&now, cycles, step, verbose);
+	fclose(f);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if(!ok)
+		fprintf(stderr, "The model ended\n");
+	else if(!quiet)
+		fprintf(stderr, "Cycles: %lld, status %d, %.3f s\n", now, pico_cosim_status(), seconds);
+
+	pico_cosim_close();
+	return ok? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,323 @@
+/**
+ * picoirq.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+/**
+ * Measures the interrupt latency of the program under a stress schedule
+ * of interrupts (see latency.h). Prints the percentiles, the histograms
+ * and the instructions that delayed the worst interrupt, by the lines
+ * of the source with -a.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pc.h"
+#include "sim.h"
+#include "source.h"
+#include "ports.h"
+#include "scheduler.h"
+#include "latency.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico Interrupt Latency"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-i<hexfile>|-a<srcfile>] [-n<cycles>] [-p<period>|-r<min>:<max>] [-f<first>] " \
+		"[-s<seed>] [-e<events>] [-qh]"
+
+#define DEFAULT_CYCLES 1000000
+#define MSG_LEN 64
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-i<hexfile>      Program assembled by pico\n"
+				"\t-a<srcfile>      Source file, assembled before the simulation\n"
+				"\t-n<cycles>       Cycles to simulate, default %d\n"
+				"\t-p<period>       Asserts the interrupt every period of cycles\n"
+				"\t-r<min>:<max>    Asserts the interrupt after random gaps of cycles\n"
+				"\t-f<first>        Cycle of the first assertion, default 0\n"
+				"\t-s<seed>         Seed of the random gaps, default 1\n"
+				"\t-e<events>       Schedules inputs, see picosim\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n", DEFAULT_CYCLES);
+	printf("The latencies are in cycles from the assertion of the interrupt to the start\n"
+			"of its handler (entry) and to the end of its RETURNI (return).\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+bool error(struct pico *p, char *msg)
+{
+	if(p != NULL)
+		fprintf(stderr, "[l.%d] %s\n", p->lineno, msg);
+	else
+		fprintf(stderr, "%s\n", msg);
+	return false;
+}
+
+/**
+ * Loads the HEX file produced by pico.
+ */
+static bool load_hex(struct sim *s, const char *hexfile)
+{
+	code_t code[SIM_PROGRAM_LEN];
+	progaddr_t len;
+	if(!sim_read_hex(hexfile, code, &len))
+		return error(NULL, "Can not open the program file");
+	return sim_load(s, code, len);
+}
+
+static bool load_events(struct sched *q, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return error(NULL, "Can not open the events");
+
+	unsigned lineno;
+	const bool read = sched_read(q, f, &lineno);
+	fclose(f);
+
+	if(!read) {
+		fprintf(stderr, "%s:%u: Invalid event\n", path, lineno);
+		return false;
+	}
+	return true;
+}
+
+static void percentiles(const struct latency *l, enum latency_kind kind, const char *name)
+{
+	printf("%s latency: p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu\n", name,
+			(unsigned long long) latency_percentile(l, kind, 0.5),
+			(unsigned long long) latency_percentile(l, kind, 0.9),
+			(unsigned long long) latency_percentile(l, kind, 0.99),
+			(unsigned long long) latency_percentile(l, kind, 0.999),
+			(unsigned long long) latency_max(l, kind));
+}
+
+static void append(char *msg, const char *what)
+{
+	const size_t len = strlen(msg);
+	snprintf(msg + len, MSG_LEN - len, "%s%s", len > 0? ", " : "", what);
+}
+
+/**
+ * Prints the messages by the lines of the source, by addresses without it.
+ */
+static bool print_messages(char msg[SIM_PROGRAM_LEN][MSG_LEN], const int *lines, const char *srcfile)
+{
+	if(srcfile == NULL) {
+		for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+			if(msg[i][0] != '\0')
+				printf("%.3X: %s\n", i, msg[i]);
+		}
+		return true;
+	}
+
+	const char *text[SIM_PROGRAM_LEN];
+	for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++)
+		text[i] = msg[i][0] != '\0'? msg[i] : NULL;
+	return source_print(text, lines, srcfile);
+}
+
+/**
+ * The instructions executed while the worst interrupt was pending,
+ * cycles summed by addresses.
+ */
+static bool report_worst(const struct latency *l, const int *lines, const char *srcfile)
+{
+	const struct latency_worst *w = latency_worst(l);
+	if(w == NULL)
+		return true;
+
+	printf("Worst entry: %llu cycles, asserted at cycle %llu\n",
+			(unsigned long long) w->cycles, (unsigned long long) w->asserted);
+
+	static char msg[SIM_PROGRAM_LEN][MSG_LEN];
+	uint64_t cycles[SIM_PROGRAM_LEN] = {0};
+	memset(msg, 0, sizeof(msg));
+	for(size_t i = 0; i < w->len; i++)
+		cycles[w->steps[i].pc] += w->steps[i].cycles;
+
+	append(msg[w->pc], "asserted");
+	for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+		if(cycles[i] > 0) {
+			char what[MSG_LEN];
+			snprintf(what, sizeof(what), "%llu cycles", (unsigned long long) cycles[i]);
+			append(msg[i], what);
+		}
+	}
+	if(w->enabled)
+		append(msg[w->released], "enabled");
+	if(w->len == LATENCY_BLOCKED)
+		printf("Only the first %d instructions are listed\n", LATENCY_BLOCKED);
+
+	return print_messages(msg, lines, srcfile);
+}
+
+int main(int argc, char *argv[argc])
+{
+	char *hexfile = NULL;
+	char *srcfile = NULL;
+	char *events_file = NULL;
+	uint64_t cycles = DEFAULT_CYCLES;
+	uint64_t period = 0;
+	uint64_t min = 0, max = 0;
+	uint64_t first = 0;
+	uint64_t seed = 1;
+	bool quiet = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "qhi:a:n:p:r:f:s:e:")) != -1) {
+		switch(opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'i':
+			hexfile = optarg;
+			break;
+		case 'a':
+			srcfile = optarg;
+			break;
+		case 'n':
+			cycles = strtoull(optarg, NULL, 0);
+			break;
+		case 'p':
+			period = strtoull(optarg, NULL, 0);
+			break;
+		case 'r': {
+			char *end;
+			min = strtoull(optarg, &end, 0);
+			if(*end != ':') {
+				fprintf(stderr, "Give the gaps as <min>:<max>\n");
+				return EXIT_FAILURE;
+			}
+			max = strtoull(end + 1, NULL, 0);
+			break;
+		}
+		case 'f':
+			first = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'e':
+			events_file = optarg;
+			break;
+		case '?':
+			fprintf(stderr, "Unknown option or missing argument: -%c\n", optopt);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if((hexfile == NULL) == (srcfile == NULL)) {
+		fprintf(stderr, "Give the program, either -i or -a\n");
+		return EXIT_FAILURE;
+	}
+	if((period == 0) == (max == 0) || (max != 0 && min > max)) {
+		fprintf(stderr, "Give the schedule, either -p or -r\n");
+		return EXIT_FAILURE;
+	}
+
+	struct sim *s = (struct sim *) calloc(1, sizeof(struct sim));
+	if(s == NULL)
+		return EXIT_FAILURE;
+
+	int lines[SIM_PROGRAM_LEN] = {0};
+	if(!(hexfile != NULL? load_hex(s, hexfile) : source_assemble(s, lines, srcfile))) {
+		free(s);
+		return EXIT_FAILURE;
+	}
+
+	// INPUT reads zero unless scheduled, OUTPUT is not printed
+	struct ports *ports = ports_init(NULL, NULL);
+	struct sched *q = NULL;
+	struct latency *l = NULL;
+	if(ports != NULL) {
+		for(int i = 0; i < PORTS; i++)
+			ports_constant(ports, i, 0);
+		ports_attach(ports, s);
+		// inputs change only by the events, between runs of the simulator
+		s->stable_until = UINT64_MAX;
+		q = sched_init(s, ports);
+	}
+	if(q != NULL && (l = latency_init(s, q)) != NULL) {
+		const bool scheduled = period != 0? latency_periodic(l, first, period)
+				: latency_random(l, first, min, max, seed);
+		if(!scheduled) {
+			latency_destroy(l);
+			l = NULL;
+		}
+	}
+	if(l == NULL || (events_file != NULL && !load_events(q, events_file))) {
+		if(l == NULL)
+			error(NULL, "Memory allocation error");
+		latency_destroy(l);
+		sched_destroy(q);
+		ports_destroy(ports);
+		free(s);
+		return EXIT_FAILURE;
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sched_run(q, s->cycles + cycles);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	const struct latency_counts *counts = latency_counts(l);
+	printf("Interrupts: %llu asserted, %llu merged, %llu entered, %llu returned\n",
+			(unsigned long long) counts->asserted, (unsigned long long) counts->merged,
+			(unsigned long long) counts->entered, (unsigned long long) counts->returned);
+	percentiles(l, LATENCY_ENTRY, "Entry");
+	percentiles(l, LATENCY_RETURN, "Return");
+	printf("Entry histogram:\n");
+	latency_histogram(l, LATENCY_ENTRY, stdout);
+	printf("Return histogram:\n");
+	latency_histogram(l, LATENCY_RETURN, stdout);
+	bool result = report_worst(l, lines, srcfile);
+
+	const double seconds = (end.tv_sec - start.tv_sec)
+			+ (end.tv_nsec - start.tv_nsec) / 1e9;
+	if(!quiet) {
+		fprintf(stderr, "Status: %s at %.3X\n",
+				s->status == SIM_INVALID? "invalid instruction" : "done", s->pc);
+		fprintf(stderr, "Instructions: %llu, cycles: %llu",
+				(unsigned long long) s->instructions, (unsigned long long) s->cycles);
+		if(seconds > 0)
+			fprintf(stderr, ", %.1f MIPS", s->instructions / seconds / 1e6);
+		fputc('\n', stderr);
+	}
+	if(s->status == SIM_INVALID)
+		result = false;
+
+	latency_destroy(l);
+	sched_destroy(q);
+	ports_destroy(ports);
+	free(s);
+	return result? EXIT_SUCCESS : EXIT_FAILURE;
+}
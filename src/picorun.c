@@ -0,0 +1,722 @@
+/**
+ * picorun.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+/**
+ * Runs a manifest of simulation jobs on all processors. Each line of the
+ * manifest is a job:
+ *   <hexfile> <stimulus|-> <cycles> <expected|-> [snapshot]
+ * Relative paths are relative to the directory of the manifest, empty lines
+ * and lines starting by '#' are skipped. The stimulus and the expected outputs
+ * have the format of picosim (lines <cycle> <port> <value>). A stimulus line
+ * sets the value read by INPUT from the port since the cycle. The job passes
+ * when the program writes exactly the expected outputs until the cycle
+ * and does not reach an invalid instruction. With a snapshot (picosim -s)
+ * the job continues from it instead of the reset.
+ *
+ * Jobs are split among the workers, every worker owns a deque of jobs and
+ * when it is empty, the worker steals from the others. Each worker keeps its
+ * simulator and buffers for all its jobs. Results are printed as the jobs
+ * finish. With -c the coverage of each job is written to <dir>/<line>.cov
+ * to be merged by picocov.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "sim.h"
+#include "snapshot.h"
+#include "coverage.h"
+#include "path.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico Runner"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-j<threads>] [-c<dir>] [-qh] <manifest>"
+
+#define MSG_MAX 128
+#define MANIFEST_LINE_MAX (3 * PATH_MAX)
+#define PORTS 256
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-j<threads>      Number of workers, default is the number of processors\n"
+				"\t-c<dir>          Writes the coverage of each job to <dir>/<line>.cov\n"
+				"\t-q               Quite mode, prints only failed jobs\n"
+				"\t-h               Prints this help\n");
+	printf("Lines of the manifest are jobs: <hexfile> <stimulus|-> <cycles> <expected|-> [snapshot]\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+/**
+ * Program shared by jobs, loaded once.
+ */
+struct rom {
+	char *path;
+	code_t code[SIM_PROGRAM_LEN];
+	progaddr_t len;
+};
+
+/**
+ * Snapshot shared by jobs, read once.
+ */
+struct checkpoint {
+	char *path;
+	struct snapshot snap;
+};
+
+struct job {
+	unsigned line;	// of the manifest
+	const struct rom *rom;
+	const struct checkpoint *checkpoint;	// NULL for the reset
+	char *stimulus;	// NULL when not given
+	char *expected;
+	uint64_t cycles;
+};
+
+/**
+ * Line of the stimulus or of the expected outputs.
+ */
+struct event {
+	unsigned long long cycle;
+	unsigned int port;
+	unsigned int value;
+};
+
+struct events {
+	struct event *entry;
+	size_t len;
+	size_t size;
+};
+
+/**
+ * Jobs of a worker, the owner takes them from the bottom,
+ * thieves from the top.
+ */
+struct deque {
+	pthread_mutex_t lock;
+	size_t *job;
+	size_t top;
+	size_t bottom;
+};
+
+struct runner;
+
+struct worker {
+	struct runner *r;
+	pthread_t tid;
+	unsigned id;
+	unsigned seed;
+	struct deque deque;
+
+	// context reused by all jobs of the worker
+	struct sim sim;
+	const struct rom *loaded;
+	struct events stimulus;
+	struct events expected;
+	size_t next;	// stimulus not applied yet
+	size_t outputs;
+	uint8_t port[PORTS];
+	struct sim_coverage coverage;
+	char msg[MSG_MAX];
+};
+
+struct runner {
+	struct job *job;
+	size_t len;
+	struct rom **rom;
+	size_t roms;
+	struct checkpoint **checkpoint;
+	size_t checkpoints;
+	struct worker **worker;
+	unsigned workers;
+
+	pthread_mutex_t lock;	// of the results
+	bool quiet;
+	const char *coverage;	// directory, NULL when not collected
+	size_t passed;
+	size_t failed;
+};
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// =================================== //
+// ------------- manifest ------------ //
+// =================================== //
+
+/**
+ * Finds the program in the cache or loads it.
+ * @return NULL on error, the path is freed
+ */
+static const struct rom *get_rom(struct runner *r, char *path)
+{
+	for(size_t i = 0; i < r->roms; i++) {
+		if(!strcmp(r->rom[i]->path, path)) {
+			free(path);
+			return r->rom[i];
+		}
+	}
+
+	struct rom **more = (struct rom **) realloc(r->rom, (r->roms + 1) * sizeof(struct rom *));
+	struct rom *rom = (struct rom *) calloc(1, sizeof(struct rom));
+	if(more != NULL)
+		r->rom = more;
+	if(more == NULL || rom == NULL) {
+		free(rom);
+		free(path);
+		return NULL;
+	}
+
+	rom->path = path;
+	if(!sim_read_hex(path, rom->code, &rom->len)) {
+		fprintf(stderr, "Can not open the program file '%s'\n", path);
+		free(rom);
+		free(path);
+		return NULL;
+	}
+
+	r->rom[r->roms++] = rom;
+	return rom;
+}
+
+/**
+ * Finds the snapshot in the cache or reads it.
+ * @return NULL on error, the path is freed
+ */
+static const struct checkpoint *get_checkpoint(struct runner *r, char *path)
+{
+	for(size_t i = 0; i < r->checkpoints; i++) {
+		if(!strcmp(r->checkpoint[i]->path, path)) {
+			free(path);
+			return r->checkpoint[i];
+		}
+	}
+
+	struct checkpoint **more = (struct checkpoint **) realloc(r->checkpoint,
+			(r->checkpoints + 1) * sizeof(struct checkpoint *));
+	struct checkpoint *c = (struct checkpoint *) calloc(1, sizeof(struct checkpoint));
+	if(more != NULL)
+		r->checkpoint = more;
+	if(more == NULL || c == NULL) {
+		free(c);
+		free(path);
+		return NULL;
+	}
+
+	FILE *f = fopen(path, "rb");
+	const bool read = f != NULL && snapshot_read(f, &c->snap, NULL, NULL);
+	if(f != NULL)
+		fclose(f);
+	if(!read) {
+		fprintf(stderr, "Can not read the snapshot '%s'\n", path);
+		free(c);
+		free(path);
+		return NULL;
+	}
+
+	c->path = path;
+	r->checkpoint[r->checkpoints++] = c;
+	return c;
+}
+
+static bool parse_job(struct runner *r, struct job *job, char *line, const char *dir)
+{
+	char *field[6];
+	char *save = NULL;
+	int n = 0;
+	for(char *tok = strtok_r(line, " \t\r\n", &save); tok != NULL && n < 6;
+			tok = strtok_r(NULL, " \t\r\n", &save))
+		field[n++] = tok;
+
+	if(n != 4 && n != 5) {
+		fprintf(stderr, "[l.%u] Expected <hexfile> <stimulus|-> <cycles> <expected|-> [snapshot]\n",
+				job->line);
+		return false;
+	}
+
+	char *end;
+	job->cycles = strtoull(field[2], &end, 0);
+	if(*end != '\0') {
+		fprintf(stderr, "[l.%u] Invalid number of cycles '%s'\n", job->line, field[2]);
+		return false;
+	}
+
+	char *path = path_resolve(dir, field[0]);
+	job->rom = path == NULL? NULL : get_rom(r, path);
+	if(job->rom == NULL)
+		return false;
+
+	if(strcmp(field[1], "-")) {
+		job->stimulus = path_resolve(dir, field[1]);
+		if(job->stimulus == NULL)
+			return false;
+	}
+
+	if(strcmp(field[3], "-")) {
+		job->expected = path_resolve(dir, field[3]);
+		if(job->expected == NULL)
+			return false;
+	}
+
+	if(n == 5) {
+		path = path_resolve(dir, field[4]);
+		job->checkpoint = path == NULL? NULL : get_checkpoint(r, path);
+		if(job->checkpoint == NULL)
+			return false;
+	}
+
+	return true;
+}
+
+static bool read_manifest(struct runner *r, const char *manifest)
+{
+	FILE *f = fopen(manifest, "r");
+	if(f == NULL) {
+		fprintf(stderr, "Can not open the manifest '%s'\n", manifest);
+		return false;
+	}
+
+	char dir[PATH_MAX];
+	path_dir(dir, sizeof(dir), manifest);
+
+	static char line[MANIFEST_LINE_MAX];
+	size_t size = 0;
+	unsigned lineno = 0;
+	bool result = true;
+
+	while(result && fgets(line, sizeof(line), f) != NULL) {
+		lineno += 1;
+		const char *p = line + strspn(line, " \t\r\n");
+		if(*p == '\0' || *p == '#')
+			continue;
+
+		if(r->len == size) {
+			size = size == 0? 64 : 2 * size;
+			struct job *more = (struct job *) realloc(r->job, size * sizeof(struct job));
+			if(more == NULL) {
+				fprintf(stderr, "Memory allocation error\n");
+				result = false;
+				break;
+			}
+			r->job = more;
+		}
+
+		struct job *job = &r->job[r->len++];
+		memset(job, 0, sizeof(struct job));
+		job->line = lineno;
+		result = parse_job(r, job, line, dir);
+	}
+
+	fclose(f);
+	return result;
+}
+
+// =================================== //
+// ------------- jobs ---------------- //
+// =================================== //
+
+/**
+ * Reads lines <cycle> <port> <value>, the buffer is reused.
+ */
+static bool read_events(struct worker *w, const char *path, struct events *e, bool sorted)
+{
+	e->len = 0;
+	if(path == NULL)
+		return true;
+
+	FILE *f = fopen(path, "r");
+	if(f == NULL) {
+		snprintf(w->msg, MSG_MAX, "can not open '%s'", path);
+		return false;
+	}
+
+	struct event ev;
+	bool result = true;
+	while(fscanf(f, "%llu %x %x", &ev.cycle, &ev.port, &ev.value) == 3) {
+		if(sorted && e->len > 0 && ev.cycle < e->entry[e->len - 1].cycle) {
+			snprintf(w->msg, MSG_MAX, "'%s' is not sorted by cycles", path);
+			result = false;
+			break;
+		}
+
+		if(e->len == e->size) {
+			const size_t size = e->size == 0? 256 : 2 * e->size;
+			struct event *more = (struct event *) realloc(e->entry, size * sizeof(struct event));
+			if(more == NULL) {
+				snprintf(w->msg, MSG_MAX, "Memory allocation error");
+				result = false;
+				break;
+			}
+			e->entry = more;
+			e->size = size;
+		}
+
+		e->entry[e->len++] = ev;
+	}
+
+	fclose(f);
+	return result;
+}
+
+static uint8_t stimulus_input(struct sim *s, uint8_t port, void *ctx)
+{
+	struct worker *w = (struct worker *) ctx;
+	const struct events *e = &w->stimulus;
+
+	while(w->next < e->len && e->entry[w->next].cycle <= s->cycles) {
+		w->port[e->entry[w->next].port % PORTS] = e->entry[w->next].value;
+		w->next += 1;
+	}
+	s->stable_until = w->next < e->len? e->entry[w->next].cycle : UINT64_MAX;
+
+	return w->port[port];
+}
+
+/**
+ * Compares the output with the expected one, stops at the first difference.
+ */
+static void check_output(struct sim *s, uint8_t port, uint8_t value, void *ctx)
+{
+	struct worker *w = (struct worker *) ctx;
+	const size_t i = w->outputs++;
+	const unsigned long long cycle = s->cycles;
+
+	if(i >= w->expected.len) {
+		snprintf(w->msg, MSG_MAX, "unexpected output %llu %.2X %.2X", cycle, port, value);
+		sim_stop(s);
+		return;
+	}
+
+	const struct event *e = &w->expected.entry[i];
+	if(e->cycle != cycle || e->port != port || e->value != value) {
+		snprintf(w->msg, MSG_MAX, "output %zu differs: %llu %.2X %.2X, expected %llu %.2X %.2X",
+				i, cycle, port, value, e->cycle, e->port, e->value);
+		sim_stop(s);
+	}
+}
+
+/**
+ * @return true when the job passed, otherwise w->msg tells why
+ */
+static bool run_job(struct worker *w, const struct job *job)
+{
+	struct sim *s = &w->sim;
+	w->msg[0] = '\0';
+	s->coverage = NULL;
+
+	if(!read_events(w, job->stimulus, &w->stimulus, true)
+			|| !read_events(w, job->expected, &w->expected, false))
+		return false;
+
+	// the predecoded program is kept for the following jobs
+	if(w->loaded != job->rom) {
+		sim_load(s, job->rom->code, job->rom->len);
+		w->loaded = job->rom;
+	}
+	else
+		sim_reset(s);
+
+	if(job->checkpoint != NULL && !snapshot_restore(s, &job->checkpoint->snap)) {
+		snprintf(w->msg, MSG_MAX, "'%s' is of another program", job->checkpoint->path);
+		return false;
+	}
+
+	s->io.input = &stimulus_input;
+	s->io.output = &check_output;
+	s->io.ctx = w;
+	memset(w->port, 0, sizeof(w->port));
+	w->next = 0;
+	w->outputs = 0;
+	// the loops polling an input are skipped until the next stimulus
+	s->stable_until = w->stimulus.len > 0? w->stimulus.entry[0].cycle : UINT64_MAX;
+
+	if(w->r->coverage != NULL) {
+		memset(&w->coverage, 0, sizeof(w->coverage));
+		s->coverage = &w->coverage;
+	}
+
+	const uint64_t left = job->cycles > s->cycles? job->cycles - s->cycles : 0;
+	const enum sim_status status = sim_run(s, left / SIM_CYCLES_PER_INSTR);
+	if(w->msg[0] != '\0')
+		return false;
+
+	if(status == SIM_INVALID) {
+		snprintf(w->msg, MSG_MAX, "invalid instruction at %.3X", s->pc);
+		return false;
+	}
+
+	if(w->outputs != w->expected.len) {
+		snprintf(w->msg, MSG_MAX, "expected %zu outputs, got %zu", w->expected.len, w->outputs);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Writes the coverage of the job, also of the failed one.
+ */
+static bool write_coverage(struct worker *w, const struct job *job)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%u.cov", w->r->coverage, job->line);
+
+	FILE *f = fopen(path, "wb");
+	const bool written = f != NULL && coverage_write(f, &w->coverage, w->sim.checksum);
+	if(f == NULL || fclose(f) != 0 || !written) {
+		if(w->msg[0] == '\0')
+			snprintf(w->msg, MSG_MAX, "can not write the coverage");
+		return false;
+	}
+	return true;
+}
+
+static void report(struct worker *w, const struct job *job, bool passed, double ms)
+{
+	struct runner *r = w->r;
+
+	pthread_mutex_lock(&r->lock);
+	if(passed)
+		r->passed += 1;
+	else
+		r->failed += 1;
+
+	if(!passed || !r->quiet) {
+		printf("==== %u %s == [%s] == %llu cycles %8.3f ms", job->line, job->rom->path,
+				passed? "SUCCESS" : "FAILED", (unsigned long long) w->sim.cycles, ms);
+		if(!passed)
+			printf(" %s", w->msg);
+		putchar('\n');
+		fflush(stdout);
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+// =================================== //
+// ---------- work stealing ---------- //
+// =================================== //
+
+static bool deque_pop(struct deque *d, size_t *job)
+{
+	pthread_mutex_lock(&d->lock);
+	const bool found = d->top < d->bottom;
+	if(found)
+		*job = d->job[--d->bottom];
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static bool deque_steal(struct deque *d, size_t *job)
+{
+	pthread_mutex_lock(&d->lock);
+	const bool found = d->top < d->bottom;
+	if(found)
+		*job = d->job[d->top++];
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+/**
+ * Takes the next job of the worker or steals one. No jobs are added,
+ * so when all deques are empty, the work is done.
+ */
+static bool next_job(struct worker *w, size_t *job)
+{
+	if(deque_pop(&w->deque, job))
+		return true;
+
+	const unsigned n = w->r->workers;
+	w->seed = w->seed * 1103515245 + 12345;
+	const unsigned first = (w->seed >> 16) % n;
+
+	for(unsigned i = 0; i < n; i++) {
+		const unsigned victim = (first + i) % n;
+		if(victim != w->id && deque_steal(&w->r->worker[victim]->deque, job))
+			return true;
+	}
+
+	return false;
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	size_t i;
+
+	while(next_job(w, &i)) {
+		const double start = now_ms();
+		bool passed = run_job(w, &w->r->job[i]);
+		if(w->sim.coverage != NULL)
+			passed = write_coverage(w, &w->r->job[i]) && passed;
+		report(w, &w->r->job[i], passed, now_ms() - start);
+	}
+
+	return NULL;
+}
+
+/**
+ * Creates the workers, each one gets a contiguous part of the jobs.
+ */
+static bool create_workers(struct runner *r, unsigned n)
+{
+	r->worker = (struct worker **) calloc(n, sizeof(struct worker *));
+	if(r->worker == NULL)
+		return false;
+
+	for(unsigned i = 0; i < n; i++) {
+		struct worker *w = (struct worker *) calloc(1, sizeof(struct worker));
+		const size_t first = r->len * i / n;
+		const size_t last = r->len * (i + 1) / n;
+		if(w != NULL)
+			w->deque.job = (size_t *) malloc((last - first + 1) * sizeof(size_t));
+		if(w == NULL || w->deque.job == NULL) {
+			free(w);
+			return false;
+		}
+
+		w->r = r;
+		w->id = i;
+		w->seed = i + 1;
+		pthread_mutex_init(&w->deque.lock, NULL);
+		// the owner pops from the bottom, so the first job is the last one
+		for(size_t j = first; j < last; j++)
+			w->deque.job[w->deque.bottom++] = last - 1 - (j - first);
+
+		r->worker[r->workers++] = w;
+	}
+
+	return true;
+}
+
+static void destroy(struct runner *r)
+{
+	for(unsigned i = 0; i < r->workers; i++) {
+		struct worker *w = r->worker[i];
+		pthread_mutex_destroy(&w->deque.lock);
+		free(w->deque.job);
+		free(w->stimulus.entry);
+		free(w->expected.entry);
+		free(w);
+	}
+
+	for(size_t i = 0; i < r->len; i++) {
+		free(r->job[i].stimulus);
+		free(r->job[i].expected);
+	}
+
+	for(size_t i = 0; i < r->roms; i++) {
+		free(r->rom[i]->path);
+		free(r->rom[i]);
+	}
+
+	for(size_t i = 0; i < r->checkpoints; i++) {
+		free(r->checkpoint[i]->path);
+		free(r->checkpoint[i]);
+	}
+
+	free(r->worker);
+	free(r->job);
+	free(r->rom);
+	free(r->checkpoint);
+	pthread_mutex_destroy(&r->lock);
+}
+
+int main(int argc, char *argv[argc])
+{
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	struct runner r;
+	memset(&r, 0, sizeof(r));
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "qhj:c:")) != -1) {
+		switch(opt) {
+		case 'q':
+			r.quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'j':
+			threads = atol(optarg);
+			break;
+		case 'c':
+			r.coverage = optarg;
+			break;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(optind + 1 != argc) {
+		fprintf(stderr, "Give one manifest\n");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_init(&r.lock, NULL);
+	if(!read_manifest(&r, argv[optind])) {
+		destroy(&r);
+		return EXIT_FAILURE;
+	}
+
+	if(threads < 1)
+		threads = 1;
+	if((size_t) threads > r.len)
+		threads = r.len > 0? r.len : 1;
+
+	if(!create_workers(&r, threads)) {
+		fprintf(stderr, "Memory allocation error\n");
+		destroy(&r);
+		return EXIT_FAILURE;
+	}
+
+	const double start = now_ms();
+	unsigned started = 1;
+	for(; started < r.workers; started++) {
+		if(pthread_create(&r.worker[started]->tid, NULL, &worker, r.worker[started]))
+			break;
+	}
+
+	// the main thread is the first worker, jobs of threads that were
+	// not created are stolen by the others
+	worker(r.worker[0]);
+	for(unsigned i = 1; i < started; i++)
+		pthread_join(r.worker[i]->tid, NULL);
+
+	printf("%zu passed, %zu failed (%u threads, %.3f s)\n",
+			r.passed, r.failed, started, (now_ms() - start) / 1e3);
+
+	const int result = r.failed == 0? EXIT_SUCCESS : EXIT_FAILURE;
+	destroy(&r);
+	return result;
+}
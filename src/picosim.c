@@ -0,0 +1,708 @@
+/**
+ * picosim.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pc.h"
+#include "buffer.h"
+#include "scanner.h"
+#include "stab.h"
+#include "output.h"
+#include "assembler.h"
+#include "isa.h"
+#include "sim.h"
+#include "jit.h"
+#include "snapshot.h"
+#include "ports.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "profile.h"
+#include "coverage.h"
+#include "cosim.h"
+#include "vcd.h"
+#include "activity.h"
+#include "stimulus.h"
+#include "gdb.h"
+#include "history.h"
+#include "step.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#define PROGRAM "Pico Simulator"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-i<hexfile>|-a<srcfile>] [-n<instructions>] [-r<snapshot>] [-s<snapshot>] [-e<events>] " \
+		"[-m<stimulus>] [-t<trace>] [-p<profile>] [-f<folded>] [-l<listing>] [-c<coverage>] [-w<vcd>] " \
+		"[-g<start>:<stop>] [-x<name>] [-y<saif>] [-u<energy>] [-d<address>] [-b<interval>] [-jqh]"
+
+#define DEFAULT_BUDGET 1000000
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-i<hexfile>      Program assembled by pico\n"
+				"\t-a<srcfile>      Source file, assembled before the simulation\n"
+				"\t-n<instructions> Number of instructions to execute, default %d\n"
+				"\t-r<snapshot>     Continues from the snapshot of the same program\n"
+				"\t-s<snapshot>     Saves the state at the end to the snapshot\n"
+				"\t-e<events>       Schedules interrupts and inputs, runs for 2*n cycles\n"
+				"\t-m<stimulus>     Reads the events from the binary stimulus (see picostim) like -e\n"
+				"\t-t<trace>        Records the executed instructions, see picotrace\n"
+				"\t-p<profile>      Writes subroutines and the listing annotated by counts and cycles\n"
+				"\t-f<folded>       Writes folded call stacks for flamegraphs\n"
+				"\t-l<listing>      Names of labels for -i and -d, the listing of pico\n"
+				"\t-c<coverage>     Writes the executed addresses and branch directions, see picocov\n"
+				"\t-w<vcd>          Writes the waveforms for GTKWave\n"
+				"\t-g<start>:<stop> Triggers of -w: <address>, in<port>, out<port> or @<cycle>,\n"
+				"\t                 either may be empty, eg. -g2B0:@100000\n"
+				"\t-x<name>         Co-simulation, runs as told by the HDL testbench through\n"
+				"\t                 the shared memory of the name, see picohdl\n"
+				"\t-y<saif>         Writes the switching activity for the power estimation\n"
+				"\t-u<energy>       Writes the toggles of subroutines and signals, the energy proxy\n"
+				"\t-d<address>      Waits for GDB at [<host>]:<port>, a Unix socket or - (stdin),\n"
+				"\t                 the budget of -n is for the whole session\n"
+				"\t-b<interval>     Records the history for GDB to step and continue back,\n"
+				"\t                 a checkpoint every <interval> instructions, eg. 65536\n"
+				"\t-j               Translates hot blocks to native code (x86-64)\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n", DEFAULT_BUDGET);
+	printf("Values written by OUTPUT are printed as <cycle> <port> <value>,\n"
+			"INPUT reads zero.\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+bool error(struct pico *p, char *msg)
+{
+	if(p != NULL)
+		fprintf(stderr, "[l.%d] %s\n", p->lineno, msg);
+	else
+		fprintf(stderr, "%s\n", msg);
+	return false;
+}
+
+/**
+ * Loads the HEX file produced by pico.
+ */
+static bool load_hex(struct sim *s, const char *hexfile)
+{
+	code_t code[SIM_PROGRAM_LEN];
+	progaddr_t len;
+	if(!sim_read_hex(hexfile, code, &len))
+		return error(NULL, "Can not open the program file");
+	return sim_load(s, code, len);
+}
+
+/**
+ * Assembles the source file, the symbol table is kept in p.
+ */
+static bool load_source(struct sim *s, struct pico *p, char *srcfile)
+{
+	p->stab = stab_init();
+	if(p->stab == NULL)
+		return error(NULL, "Memory allocation error");
+
+	bool result = assembler_setup(p, isa_default())
+			&& buffer_init(p, srcfile)
+			&& output_init_memory(p)
+			&& assembler_run(p);
+
+	if(result) {
+		progaddr_t len;
+		const code_t *code = output_image(p, &len);
+		result = sim_load(s, code, len);
+	}
+
+	buffer_destroy(p);
+	output_destroy(p);
+	return result;
+}
+
+/**
+ * Stock port models: INPUT reads zero, OUTPUT is logged
+ * and printed in batches.
+ */
+static struct ports *stock_ports(struct sim *s, FILE *out)
+{
+	struct ports *ports = ports_init(&ports_print_log, out);
+	if(ports == NULL)
+		return NULL;
+
+	for(int i = 0; i < PORTS; i++) {
+		ports_constant(ports, i, 0);
+		ports_log(ports, i);
+	}
+
+	ports_attach(ports, s);
+	return ports;
+}
+
+static bool restore(struct sim *s, const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if(f == NULL)
+		return error(NULL, "Can not open the snapshot");
+
+	struct snapshot snap;
+	const bool read = snapshot_read(f, &snap, NULL, NULL);
+	fclose(f);
+
+	if(!read)
+		return error(NULL, "Invalid snapshot");
+	if(!snapshot_restore(s, &snap))
+		return error(NULL, "The snapshot is of another program");
+	return true;
+}
+
+static bool save(const struct sim *s, const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	if(f == NULL)
+		return error(NULL, "Can not create the snapshot");
+
+	struct snapshot snap;
+	snapshot_save(s, &snap);
+	const bool written = snapshot_write(f, &snap, NULL, 0);
+	if(fclose(f) != 0 || !written)
+		return error(NULL, "Can not write the snapshot");
+	return true;
+}
+
+static bool write_coverage(const struct sim *s, const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	if(f == NULL)
+		return error(NULL, "Can not create the coverage");
+
+	const bool written = coverage_write(f, s->coverage, s->checksum);
+	if(fclose(f) != 0 || !written)
+		return error(NULL, "Can not write the coverage");
+	return true;
+}
+
+static bool load_events(struct sched *q, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return error(NULL, "Can not open the events");
+
+	unsigned lineno;
+	const bool read = sched_read(q, f, &lineno);
+	fclose(f);
+
+	if(!read) {
+		fprintf(stderr, "%s:%u: Invalid event\n", path, lineno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Receiver of the labels, the profiler or the debugger.
+ */
+struct namer {
+	bool (*name)(void *target, uint16_t addr, const char *name);
+	void *target;
+};
+
+static bool name_profile(void *target, uint16_t addr, const char *name)
+{
+	return profile_name((struct profile *) target, addr, name);
+}
+
+static bool name_gdb(void *target, uint16_t addr, const char *name)
+{
+	return gdb_name((struct gdb *) target, addr, name);
+}
+
+/**
+ * Reads the labels of the listing produced by pico (<addr>\t<label>).
+ */
+static bool load_labels(const struct namer *namer, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return error(NULL, "Can not open the listing");
+
+	char line[256];
+	char name[256];
+	unsigned addr;
+	int n;
+	bool result = true;
+
+	while(result && fgets(line, sizeof(line), f) != NULL) {
+		if(sscanf(line, "%x%n", &addr, &n) == 1 && line[n] == '\t'
+				&& sscanf(line + n, "%255s", name) == 1)
+			result = namer->name(namer->target, addr, name);
+	}
+
+	fclose(f);
+	return result || error(NULL, "Memory allocation error");
+}
+
+static void stab_label_visit(struct stab_data *data, void *op)
+{
+	const struct namer *namer = (const struct namer *) op;
+	if(data->lit == L_LABEL)
+		namer->name(namer->target, data->value.a, data->key);
+}
+
+static bool write_profile(const struct profile *prof, const char *path, bool folded)
+{
+	FILE *f = fopen(path, "w");
+	if(f == NULL)
+		return error(NULL, "Can not create the profile");
+
+	if(folded)
+		profile_print_folded(prof, f);
+	else
+		profile_print(prof, f);
+	return fclose(f) == 0 || error(NULL, "Can not write the profile");
+}
+
+static void summary(struct sim *s, double seconds)
+{
+	static const char *status[] = {
+		[SIM_RUNNING] = "running",
+		[SIM_BUDGET] = "budget exhausted",
+		[SIM_INVALID] = "invalid instruction",
+		[SIM_STOPPED] = "stopped",
+		[SIM_BREAK] = "breakpoint"
+	};
+
+	fprintf(stderr, "Status: %s at %.3X\n", status[s->status], s->pc);
+	fprintf(stderr, "Instructions: %llu, cycles: %llu",
+			(unsigned long long) s->instructions, (unsigned long long) s->cycles);
+	if(seconds > 0)
+		fprintf(stderr, ", %.1f MIPS", s->instructions / seconds / 1e6);
+	fputc('\n', stderr);
+
+	for(int i = 0; i < SIM_REGS; i++)
+		fprintf(stderr, "s%X=%.2X%c", i, s->reg[i], i % 8 == 7? '\n' : ' ');
+	fprintf(stderr, "Z=%d C=%d IE=%d stack depth=%u%s%s\n", sim_zero(s), sim_carry(s),
+			s->ie, s->depth,
+			s->faults & SIM_FAULT_OVERFLOW? " OVERFLOW" : "",
+			s->faults & SIM_FAULT_UNDERFLOW? " UNDERFLOW" : "");
+}
+
+static bool write_activity(const struct activity *act, const char *path, bool saif)
+{
+	FILE *f = fopen(path, "w");
+	if(f == NULL)
+		return error(NULL, "Can not create the activity");
+
+	if(saif)
+		activity_print_saif(act, VCD_PERIOD_NS, f);
+	else
+		activity_print_energy(act, f);
+	return fclose(f) == 0 || error(NULL, "Can not write the activity");
+}
+
+/**
+ * Splits <start>:<stop> of -g, none when not given.
+ */
+static bool parse_triggers(char *triggers, struct vcd_trigger *start, struct vcd_trigger *stop)
+{
+	char *colon = triggers != NULL? strchr(triggers, ':') : NULL;
+	if(triggers != NULL && colon == NULL) {
+		fprintf(stderr, "Give the triggers as <start>:<stop>\n");
+		return false;
+	}
+
+	if(colon != NULL)
+		*colon = '\0';
+	if(!vcd_parse_trigger(colon != NULL? triggers : "", start)
+			|| !vcd_parse_trigger(colon != NULL? colon + 1 : "", stop)) {
+		fprintf(stderr, "Invalid trigger, give <address>, in<port>, out<port> or @<cycle>\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Serves the testbench until it quits, the summary is printed at the end.
+ */
+static bool cosimulate(struct sim *s, const char *name, bool quiet)
+{
+	struct cosim *c = cosim_attach(name);
+	if(c == NULL)
+		return error(NULL, "Can not attach to the testbench");
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	const bool served = cosim_serve(c, s);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	cosim_close(c);
+
+	if(!quiet)
+		summary(s, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+	return served || error(NULL, "The testbench ended without quitting");
+}
+
+/**
+ * Serves the debugger, after it detaches the program runs on for the rest
+ * of the budget. With the standard input and output for the debugger
+ * the values written by OUTPUT are printed to stderr.
+ */
+static bool serve_debugger(struct sim *s, struct stab *stab, const char *listing_file,
+		const char *address, uint64_t budget, uint64_t interval, bool quiet)
+{
+	struct ports *ports = stock_ports(s, strcmp(address, "-")? stdout : stderr);
+	struct gdb *g = ports != NULL? gdb_init(s, budget) : NULL;
+	struct history *h = g != NULL && interval > 0? history_init(s, interval) : NULL;
+	if(g == NULL || (interval > 0 && h == NULL)) {
+		gdb_destroy(g);
+		ports_destroy(ports);
+		return error(NULL, "Memory allocation error");
+	}
+	gdb_set_history(g, h);
+
+	const struct namer namer = {&name_gdb, g};
+	if(stab != NULL)
+		stab_visit(stab, &stab_label_visit, (void *) &namer);
+	int in, out;
+	bool result = (listing_file == NULL || load_labels(&namer, listing_file))
+		&& (gdb_accept(address, &in, &out) || error(NULL, "Can not connect the debugger"));
+
+	if(result) {
+		// inputs do not change, the idle loops are skipped without breakpoints
+		s->stable_until = UINT64_MAX;
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		result = gdb_serve(g, in, out) || error(NULL, "Connection to the debugger failed");
+		if(gdb_left(g) > 0 && h != NULL)
+			history_run(h, gdb_left(g));
+		else if(gdb_left(g) > 0)
+			sim_run(s, gdb_left(g));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		if(in != STDIN_FILENO)
+			close(in);
+
+		ports_flush(s, ports);
+		if(!quiet)
+			summary(s, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+	}
+
+	gdb_destroy(g);
+	history_destroy(h);
+	ports_destroy(ports);
+	return result;
+}
+
+int main(int argc, char *argv[argc])
+{
+	char *hexfile = NULL;
+	char *srcfile = NULL;
+	char *restore_file = NULL;
+	char *save_file = NULL;
+	char *events_file = NULL;
+	char *stimulus_file = NULL;
+	char *trace_file = NULL;
+	char *profile_file = NULL;
+	char *folded_file = NULL;
+	char *listing_file = NULL;
+	char *coverage_file = NULL;
+	char *cosim_name = NULL;
+	char *vcd_file = NULL;
+	char *saif_file = NULL;
+	char *energy_file = NULL;
+	char *triggers = NULL;
+	char *debug_address = NULL;
+	unsigned long long interval = 0;
+	unsigned long long budget = DEFAULT_BUDGET;
+	bool quiet = false;
+	bool native = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "qjhi:a:n:r:s:e:m:t:p:f:l:c:w:g:x:y:u:d:b:")) != -1) {
+		switch(opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 'j':
+			native = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'i':
+			hexfile = optarg;
+			break;
+		case 'a':
+			srcfile = optarg;
+			break;
+		case 'n':
+			budget = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			restore_file = optarg;
+			break;
+		case 's':
+			save_file = optarg;
+			break;
+		case 'e':
+			events_file = optarg;
+			break;
+		case 'm':
+			stimulus_file = optarg;
+			break;
+		case 't':
+			trace_file = optarg;
+			break;
+		case 'p':
+			profile_file = optarg;
+			break;
+		case 'f':
+			folded_file = optarg;
+			break;
+		case 'l':
+			listing_file = optarg;
+			break;
+		case 'c':
+			coverage_file = optarg;
+			break;
+		case 'w':
+			vcd_file = optarg;
+			break;
+		case 'g':
+			triggers = optarg;
+			break;
+		case 'x':
+			cosim_name = optarg;
+			break;
+		case 'y':
+			saif_file = optarg;
+			break;
+		case 'u':
+			energy_file = optarg;
+			break;
+		case 'd':
+			debug_address = optarg;
+			break;
+		case 'b':
+			interval = strtoull(optarg, NULL, 0);
+			break;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if((hexfile == NULL) == (srcfile == NULL)) {
+		fprintf(stderr, "Give either a program file (-i) or a source file (-a)\n");
+		return EXIT_FAILURE;
+	}
+	// the energy of subroutines is attributed by the profile
+	const bool scheduled = events_file != NULL || stimulus_file != NULL;
+	const bool profiling = profile_file != NULL || folded_file != NULL || energy_file != NULL;
+	const bool counting = saif_file != NULL || energy_file != NULL;
+	// the observers of single steps, they can be combined
+	const bool observed = trace_file != NULL || profiling || vcd_file != NULL || counting;
+	if(observed && native) {
+		fprintf(stderr, "The trace, the profile, the waveforms and the activity are recorded by the interpreter\n");
+		return EXIT_FAILURE;
+	}
+	struct vcd_trigger vcd_start, vcd_stop;
+	if(!parse_triggers(triggers, &vcd_start, &vcd_stop))
+		return EXIT_FAILURE;
+	if(triggers != NULL && vcd_file == NULL) {
+		fprintf(stderr, "The triggers need the waveforms (-w)\n");
+		return EXIT_FAILURE;
+	}
+
+	if(cosim_name != NULL && (native || scheduled || observed)) {
+		fprintf(stderr, "The co-simulation is run by the interpreter, the testbench gives the events\n");
+		return EXIT_FAILURE;
+	}
+	if(debug_address != NULL && (native || scheduled || observed
+				|| coverage_file != NULL || cosim_name != NULL)) {
+		fprintf(stderr, "The debugger runs the interpreter alone\n");
+		return EXIT_FAILURE;
+	}
+	if(interval > 0 && debug_address == NULL) {
+		fprintf(stderr, "The history is recorded for the debugger (-d)\n");
+		return EXIT_FAILURE;
+	}
+	if(coverage_file != NULL && native) {
+		fprintf(stderr, "The coverage is collected by the interpreter\n");
+		return EXIT_FAILURE;
+	}
+
+	struct sim *s = (struct sim *) calloc(1, sizeof(struct sim));
+	if(s == NULL)
+		return EXIT_FAILURE;
+	struct sim_coverage cov;
+	if(coverage_file != NULL) {
+		memset(&cov, 0, sizeof(cov));
+		s->coverage = &cov;
+	}
+
+	struct token tok = {.type = T_UNKNOWN, .lineno = -1};
+	struct pico p = {.tok = &tok, .stab = NULL, .address = 0,
+		.buff = NULL, .offset = NULL, .lineno = 1};
+
+	bool loaded = hexfile != NULL? load_hex(s, hexfile) : load_source(s, &p, srcfile);
+	if(loaded && restore_file != NULL)
+		loaded = restore(s, restore_file);
+	if(!loaded) {
+		stab_destroy(p.stab);
+		free(s);
+		return EXIT_FAILURE;
+	}
+
+	if(cosim_name != NULL) {
+		int result = cosimulate(s, cosim_name, quiet)? EXIT_SUCCESS : EXIT_FAILURE;
+		if(save_file != NULL && !save(s, save_file))
+			result = EXIT_FAILURE;
+		if(coverage_file != NULL && !write_coverage(s, coverage_file))
+			result = EXIT_FAILURE;
+		stab_destroy(p.stab);
+		free(s);
+		return result;
+	}
+
+	if(debug_address != NULL) {
+		int result = serve_debugger(s, p.stab, listing_file, debug_address, budget, interval, quiet)?
+			EXIT_SUCCESS : EXIT_FAILURE;
+		if(save_file != NULL && !save(s, save_file))
+			result = EXIT_FAILURE;
+		stab_destroy(p.stab);
+		free(s);
+		return result;
+	}
+
+	struct ports *ports = stock_ports(s, stdout);
+	// inputs change only by the events, between runs of the simulator
+	s->stable_until = UINT64_MAX;
+	struct jit *j = NULL;
+	if(native && ports != NULL)
+		j = jit_init(s);
+	struct sched *q = NULL;
+	if(scheduled && ports != NULL)
+		q = sched_init(s, ports);
+	struct stimulus *st = NULL;
+	if(stimulus_file != NULL && q != NULL && (st = stimulus_open(stimulus_file)) == NULL)
+		error(NULL, "Can not open the stimulus");
+	struct trace *t = NULL;
+	if(trace_file != NULL && ports != NULL && (t = trace_open(s, trace_file)) == NULL)
+		error(NULL, "Can not create the trace");
+	struct vcd *v = NULL;
+	if(vcd_file != NULL && ports != NULL
+			&& (v = vcd_open(s, vcd_file, VCD_PERIOD_NS, &vcd_start, &vcd_stop)) == NULL)
+		error(NULL, "Can not create the waveforms");
+	struct profile *prof = NULL;
+	if(profiling && ports != NULL && (prof = profile_init(s)) != NULL) {
+		const struct namer namer = {&name_profile, prof};
+		if(p.stab != NULL)
+			stab_visit(p.stab, &stab_label_visit, (void *) &namer);
+		if(listing_file != NULL && !load_labels(&namer, listing_file)) {
+			profile_destroy(prof);
+			prof = NULL;
+		}
+	}
+	struct activity *act = NULL;
+	if(counting && ports != NULL && (!profiling || prof != NULL))
+		act = activity_init(s, prof);
+	struct stepper steps;
+	step_init(&steps, s);
+	if(ports == NULL || (native && j == NULL) || (scheduled && q == NULL)
+			|| (events_file != NULL && q != NULL && !load_events(q, events_file))
+			|| (stimulus_file != NULL && st == NULL)
+			|| (trace_file != NULL && (t == NULL || !trace_observe(t, &steps)))
+			|| (profiling && (prof == NULL || !profile_observe(prof, &steps)))
+			|| (vcd_file != NULL && (v == NULL || !vcd_observe(v, &steps)))
+			|| (counting && (act == NULL || !activity_observe(act, &steps)))) {
+		if(t != NULL)
+			trace_close(t);
+		if(v != NULL)
+			vcd_close(v);
+		activity_destroy(act);
+		profile_destroy(prof);
+		stimulus_close(st);
+		sched_destroy(q);
+		jit_destroy(j);
+		ports_destroy(ports);
+		stab_destroy(p.stab);
+		free(s);
+		return EXIT_FAILURE;
+	}
+
+	if(native) {
+		if(!jit_native(j))
+			fprintf(stderr, "Native code is not available, interpreting\n");
+	}
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if(q != NULL) {
+		sched_set_jit(q, j);
+		if(st != NULL)
+			sched_set_source(q, &stimulus_next, st);
+		if(observed)
+			sched_set_runner(q, &step_runner, &steps);
+		sched_run(q, s->cycles + SIM_CYCLES_PER_INSTR * budget);
+	}
+	else if(j != NULL)
+		jit_run(j, budget);
+	else if(observed)
+		step_run(&steps, budget);
+	else
+		sim_run(s, budget);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ports_flush(s, ports);
+	const bool traced = t == NULL || trace_close(t) || error(NULL, "Can not write the trace");
+	const bool dumped = v == NULL || vcd_close(v) || error(NULL, "Can not write the waveforms");
+	const bool stimulated = st == NULL || !stimulus_invalid(st)
+		|| error(NULL, "Invalid record in the stimulus");
+
+	const double seconds = (end.tv_sec - start.tv_sec)
+			+ (end.tv_nsec - start.tv_nsec) / 1e9;
+	if(!quiet)
+		summary(s, seconds);
+
+	int result = s->status == SIM_INVALID || !traced || !dumped || !stimulated?
+		EXIT_FAILURE : EXIT_SUCCESS;
+	if(save_file != NULL && !save(s, save_file))
+		result = EXIT_FAILURE;
+	if(profile_file != NULL && !write_profile(prof, profile_file, false))
+		result = EXIT_FAILURE;
+	if(folded_file != NULL && !write_profile(prof, folded_file, true))
+		result = EXIT_FAILURE;
+	if(coverage_file != NULL && !write_coverage(s, coverage_file))
+		result = EXIT_FAILURE;
+	if(saif_file != NULL && !write_activity(act, saif_file, true))
+		result = EXIT_FAILURE;
+	if(energy_file != NULL && !write_activity(act, energy_file, false))
+		result = EXIT_FAILURE;
+
+	activity_destroy(act);
+	profile_destroy(prof);
+	stimulus_close(st);
+	sched_destroy(q);
+	jit_destroy(j);
+	ports_destroy(ports);
+	stab_destroy(p.stab);
+	free(s);
+	return result;
+}
@@ -0,0 +1,341 @@
+/**
+ * picostim.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+/**
+ * Converts the stimulus to the binary format of picosim -m (see stimulus.h).
+ * Text lines are the events of picosim -e, the fields separated by spaces
+ * or commas (CSV):
+ *   <cycle> irq <0|1>
+ *   <cycle> in <port> <value>
+ *   <cycle> stop
+ * Numbers of ports and values are hexadecimal, lines starting by '#' and
+ * a header line are skipped.
+ *
+ * A logic-analyzer dump (-f la) is a CSV export of the samples: the time
+ * in seconds and the levels (0 or 1) of the channels. The channels are
+ * mapped to the signals by -m, eg. -m in02=1:8 -m irq=9 (columns after
+ * the time, the first one is the least significant bit). A record is
+ * written when a signal changes, the time is converted to the cycles
+ * of the clock.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "scheduler.h"
+#include "stimulus.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico Stimulus"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-f<events|la>] [-m<signal>=<first>[:<last>]]... [-c<hz>] [-qh] <input> <stimulus>"
+
+#define DEFAULT_CLOCK 50000000
+#define LINE_MAX_LEN 4096
+#define SIGNALS_MAX 64
+#define BUFFER_LEN (1 << 20)
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-f<format>       Format of the input: events (also CSV, default)\n"
+				"\t                 or la (logic-analyzer dump)\n"
+				"\t-m<signal>=<first>[:<last>]\n"
+				"\t                 Channels of the dump of the signal in<port> or irq\n"
+				"\t-c<hz>           Clock of the processor, default %d\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n", DEFAULT_CLOCK);
+	printf("Lines of events: <cycle> irq <0|1>, <cycle> in <port> <value> or <cycle> stop,\n"
+			"fields separated by spaces or commas. Lines of the dump: <time>,<level>,...\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+/**
+ * Channels of the dump forming a signal.
+ */
+struct signal {
+	uint8_t kind;	// SCHED_INTERRUPT or SCHED_INPUT
+	uint8_t port;
+	unsigned first;
+	unsigned last;
+	uint8_t value;	// the last written
+};
+
+struct converter {
+	FILE *out;
+	uint64_t records;
+	uint64_t cycle;	// of the last record
+	unsigned lineno;
+	const char *path;
+	bool started;	// a line other than a comment was read, the first one may be the header
+};
+
+static bool emit(struct converter *c, const struct sched_event *e)
+{
+	if(e->cycle < c->cycle) {
+		fprintf(stderr, "%s:%u: The cycles decrease\n", c->path, c->lineno);
+		return false;
+	}
+	if(!stimulus_write(c->out, e)) {
+		fprintf(stderr, "Can not write the stimulus\n");
+		return false;
+	}
+
+	c->cycle = e->cycle;
+	c->records += 1;
+	return true;
+}
+
+static bool parse_hex(const char *text, uint8_t *value)
+{
+	char *end;
+	const unsigned long v = text != NULL? strtoul(text, &end, 16) : 0;
+	if(text == NULL || *end != '\0' || end == text || v > 0xFF)
+		return false;
+	*value = v;
+	return true;
+}
+
+/**
+ * @return -1 on error, 0 for the header, 1 for the event
+ */
+static int parse_event(char *line, bool header, struct sched_event *e)
+{
+	const char *sep = " \t,\r\n";
+	char *field[4] = {NULL};
+	int n = 0;
+	for(char *f = strtok(line, sep); f != NULL && n < 4; f = strtok(NULL, sep))
+		field[n++] = f;
+
+	char *end;
+	memset(e, 0, sizeof(*e));
+	e->cycle = strtoull(field[0], &end, 10);
+	if(*end != '\0' || end == field[0])
+		return header? 0 : -1;
+
+	if(n == 3 && !strcmp(field[1], "irq") && parse_hex(field[2], &e->value) && e->value <= 1)
+		e->kind = SCHED_INTERRUPT;
+	else if(n == 4 && !strcmp(field[1], "in") && parse_hex(field[2], &e->port)
+			&& parse_hex(field[3], &e->value))
+		e->kind = SCHED_INPUT;
+	else if(n == 2 && !strcmp(field[1], "stop"))
+		e->kind = SCHED_STOP;
+	else
+		return -1;
+	return 1;
+}
+
+static bool convert_events(struct converter *c, FILE *in)
+{
+	char line[LINE_MAX_LEN];
+	while(fgets(line, sizeof(line), in) != NULL) {
+		c->lineno += 1;
+
+		if(line[0] == '#' || strspn(line, " \t,\r\n") == strlen(line))
+			continue;
+
+		struct sched_event e;
+		const int parsed = parse_event(line, !c->started, &e);
+		c->started = true;
+		if(parsed < 0) {
+			fprintf(stderr, "%s:%u: Invalid event\n", c->path, c->lineno);
+			return false;
+		}
+		if(parsed > 0 && !emit(c, &e))
+			return false;
+	}
+	return true;
+}
+
+static bool convert_dump(struct converter *c, FILE *in, struct signal *signals, size_t len,
+		double clock)
+{
+	char line[LINE_MAX_LEN];
+	unsigned columns = 0;
+	for(size_t i = 0; i < len; i++)
+		columns = signals[i].last > columns? signals[i].last : columns;
+
+	while(fgets(line, sizeof(line), in) != NULL) {
+		c->lineno += 1;
+		if(line[0] == '#' || line[0] == ';' || strspn(line, " \t\r\n") == strlen(line))
+			continue;
+
+		// the time and the levels of the channels
+		uint8_t level[LINE_MAX_LEN / 2];
+		char *end;
+		const double time = strtod(line, &end);
+		const bool header = !c->started;
+		c->started = true;
+		if(end == line) {
+			if(header)
+				continue;
+			fprintf(stderr, "%s:%u: Invalid time\n", c->path, c->lineno);
+			return false;
+		}
+
+		unsigned n = 0;
+		for(char *p = end; *p == ',' && n < columns; ) {
+			p += 1 + strspn(p + 1, " \t");
+			if(*p != '0' && *p != '1')
+				break;
+			level[++n] = *p - '0';
+			p += 1 + strspn(p + 1, " \t");
+		}
+		if(n < columns) {
+			fprintf(stderr, "%s:%u: Expected %u channels of 0 or 1\n", c->path, c->lineno, columns);
+			return false;
+		}
+
+		const uint64_t cycle = llround(time * clock);
+		for(size_t i = 0; i < len; i++) {
+			struct signal *sig = &signals[i];
+			uint8_t value = 0;
+			for(unsigned k = sig->first; k <= sig->last; k++)
+				value |= level[k] << (k - sig->first);
+			if(value == sig->value)
+				continue;
+
+			struct sched_event e = {.cycle = cycle, .kind = sig->kind,
+				.port = sig->port, .value = value};
+			if(!emit(c, &e))
+				return false;
+			sig->value = value;
+		}
+	}
+	return true;
+}
+
+/**
+ * Parses in<port>=<first>[:<last>] or irq=<column> of -m.
+ */
+static bool parse_signal(const char *text, struct signal *sig)
+{
+	unsigned port = 0, first = 0, last = 0;
+	int len = 0;
+	memset(sig, 0, sizeof(*sig));
+
+	if(sscanf(text, "irq=%u%n", &first, &len) == 1 && text[len] == '\0') {
+		sig->kind = SCHED_INTERRUPT;
+		last = first;
+	}
+	else if(sscanf(text, "in%x=%u%n", &port, &first, &len) == 2 && port <= 0xFF) {
+		sig->kind = SCHED_INPUT;
+		last = first;
+		int more = 0;
+		if(text[len] == ':' && sscanf(text + len, ":%u%n", &last, &more) == 1)
+			len += more;
+	}
+	else
+		return false;
+
+	sig->port = port;
+	sig->first = first;
+	sig->last = last;
+	return text[len] == '\0' && first >= 1 && last >= first && last - first < 8
+		&& last < LINE_MAX_LEN / 2;
+}
+
+int main(int argc, char *argv[argc])
+{
+	struct signal signals[SIGNALS_MAX];
+	size_t len = 0;
+	bool dump = false;
+	double clock = DEFAULT_CLOCK;
+	bool quiet = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "qhf:m:c:")) != -1) {
+		switch(opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'f':
+			if(strcmp(optarg, "events") && strcmp(optarg, "la")) {
+				fprintf(stderr, "Unknown format: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			dump = !strcmp(optarg, "la");
+			break;
+		case 'm':
+			if(len == SIGNALS_MAX || !parse_signal(optarg, &signals[len])) {
+				fprintf(stderr, "Invalid signal, give in<port>=<first>[:<last>] or irq=<column>\n");
+				return EXIT_FAILURE;
+			}
+			len += 1;
+			break;
+		case 'c':
+			clock = strtod(optarg, NULL);
+			break;
+		case '?':
+			fprintf(stderr, "Unknown option or missing argument: -%c\n", optopt);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(argc - optind != 2) {
+		fprintf(stderr, "Give the input and the stimulus\n");
+		return EXIT_FAILURE;
+	}
+	if(dump != (len > 0)) {
+		fprintf(stderr, "The signals (-m) are the channels of a dump (-f la)\n");
+		return EXIT_FAILURE;
+	}
+
+	FILE *in = fopen(argv[optind], "r");
+	if(in == NULL) {
+		fprintf(stderr, "%s: Can not open the input\n", argv[optind]);
+		return EXIT_FAILURE;
+	}
+	FILE *out = fopen(argv[optind + 1], "wb");
+	if(out == NULL) {
+		fprintf(stderr, "%s: Can not create the stimulus\n", argv[optind + 1]);
+		fclose(in);
+		return EXIT_FAILURE;
+	}
+	setvbuf(out, NULL, _IOFBF, BUFFER_LEN);
+
+	struct converter c = {.out = out, .path = argv[optind]};
+	bool result = stimulus_write_header(out)
+		&& (dump? convert_dump(&c, in, signals, len, clock) : convert_events(&c, in));
+	if(ferror(in)) {
+		fprintf(stderr, "%s: Can not read the input\n", argv[optind]);
+		result = false;
+	}
+	if(fclose(out) != 0) {
+		fprintf(stderr, "%s: Can not write the stimulus\n", argv[optind + 1]);
+		result = false;
+	}
+	fclose(in);
+
+	if(result && !quiet)
+		fprintf(stderr, "Records: %llu, last cycle: %llu\n",
+				(unsigned long long) c.records, (unsigned long long) c.cycle);
+	return result? EXIT_SUCCESS : EXIT_FAILURE;
+}
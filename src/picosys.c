@@ -0,0 +1,321 @@
+/**
+ * picosys.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+/**
+ * Simulates a system of processors described by a file, one item per line:
+ *   core <hexfile> [events]
+ *   channel <core> <out-port> <core> <in-port> [depth]
+ *   status <core> <port> <in-port>   (after the channel)
+ * Cores are numbered from 0 in the order of their lines, ports are
+ * hexadecimal. The events of a core have the format of picosim -e. The channel
+ * connects the OUTPUT port to the INPUT port of the other core, the status
+ * port reads 1 when a value of the channel to the in-port can be read
+ * (see cluster.h). Relative paths are relative to the directory of the file,
+ * empty lines and lines starting by '#' are skipped. Values written to other
+ * ports are printed as <cycle> <core> <port> <value>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cluster.h"
+#include "path.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico System Simulator"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-n<cycles>] [-l<latency>] [-j<threads>] [-qh] <system>"
+
+#define DEFAULT_CYCLES 2000000
+#define DEFAULT_LATENCY 64
+#define LINE_MAX_LEN (2 * PATH_MAX)
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-n<cycles>       Cycles to simulate, default %d\n"
+				"\t-l<latency>      Cycles from OUTPUT to a channel until INPUT can read it,\n"
+				"\t                 default %d, the threads synchronize every latency cycles\n"
+				"\t-j<threads>      Number of threads, default the number of processors,\n"
+				"\t                 the results do not depend on it\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n", DEFAULT_CYCLES, DEFAULT_LATENCY);
+	printf("Lines of the system: core <hexfile> [events],\n"
+			"channel <core> <out-port> <core> <in-port> [depth], status <core> <port> <in-port>\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+/**
+ * Loads the HEX file produced by pico.
+ */
+static bool load_hex(struct sim *s, const char *hexfile)
+{
+	code_t code[SIM_PROGRAM_LEN];
+	progaddr_t len;
+	return sim_read_hex(hexfile, code, &len) && sim_load(s, code, len);
+}
+
+static bool load_events(struct sched *q, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return false;
+
+	unsigned lineno;
+	const bool result = sched_read(q, f, &lineno);
+	fclose(f);
+	if(!result)
+		fprintf(stderr, "%s:%u: invalid event\n", path, lineno);
+	return result;
+}
+
+/**
+ * Splits the line to at most max fields.
+ * @return number of fields
+ */
+static int split(char *line, char *field[], int max)
+{
+	char *save = NULL;
+	int n = 0;
+	for(char *tok = strtok_r(line, " \t\r\n", &save); tok != NULL && n < max;
+			tok = strtok_r(NULL, " \t\r\n", &save))
+		field[n++] = tok;
+	return n;
+}
+
+static bool parse_core(struct cluster *c, unsigned core, char *field[], int n,
+		const char *dir)
+{
+	char *path = path_resolve(dir, field[1]);
+	if(path == NULL)
+		return false;
+	if(!load_hex(cluster_sim(c, core), path)) {
+		fprintf(stderr, "Can not load the program file '%s'\n", path);
+		free(path);
+		return false;
+	}
+	free(path);
+
+	if(n < 3)
+		return true;
+
+	path = path_resolve(dir, field[2]);
+	if(path == NULL)
+		return false;
+	const bool result = load_events(cluster_sched(c, core), path);
+	if(!result)
+		fprintf(stderr, "Can not read the events '%s'\n", path);
+	free(path);
+	return result;
+}
+
+static bool parse_number(const char *text, int base, unsigned long max, unsigned long *value)
+{
+	char *end;
+	*value = strtoul(text, &end, base);
+	return *text != '\0' && *end == '\0' && *value <= max;
+}
+
+static bool parse_link(struct cluster *c, unsigned cores, char *field[], int n)
+{
+	unsigned long v[5] = {0, 0, 0, 0, CLUSTER_DEPTH};
+	const bool status = !strcmp(field[0], "status");
+	for(int i = 1; i < n; i++) {
+		const bool core = i == 1 || (!status && i == 3);
+		const unsigned long max = core? cores - 1 : i == 5? UINT32_MAX : 0xFF;
+		if(!parse_number(field[i], core || i == 5? 10 : 16, max, &v[i - 1]))
+			return false;
+	}
+
+	if(status)
+		return cluster_status(c, v[0], v[1], v[2]);
+	return cluster_channel(c, v[0], v[1], v[2], v[3], v[4]);
+}
+
+/**
+ * Reads the system, the cores are counted by the first pass.
+ * @return NULL on error
+ */
+static struct cluster *read_system(const char *file, uint64_t latency, unsigned *cores)
+{
+	FILE *f = fopen(file, "r");
+	if(f == NULL) {
+		fprintf(stderr, "Can not open the system '%s'\n", file);
+		return NULL;
+	}
+
+	char dir[PATH_MAX];
+	path_dir(dir, sizeof(dir), file);
+
+	static char line[LINE_MAX_LEN];
+	char *field[7];
+	*cores = 0;
+	while(fgets(line, sizeof(line), f) != NULL) {
+		if(split(line, field, 7) > 0 && !strcmp(field[0], "core"))
+			*cores += 1;
+	}
+
+	struct cluster *c = cluster_init(*cores, latency);
+	if(c == NULL) {
+		fprintf(stderr, *cores == 0 || *cores > CLUSTER_CORES?
+				"The system needs 1 to %d cores\n" : "Memory allocation error\n", CLUSTER_CORES);
+		fclose(f);
+		return NULL;
+	}
+
+	rewind(f);
+	unsigned lineno = 0;
+	unsigned core = 0;
+	bool result = true;
+
+	while(result && fgets(line, sizeof(line), f) != NULL) {
+		lineno += 1;
+		const int n = split(line, field, 7);
+		if(n == 0 || field[0][0] == '#')
+			continue;
+
+		if(!strcmp(field[0], "core") && (n == 2 || n == 3))
+			result = parse_core(c, core++, field, n, dir);
+		else if(!strcmp(field[0], "channel") && (n == 5 || n == 6))
+			result = parse_link(c, *cores, field, n);
+		else if(!strcmp(field[0], "status") && n == 4)
+			result = parse_link(c, *cores, field, n);
+		else
+			result = false;
+
+		if(!result)
+			fprintf(stderr, "%s:%u: invalid line\n", file, lineno);
+	}
+
+	fclose(f);
+	if(!result) {
+		cluster_destroy(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+static void print_output(unsigned core, const struct port_log *e, void *ctx)
+{
+	fprintf((FILE *) ctx, "%llu %u %.2X %.2X\n", (unsigned long long) e->cycle,
+			core, e->port, e->value);
+}
+
+static void summary(struct cluster *c, unsigned cores, double seconds)
+{
+	static const char *status[] = {
+		[SIM_RUNNING] = "running",
+		[SIM_BUDGET] = "budget exhausted",
+		[SIM_INVALID] = "invalid instruction",
+		[SIM_STOPPED] = "stopped",
+		[SIM_BREAK] = "breakpoint"
+	};
+
+	uint64_t instructions = 0;
+	uint64_t cycles = 0;
+	for(unsigned i = 0; i < cores; i++) {
+		const struct sim *s = cluster_sim(c, i);
+		fprintf(stderr, "Core %u: %s at %.3X, instructions: %llu, lost: %llu\n",
+				i, status[s->status], s->pc, (unsigned long long) s->instructions,
+				(unsigned long long) cluster_lost(c, i));
+		instructions += s->instructions;
+		if(s->cycles > cycles)
+			cycles = s->cycles;
+	}
+
+	fprintf(stderr, "Instructions: %llu, cycles: %llu",
+			(unsigned long long) instructions, (unsigned long long) cycles);
+	if(seconds > 0)
+		fprintf(stderr, ", %.1f MIPS", instructions / seconds / 1e6);
+	fprintf(stderr, " (%u threads)\n", cluster_threads(c));
+}
+
+int main(int argc, char *argv[argc])
+{
+	unsigned long long cycles = DEFAULT_CYCLES;
+	unsigned long long latency = DEFAULT_LATENCY;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	bool quiet = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "qhn:l:j:")) != -1) {
+		switch(opt) {
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'n':
+			cycles = strtoull(optarg, NULL, 0);
+			break;
+		case 'l':
+			latency = strtoull(optarg, NULL, 0);
+			break;
+		case 'j':
+			threads = atol(optarg);
+			break;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(optind + 1 != argc) {
+		fprintf(stderr, "Give one system file\n");
+		return EXIT_FAILURE;
+	}
+
+	if(latency == 0) {
+		fprintf(stderr, "The latency must be at least 1 cycle\n");
+		return EXIT_FAILURE;
+	}
+
+	unsigned cores;
+	struct cluster *c = read_system(argv[optind], latency, &cores);
+	if(c == NULL)
+		return EXIT_FAILURE;
+
+	if(threads < 1)
+		threads = 1;
+	if((unsigned long) threads > cores)
+		threads = cores;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	const bool result = cluster_run(c, cycles, threads, &print_output, stdout);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if(!result)
+		fprintf(stderr, "Memory allocation error\n");
+	if(!quiet)
+		summary(c, cores, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+	cluster_destroy(c);
+	return result? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,122 @@
+/**
+ * picotrace.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+
+#define PROGRAM "Pico Trace"
+#define AUTHOR "Jan Viktorin"
+#define YEAR "2010"
+#define VERSION "0.1"
+#define USAGE "[-oqh] <trace>"
+
+static void help(char *pname)
+{
+	printf("Program '%s' v%s, Copyright (c) %s %s\n", PROGRAM, VERSION, YEAR, AUTHOR);
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-o               Prints only the outputs like picosim\n"
+				"\t-q               Quite mode, no summary\n"
+				"\t-h               Prints this help\n");
+	printf("Converts the trace recorded by 'picosim -t' to text, one instruction per line:\n"
+			"<cycle> <pc> [INT] [s<reg>=<value>] [Z=<z> C=<c> IE=<ie>]\n"
+			"[IN <port> <value>] [OUT <port> <value>] [STORE <address> <value>]\n");
+	printf("This program is under GNU GPL license, please see www.gnu.org\n");
+}
+
+static void print_record(const struct trace_record *rec)
+{
+	printf("%llu %.3X", (unsigned long long) rec->cycle, rec->pc);
+	if(rec->what & TRACE_INTERRUPT)
+		printf(" INT");
+	if(rec->what & TRACE_REG)
+		printf(" s%X=%.2X", rec->reg, rec->value);
+	if(rec->what & TRACE_FLAGS)
+		printf(" Z=%d C=%d IE=%d", !!(rec->flags & TRACE_FLAG_ZERO),
+				!!(rec->flags & TRACE_FLAG_CARRY), !!(rec->flags & TRACE_FLAG_IE));
+	if(rec->what & TRACE_INPUT)
+		printf(" IN %.2X %.2X", rec->port, rec->data);
+	if(rec->what & TRACE_OUTPUT)
+		printf(" OUT %.2X %.2X", rec->port, rec->data);
+	if(rec->what & TRACE_STORE)
+		printf(" STORE %.2X %.2X", rec->address, rec->stored);
+	putchar('\n');
+}
+
+int main(int argc, char *argv[argc])
+{
+	bool outputs = false;
+	bool quiet = false;
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "oqh")) != -1) {
+		switch(opt) {
+		case 'o':
+			outputs = true;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(optind + 1 != argc) {
+		fprintf(stderr, "Give one trace file\n");
+		return EXIT_FAILURE;
+	}
+
+	struct trace_reader *r = trace_reader_open(argv[optind]);
+	if(r == NULL) {
+		fprintf(stderr, "Can not read the trace\n");
+		return EXIT_FAILURE;
+	}
+
+	const struct trace_state *st = trace_reader_state(r);
+	const uint64_t first = st->instructions;
+	struct trace_record rec;
+
+	while(trace_reader_next(r, &rec)) {
+		if(!outputs)
+			print_record(&rec);
+		else if(rec.what & TRACE_OUTPUT)
+			// picosim prints the cycle after the instruction
+			printf("%llu %.2X %.2X\n", (unsigned long long) rec.cycle + SIM_CYCLES_PER_INSTR,
+					rec.port, rec.data);
+	}
+
+	const bool failed = trace_reader_error(r);
+	if(failed)
+		fprintf(stderr, "The trace is truncated or invalid\n");
+	if(!quiet)
+		fprintf(stderr, "Instructions: %llu, cycles: %llu, pc: %.3X\n",
+				(unsigned long long) (st->instructions - first),
+				(unsigned long long) st->cycles, st->pc);
+
+	trace_reader_close(r);
+	return failed? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,286 @@
+/**
+ * ports.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "ports.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct ports *ports_init(port_notify_t notify, void *ctx)
+{
+	struct ports *p = (struct ports *) calloc(1, sizeof(struct ports));
+	if(p == NULL)
+		return NULL;
+
+	p->notify = notify;
+	p->ctx = ctx;
+	return p;
+}
+
+static void release(struct port *q)
+{
+	free(q->buffer);
+	memset(q, 0, sizeof(struct port));
+}
+
+void ports_destroy(struct ports *p)
+{
+	if(p == NULL)
+		return;
+
+	for(int i = 0; i < PORTS; i++) {
+		release(&p->in[i]);
+		release(&p->out[i]);
+	}
+
+	free(p);
+}
+
+void ports_attach(struct ports *p, struct sim *s)
+{
+	p->host = s->io;
+	s->io.input = &ports_input;
+	s->io.output = &ports_output;
+	s->io.ctx = p;
+	s->ports = p;
+}
+
+void ports_detach(struct ports *p, struct sim *s)
+{
+	s->io = p->host;
+	s->ports = NULL;
+}
+
+static struct port *get(struct ports *p, enum port_dir dir, uint8_t port)
+{
+	return dir == PORT_IN? &p->in[port] : &p->out[port];
+}
+
+// =================================== //
+// ------------- models -------------- //
+// =================================== //
+
+void ports_register(struct ports *p, enum port_dir dir, uint8_t port, uint8_t value)
+{
+	struct port *q = get(p, dir, port);
+	release(q);
+	q->kind = PORT_REGISTER;
+	q->value = value;
+}
+
+bool ports_fifo(struct ports *p, enum port_dir dir, uint8_t port, enum port_kind kind,
+		uint32_t size, uint32_t threshold)
+{
+	if(size == 0 || (size & (size - 1)) != 0)
+		return false;
+	if(kind != PORT_FIFO && kind != PORT_RING)
+		return false;
+
+	struct port *q = get(p, dir, port);
+	release(q);
+	q->buffer = (uint8_t *) malloc(size);
+	if(q->buffer == NULL)
+		return false;
+
+	q->kind = kind;
+	q->mask = size - 1;
+	q->threshold = threshold;
+	return true;
+}
+
+void ports_watch(struct ports *p, enum port_dir dir, uint8_t port, bool watch)
+{
+	get(p, dir, port)->watch = watch;
+}
+
+void ports_constant(struct ports *p, uint8_t port, uint8_t value)
+{
+	ports_register(p, PORT_IN, port, value);
+}
+
+void ports_counter(struct ports *p, uint8_t port, uint8_t start, uint8_t step)
+{
+	struct port *q = get(p, PORT_IN, port);
+	release(q);
+	q->kind = PORT_COUNTER;
+	q->value = start;
+	q->step = step;
+}
+
+void ports_log(struct ports *p, uint8_t port)
+{
+	struct port *q = get(p, PORT_OUT, port);
+	release(q);
+	q->kind = PORT_LOG;
+}
+
+// =================================== //
+// ------------ host side ------------ //
+// =================================== //
+
+static bool is_fifo(const struct port *q)
+{
+	return q->kind == PORT_FIFO || q->kind == PORT_RING;
+}
+
+/**
+ * Appends to the FIFO, a full ring drops its oldest value.
+ */
+static bool push(struct port *q, uint8_t value)
+{
+	if(q->tail - q->head > q->mask) {
+		if(q->kind != PORT_RING) {
+			q->lost += 1;
+			return false;
+		}
+		q->head += 1;
+		q->lost += 1;
+	}
+
+	q->buffer[q->tail++ & q->mask] = value;
+	return true;
+}
+
+static bool pop(struct port *q, uint8_t *value)
+{
+	if(q->tail == q->head)
+		return false;
+
+	*value = q->buffer[q->head++ & q->mask];
+	return true;
+}
+
+bool ports_push(struct ports *p, enum port_dir dir, uint8_t port, uint8_t value)
+{
+	struct port *q = get(p, dir, port);
+	return is_fifo(q) && push(q, value);
+}
+
+bool ports_pop(struct ports *p, enum port_dir dir, uint8_t port, uint8_t *value)
+{
+	struct port *q = get(p, dir, port);
+	return is_fifo(q) && pop(q, value);
+}
+
+uint32_t ports_level(const struct ports *p, enum port_dir dir, uint8_t port)
+{
+	const struct port *q = dir == PORT_IN? &p->in[port] : &p->out[port];
+	return is_fifo(q)? q->tail - q->head : 0;
+}
+
+static void notify(struct sim *s, struct ports *p, enum port_dir dir, uint8_t port,
+		enum port_event event)
+{
+	if(p->notify != NULL)
+		p->notify(s, p, dir, port, event, p->ctx);
+}
+
+void ports_flush(struct sim *s, struct ports *p)
+{
+	if(p->log_len > 0)
+		notify(s, p, PORT_OUT, p->log[p->log_len - 1].port, PORT_LOG_FULL);
+	p->log_len = 0;
+}
+
+void ports_print_log(struct sim *s, struct ports *p, enum port_dir dir,
+		uint8_t port, enum port_event event, void *ctx)
+{
+	(void) s;
+	(void) dir;
+	(void) port;
+	if(event != PORT_LOG_FULL)
+		return;
+
+	FILE *f = (FILE *) ctx;
+	for(uint32_t i = 0; i < p->log_len; i++)
+		fprintf(f, "%llu %.2X %.2X\n", (unsigned long long) p->log[i].cycle,
+				p->log[i].port, p->log[i].value);
+}
+
+// =================================== //
+// ----------- slow paths ------------ //
+// =================================== //
+
+uint8_t ports_input(struct sim *s, uint8_t port, void *ctx)
+{
+	struct ports *p = (struct ports *) ctx;
+	struct port *q = &p->in[port];
+	uint8_t value = 0;
+
+	switch(q->kind) {
+	case PORT_REGISTER:
+		value = q->value;
+		break;
+	case PORT_COUNTER:
+		value = q->value;
+		q->value += q->step;
+		break;
+	case PORT_FIFO:
+	case PORT_RING:
+		if(!pop(q, &value)) {
+			value = q->value;
+			q->lost += 1;
+		}
+		else if(q->tail - q->head == q->threshold)
+			notify(s, p, PORT_IN, port, PORT_THRESHOLD);
+		break;
+	default:
+		if(p->host.input != NULL)
+			value = p->host.input(s, port, p->host.ctx);
+		break;
+	}
+
+	if(q->watch)
+		notify(s, p, PORT_IN, port, PORT_WATCH);
+	return value;
+}
+
+void ports_output(struct sim *s, uint8_t port, uint8_t value, void *ctx)
+{
+	struct ports *p = (struct ports *) ctx;
+	struct port *q = &p->out[port];
+
+	switch(q->kind) {
+	case PORT_REGISTER:
+	case PORT_COUNTER:
+		q->value = value;
+		break;
+	case PORT_FIFO:
+	case PORT_RING:
+		if(push(q, value) && q->tail - q->head == q->threshold)
+			notify(s, p, PORT_OUT, port, PORT_THRESHOLD);
+		break;
+	case PORT_LOG:
+		p->log[p->log_len].cycle = s->cycles;
+		p->log[p->log_len].port = port;
+		p->log[p->log_len].value = value;
+		p->log_len += 1;
+		if(p->log_len == PORTS_LOG) {
+			notify(s, p, PORT_OUT, port, PORT_LOG_FULL);
+			p->log_len = 0;
+		}
+		break;
+	default:
+		if(p->host.output != NULL)
+			p->host.output(s, port, value, p->host.ctx);
+		break;
+	}
+
+	if(q->watch)
+		notify(s, p, PORT_OUT, port, PORT_WATCH);
+}
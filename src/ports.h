@@ -0,0 +1,238 @@
+/**
+ * ports.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _PORTS_H
+#define _PORTS_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Models of I/O ports kept in memory. The simulator reads and writes
+ * them inline without calling the host. The host is notified only when
+ * a watched port is accessed, when a FIFO reaches its threshold or when
+ * the log of outputs is full. Ports without a model use the callbacks
+ * of the simulator given before ports_attach.
+ */
+
+#define PORTS 256
+#define PORTS_LOG 4096	// entries of the log delivered at once
+#define PORTS_NO_THRESHOLD UINT32_MAX
+
+enum port_dir {
+	PORT_IN,
+	PORT_OUT
+};
+
+enum port_kind {
+	PORT_HOST,	// callbacks of the simulator
+	PORT_REGISTER,	// a byte of memory
+	PORT_COUNTER,	// INPUT reads the value, then the step is added
+	PORT_FIFO,	// INPUT from an empty FIFO reads the default value, OUTPUT to a full one is lost
+	PORT_RING,	// like FIFO, but a write to a full ring overwrites the oldest value
+	PORT_LOG	// OUTPUT is appended to the log of all logging ports
+};
+
+enum port_event {
+	PORT_WATCH,	// a watched port was accessed
+	PORT_THRESHOLD,	// a FIFO reached its threshold
+	PORT_LOG_FULL	// the log is full or flushed, see ports_log
+};
+
+struct port {
+	uint8_t kind;
+	uint8_t value;	// of register, counter or the default of FIFO
+	uint8_t step;
+	bool watch;
+	uint8_t *buffer;	// of FIFO and ring
+	uint32_t mask;	// size - 1
+	uint32_t head;	// free running indexes
+	uint32_t tail;
+	uint32_t threshold;	// level that notifies the host
+	uint32_t lost;	// reads from empty and writes to full FIFO
+};
+
+struct port_log {
+	uint64_t cycle;
+	uint8_t port;
+	uint8_t value;
+};
+
+struct ports;
+
+/**
+ * Host notification, it can stop the simulation or raise the interrupt.
+ */
+typedef void (*port_notify_t)(struct sim *s, struct ports *p, enum port_dir dir,
+		uint8_t port, enum port_event event, void *ctx);
+
+struct ports {
+	struct port in[PORTS];
+	struct port out[PORTS];
+	struct port_log log[PORTS_LOG];
+	uint32_t log_len;
+
+	struct sim_io host;	// for PORT_HOST
+	port_notify_t notify;
+	void *ctx;
+};
+
+/**
+ * @return NULL on allocation error
+ */
+struct ports *ports_init(port_notify_t notify, void *ctx);
+
+void ports_destroy(struct ports *p);
+
+/**
+ * Connects the models to the simulator, its current callbacks serve
+ * the ports without a model.
+ */
+void ports_attach(struct ports *p, struct sim *s);
+
+void ports_detach(struct ports *p, struct sim *s);
+
+void ports_register(struct ports *p, enum port_dir dir, uint8_t port, uint8_t value);
+
+/**
+ * @param size power of 2
+ * @param threshold level that notifies the host when it is reached by OUTPUT
+ * (to drain the FIFO) or by INPUT (to fill it), PORTS_NO_THRESHOLD for none
+ * @return false on allocation error
+ */
+bool ports_fifo(struct ports *p, enum port_dir dir, uint8_t port, enum port_kind kind,
+		uint32_t size, uint32_t threshold);
+
+void ports_watch(struct ports *p, enum port_dir dir, uint8_t port, bool watch);
+
+/**
+ * Stock models.
+ */
+void ports_constant(struct ports *p, uint8_t port, uint8_t value);
+void ports_counter(struct ports *p, uint8_t port, uint8_t start, uint8_t step);
+void ports_log(struct ports *p, uint8_t port);
+
+/**
+ * Host side of FIFOs and rings.
+ * @return false when the FIFO is full (push) or empty (pop)
+ */
+bool ports_push(struct ports *p, enum port_dir dir, uint8_t port, uint8_t value);
+bool ports_pop(struct ports *p, enum port_dir dir, uint8_t port, uint8_t *value);
+uint32_t ports_level(const struct ports *p, enum port_dir dir, uint8_t port);
+
+/**
+ * Delivers the rest of the log by PORT_LOG_FULL, eg. at the end of the simulation.
+ */
+void ports_flush(struct sim *s, struct ports *p);
+
+/**
+ * Notification that prints the log like picosim to the FILE given as ctx.
+ */
+void ports_print_log(struct sim *s, struct ports *p, enum port_dir dir,
+		uint8_t port, enum port_event event, void *ctx);
+
+/**
+ * Slow paths, the callbacks of the simulator after ports_attach.
+ */
+uint8_t ports_input(struct sim *s, uint8_t port, void *ctx);
+void ports_output(struct sim *s, uint8_t port, uint8_t value, void *ctx);
+
+/**
+ * @return true when INPUT reads the same value until the host changes it
+ */
+static inline bool ports_stable(const struct ports *p, uint8_t port)
+{
+	const struct port *q = &p->in[port];
+	return !q->watch && (q->kind == PORT_REGISTER || q->kind == PORT_HOST);
+}
+
+// =================================== //
+// ------- inline access by sim ------ //
+// =================================== //
+
+/**
+ * Reads the port when the host need not be called.
+ * @return false to take the slow path
+ */
+static inline bool ports_fast_input(struct ports *p, uint8_t port, uint8_t *value)
+{
+	struct port *q = &p->in[port];
+	if(q->watch)
+		return false;
+
+	switch(q->kind) {
+	case PORT_REGISTER:
+		*value = q->value;
+		return true;
+	case PORT_COUNTER:
+		*value = q->value;
+		q->value += q->step;
+		return true;
+	case PORT_FIFO:
+	case PORT_RING: {
+		const uint32_t level = q->tail - q->head;
+		if(level == 0 || level - 1 == q->threshold)
+			return false;
+		*value = q->buffer[q->head++ & q->mask];
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+/**
+ * Writes the port when the host need not be called.
+ * @return false to take the slow path
+ */
+static inline bool ports_fast_output(struct ports *p, uint8_t port, uint8_t value,
+		uint64_t cycle)
+{
+	struct port *q = &p->out[port];
+	if(q->watch)
+		return false;
+
+	switch(q->kind) {
+	case PORT_REGISTER:
+		q->value = value;
+		return true;
+	case PORT_FIFO:
+	case PORT_RING: {
+		const uint32_t level = q->tail - q->head;
+		if(level > q->mask || level + 1 == q->threshold)
+			return false;
+		q->buffer[q->tail++ & q->mask] = value;
+		return true;
+	}
+	case PORT_LOG:
+		if(p->log_len + 1 >= PORTS_LOG)
+			return false;
+		p->log[p->log_len].cycle = cycle;
+		p->log[p->log_len].port = port;
+		p->log[p->log_len].value = value;
+		p->log_len += 1;
+		return true;
+	default:
+		return false;
+	}
+}
+
+#endif
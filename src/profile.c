@@ -0,0 +1,411 @@
+/**
+ * profile.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+#define NAME_MAX_LEN 64
+#define INSTR_MAX_LEN (NAME_MAX_LEN + 16)
+
+/**
+ * Node of the call tree, a path from the root is a folded stack.
+ */
+struct node {
+	uint16_t entry;
+	uint32_t parent;
+	uint32_t child;	// the first one, 0 for none (the root is never a child)
+	uint32_t sibling;
+	uint64_t cycles;
+};
+
+struct frame {
+	uint16_t entry;
+	uint32_t node;
+	uint64_t start;
+};
+
+struct stats {
+	bool found;
+	unsigned active;	// frames on the stack
+	uint64_t calls;
+	uint64_t inclusive;
+	uint64_t exclusive;
+};
+
+struct profile {
+	struct sim *sim;
+	uint64_t start;
+	uint64_t count[SIM_PROGRAM_LEN];
+	uint64_t cycles[SIM_PROGRAM_LEN];
+	struct stats routine[SIM_PROGRAM_LEN];
+	char *name[SIM_PROGRAM_LEN];
+
+	struct frame stack[PROFILE_STACK];
+	unsigned depth;
+	unsigned lost;	// calls deeper than the stack not returned yet
+
+	struct node *nodes;
+	size_t len;
+	size_t size;
+};
+
+struct profile *profile_init(struct sim *s)
+{
+	struct profile *p = (struct profile *) calloc(1, sizeof(struct profile));
+	if(p == NULL)
+		return NULL;
+
+	p->size = 64;
+	p->nodes = (struct node *) calloc(p->size, sizeof(struct node));
+	if(p->nodes == NULL) {
+		free(p);
+		return NULL;
+	}
+
+	p->sim = s;
+	p->start = s->cycles;
+	p->len = 1;
+	p->nodes[0].entry = s->pc;
+	p->stack[0].entry = s->pc;
+	p->stack[0].start = s->cycles;
+	p->depth = 1;
+
+	struct stats *root = &p->routine[s->pc];
+	root->found = true;
+	root->active = 1;
+	root->calls = 1;
+	return p;
+}
+
+void profile_destroy(struct profile *p)
+{
+	if(p == NULL)
+		return;
+
+	for(int i = 0; i < SIM_PROGRAM_LEN; i++)
+		free(p->name[i]);
+	free(p->nodes);
+	free(p);
+}
+
+bool profile_name(struct profile *p, uint16_t addr, const char *name)
+{
+	const size_t len = strlen(name);
+	char *copy = (char *) malloc(len + 1);
+	if(copy == NULL)
+		return false;
+
+	memcpy(copy, name, len + 1);
+	addr &= PC_MASK;
+	free(p->name[addr]);
+	p->name[addr] = copy;
+	return true;
+}
+
+const char *profile_label(const struct profile *p, uint16_t addr)
+{
+	return p->name[addr & PC_MASK];
+}
+
+uint16_t profile_current(const struct profile *p)
+{
+	return p->stack[p->depth - 1].entry;
+}
+
+uint64_t profile_count(const struct profile *p, uint16_t addr)
+{
+	return p->count[addr & PC_MASK];
+}
+
+uint64_t profile_cycles(const struct profile *p, uint16_t addr)
+{
+	return p->cycles[addr & PC_MASK];
+}
+
+// =================================== //
+// ------------ profiling ------------ //
+// =================================== //
+
+/**
+ * @return the child of the node for the subroutine, the node itself
+ * on allocation error
+ */
+static uint32_t child(struct profile *p, uint32_t node, uint16_t entry)
+{
+	uint32_t i = p->nodes[node].child;
+	for(; i != 0; i = p->nodes[i].sibling) {
+		if(p->nodes[i].entry == entry)
+			return i;
+	}
+
+	if(p->len == p->size) {
+		struct node *nodes = (struct node *)
+			realloc(p->nodes, 2 * p->size * sizeof(struct node));
+		if(nodes == NULL)
+			return node;
+
+		p->nodes = nodes;
+		p->size *= 2;
+	}
+
+	i = p->len++;
+	memset(&p->nodes[i], 0, sizeof(struct node));
+	p->nodes[i].entry = entry;
+	p->nodes[i].parent = node;
+	p->nodes[i].sibling = p->nodes[node].child;
+	p->nodes[node].child = i;
+	return i;
+}
+
+static void enter(struct profile *p, uint16_t entry, uint64_t cycle)
+{
+	struct stats *r = &p->routine[entry];
+	r->found = true;
+	r->calls += 1;
+
+	if(p->depth == PROFILE_STACK) {
+		p->lost += 1;
+		return;
+	}
+
+	struct frame *f = &p->stack[p->depth++];
+	f->entry = entry;
+	f->node = child(p, p->stack[p->depth - 2].node, entry);
+	f->start = cycle;
+	r->active += 1;
+}
+
+static void leave(struct profile *p, uint64_t cycle)
+{
+	if(p->lost > 0) {
+		p->lost -= 1;
+		return;
+	}
+	if(p->depth == 1)
+		return;	// the root does not return
+
+	const struct frame *f = &p->stack[--p->depth];
+	struct stats *r = &p->routine[f->entry];
+	if(--r->active == 0)
+		r->inclusive += cycle - f->start;
+}
+
+/**
+ * Attributes the cycles spent at the address to the running subroutine.
+ */
+static void spend(struct profile *p, uint16_t addr, uint64_t spent)
+{
+	const struct frame *top = &p->stack[p->depth - 1];
+	p->cycles[addr] += spent;
+	p->routine[top->entry].exclusive += spent;
+	p->nodes[top->node].cycles += spent;
+}
+
+static void acknowledged(struct sim *s, uint64_t end, void *ctx)
+{
+	struct profile *p = (struct profile *) ctx;
+	enter(p, SIM_VECTOR, end);
+	spend(p, SIM_VECTOR, s->cycles - end);
+}
+
+static void after(struct sim *s, const struct step *st, void *ctx)
+{
+	struct profile *p = (struct profile *) ctx;
+	if(st->ack)
+		enter(p, SIM_VECTOR, st->cycle);
+
+	p->count[st->address] += 1;
+	spend(p, st->address, s->cycles - st->cycle);
+
+	// taken calls and returns move the stack pointer
+	const struct sim_instr *ins = &s->rom[st->address];
+	switch(ins->op) {
+	case S_CALL: case S_CALL_Z: case S_CALL_NZ: case S_CALL_C: case S_CALL_NC:
+		if(s->sp != st->sp)
+			enter(p, ins->target, s->cycles);
+		break;
+	case S_RETURN: case S_RETURN_Z: case S_RETURN_NZ: case S_RETURN_C:
+	case S_RETURN_NC: case S_RETURNI_DISABLE: case S_RETURNI_ENABLE:
+		if(s->sp != st->sp)
+			leave(p, s->cycles);
+		break;
+	default:
+		break;
+	}
+}
+
+bool profile_observe(struct profile *p, struct stepper *st)
+{
+	const struct step_observer o = {.acknowledged = &acknowledged, .after = &after, .ctx = p};
+	return step_observe(st, &o);
+}
+
+bool profile_routine(const struct profile *p, uint16_t entry, struct profile_routine *r)
+{
+	entry &= PC_MASK;
+	const struct stats *st = &p->routine[entry];
+	if(!st->found)
+		return false;
+
+	r->entry = entry;
+	r->calls = st->calls;
+	r->exclusive = st->exclusive;
+	r->inclusive = st->inclusive;
+
+	// the outermost frame of a running subroutine
+	for(unsigned i = 0; i < p->depth; i++) {
+		if(p->stack[i].entry == entry) {
+			r->inclusive += p->sim->cycles - p->stack[i].start;
+			break;
+		}
+	}
+
+	return true;
+}
+
+// =================================== //
+// ------------- output -------------- //
+// =================================== //
+
+static const char *op_name[] = {
+#define SIM_OP_NAME(op) #op,
+	SIM_OPS(SIM_OP_NAME)
+};
+
+static const char *name_of(const struct profile *p, uint16_t addr, char buf[NAME_MAX_LEN])
+{
+	if(p->name[addr] != NULL)
+		return p->name[addr];
+
+	snprintf(buf, NAME_MAX_LEN, "%.3X", addr);
+	return buf;
+}
+
+/**
+ * Formats the instruction like the source, eg. JUMP NZ, loop.
+ */
+static void disassemble(const struct profile *p, const struct sim_instr *ins,
+		char buf[INSTR_MAX_LEN])
+{
+	const char *name = op_name[ins->op] + 2;	// without S_
+	const size_t len = strlen(name);
+	const char *suffix = len > 3 && name[len - 3] == '_'? name + len - 2 : NULL;
+	const bool memory = ins->op >= S_FETCH_RR && ins->op <= S_OUTPUT_RK;
+	char target[NAME_MAX_LEN];
+
+	if(suffix != NULL && !strcmp(suffix, "RR"))
+		snprintf(buf, INSTR_MAX_LEN, memory? "%.*s s%X, (s%X)" : "%.*s s%X, s%X",
+				(int) len - 3, name, ins->x, ins->y);
+	else if(suffix != NULL && !strcmp(suffix, "RK"))
+		snprintf(buf, INSTR_MAX_LEN, "%.*s s%X, %.2X", (int) len - 3, name, ins->x, ins->y);
+	else if(ins->op >= S_SL0 && ins->op <= S_RR)
+		snprintf(buf, INSTR_MAX_LEN, "%s s%X", name, ins->x);
+	else if(ins->op >= S_JUMP && ins->op <= S_CALL_NC) {
+		const char *cond = strchr(name, '_');
+		snprintf(buf, INSTR_MAX_LEN, "%.4s %s%s%s", name, cond != NULL? cond + 1 : "",
+				cond != NULL? ", " : "", name_of(p, ins->target, target));
+	}
+	else if(ins->op == S_INVALID)
+		snprintf(buf, INSTR_MAX_LEN, "-");
+	else {
+		snprintf(buf, INSTR_MAX_LEN, "%s", name);
+		for(char *c = buf; *c != '\0'; c++)
+			*c = *c == '_'? ' ' : *c;
+	}
+}
+
+static int cmp_inclusive(const void *a, const void *b)
+{
+	const struct profile_routine *x = (const struct profile_routine *) a;
+	const struct profile_routine *y = (const struct profile_routine *) b;
+	if(x->inclusive != y->inclusive)
+		return x->inclusive < y->inclusive? 1 : -1;
+	return x->entry - y->entry;
+}
+
+static double percent(uint64_t part, uint64_t total)
+{
+	return total == 0? 0 : 100.0 * part / total;
+}
+
+void profile_print(const struct profile *p, FILE *f)
+{
+	const struct sim *s = p->sim;
+	const uint64_t total = s->cycles - p->start;
+	struct profile_routine routines[SIM_PROGRAM_LEN];
+	size_t len = 0;
+	char name[NAME_MAX_LEN];
+
+	for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+		if(profile_routine(p, i, &routines[len]))
+			len += 1;
+	}
+	qsort(routines, len, sizeof(routines[0]), &cmp_inclusive);
+
+	fprintf(f, "# %llu cycles\n", (unsigned long long) total);
+	fprintf(f, "#     calls    inclusive       %%    exclusive       %%  routine\n");
+	for(size_t i = 0; i < len; i++) {
+		const struct profile_routine *r = &routines[i];
+		fprintf(f, "%11llu %12llu %6.2f%% %12llu %6.2f%%  %s\n",
+				(unsigned long long) r->calls,
+				(unsigned long long) r->inclusive, percent(r->inclusive, total),
+				(unsigned long long) r->exclusive, percent(r->exclusive, total),
+				name_of(p, r->entry, name));
+	}
+
+	fprintf(f, "\n#     count       cycles       %%  addr  instruction\n");
+	for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+		if(p->count[i] == 0 && p->name[i] == NULL && s->code[i] == 0)
+			continue;
+
+		char ins[INSTR_MAX_LEN];
+		disassemble(p, &s->rom[i], ins);
+		if(p->name[i] != NULL)
+			fprintf(f, "%*s%s:\n", 42, "", p->name[i]);
+		fprintf(f, "%11llu %12llu %6.2f%%   %.3X  %s\n",
+				(unsigned long long) p->count[i], (unsigned long long) p->cycles[i],
+				percent(p->cycles[i], total), i, ins);
+	}
+}
+
+void profile_print_folded(const struct profile *p, FILE *f)
+{
+	char name[NAME_MAX_LEN];
+
+	for(size_t i = 0; i < p->len; i++) {
+		if(p->nodes[i].cycles == 0)
+			continue;
+
+		// the path is collected from the node to the root
+		uint32_t path[PROFILE_STACK];
+		unsigned len = 0;
+		for(uint32_t n = i; len < PROFILE_STACK; n = p->nodes[n].parent) {
+			path[len++] = n;
+			if(n == 0)
+				break;
+		}
+
+		while(len-- > 0)
+			fprintf(f, "%s%c", name_of(p, p->nodes[path[len]].entry, name),
+					len > 0? ';' : ' ');
+		fprintf(f, "%llu\n", (unsigned long long) p->nodes[i].cycles);
+	}
+}
@@ -0,0 +1,107 @@
+/**
+ * profile.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include "sim.h"
+#include "step.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Profiler of the firmware. Executions and cycles are counted per program
+ * address and attributed to subroutines found at the targets of taken CALLs,
+ * the interrupt vector and the address where the profiling started (the root).
+ * The exclusive time of a subroutine is spent by its own instructions,
+ * the inclusive time lasts from the CALL to the RETURN (recursive calls
+ * are counted once). The cycles of the interrupt acknowledge belong to the
+ * handler. The profile observes the single steps of a stepper (see step.h).
+ *
+ * Returns are paired with calls by the call stack of the processor, a deeper
+ * nesting than PROFILE_STACK is attributed to the last profiled subroutine.
+ */
+
+#define PROFILE_STACK 64
+
+struct profile_routine {
+	uint16_t entry;
+	uint64_t calls;
+	uint64_t inclusive;	// cycles
+	uint64_t exclusive;
+};
+
+struct profile;
+
+/**
+ * Starts profiling at the current state of the simulator.
+ * @return NULL on allocation error
+ */
+struct profile *profile_init(struct sim *s);
+
+void profile_destroy(struct profile *p);
+
+/**
+ * Names the address in the output, eg. by a label of the symbol table.
+ * @return false on allocation error
+ */
+bool profile_name(struct profile *p, uint16_t addr, const char *name);
+
+/**
+ * Profiles the instructions executed by the stepper.
+ * @return false when it has too many observers
+ */
+bool profile_observe(struct profile *p, struct stepper *st);
+
+/**
+ * Name of the address given by profile_name.
+ * @return NULL when it has none
+ */
+const char *profile_label(const struct profile *p, uint16_t addr);
+
+/**
+ * Entry of the subroutine running now, the cycles of the next
+ * instruction are attributed to it.
+ */
+uint16_t profile_current(const struct profile *p);
+
+uint64_t profile_count(const struct profile *p, uint16_t addr);
+uint64_t profile_cycles(const struct profile *p, uint16_t addr);
+
+/**
+ * Statistics of the subroutine starting at the entry, the subroutines
+ * still running are counted until now.
+ * @return false when no subroutine starts at the entry
+ */
+bool profile_routine(const struct profile *p, uint16_t entry, struct profile_routine *r);
+
+/**
+ * Prints the subroutines ordered by the inclusive time and the listing
+ * of the program annotated by the counts and cycles.
+ */
+void profile_print(const struct profile *p, FILE *f);
+
+/**
+ * Prints the folded call stacks with their cycles, the input
+ * of flamegraph.pl: <root>;<routine>;... <cycles>
+ */
+void profile_print_folded(const struct profile *p, FILE *f);
+
+#endif
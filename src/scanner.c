@@ -20,6 +20,8 @@
 #include "pico.h"
 #include "scanner.h"
 #include "buffer.h"
+#include "isa.h"
+#include "xref.h"
 #include "util.h"
 #include <stdbool.h>
 #include <stdlib.h>
@@ -103,6 +105,17 @@ static inline bool token_ok(struct pico *p)
 // =================================== //
 
 #define islit(c) (isalnum(c) || (c) == '_')
+// JUMP@, CALL@ and LOAD&RETURN of kcpsm6
+#define islitcont(c) (islit(c) || (c) == '@' || (c) == '&')
+
+/**
+ * Tests whether the digit can start a program address of the target.
+ */
+static inline bool isaddrlead(struct pico *p, char c)
+{
+	const unsigned lead = (p->isa->program_len - 1) >> 8;
+	return c >= '0' && c <= '9' && (unsigned) (c - '0') <= lead;
+}
 
 static bool read_literal(struct pico *p)
 {
@@ -112,7 +125,7 @@ static bool read_literal(struct pico *p)
 	while(!buffer_isend(p, p->offset)) {
 		char c = *(p->offset++);
 
-		if(!islit(c)) {
+		if(!islitcont(c)) {
 			p->offset -= 1;
 			break;
 		}
@@ -125,6 +138,9 @@ static bool read_literal(struct pico *p)
 	if(data == NULL)
 		return error(p, "Memory allocation error");
 
+	if(data->kw != K_UNKNOWN && !isa_keyword(p->isa, data->kw))
+		data->kw = K_UNKNOWN;
+
 	p->tok->value.l = data;
 	p->tok->type = T_LITERAL;
 	return token_ok(p);
@@ -285,7 +301,7 @@ bool scanner_next(struct pico *p)
 			return read_flg_lit(p);
 		if(toupper(c) == 'N')
 			return read_notflg_lit(p);
-		if(c >= '0' && c <= '3')
+		if(isaddrlead(p, c))
 			return read_num_addr_lit(p);
 		if(isxdigit(c))
 			return read_num_lit(p);
@@ -371,6 +387,13 @@ static struct keyword keywords[] = {
 	{"SLA", K_SLA},
 	{"SLX", K_SLX},
 	{"RL", K_RL},
+	{"TESTCY", K_TESTCY},
+	{"COMPARECY", K_COMPARECY},
+	{"STAR", K_STAR},
+	{"JUMP@", K_JUMP_AT},
+	{"CALL@", K_CALL_AT},
+	{"LOAD&RETURN", K_LOAD_RETURN},
+	{"REGBANK", K_REGBANK},
 	{"ADDRESS", K_ADDRESS},
 	{"CONSTANT", K_CONSTANT},
 	{"NAMEREG", K_NAMEREG},
@@ -383,7 +406,7 @@ static struct keyword keywords[] = {
 	{"DISABLE", K_DISABLE},
 };
 
-#define LONGEST_KEYWORD strlen("INTERRUPT")
+#define LONGEST_KEYWORD strlen("LOAD&RETURN")
 #define KEYWORDS_LEN (sizeof(keywords)/sizeof(struct keyword))
 
 int getkw(char *s, size_t len)
@@ -425,11 +448,13 @@ struct stab_data *stab_newdata(char *key)
 	data->kw = getkw(key, keylen);
 	data->lit = L_UNKNOWN;
 	data->wait_queue = NULL;
+	data->xref = NULL;
 	return data;
 }
 
 void stab_freedata(struct stab_data *data)
 {
+	xref_free(data->xref);
 	free(data);	
 }
 
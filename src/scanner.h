@@ -65,6 +65,12 @@ enum keyword_type {
 	K_SL0,	K_SL1,
 	K_SLA,	K_SLX,
 	K_RL,
+	// kcpsm6 only:
+	K_TESTCY, K_COMPARECY,
+	K_STAR,
+	K_JUMP_AT, K_CALL_AT,
+	K_LOAD_RETURN,
+	K_REGBANK,
 	K_ADDRESS,
 	K_CONSTANT,
 	K_NAMEREG
@@ -97,10 +103,13 @@ union literal_value {
  *
  */
 struct wait_instr;
+struct xref;
 
 struct stab_data {
 	// table to store incomplete instructions
 	struct wait_instr *wait_queue;
+	// sites of the symbol, NULL unless requested
+	struct xref *xref;
 	enum literal_type lit;
 	union literal_value value;
 	enum keyword_type kw;
@@ -0,0 +1,318 @@
+/**
+ * scheduler.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "scheduler.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct sched {
+	struct sim *sim;
+	struct ports *ports;
+	struct jit *jit;
+	sched_runner_t run;
+	void *ctx;
+
+	struct sched_event *heap;
+	size_t len;
+	size_t size;
+	uint64_t seq;
+
+	sched_source_t source;
+	void *source_ctx;
+	bool ahead;	// the next event of the source was read
+	struct sched_event next;
+};
+
+struct sched *sched_init(struct sim *s, struct ports *p)
+{
+	struct sched *q = (struct sched *) calloc(1, sizeof(struct sched));
+	if(q == NULL)
+		return NULL;
+
+	q->sim = s;
+	q->ports = p;
+	return q;
+}
+
+void sched_destroy(struct sched *q)
+{
+	if(q == NULL)
+		return;
+
+	free(q->heap);
+	free(q);
+}
+
+void sched_set_jit(struct sched *q, struct jit *j)
+{
+	q->jit = j;
+}
+
+void sched_set_runner(struct sched *q, sched_runner_t run, void *ctx)
+{
+	q->run = run;
+	q->ctx = ctx;
+}
+
+void sched_set_source(struct sched *q, sched_source_t next, void *ctx)
+{
+	q->source = next;
+	q->source_ctx = ctx;
+	q->ahead = next != NULL && next(ctx, &q->next);
+}
+
+size_t sched_pending(const struct sched *q)
+{
+	return q->len + q->ahead;
+}
+
+// =================================== //
+// ------------- min-heap ------------ //
+// =================================== //
+
+static bool before(const struct sched_event *a, const struct sched_event *b)
+{
+	return a->cycle < b->cycle || (a->cycle == b->cycle && a->seq < b->seq);
+}
+
+static void swap(struct sched_event *a, struct sched_event *b)
+{
+	struct sched_event tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void sift_up(struct sched *q, size_t i)
+{
+	while(i > 0) {
+		const size_t parent = (i - 1) / 2;
+		if(!before(&q->heap[i], &q->heap[parent]))
+			break;
+
+		swap(&q->heap[i], &q->heap[parent]);
+		i = parent;
+	}
+}
+
+static void sift_down(struct sched *q, size_t i)
+{
+	for(;;) {
+		const size_t l = 2 * i + 1;
+		const size_t r = l + 1;
+		size_t min = i;
+
+		if(l < q->len && before(&q->heap[l], &q->heap[min]))
+			min = l;
+		if(r < q->len && before(&q->heap[r], &q->heap[min]))
+			min = r;
+		if(min == i)
+			break;
+
+		swap(&q->heap[i], &q->heap[min]);
+		i = min;
+	}
+}
+
+static void pop(struct sched *q, struct sched_event *e)
+{
+	*e = q->heap[0];
+	q->len -= 1;
+	q->heap[0] = q->heap[q->len];
+	sift_down(q, 0);
+}
+
+bool sched_add(struct sched *q, const struct sched_event *e)
+{
+	// the host owns its ports, eg. the channels of a cluster (see cluster.h)
+	if(e->kind == SCHED_INPUT
+			&& (q->ports == NULL || q->ports->in[e->port].kind == PORT_HOST))
+		return false;
+
+	if(q->len == q->size) {
+		const size_t size = q->size == 0? 64 : 2 * q->size;
+		struct sched_event *heap = (struct sched_event *)
+			realloc(q->heap, size * sizeof(struct sched_event));
+		if(heap == NULL)
+			return false;
+
+		q->heap = heap;
+		q->size = size;
+	}
+
+	q->heap[q->len] = *e;
+	q->heap[q->len].seq = q->seq++;
+	q->len += 1;
+	sift_up(q, q->len - 1);
+	return true;
+}
+
+bool sched_interrupt(struct sched *q, uint64_t cycle, bool level)
+{
+	struct sched_event e = {.cycle = cycle, .kind = SCHED_INTERRUPT, .value = level};
+	return sched_add(q, &e);
+}
+
+bool sched_input(struct sched *q, uint64_t cycle, uint8_t port, uint8_t value)
+{
+	struct sched_event e = {.cycle = cycle, .kind = SCHED_INPUT,
+		.port = port, .value = value};
+	return sched_add(q, &e);
+}
+
+bool sched_stop(struct sched *q, uint64_t cycle)
+{
+	struct sched_event e = {.cycle = cycle, .kind = SCHED_STOP};
+	return sched_add(q, &e);
+}
+
+bool sched_call(struct sched *q, uint64_t cycle, sched_call_t call, void *ctx)
+{
+	struct sched_event e = {.cycle = cycle, .kind = SCHED_CALL,
+		.call = call, .ctx = ctx};
+	return sched_add(q, &e);
+}
+
+// =================================== //
+// ------------- events -------------- //
+// =================================== //
+
+bool sched_read(struct sched *q, FILE *f, unsigned *lineno)
+{
+	char line[256];
+	*lineno = 0;
+
+	while(fgets(line, sizeof(line), f) != NULL) {
+		*lineno += 1;
+
+		unsigned long long cycle;
+		char what[8];
+		unsigned a;
+		unsigned b;
+		int len;
+
+		if(line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		if(sscanf(line, "%llu %7s %n", &cycle, what, &len) != 2)
+			return false;
+
+		const char *args = line + len;
+		bool ok = false;
+
+		if(!strcmp(what, "irq") && sscanf(args, "%u", &a) == 1 && a <= 1)
+			ok = sched_interrupt(q, cycle, a);
+		else if(!strcmp(what, "in") && sscanf(args, "%x %x", &a, &b) == 2
+				&& a <= 0xFF && b <= 0xFF)
+			ok = sched_input(q, cycle, a, b);
+		else if(!strcmp(what, "stop"))
+			ok = sched_stop(q, cycle);
+
+		if(!ok)
+			return false;
+	}
+
+	return !ferror(f);
+}
+
+/**
+ * @return false when the simulation should stop
+ */
+static bool apply(struct sched *q, const struct sched_event *e)
+{
+	struct sim *s = q->sim;
+
+	switch(e->kind) {
+	case SCHED_INTERRUPT:
+		s->irq = e->value;
+		break;
+	case SCHED_INPUT: {
+		if(q->ports == NULL)
+			break;	// from the source
+		struct port *p = &q->ports->in[e->port];
+		if(p->kind == PORT_HOST)
+			break;	// of the stream or connected to the host later
+		if(p->kind == PORT_REGISTER)
+			p->value = e->value;
+		else
+			ports_register(q->ports, PORT_IN, e->port, e->value);
+		break;
+	}
+	case SCHED_STOP:
+		sim_stop(s);
+		return false;
+	case SCHED_CALL:
+		e->call(s, e->ctx);
+		return s->status != SIM_STOPPED;
+	}
+
+	return true;
+}
+
+// =================================== //
+// ------------ execution ------------ //
+// =================================== //
+
+enum sim_status sched_run(struct sched *q, uint64_t cycles)
+{
+	struct sim *s = q->sim;
+	s->status = SIM_RUNNING;
+
+	for(;;) {
+		for(;;) {
+			const bool queued = q->len > 0 && q->heap[0].cycle <= s->cycles;
+			const bool streamed = q->ahead && q->next.cycle <= s->cycles;
+			struct sched_event e;
+			if(queued && (!streamed || q->heap[0].cycle <= q->next.cycle))
+				pop(q, &e);
+			else if(streamed) {
+				e = q->next;
+				q->ahead = q->source(q->source_ctx, &q->next);
+			}
+			else
+				break;
+
+			if(!apply(q, &e))
+				return s->status = SIM_STOPPED;
+		}
+
+		if(s->cycles >= cycles)
+			return s->status = SIM_BUDGET;
+		if(sim_acknowledge(s))
+			continue;
+
+		// straight-line until the instruction starting at the next event
+		uint64_t until = cycles;
+		if(q->len > 0 && q->heap[0].cycle < until)
+			until = q->heap[0].cycle;
+		if(q->ahead && q->next.cycle < until)
+			until = q->next.cycle;
+
+		uint64_t n = (until - s->cycles + SIM_CYCLES_PER_INSTR - 1)
+			/ SIM_CYCLES_PER_INSTR;
+		if(s->irq)
+			n = 1;	// enabling of the interrupt is acknowledged above
+
+		enum sim_status status;
+		if(q->run != NULL)
+			status = q->run(q->ctx, n);
+		else
+			status = q->jit != NULL? jit_run(q->jit, n) : sim_run(s, n);
+		if(status != SIM_BUDGET)
+			return status;
+	}
+}
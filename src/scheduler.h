@@ -0,0 +1,129 @@
+/**
+ * scheduler.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include "sim.h"
+#include "ports.h"
+#include "jit.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Timed events of the simulation ordered by cycles in a min-heap, events
+ * of the same cycle keep their order. The program runs without any checks
+ * until the cycle of the next event, then the event is applied before the
+ * first instruction (or interrupt acknowledge) starting at that cycle or
+ * later.
+ *
+ * While the interrupt input is set, but disabled, the program runs by single
+ * instructions, so an interrupt enabled by the program is acknowledged
+ * by the scheduler at the exact cycle. An interrupt raised by an I/O callback
+ * is taken by the simulator at once and the following events may be applied
+ * one slot later, schedule it as an event for exact timing.
+ */
+
+enum sched_kind {
+	SCHED_INTERRUPT,	// sets the interrupt input to the value
+	SCHED_INPUT,	// sets the value of the input port (register model)
+	SCHED_STOP,	// stops sched_run
+	SCHED_CALL	// calls the host
+};
+
+typedef void (*sched_call_t)(struct sim *s, void *ctx);
+
+struct sched_event {
+	uint64_t cycle;
+	uint64_t seq;	// order of events of the same cycle
+	uint8_t kind;
+	uint8_t port;
+	uint8_t value;
+	sched_call_t call;
+	void *ctx;
+};
+
+struct sched;
+
+/**
+ * @param p models of ports changed by SCHED_INPUT, may be NULL without them
+ * @return NULL on allocation error
+ */
+struct sched *sched_init(struct sim *s, struct ports *p);
+
+void sched_destroy(struct sched *q);
+
+/**
+ * Runs the program by the translator instead of sim_run.
+ */
+void sched_set_jit(struct sched *q, struct jit *j);
+
+typedef enum sim_status (*sched_runner_t)(void *ctx, uint64_t instructions);
+
+/**
+ * Runs the program by the function instead of sim_run, eg. to record it.
+ */
+void sched_set_runner(struct sched *q, sched_runner_t run, void *ctx);
+
+/**
+ * Adds the event.
+ * @return false on allocation error (or SCHED_INPUT without ports or to
+ * a PORT_HOST port, those are left to the host, eg. channels of a cluster)
+ */
+bool sched_add(struct sched *q, const struct sched_event *e);
+
+/**
+ * Reads the next event of a stream ordered by cycles.
+ * @return false at the end of the stream
+ */
+typedef bool (*sched_source_t)(void *ctx, struct sched_event *e);
+
+/**
+ * Takes the events also from the stream, eg. a stimulus file (see stimulus.h),
+ * one at a time instead of adding all to the queue. Events of the queue
+ * are applied before the events of the stream at the same cycle.
+ */
+void sched_set_source(struct sched *q, sched_source_t next, void *ctx);
+
+bool sched_interrupt(struct sched *q, uint64_t cycle, bool level);
+bool sched_input(struct sched *q, uint64_t cycle, uint8_t port, uint8_t value);
+bool sched_stop(struct sched *q, uint64_t cycle);
+bool sched_call(struct sched *q, uint64_t cycle, sched_call_t call, void *ctx);
+
+size_t sched_pending(const struct sched *q);
+
+/**
+ * Reads events, one per line:
+ *   <cycle> irq <0|1>
+ *   <cycle> in <port> <value>
+ *   <cycle> stop
+ * Numbers of ports and values are hexadecimal, lines starting by '#' are skipped.
+ * @param lineno set to the invalid line on error
+ */
+bool sched_read(struct sched *q, FILE *f, unsigned *lineno);
+
+/**
+ * Runs the simulation until the given cycle.
+ * @return SIM_BUDGET when the cycle was reached, SIM_STOPPED by SCHED_STOP
+ * or by the host, SIM_INVALID
+ */
+enum sim_status sched_run(struct sched *q, uint64_t cycles);
+
+#endif
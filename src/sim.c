@@ -0,0 +1,750 @@
+/**
+ * sim.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "sim.h"
+#include "ports.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+#define SCRATCHPAD_MASK (SIM_SCRATCHPAD - 1)
+#define IDLE_LOOP_MAX 16	// instructions of a loop that can be skipped
+
+/**
+ * The file is compiled three times, with SIM_COVERAGE it is only sim_run
+ * that collects the coverage, with SIM_BREAKPOINTS the one that stops
+ * at the breakpoints (see Makefile).
+ */
+#if defined(SIM_COVERAGE)
+	#define RUN sim_run_coverage
+	#define INSTANCE 2
+	#define COVER(stmt) stmt
+	#define BREAKS(stmt)
+#elif defined(SIM_BREAKPOINTS)
+	#define RUN sim_run_breakpoints
+	#define INSTANCE 3
+	#define COVER(stmt)
+	#define BREAKS(stmt) stmt
+#else
+	#define RUN run
+	#define INSTANCE 1
+	#define COVER(stmt)
+	#define BREAKS(stmt)
+#endif
+
+#if defined(SIM_COVERAGE) || defined(SIM_BREAKPOINTS)
+	#define INSTRUMENTED 1
+#endif
+
+enum sim_status sim_run_coverage(struct sim *s, uint64_t instructions);
+enum sim_status sim_run_breakpoints(struct sim *s, uint64_t instructions);
+
+#ifndef INSTRUMENTED
+
+// =================================== //
+// ------------ decoding ------------- //
+// =================================== //
+
+/**
+ * Operations by bits 17:12 of the instruction, shifts and
+ * conditional jumps are resolved separately.
+ */
+static const uint8_t decode_table[64] = {
+	[0x00] = S_LOAD_RK, [0x01] = S_LOAD_RR,
+	[0x02] = S_INVALID, [0x03] = S_INVALID,
+	[0x04] = S_INPUT_RK, [0x05] = S_INPUT_RR,
+	[0x06] = S_FETCH_RK, [0x07] = S_FETCH_RR,
+	[0x08] = S_INVALID, [0x09] = S_INVALID,
+	[0x0A] = S_AND_RK, [0x0B] = S_AND_RR,
+	[0x0C] = S_OR_RK, [0x0D] = S_OR_RR,
+	[0x0E] = S_XOR_RK, [0x0F] = S_XOR_RR,
+	[0x10] = S_INVALID, [0x11] = S_INVALID,
+	[0x12] = S_TEST_RK, [0x13] = S_TEST_RR,
+	[0x14] = S_COMPARE_RK, [0x15] = S_COMPARE_RR,
+	[0x16] = S_INVALID, [0x17] = S_INVALID,
+	[0x18] = S_ADD_RK, [0x19] = S_ADD_RR,
+	[0x1A] = S_ADDCY_RK, [0x1B] = S_ADDCY_RR,
+	[0x1C] = S_SUB_RK, [0x1D] = S_SUB_RR,
+	[0x1E] = S_SUBCY_RK, [0x1F] = S_SUBCY_RR,
+	[0x20] = S_SL0, // see decode_shift
+	[0x21] = S_INVALID, [0x22] = S_INVALID,
+	[0x23] = S_INVALID, [0x24] = S_INVALID,
+	[0x25] = S_INVALID, [0x26] = S_INVALID,
+	[0x27] = S_INVALID, [0x28] = S_INVALID,
+	[0x29] = S_INVALID,
+	[0x2A] = S_RETURN, [0x2B] = S_RETURN_Z,
+	[0x2C] = S_OUTPUT_RK, [0x2D] = S_OUTPUT_RR,
+	[0x2E] = S_STORE_RK, [0x2F] = S_STORE_RR,
+	[0x30] = S_CALL, [0x31] = S_CALL_Z,
+	[0x32] = S_INVALID, [0x33] = S_INVALID,
+	[0x34] = S_JUMP, [0x35] = S_JUMP_Z,
+	[0x36] = S_INVALID, [0x37] = S_INVALID,
+	[0x38] = S_RETURNI_DISABLE,
+	[0x39] = S_INVALID, [0x3A] = S_INVALID, [0x3B] = S_INVALID,
+	[0x3C] = S_DISABLE_INTERRUPT,
+	[0x3D] = S_INVALID, [0x3E] = S_INVALID, [0x3F] = S_INVALID
+};
+
+static const uint8_t decode_shift[16] = {
+	[0x0] = S_SLA, [0x1] = S_INVALID, [0x2] = S_RL, [0x3] = S_INVALID,
+	[0x4] = S_SLX, [0x5] = S_INVALID, [0x6] = S_SL0, [0x7] = S_SL1,
+	[0x8] = S_SRA, [0x9] = S_INVALID, [0xA] = S_SRX, [0xB] = S_INVALID,
+	[0xC] = S_RR, [0xD] = S_INVALID, [0xE] = S_SR0, [0xF] = S_SR1
+};
+
+struct sim_instr sim_decode(code_t code)
+{
+	struct sim_instr ins = {
+		.op = decode_table[(code >> 12) & 0x3F],
+		.x = (code >> 8) & 0x0F,
+		.y = code & 0xFF,
+		.target = code & PC_MASK
+	};
+
+	switch(ins.op) {
+	case S_LOAD_RR: case S_AND_RR: case S_OR_RR: case S_XOR_RR:
+	case S_TEST_RR: case S_ADD_RR: case S_ADDCY_RR: case S_SUB_RR:
+	case S_SUBCY_RR: case S_COMPARE_RR: case S_FETCH_RR: case S_STORE_RR:
+	case S_INPUT_RR: case S_OUTPUT_RR:
+		ins.y = (code >> 4) & 0x0F;
+		break;
+	case S_SL0:
+		ins.op = decode_shift[code & 0x0F];
+		break;
+	case S_JUMP_Z: case S_CALL_Z: case S_RETURN_Z:
+		// conditions Z, NZ, C, NC follow in enum sim_op
+		ins.op += (code >> 10) & 0x03;
+		break;
+	case S_RETURNI_DISABLE:
+		if(code & 1)
+			ins.op = S_RETURNI_ENABLE;
+		break;
+	case S_DISABLE_INTERRUPT:
+		if(code & 1)
+			ins.op = S_ENABLE_INTERRUPT;
+		break;
+	default:
+		break;
+	}
+
+	return ins;
+}
+
+/**
+ * FNV-1a of the program words.
+ */
+static uint32_t checksum(const code_t *code)
+{
+	uint32_t h = 2166136261u;
+	for(unsigned i = 0; i < SIM_PROGRAM_LEN; i++) {
+		for(unsigned b = 0; b < 24; b += 8)
+			h = (h ^ ((code[i] >> b) & 0xFF)) * 16777619u;
+	}
+
+	return h;
+}
+
+/**
+ * A loop can reach a state repeated by every iteration when it is closed
+ * by a backward jump and it has no side effects: no STORE, OUTPUT, calls,
+ * other jumps and no changes of the interrupt. Registers must not be changed
+ * by ADD, SUB, XOR or shifts unless they were loaded in the same iteration,
+ * that rejects eg. the delay loops counting down.
+ */
+static bool idle_loop(const struct sim_instr *rom, unsigned at)
+{
+	const struct sim_instr *jump = &rom[at];
+	if(jump->op < S_JUMP || jump->op > S_JUMP_NC)
+		return false;
+	if(jump->target > at || at - jump->target >= IDLE_LOOP_MAX)
+		return false;
+
+	unsigned loaded = 0;
+	for(unsigned a = jump->target; a < at; a++) {
+		const struct sim_instr *ins = &rom[a];
+		switch(ins->op) {
+		case S_LOAD_RR: case S_LOAD_RK:
+		case S_FETCH_RR: case S_FETCH_RK:
+		case S_INPUT_RR: case S_INPUT_RK:
+			loaded |= 1u << ins->x;
+			break;
+		case S_AND_RR: case S_AND_RK: case S_OR_RR: case S_OR_RK:
+		case S_TEST_RR: case S_TEST_RK: case S_COMPARE_RR: case S_COMPARE_RK:
+			break;
+		case S_XOR_RR: case S_XOR_RK: case S_ADD_RR: case S_ADD_RK:
+		case S_ADDCY_RR: case S_ADDCY_RK: case S_SUB_RR: case S_SUB_RK:
+		case S_SUBCY_RR: case S_SUBCY_RK:
+		case S_SL0: case S_SL1: case S_SLX: case S_SLA: case S_RL:
+		case S_SR0: case S_SR1: case S_SRX: case S_SRA: case S_RR:
+			if(!(loaded & (1u << ins->x)))
+				return false;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool sim_load(struct sim *s, const code_t *code, progaddr_t len)
+{
+	if(len > SIM_PROGRAM_LEN)
+		return false;
+
+	memset(s->code, 0, sizeof(s->code));
+	memcpy(s->code, code, len * sizeof(code_t));
+
+	for(unsigned i = 0; i < SIM_PROGRAM_LEN; i++)
+		s->rom[i] = sim_decode(s->code[i]);
+	for(unsigned i = 0; i < SIM_PROGRAM_LEN; i++)
+		s->rom[i].idle = idle_loop(s->rom, i);
+	s->threaded = 0;
+	s->generation += 1;
+	s->checksum = checksum(s->code);
+
+	sim_reset(s);
+	return true;
+}
+
+bool sim_read_hex(const char *path, code_t *code, progaddr_t *len)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return false;
+
+	unsigned int word;
+	*len = 0;
+	while(*len < SIM_PROGRAM_LEN && fscanf(f, "%x", &word) == 1)
+		code[(*len)++] = word;
+
+	fclose(f);
+	return true;
+}
+
+void sim_reset(struct sim *s)
+{
+	memset(s->reg, 0, sizeof(s->reg));
+	memset(s->scratchpad, 0, sizeof(s->scratchpad));
+	memset(s->stack, 0, sizeof(s->stack));
+	s->pc = 0;
+	sim_set_flags(s, false, false);
+	s->saved_flags = s->flags;
+	s->ie = false;
+	s->irq = false;
+	s->sp = 0;
+	s->depth = 0;
+	s->faults = 0;
+	s->cycles = 0;
+	s->instructions = 0;
+	s->status = SIM_RUNNING;
+}
+
+#endif
+
+// =================================== //
+// ------------ execution ------------ //
+// =================================== //
+
+/**
+ * Acknowledges the interrupt, it takes one instruction slot.
+ * @return the interrupt vector
+ */
+static inline uint16_t interrupt(struct sim *s, uint16_t pc, unsigned flags)
+{
+	sim_push(s, pc);
+	s->saved_flags = flags;
+	s->irq = false;
+	return SIM_VECTOR;
+}
+
+/**
+ * Kept out of sim_run, it would get in the way of the registers there.
+ */
+#ifdef __GNUC__
+	#define IDLE_COLD static __attribute__((noinline, cold))
+#else
+	#define IDLE_COLD static
+#endif
+
+/**
+ * State of the last iteration of a marked loop.
+ */
+struct idle {
+	unsigned at;	// of the jump, SIM_PROGRAM_LEN for none
+	unsigned flags;
+	uint64_t cycles;	// after the jump
+	uint8_t reg[SIM_REGS];
+};
+
+/**
+ * The loop is executed again by the taken jump at s->pc - 1 (after SYNC).
+ * When the previous iteration (just before, without an interrupt) ended in
+ * the same state, every next one does the same until an input changes.
+ * @param left instructions of the budget
+ * @return number of instructions to skip, whole iterations
+ */
+IDLE_COLD uint64_t idle(struct sim *s, struct idle *last, uint64_t left)
+{
+	const unsigned at = (s->pc - 1) & PC_MASK;
+	const unsigned flags = s->flags;
+	const uint64_t now = s->cycles;
+	const unsigned start = s->rom[at].target;
+	const uint64_t len = at - start + 1;
+	const uint64_t period = SIM_CYCLES_PER_INSTR * len;
+
+	const bool same = last->at == at && last->cycles + period == now
+		&& last->flags == flags && !memcmp(last->reg, s->reg, SIM_REGS);
+	last->at = at;
+	last->flags = flags;
+	last->cycles = now;
+	if(!same) {
+		memcpy(last->reg, s->reg, SIM_REGS);
+		return 0;
+	}
+
+	if(s->stable_until <= now)
+		return 0;
+	if(s->ports != NULL) {
+		for(unsigned a = start; a < at; a++) {
+			const struct sim_instr *ins = &s->rom[a];
+			if(ins->op == S_INPUT_RR || (ins->op == S_INPUT_RK
+						&& !ports_stable(s->ports, ins->y)))
+				return 0;
+		}
+	}
+
+	// reads of the skipped iterations end before stable_until
+	uint64_t iterations = (s->stable_until - 1 - now) / period;
+	if(iterations > left / len)
+		iterations = left / len;
+	last->cycles += iterations * period;
+	return iterations * len;
+}
+
+#define ZERO(flags) (((flags) & 0xFF) == 0)
+#define CARRY(flags) sim_flags_carry(flags)
+
+/**
+ * Writes the local state back to the structure,
+ * eg. before the I/O callbacks.
+ */
+#define SYNC() {\
+	s->pc = pc;\
+	s->flags = flags;\
+	s->ie = ie;\
+	s->cycles = cycles + SIM_CYCLES_PER_INSTR * (n + slots);\
+	s->instructions = instrs + n;}
+
+#define BIT(map, i) ((map)[(i) >> 6] >> ((i) & 63) & 1)
+
+/**
+ * Takes the interrupt if pending and fetches the next instruction. The
+ * breakpoint at the address where sim_run started does not stop it again.
+ */
+#define FETCH() \
+	if(n == instructions)\
+		goto budget;\
+	if(pending) {\
+		pc = interrupt(s, pc, flags);\
+		slots += 1;\
+		ie = false;\
+		pending = false;\
+	}\
+	BREAKS(if(BIT(bp->code, pc) && !(n == 0 && pc == s->pc)) {\
+		bp->hit = SIM_BREAK_CODE;\
+		s->status = SIM_BREAK;\
+		goto stop;\
+	})\
+	ins = &rom[pc];\
+	COVER(cov->executed[pc >> 6] |= (uint64_t) 1 << (pc & 63));\
+	pc = (pc + 1) & PC_MASK;\
+	n += 1;
+
+#ifdef SIM_THREADED
+	#define OP(op) L_##op
+	#define NEXT() {\
+		FETCH();\
+		__extension__ ({goto *ins->handler;});}
+#else
+	#define OP(op) case op
+	#define NEXT() continue
+#endif
+
+#define LOGIC(op, src) \
+	flags = reg[ins->x] = reg[ins->x] op (src);\
+	NEXT();
+
+#define TEST(src) \
+	flags = (reg[ins->x] & (src)) | SIM_FLAGS_PARITY;\
+	NEXT();
+
+#define ARITH(op, src, cy) \
+	flags = (reg[ins->x] op (src) op (cy)) & 0x1FF;\
+	reg[ins->x] = flags;\
+	NEXT();
+
+#define COMPARE(src) \
+	flags = (reg[ins->x] - (src)) & 0x1FF;\
+	NEXT();
+
+#define SHIFT_LEFT(in) {\
+	const unsigned v = reg[ins->x];\
+	flags = (v << 1) | (in);\
+	reg[ins->x] = flags;\
+	NEXT();}
+
+#define SHIFT_RIGHT(in) {\
+	const unsigned v = reg[ins->x];\
+	flags = (v >> 1) | ((in) << 7) | ((v & 1) << 8);\
+	reg[ins->x] = flags;\
+	NEXT();}
+
+#define INPUT(port) \
+	if(s->ports != NULL && ports_fast_input(s->ports, port, &reg[ins->x]))\
+		NEXT();\
+	SYNC();\
+	reg[ins->x] = s->io.input == NULL? 0 : s->io.input(s, port, s->io.ctx);\
+	AFTER_IO();
+
+#define OUTPUT(port) \
+	if(s->ports != NULL && ports_fast_output(s->ports, port, reg[ins->x],\
+				cycles + SIM_CYCLES_PER_INSTR * (n + slots)))\
+		NEXT();\
+	SYNC();\
+	if(s->io.output != NULL)\
+		s->io.output(s, port, reg[ins->x], s->io.ctx);\
+	AFTER_IO();
+
+/**
+ * The callback may raise the interrupt or stop the simulation.
+ */
+#define AFTER_IO() \
+	pending = ie && s->irq;\
+	if(s->status != SIM_RUNNING)\
+		goto stop;\
+	NEXT();
+
+/**
+ * Marked jumps of the threaded dispatch have their own handlers (IDLE),
+ * so the other jumps do not test ins->idle.
+ */
+#ifdef SIM_THREADED
+	#define IDLE(op) L_IDLE_##op
+	#define BRANCH(cond) JUMP_TO(cond, false)
+#else
+	#define BRANCH(cond) JUMP_TO(cond, ins->idle)
+#endif
+#ifdef SIM_BREAKPOINTS
+	// the skipped iterations would pass the breakpoints
+	#define IDLE_BRANCH(cond) JUMP_TO(cond, false)
+	#undef BRANCH
+	#define BRANCH(cond) JUMP_TO(cond, false)
+#else
+	#define IDLE_BRANCH(cond) JUMP_TO(cond, true)
+#endif
+
+/**
+ * Stops after the access to the watched address of the scratchpad,
+ * the instruction is complete.
+ */
+#ifdef SIM_BREAKPOINTS
+	#define WATCH(map, kind, addr) {\
+		const unsigned a = (addr) & SCRATCHPAD_MASK;\
+		if(BIT(bp->map, a)) {\
+			bp->hit = kind;\
+			bp->address = a;\
+			s->status = SIM_BREAK;\
+			goto stop;\
+		}}
+#else
+	#define WATCH(map, kind, addr)
+#endif
+
+#define JUMP_TO(cond, marked) \
+	if(cond) {\
+		if(marked) {\
+			SYNC();\
+			n += idle(s, &last, instructions - n);\
+		}\
+		pc = ins->target;\
+	}\
+	NEXT();
+
+#define CALL(cond) \
+	if(cond) {\
+		sim_push(s, (pc - 1) & PC_MASK);\
+		pc = ins->target;\
+	}\
+	NEXT();
+
+#define RETURN(cond) \
+	if(cond)\
+		pc = (sim_pop(s) + 1) & PC_MASK;\
+	NEXT();
+
+/**
+ * Records the direction of the conditional BRANCH, CALL or RETURN at pc - 1.
+ */
+#ifdef SIM_COVERAGE
+	#define CONDITIONAL(op, cond) {\
+		const bool taken = cond;\
+		(taken? cov->taken : cov->not_taken)[((pc - 1) & PC_MASK) >> 6]\
+			|= (uint64_t) 1 << ((pc - 1) & 63);\
+		op(taken);}
+#else
+	#define CONDITIONAL(op, cond) op(cond)
+#endif
+
+#ifndef INSTRUMENTED
+static
+#endif
+enum sim_status RUN(struct sim *s, uint64_t instructions)
+{
+#ifdef SIM_THREADED
+	#define SIM_OP_LABEL(op) [op] = __extension__ &&L_##op,
+	static const void *const labels[S_COUNT] = {
+		SIM_OPS(SIM_OP_LABEL)
+	};
+	static const void *const idle_labels[S_COUNT] = {
+		[S_JUMP] = __extension__ &&IDLE(S_JUMP), [S_JUMP_Z] = __extension__ &&IDLE(S_JUMP_Z),
+		[S_JUMP_NZ] = __extension__ &&IDLE(S_JUMP_NZ), [S_JUMP_C] = __extension__ &&IDLE(S_JUMP_C),
+		[S_JUMP_NC] = __extension__ &&IDLE(S_JUMP_NC)
+	};
+
+	if(s->threaded != INSTANCE) {
+		for(unsigned i = 0; i < SIM_PROGRAM_LEN; i++)
+			s->rom[i].handler = (s->rom[i].idle? idle_labels : labels)[s->rom[i].op];
+		s->threaded = INSTANCE;
+	}
+#endif
+
+	const struct sim_instr *const rom = s->rom;
+	COVER(struct sim_coverage *const cov = s->coverage);
+	BREAKS(struct sim_breakpoints *const bp = s->breakpoints);
+	const struct sim_instr *ins;
+	uint8_t *const reg = s->reg;
+	uint16_t pc = s->pc;
+	unsigned flags = s->flags;
+	bool ie = s->ie;
+	bool pending = ie && s->irq;
+
+	const uint64_t cycles = s->cycles;
+	const uint64_t instrs = s->instructions;
+	uint64_t n = 0;	// executed instructions
+	uint64_t slots = 0;	// acknowledged interrupts
+	struct idle last = {.at = SIM_PROGRAM_LEN};
+
+	s->status = SIM_RUNNING;
+
+#ifdef SIM_THREADED
+	NEXT();
+#else
+	for(;;) {
+		FETCH();
+		switch(ins->op) {
+#endif
+
+	OP(S_LOAD_RR):
+		reg[ins->x] = reg[ins->y];
+		NEXT();
+	OP(S_LOAD_RK):
+		reg[ins->x] = ins->y;
+		NEXT();
+
+	OP(S_AND_RR):
+		LOGIC(&, reg[ins->y]);
+	OP(S_AND_RK):
+		LOGIC(&, ins->y);
+	OP(S_OR_RR):
+		LOGIC(|, reg[ins->y]);
+	OP(S_OR_RK):
+		LOGIC(|, ins->y);
+	OP(S_XOR_RR):
+		LOGIC(^, reg[ins->y]);
+	OP(S_XOR_RK):
+		LOGIC(^, ins->y);
+	OP(S_TEST_RR):
+		TEST(reg[ins->y]);
+	OP(S_TEST_RK):
+		TEST(ins->y);
+
+	OP(S_ADD_RR):
+		ARITH(+, reg[ins->y], 0u);
+	OP(S_ADD_RK):
+		ARITH(+, ins->y, 0u);
+	OP(S_ADDCY_RR):
+		ARITH(+, reg[ins->y], CARRY(flags));
+	OP(S_ADDCY_RK):
+		ARITH(+, ins->y, CARRY(flags));
+	OP(S_SUB_RR):
+		ARITH(-, reg[ins->y], 0u);
+	OP(S_SUB_RK):
+		ARITH(-, ins->y, 0u);
+	OP(S_SUBCY_RR):
+		ARITH(-, reg[ins->y], CARRY(flags));
+	OP(S_SUBCY_RK):
+		ARITH(-, ins->y, CARRY(flags));
+	OP(S_COMPARE_RR):
+		COMPARE(reg[ins->y]);
+	OP(S_COMPARE_RK):
+		COMPARE(ins->y);
+
+	OP(S_FETCH_RR): {
+		const unsigned addr = reg[ins->y] & SCRATCHPAD_MASK;
+		reg[ins->x] = s->scratchpad[addr];
+		WATCH(read, SIM_BREAK_READ, addr);
+		NEXT();}
+	OP(S_FETCH_RK):
+		reg[ins->x] = s->scratchpad[ins->y & SCRATCHPAD_MASK];
+		WATCH(read, SIM_BREAK_READ, ins->y);
+		NEXT();
+	OP(S_STORE_RR):
+		s->scratchpad[reg[ins->y] & SCRATCHPAD_MASK] = reg[ins->x];
+		WATCH(write, SIM_BREAK_WRITE, reg[ins->y]);
+		NEXT();
+	OP(S_STORE_RK):
+		s->scratchpad[ins->y & SCRATCHPAD_MASK] = reg[ins->x];
+		WATCH(write, SIM_BREAK_WRITE, ins->y);
+		NEXT();
+
+	OP(S_INPUT_RR):
+		INPUT(reg[ins->y]);
+	OP(S_INPUT_RK):
+		INPUT(ins->y);
+	OP(S_OUTPUT_RR):
+		OUTPUT(reg[ins->y]);
+	OP(S_OUTPUT_RK):
+		OUTPUT(ins->y);
+
+	OP(S_SL0):
+		SHIFT_LEFT(0u);
+	OP(S_SL1):
+		SHIFT_LEFT(1u);
+	OP(S_SLX):
+		SHIFT_LEFT(reg[ins->x] & 1u);
+	OP(S_SLA):
+		SHIFT_LEFT(CARRY(flags));
+	OP(S_RL):
+		SHIFT_LEFT((unsigned) reg[ins->x] >> 7);
+	OP(S_SR0):
+		SHIFT_RIGHT(0u);
+	OP(S_SR1):
+		SHIFT_RIGHT(1u);
+	OP(S_SRX):
+		SHIFT_RIGHT((unsigned) reg[ins->x] >> 7);
+	OP(S_SRA):
+		SHIFT_RIGHT((unsigned) CARRY(flags));
+	OP(S_RR):
+		SHIFT_RIGHT(reg[ins->x] & 1u);
+
+	OP(S_JUMP):
+		BRANCH(true);
+	OP(S_JUMP_Z):
+		CONDITIONAL(BRANCH, ZERO(flags));
+	OP(S_JUMP_NZ):
+		CONDITIONAL(BRANCH, !ZERO(flags));
+	OP(S_JUMP_C):
+		CONDITIONAL(BRANCH, CARRY(flags));
+	OP(S_JUMP_NC):
+		CONDITIONAL(BRANCH, !CARRY(flags));
+
+	OP(S_CALL):
+		CALL(true);
+	OP(S_CALL_Z):
+		CONDITIONAL(CALL, ZERO(flags));
+	OP(S_CALL_NZ):
+		CONDITIONAL(CALL, !ZERO(flags));
+	OP(S_CALL_C):
+		CONDITIONAL(CALL, CARRY(flags));
+	OP(S_CALL_NC):
+		CONDITIONAL(CALL, !CARRY(flags));
+
+	OP(S_RETURN):
+		RETURN(true);
+	OP(S_RETURN_Z):
+		CONDITIONAL(RETURN, ZERO(flags));
+	OP(S_RETURN_NZ):
+		CONDITIONAL(RETURN, !ZERO(flags));
+	OP(S_RETURN_C):
+		CONDITIONAL(RETURN, CARRY(flags));
+	OP(S_RETURN_NC):
+		CONDITIONAL(RETURN, !CARRY(flags));
+
+	OP(S_RETURNI_DISABLE):
+	OP(S_RETURNI_ENABLE):
+		// returns to the interrupted instruction
+		pc = sim_pop(s);
+		flags = s->saved_flags;
+		ie = ins->op == S_RETURNI_ENABLE;
+		pending = ie && s->irq;
+		NEXT();
+
+	OP(S_DISABLE_INTERRUPT):
+		ie = false;
+		pending = false;
+		NEXT();
+	OP(S_ENABLE_INTERRUPT):
+		ie = true;
+		pending = s->irq;
+		NEXT();
+
+	OP(S_INVALID):
+		// stays at the invalid instruction
+		pc = (pc - 1) & PC_MASK;
+		n -= 1;
+		s->status = SIM_INVALID;
+		goto stop;
+
+#ifdef SIM_THREADED
+	// marked jumps closing the idle loops
+	IDLE(S_JUMP):
+		IDLE_BRANCH(true);
+	IDLE(S_JUMP_Z):
+		CONDITIONAL(IDLE_BRANCH, ZERO(flags));
+	IDLE(S_JUMP_NZ):
+		CONDITIONAL(IDLE_BRANCH, !ZERO(flags));
+	IDLE(S_JUMP_C):
+		CONDITIONAL(IDLE_BRANCH, CARRY(flags));
+	IDLE(S_JUMP_NC):
+		CONDITIONAL(IDLE_BRANCH, !CARRY(flags));
+#else
+		default:
+			break;
+		}
+	}
+#endif
+
+budget:
+	s->status = SIM_BUDGET;
+stop:
+	SYNC();
+	return s->status;
+}
+
+#ifndef INSTRUMENTED
+enum sim_status sim_run(struct sim *s, uint64_t instructions)
+{
+	if(s->breakpoints != NULL)
+		return sim_run_breakpoints(s, instructions);
+	return s->coverage != NULL? sim_run_coverage(s, instructions) : run(s, instructions);
+}
+#endif
@@ -0,0 +1,343 @@
+/**
+ * sim.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include "pico.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Simulator of the KCPSM3 processor. The program is predecoded
+ * once when loaded, each instruction takes 2 clock cycles.
+ */
+
+#define SIM_PROGRAM_LEN 1024
+#define SIM_REGS 16
+#define SIM_SCRATCHPAD 64
+#define SIM_STACK 31
+#define SIM_VECTOR 0x3FF
+#define SIM_CYCLES_PER_INSTR 2
+
+/**
+ * Operations of predecoded instructions.
+ * _RR takes the second operand from register y, _RK uses y as a constant.
+ */
+#define SIM_OPS(X) \
+	X(S_LOAD_RR) X(S_LOAD_RK) \
+	X(S_AND_RR) X(S_AND_RK) \
+	X(S_OR_RR) X(S_OR_RK) \
+	X(S_XOR_RR) X(S_XOR_RK) \
+	X(S_TEST_RR) X(S_TEST_RK) \
+	X(S_ADD_RR) X(S_ADD_RK) \
+	X(S_ADDCY_RR) X(S_ADDCY_RK) \
+	X(S_SUB_RR) X(S_SUB_RK) \
+	X(S_SUBCY_RR) X(S_SUBCY_RK) \
+	X(S_COMPARE_RR) X(S_COMPARE_RK) \
+	X(S_FETCH_RR) X(S_FETCH_RK) \
+	X(S_STORE_RR) X(S_STORE_RK) \
+	X(S_INPUT_RR) X(S_INPUT_RK) \
+	X(S_OUTPUT_RR) X(S_OUTPUT_RK) \
+	X(S_SL0) X(S_SL1) X(S_SLX) X(S_SLA) X(S_RL) \
+	X(S_SR0) X(S_SR1) X(S_SRX) X(S_SRA) X(S_RR) \
+	X(S_JUMP) X(S_JUMP_Z) X(S_JUMP_NZ) X(S_JUMP_C) X(S_JUMP_NC) \
+	X(S_CALL) X(S_CALL_Z) X(S_CALL_NZ) X(S_CALL_C) X(S_CALL_NC) \
+	X(S_RETURN) X(S_RETURN_Z) X(S_RETURN_NZ) X(S_RETURN_C) X(S_RETURN_NC) \
+	X(S_RETURNI_DISABLE) X(S_RETURNI_ENABLE) \
+	X(S_DISABLE_INTERRUPT) X(S_ENABLE_INTERRUPT) \
+	X(S_INVALID)
+
+#define SIM_OP_ENUM(op) op,
+
+enum sim_op {
+	SIM_OPS(SIM_OP_ENUM)
+	S_COUNT
+};
+
+/**
+ * With GCC the simulator uses direct-threaded dispatch, every predecoded
+ * instruction holds the address of its handler in sim_run. Define
+ * SIM_SWITCH to use the portable switch instead.
+ */
+#if defined(__GNUC__) && !defined(SIM_SWITCH)
+	#define SIM_THREADED 1
+#endif
+
+/**
+ * Predecoded instruction.
+ */
+struct sim_instr {
+#ifdef SIM_THREADED
+	const void *handler;
+#endif
+	uint8_t op;
+	uint8_t x;	// destination register
+	uint8_t y;	// source register or constant
+	uint8_t idle;	// the jump closes a loop without side effects, see sim_load
+	uint16_t target;	// address of jumps and calls
+};
+
+/**
+ * Reasons to stop the simulation.
+ */
+enum sim_status {
+	SIM_RUNNING,
+	SIM_BUDGET,	// the given number of instructions was executed
+	SIM_INVALID,	// an invalid instruction was reached
+	SIM_STOPPED,	// sim_stop was called
+	SIM_BREAK	// a breakpoint was reached, see struct sim_breakpoints
+};
+
+/**
+ * Faults that do not stop the processor but are usually bugs.
+ */
+#define SIM_FAULT_OVERFLOW 0x01	// call stack overflow
+#define SIM_FAULT_UNDERFLOW 0x02	// return with empty call stack
+
+struct sim;
+struct ports;
+
+/**
+ * Host side of INPUT and OUTPUT instructions.
+ */
+struct sim_io {
+	uint8_t (*input)(struct sim *s, uint8_t port, void *ctx);
+	void (*output)(struct sim *s, uint8_t port, uint8_t value, void *ctx);
+	void *ctx;
+};
+
+#define SIM_COVERAGE_WORDS (SIM_PROGRAM_LEN / 64)
+
+/**
+ * Bitmaps of program addresses covered by sim_run, see coverage.h. Its
+ * second instance collects them, so the simulation without coverage
+ * is not slowed down.
+ */
+struct sim_coverage {
+	uint64_t executed[SIM_COVERAGE_WORDS];
+	uint64_t taken[SIM_COVERAGE_WORDS];	// jumps, calls and returns
+	uint64_t not_taken[SIM_COVERAGE_WORDS];
+};
+
+#define SIM_WATCH_WORDS ((SIM_SCRATCHPAD + 63) / 64)
+
+#define SIM_BREAK_CODE 1
+#define SIM_BREAK_WRITE 2
+#define SIM_BREAK_READ 3
+
+/**
+ * Bitmaps of breakpoints and watchpoints of the scratchpad (see gdb.h).
+ * Like the coverage they are checked by another instance of sim_run,
+ * only when s->breakpoints is not NULL, and the idle loops are not
+ * skipped then. The coverage is not collected meanwhile.
+ */
+struct sim_breakpoints {
+	uint64_t code[SIM_COVERAGE_WORDS];	// stops before the instruction
+	uint64_t write[SIM_WATCH_WORDS];	// stops after STORE to the address
+	uint64_t read[SIM_WATCH_WORDS];	// after FETCH
+	unsigned hit;	// SIM_BREAK_* that stopped sim_run
+	uint8_t address;	// of the watchpoint hit
+};
+
+struct sim {
+	// processor state:
+	uint8_t reg[SIM_REGS];
+	uint8_t scratchpad[SIM_SCRATCHPAD];
+	uint16_t pc;
+	// flags are evaluated lazily from the last result, see sim_zero and sim_carry
+	uint16_t flags;
+	uint16_t saved_flags;	// preserved during the interrupt
+	bool ie;	// interrupt enable
+	bool irq;	// interrupt input
+	// the call stack is circular like in the hardware
+	uint16_t stack[SIM_STACK];
+	unsigned sp;	// top of the stack
+	unsigned depth;	// number of valid entries
+	unsigned faults;
+	uint64_t cycles;
+	uint64_t instructions;
+	enum sim_status status;
+
+	struct sim_io io;
+	struct ports *ports;	// models accessed inline, see ports.h
+	struct sim_coverage *coverage;	// collected by sim_run when not NULL
+	struct sim_breakpoints *breakpoints;	// checked by sim_run when not NULL
+	uint64_t stable_until;	// inputs and irq do not change before this cycle, see sim_run
+	code_t code[SIM_PROGRAM_LEN];
+	struct sim_instr rom[SIM_PROGRAM_LEN];
+	unsigned threaded;	// the instance of sim_run that set handlers of rom, 0 for none
+	unsigned generation;	// incremented by sim_load, for translations of the program
+	uint32_t checksum;	// of the program, see snapshot.h
+};
+
+/**
+ * The lazy flags hold the 9-bit result of the last operation that
+ * changed the flags (bit 8 is the carry). TEST sets SIM_FLAGS_PARITY,
+ * then the carry is the parity of the result.
+ */
+#define SIM_FLAGS_CARRY 0x100
+#define SIM_FLAGS_PARITY 0x200
+
+static inline bool sim_parity(unsigned v)
+{
+	v ^= v >> 4;
+	v ^= v >> 2;
+	v ^= v >> 1;
+	return v & 1;
+}
+
+static inline bool sim_zero(const struct sim *s)
+{
+	return (s->flags & 0xFF) == 0;
+}
+
+static inline bool sim_flags_carry(unsigned flags)
+{
+	if(flags & SIM_FLAGS_PARITY)
+		return sim_parity(flags & 0xFF);
+	return flags & SIM_FLAGS_CARRY;
+}
+
+static inline bool sim_carry(const struct sim *s)
+{
+	return sim_flags_carry(s->flags);
+}
+
+/**
+ * Sets the flags to the given values.
+ */
+static inline void sim_set_flags(struct sim *s, bool zero, bool carry)
+{
+	s->flags = (zero? 0 : 1) | (carry? SIM_FLAGS_CARRY : 0);
+}
+
+/**
+ * Call stack operations, overflow and underflow are recorded as faults.
+ */
+static inline void sim_push(struct sim *s, uint16_t addr)
+{
+	s->sp = s->sp == SIM_STACK - 1? 0 : s->sp + 1;
+	s->stack[s->sp] = addr;
+
+	if(s->depth == SIM_STACK)
+		s->faults |= SIM_FAULT_OVERFLOW;
+	else
+		s->depth += 1;
+}
+
+static inline uint16_t sim_pop(struct sim *s)
+{
+	const uint16_t addr = s->stack[s->sp];
+	s->sp = s->sp == 0? SIM_STACK - 1 : s->sp - 1;
+
+	if(s->depth == 0)
+		s->faults |= SIM_FAULT_UNDERFLOW;
+	else
+		s->depth -= 1;
+
+	return addr;
+}
+
+/**
+ * Takes the pending interrupt like the processor before the fetch, it takes
+ * one slot. For hosts running the simulation in parts, eg. the scheduler.
+ * @return false when the interrupt is not pending
+ */
+static inline bool sim_acknowledge(struct sim *s)
+{
+	if(!s->ie || !s->irq)
+		return false;
+
+	sim_push(s, s->pc);
+	s->saved_flags = s->flags;
+	s->irq = false;
+	s->ie = false;
+	s->pc = SIM_VECTOR;
+	s->cycles += SIM_CYCLES_PER_INSTR;
+	return true;
+}
+
+/**
+ * sim_run does not stop at the breakpoint where it starts, a host running
+ * the simulation in parts checks it before the next part.
+ * @return true when the processor would stop at a breakpoint now
+ */
+static inline bool sim_at_breakpoint(const struct sim *s)
+{
+	return s->breakpoints != NULL && !(s->ie && s->irq)
+		&& (s->breakpoints->code[s->pc >> 6] >> (s->pc & 63) & 1);
+}
+
+/**
+ * Predecodes one instruction word.
+ */
+struct sim_instr sim_decode(code_t code);
+
+/**
+ * Loads the program (eg. from output_image) and resets the processor.
+ * Shorter programs are padded by zero words. Short loops without side
+ * effects (polling of a port, waiting for the interrupt) are marked
+ * for sim_run.
+ */
+bool sim_load(struct sim *s, const code_t *code, progaddr_t len);
+
+/**
+ * Reads the HEX file produced by pico, one instruction word per line,
+ * at most SIM_PROGRAM_LEN of them.
+ * @param len set to the number of words read
+ * @return false when the file can not be opened
+ */
+bool sim_read_hex(const char *path, code_t *code, progaddr_t *len);
+
+/**
+ * Resets the processor, the program and the I/O are kept.
+ */
+void sim_reset(struct sim *s);
+
+/**
+ * Sets the interrupt input. The input is cleared when the processor
+ * acknowledges the interrupt (like INTERRUPT_ACK of the reference design).
+ */
+static inline void sim_interrupt(struct sim *s, bool level)
+{
+	s->irq = level;
+}
+
+/**
+ * Stops the running simulation after the current instruction
+ * (eg. from an I/O callback).
+ */
+static inline void sim_stop(struct sim *s)
+{
+	s->status = SIM_STOPPED;
+}
+
+/**
+ * Executes at most the given number of instructions.
+ * When a marked loop returns to the same state, its iterations are skipped
+ * (cycles and instructions are counted) until the cycle s->stable_until,
+ * the host sets it when it knows that INPUT reads the same values and the
+ * interrupt is not raised until then. By default it is 0 and nothing
+ * is skipped. Inputs of port models other than registers are never stable.
+ * @return reason of the stop
+ */
+enum sim_status sim_run(struct sim *s, uint64_t instructions);
+
+#endif
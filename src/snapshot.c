@@ -0,0 +1,173 @@
+/**
+ * snapshot.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "snapshot.h"
+#include <string.h>
+
+/**
+ * File format, little endian:
+ *   "PSNP" version:8 checksum:32 reg:8[16] scratchpad:8[64]
+ *   pc:16 flags:16 saved_flags:16 ie:8 irq:8 sp:8 depth:8 faults:8 status:8
+ *   stack:16[31] cycles:64 instructions:64 io_len:32 io:8[io_len]
+ */
+#define SNAPSHOT_MAGIC "PSNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SIZE (5 + 4 + SIM_REGS + SIM_SCRATCHPAD + 3 * 2 + 6 \
+		+ 2 * SIM_STACK + 2 * 8 + 4)
+
+void snapshot_save(const struct sim *s, struct snapshot *snap)
+{
+	snap->checksum = s->checksum;
+	memcpy(snap->reg, s->reg, sizeof(snap->reg));
+	memcpy(snap->scratchpad, s->scratchpad, sizeof(snap->scratchpad));
+	snap->pc = s->pc;
+	snap->flags = s->flags;
+	snap->saved_flags = s->saved_flags;
+	snap->ie = s->ie;
+	snap->irq = s->irq;
+	memcpy(snap->stack, s->stack, sizeof(snap->stack));
+	snap->sp = s->sp;
+	snap->depth = s->depth;
+	snap->faults = s->faults;
+	snap->status = s->status;
+	snap->cycles = s->cycles;
+	snap->instructions = s->instructions;
+}
+
+bool snapshot_restore(struct sim *s, const struct snapshot *snap)
+{
+	if(snap->checksum != s->checksum)
+		return false;
+
+	memcpy(s->reg, snap->reg, sizeof(s->reg));
+	memcpy(s->scratchpad, snap->scratchpad, sizeof(s->scratchpad));
+	s->pc = snap->pc;
+	s->flags = snap->flags;
+	s->saved_flags = snap->saved_flags;
+	s->ie = snap->ie;
+	s->irq = snap->irq;
+	memcpy(s->stack, snap->stack, sizeof(s->stack));
+	s->sp = snap->sp;
+	s->depth = snap->depth;
+	s->faults = snap->faults;
+	s->status = (enum sim_status) snap->status;
+	s->cycles = snap->cycles;
+	s->instructions = snap->instructions;
+	return true;
+}
+
+// =================================== //
+// ------------ file format ---------- //
+// =================================== //
+
+static uint8_t *put(uint8_t *p, uint64_t v, int bytes)
+{
+	for(int i = 0; i < bytes; i++)
+		*p++ = v >> (8 * i);
+	return p;
+}
+
+static const uint8_t *get(const uint8_t *p, uint64_t *v, int bytes)
+{
+	*v = 0;
+	for(int i = 0; i < bytes; i++)
+		*v |= (uint64_t) *p++ << (8 * i);
+	return p;
+}
+
+bool snapshot_write(FILE *f, const struct snapshot *snap, const void *io, uint32_t io_len)
+{
+	uint8_t buf[SNAPSHOT_SIZE];
+	uint8_t *p = buf;
+
+	memcpy(p, SNAPSHOT_MAGIC, 4);
+	p = put(p + 4, SNAPSHOT_VERSION, 1);
+	p = put(p, snap->checksum, 4);
+	memcpy(p, snap->reg, SIM_REGS);
+	memcpy(p + SIM_REGS, snap->scratchpad, SIM_SCRATCHPAD);
+	p += SIM_REGS + SIM_SCRATCHPAD;
+
+	p = put(p, snap->pc, 2);
+	p = put(p, snap->flags, 2);
+	p = put(p, snap->saved_flags, 2);
+	p = put(p, snap->ie, 1);
+	p = put(p, snap->irq, 1);
+	p = put(p, snap->sp, 1);
+	p = put(p, snap->depth, 1);
+	p = put(p, snap->faults, 1);
+	p = put(p, snap->status, 1);
+	for(int i = 0; i < SIM_STACK; i++)
+		p = put(p, snap->stack[i], 2);
+	p = put(p, snap->cycles, 8);
+	p = put(p, snap->instructions, 8);
+	put(p, io_len, 4);
+
+	return fwrite(buf, 1, sizeof(buf), f) == sizeof(buf)
+		&& (io_len == 0 || fwrite(io, 1, io_len, f) == io_len);
+}
+
+bool snapshot_read(FILE *f, struct snapshot *snap, void *io, uint32_t *io_len)
+{
+	uint8_t buf[SNAPSHOT_SIZE];
+	if(fread(buf, 1, sizeof(buf), f) != sizeof(buf))
+		return false;
+	if(memcmp(buf, SNAPSHOT_MAGIC, 4) || buf[4] != SNAPSHOT_VERSION)
+		return false;
+
+	const uint8_t *p = buf + 5;
+	uint64_t v;
+
+	p = get(p, &v, 4);
+	snap->checksum = v;
+	memcpy(snap->reg, p, SIM_REGS);
+	memcpy(snap->scratchpad, p + SIM_REGS, SIM_SCRATCHPAD);
+	p += SIM_REGS + SIM_SCRATCHPAD;
+
+	p = get(p, &v, 2);
+	snap->pc = v % SIM_PROGRAM_LEN;
+	p = get(p, &v, 2);
+	snap->flags = v;
+	p = get(p, &v, 2);
+	snap->saved_flags = v;
+	snap->ie = *p++ != 0;
+	snap->irq = *p++ != 0;
+	snap->sp = *p++ % SIM_STACK;
+	snap->depth = *p++;
+	snap->faults = *p++;
+	snap->status = *p++;
+	for(int i = 0; i < SIM_STACK; i++) {
+		p = get(p, &v, 2);
+		snap->stack[i] = v % SIM_PROGRAM_LEN;
+	}
+	p = get(p, &snap->cycles, 8);
+	p = get(p, &snap->instructions, 8);
+	get(p, &v, 4);
+
+	if(snap->depth > SIM_STACK || snap->status > SIM_BREAK)
+		return false;
+
+	const uint32_t len = v;
+	if(io_len == NULL)
+		return fseek(f, len, SEEK_CUR) == 0;
+	if(len > *io_len)
+		return false;
+
+	*io_len = len;
+	return len == 0 || fread(io, 1, len, f) == len;
+}
@@ -0,0 +1,77 @@
+/**
+ * snapshot.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * State of the processor without the program, eg. after a long boot
+ * sequence. Many simulations of the same program can continue from it,
+ * restoring is a copy of a few hundred bytes. The program is identified
+ * by its checksum only.
+ *
+ * The state of I/O models is kept by the host, in the file it is stored
+ * with the snapshot as an opaque block.
+ */
+struct snapshot {
+	uint32_t checksum;	// of the program
+	uint8_t reg[SIM_REGS];
+	uint8_t scratchpad[SIM_SCRATCHPAD];
+	uint16_t pc;
+	uint16_t flags;
+	uint16_t saved_flags;
+	bool ie;
+	bool irq;
+	uint16_t stack[SIM_STACK];
+	uint8_t sp;
+	uint8_t depth;
+	uint8_t faults;
+	uint8_t status;
+	uint64_t cycles;
+	uint64_t instructions;
+};
+
+void snapshot_save(const struct sim *s, struct snapshot *snap);
+
+/**
+ * Restores the state, the program and the I/O callbacks are kept.
+ * @return false when the snapshot is of another program
+ */
+bool snapshot_restore(struct sim *s, const struct snapshot *snap);
+
+/**
+ * Writes the snapshot in a compact portable format followed by io_len
+ * bytes of the I/O models state (io may be NULL when io_len is 0).
+ */
+bool snapshot_write(FILE *f, const struct snapshot *snap, const void *io, uint32_t io_len);
+
+/**
+ * Reads the snapshot written by snapshot_write. The I/O models state
+ * is read to io of *io_len bytes and *io_len is set to its length,
+ * when io_len is NULL, the state is skipped.
+ * @return false on error or when the I/O state does not fit
+ */
+bool snapshot_read(FILE *f, struct snapshot *snap, void *io, uint32_t *io_len);
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * source.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "source.h"
+#include "pc.h"
+#include "buffer.h"
+#include "scanner.h"
+#include "stab.h"
+#include "output.h"
+#include "assembler.h"
+#include "isa.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LINE_MAX_LEN 256
+
+bool source_assemble(struct sim *s, int *lines, char *srcfile)
+{
+	struct token tok = {.type = T_UNKNOWN, .lineno = -1};
+	struct pico p = {.tok = &tok, .stab = stab_init(), .address = 0,
+		.buff = NULL, .offset = NULL, .lineno = 1};
+	if(p.stab == NULL)
+		return error(NULL, "Memory allocation error");
+
+	bool result = assembler_setup(&p, isa_default())
+			&& buffer_init(&p, srcfile)
+			&& output_init_memory(&p)
+			&& assembler_run(&p);
+
+	if(result) {
+		progaddr_t len;
+		const code_t *code = output_image(&p, &len);
+		memcpy(lines, output_lines(&p), len * sizeof(int));
+		result = sim_load(s, code, len);
+	}
+
+	buffer_destroy(&p);
+	output_destroy(&p);
+	stab_destroy(p.stab);
+	return result;
+}
+
+bool source_print(const char *const *msg, const int *lines, const char *srcfile)
+{
+	FILE *f = fopen(srcfile, "r");
+	if(f == NULL)
+		return error(NULL, "Can not open the source file");
+
+	// the lines are in order of addresses, ADDRESS may reorder them
+	char text[LINE_MAX_LEN];
+	int n = 0;
+	while(fgets(text, sizeof(text), f) != NULL) {
+		const bool complete = strchr(text, '\n') != NULL;
+		n += 1;
+		text[strcspn(text, "\r\n")] = '\0';
+		for(uint16_t i = 0; i < SIM_PROGRAM_LEN; i++) {
+			if(lines[i] == n && msg[i] != NULL)
+				printf("%s:%d: %s: %s\n", srcfile, n, msg[i], text + strspn(text, " \t"));
+		}
+
+		// skips the rest of a long line
+		for(int c = 0; !complete && c != '\n' && c != EOF; c = fgetc(f))
+			;
+	}
+	fclose(f);
+	return true;
+}
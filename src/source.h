@@ -0,0 +1,45 @@
+/**
+ * source.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _SOURCE_H
+#define _SOURCE_H
+
+#include "sim.h"
+#include <stdbool.h>
+
+/**
+ * Reports of the tools by the lines of the assembler source (picocov,
+ * picoirq). The application provides error() like for the assembler.
+ */
+
+/**
+ * Assembles the source to get the program and the lines of instructions.
+ * @param lines SIM_PROGRAM_LEN line numbers by addresses, 0 without
+ * an instruction
+ */
+bool source_assemble(struct sim *s, int *lines, char *srcfile);
+
+/**
+ * Prints the message of each address at its line of the source:
+ *   <srcfile>:<line>: <message>: <source line>
+ * @param msg SIM_PROGRAM_LEN messages by addresses, NULL without one
+ */
+bool source_print(const char *const *msg, const int *lines, const char *srcfile);
+
+#endif
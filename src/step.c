@@ -0,0 +1,116 @@
+/**
+ * step.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "step.h"
+#include <string.h>
+
+void step_init(struct stepper *p, struct sim *s)
+{
+	p->sim = s;
+	p->observers = 0;
+	p->end = s->cycles;
+}
+
+bool step_observe(struct stepper *p, const struct step_observer *o)
+{
+	if(p->observers == STEP_OBSERVERS)
+		return false;
+
+	p->observer[p->observers++] = *o;
+	return true;
+}
+
+/**
+ * @return instructions that no observer needs
+ */
+static uint64_t unobserved(struct stepper *p, uint64_t left)
+{
+	for(unsigned i = 0; i < p->observers && left > 0; i++) {
+		const struct step_observer *o = &p->observer[i];
+		const uint64_t n = o->unobserved != NULL? o->unobserved(p->sim, o->ctx) : 0;
+		if(n < left)
+			left = n;
+	}
+	return left;
+}
+
+enum sim_status step_run(struct stepper *p, uint64_t instructions)
+{
+	struct sim *s = p->sim;
+	enum sim_status status = SIM_BUDGET;
+	const uint64_t first = s->instructions;
+
+	while(s->instructions - first < instructions) {
+		if(s->cycles != p->end && s->pc == SIM_VECTOR) {
+			for(unsigned i = 0; i < p->observers; i++) {
+				const struct step_observer *o = &p->observer[i];
+				if(o->acknowledged != NULL)
+					o->acknowledged(s, p->end, o->ctx);
+			}
+		}
+		p->end = s->cycles;
+
+		const uint64_t n = unobserved(p, instructions - (s->instructions - first));
+		if(n > 0) {
+			status = sim_run(s, n);
+			p->end = s->cycles;
+			if(status != SIM_BUDGET)
+				break;
+			continue;
+		}
+
+		// sim_run acknowledges the interrupt before the instruction
+		struct step st;
+		st.cycle = s->cycles;
+		st.ack = s->ie && s->irq;
+		st.begin = st.ack? st.cycle + SIM_CYCLES_PER_INSTR : st.cycle;
+		st.address = st.ack? SIM_VECTOR : s->pc;
+		st.irq = s->irq;
+		st.ie = s->ie;
+		st.sp = !st.ack? s->sp : s->sp == SIM_STACK - 1? 0 : s->sp + 1;
+		memcpy(st.reg, s->reg, SIM_REGS);
+
+		for(unsigned i = 0; i < p->observers; i++) {
+			const struct step_observer *o = &p->observer[i];
+			if(o->before != NULL)
+				o->before(s, &st, o->ctx);
+		}
+
+		const uint64_t retired = s->instructions;
+		status = sim_run(s, 1);
+		p->end = s->cycles;
+		if(s->instructions == retired)
+			break;
+
+		for(unsigned i = 0; i < p->observers; i++) {
+			const struct step_observer *o = &p->observer[i];
+			if(o->after != NULL)
+				o->after(s, &st, o->ctx);
+		}
+		if(status != SIM_BUDGET)
+			break;
+	}
+
+	return status;
+}
+
+enum sim_status step_runner(void *ctx, uint64_t instructions)
+{
+	return step_run((struct stepper *) ctx, instructions);
+}
@@ -0,0 +1,103 @@
+/**
+ * step.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _STEP_H
+#define _STEP_H
+
+#include "sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Execution by single instructions for the observers of the simulation,
+ * eg. the profile (see profile.h). Each step reports the acknowledge
+ * of the interrupt and the retired instruction to every observer, so they
+ * can be combined in one run, also as the runner of the scheduler (see
+ * sched_set_runner).
+ *
+ * The interrupt is acknowledged by sim_run before the instruction (ack
+ * of the step) or by the host between two runs (see sched_run), then the
+ * processor is at the vector before the step. When no observer needs
+ * the next instructions, they are run by sim_run at once.
+ */
+
+#define STEP_OBSERVERS 8
+
+/**
+ * The executed instruction, the state before it is in the step, the state
+ * after it in the simulator.
+ */
+struct step {
+	uint64_t cycle;	// at the start of the step
+	uint64_t begin;	// of the instruction, after the acknowledge
+	uint16_t address;	// of the instruction, SIM_VECTOR after the acknowledge
+	bool ack;	// the interrupt was acknowledged before the instruction
+	bool irq;	// the interrupt input at the start of the step
+	bool ie;	// the interrupts were enabled at the start of the step
+	uint8_t sp;	// stack pointer before the instruction
+	uint8_t reg[SIM_REGS];	// before the instruction
+};
+
+/**
+ * The callbacks may be NULL.
+ */
+struct step_observer {
+	/**
+	 * Called before each step.
+	 * @return instructions that may run without being reported,
+	 * 0 for none, UINT64_MAX for any number (NULL is 0)
+	 */
+	uint64_t (*unobserved)(struct sim *s, void *ctx);
+	/**
+	 * The host acknowledged the interrupt after the last instruction,
+	 * which ended at the cycle end.
+	 */
+	void (*acknowledged)(struct sim *s, uint64_t end, void *ctx);
+	void (*before)(struct sim *s, const struct step *st, void *ctx);
+	void (*after)(struct sim *s, const struct step *st, void *ctx);
+	void *ctx;
+};
+
+struct stepper {
+	struct sim *sim;
+	struct step_observer observer[STEP_OBSERVERS];
+	unsigned observers;
+	uint64_t end;	// of the last instruction
+};
+
+void step_init(struct stepper *p, struct sim *s);
+
+/**
+ * Adds the observer, they are called in the order of adding.
+ * @return false when there are STEP_OBSERVERS already
+ */
+bool step_observe(struct stepper *p, const struct step_observer *o);
+
+/**
+ * Executes at most the given number of instructions like sim_run.
+ * @return reason of the stop
+ */
+enum sim_status step_run(struct stepper *p, uint64_t instructions);
+
+/**
+ * step_run of the stepper given as ctx, a runner of the scheduler.
+ */
+enum sim_status step_runner(void *ctx, uint64_t instructions);
+
+#endif
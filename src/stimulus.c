@@ -0,0 +1,212 @@
+/**
+ * stimulus.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#define _DEFAULT_SOURCE
+
+#include "stimulus.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STIMULUS_MAGIC "PSTM"
+#define STIMULUS_VERSION 1
+
+struct stimulus {
+	int fd;
+	const uint8_t *begin;
+	const uint8_t *end;	// of the last whole record
+	size_t size;	// of the mapping
+	const uint8_t *next;
+	const uint8_t *prefetched;	// until
+	const uint8_t *released;	// before
+	uint64_t cycle;	// of the last record
+	bool invalid;
+};
+
+struct stimulus *stimulus_open(const char *path)
+{
+	const int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size < STIMULUS_HEADER) {
+		close(fd);
+		return NULL;
+	}
+
+	const size_t size = info.st_size;
+	void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	struct stimulus *st = (struct stimulus *) calloc(1, sizeof(struct stimulus));
+	if(map == MAP_FAILED || st == NULL || memcmp(map, STIMULUS_MAGIC, 4)
+			|| ((const uint8_t *) map)[4] != STIMULUS_VERSION) {
+		if(map != MAP_FAILED)
+			munmap(map, size);
+		free(st);
+		close(fd);
+		return NULL;
+	}
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	st->fd = fd;
+	st->size = size;
+	st->begin = (const uint8_t *) map;
+	st->end = st->begin + STIMULUS_HEADER
+		+ (size - STIMULUS_HEADER) / STIMULUS_RECORD * STIMULUS_RECORD;
+	st->next = st->begin + STIMULUS_HEADER;
+	st->prefetched = st->begin;
+	st->released = st->begin;
+	return st;
+}
+
+void stimulus_close(struct stimulus *st)
+{
+	if(st == NULL)
+		return;
+
+	munmap((void *) st->begin, st->size);
+	close(st->fd);
+	free(st);
+}
+
+uint64_t stimulus_len(const struct stimulus *st)
+{
+	return (st->end - st->begin - STIMULUS_HEADER) / STIMULUS_RECORD;
+}
+
+bool stimulus_invalid(const struct stimulus *st)
+{
+	return st->invalid;
+}
+
+/**
+ * Asks for the next window and gives back the windows already read,
+ * the addresses are aligned to the windows (multiples of pages).
+ */
+static void prefetch(struct stimulus *st)
+{
+	const size_t offset = (st->next - st->begin) / STIMULUS_WINDOW * STIMULUS_WINDOW;
+	const uint8_t *window = st->begin + offset;
+
+	if(window > st->released) {
+		madvise((void *) st->released, window - st->released, MADV_DONTNEED);
+		st->released = window;
+	}
+
+	const size_t left = st->size - offset;
+	const size_t len = left < 2 * STIMULUS_WINDOW? left : 2 * STIMULUS_WINDOW;
+	madvise((void *) window, len, MADV_WILLNEED);
+	st->prefetched = window + STIMULUS_WINDOW;
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for(int i = 0; i < 8; i++)
+		v |= (uint64_t) p[i] << (8 * i);
+	return v;
+}
+
+/**
+ * @return false for an unknown code
+ */
+static bool kind_of(uint8_t code, uint8_t *kind)
+{
+	switch(code) {
+	case STIMULUS_IRQ:
+		*kind = SCHED_INTERRUPT;
+		return true;
+	case STIMULUS_INPUT:
+		*kind = SCHED_INPUT;
+		return true;
+	case STIMULUS_STOP:
+		*kind = SCHED_STOP;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @return false for the kinds without a code
+ */
+static bool code_of(uint8_t kind, uint8_t *code)
+{
+	switch(kind) {
+	case SCHED_INTERRUPT:
+		*code = STIMULUS_IRQ;
+		return true;
+	case SCHED_INPUT:
+		*code = STIMULUS_INPUT;
+		return true;
+	case SCHED_STOP:
+		*code = STIMULUS_STOP;
+		return true;
+	}
+	return false;
+}
+
+bool stimulus_next(void *ctx, struct sched_event *e)
+{
+	struct stimulus *st = (struct stimulus *) ctx;
+	if(st->next == st->end)
+		return false;
+	if(st->next >= st->prefetched)
+		prefetch(st);
+
+	const uint8_t *r = st->next;
+	memset(e, 0, sizeof(*e));
+	e->cycle = get64(r);
+	e->port = r[9];
+	e->value = r[10];
+
+	const bool known = kind_of(r[8], &e->kind)
+		&& (e->kind != SCHED_INTERRUPT || e->value <= 1);
+	if(!known || e->cycle < st->cycle) {
+		st->invalid = true;
+		st->next = st->end;
+		return false;
+	}
+
+	st->cycle = e->cycle;
+	st->next += STIMULUS_RECORD;
+	return true;
+}
+
+bool stimulus_write_header(FILE *f)
+{
+	const uint8_t header[STIMULUS_HEADER] = {'P', 'S', 'T', 'M', STIMULUS_VERSION};
+	return fwrite(header, 1, sizeof(header), f) == sizeof(header);
+}
+
+bool stimulus_write(FILE *f, const struct sched_event *e)
+{
+	uint8_t r[STIMULUS_RECORD] = {0};
+	if(!code_of(e->kind, &r[8]))
+		return false;
+
+	for(int i = 0; i < 8; i++)
+		r[i] = e->cycle >> (8 * i);
+	r[9] = e->port;
+	r[10] = e->value;
+	return fwrite(r, 1, sizeof(r), f) == sizeof(r);
+}
@@ -0,0 +1,92 @@
+/**
+ * stimulus.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+
+#ifndef _STIMULUS_H
+#define _STIMULUS_H
+
+#include "scheduler.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Binary stimulus of long simulations, the events of the scheduler stamped
+ * by cycles in records of a fixed size. The file is mapped to the memory
+ * and read sequentially by the scheduler (see sched_set_source), the pages
+ * ahead are prefetched and the pages behind are released, so a file of
+ * gigabytes costs a few megabytes of memory and there is nothing to parse.
+ *
+ * File format, little endian:
+ *   "PSTM" version:8 reserved:8[3] record...
+ *   record: cycle:64 kind:8 port:8 value:8 reserved:8
+ * The kind is one of enum stimulus_kind, the cycles of the records do not
+ * decrease. The codes are a part of the format, they are mapped to the kinds
+ * of the scheduler when read and written.
+ */
+
+enum stimulus_kind {
+	STIMULUS_IRQ = 0,	// sets the interrupt input to the value (0 or 1)
+	STIMULUS_INPUT = 1,	// sets the value of the input port
+	STIMULUS_STOP = 2	// stops the simulation
+};
+
+#define STIMULUS_HEADER 8
+#define STIMULUS_RECORD 12
+#define STIMULUS_WINDOW (4 << 20)	// bytes prefetched ahead
+
+struct stimulus;
+
+/**
+ * Maps the file.
+ * @return NULL when it can not be opened or it is not a stimulus
+ */
+struct stimulus *stimulus_open(const char *path);
+
+void stimulus_close(struct stimulus *st);
+
+/**
+ * Number of records.
+ */
+uint64_t stimulus_len(const struct stimulus *st);
+
+/**
+ * The next event, the source of the scheduler.
+ * @return false at the end or at an invalid record
+ */
+bool stimulus_next(void *ctx, struct sched_event *e);
+
+/**
+ * @return true when an invalid record (an unknown kind or a decreasing
+ * cycle) ended the stimulus
+ */
+bool stimulus_invalid(const struct stimulus *st);
+
+/**
+ * Writes the header of a new file.
+ */
+bool stimulus_write_header(FILE *f);
+
+/**
+ * Appends the event, the cycles must not decrease.
+ * @return false on write error or for SCHED_CALL, which has no code
+ */
+bool stimulus_write(FILE *f, const struct sched_event *e);
+
+#endif
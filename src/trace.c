@@ -0,0 +1,391 @@
+/**
+ * trace.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _GNU_SOURCE	// O_DIRECT
+
+#include "trace.h"
+#include "writer.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define TRACE_MAGIC "PTRC"
+#define TRACE_VERSION 1
+#define TRACE_HEADER (5 + 4 + 2 + 1 + SIM_REGS + SIM_SCRATCHPAD + 2 * 8)
+#define TRACE_RECORD_MAX 16
+// alignment of buffers and writes for O_DIRECT
+#define TRACE_ALIGN 4096
+#define PC_MASK (SIM_PROGRAM_LEN - 1)
+
+#ifndef O_DIRECT
+	#define O_DIRECT 0
+#endif
+
+struct trace {
+	struct sim *sim;
+	uint8_t flags;	// of the last record
+	bool acked;	// by the host before the next instruction
+	struct writer w;
+};
+
+static uint8_t *put(uint8_t *p, uint64_t v, int bytes)
+{
+	for(int i = 0; i < bytes; i++)
+		*p++ = v >> (8 * i);
+	return p;
+}
+
+static uint64_t get(const uint8_t *p, int bytes)
+{
+	uint64_t v = 0;
+	for(int i = 0; i < bytes; i++)
+		v |= (uint64_t) p[i] << (8 * i);
+	return v;
+}
+
+static uint8_t flags_of(const struct sim *s)
+{
+	return (sim_zero(s)? TRACE_FLAG_ZERO : 0) | (sim_carry(s)? TRACE_FLAG_CARRY : 0)
+		| (s->ie? TRACE_FLAG_IE : 0);
+}
+
+// =================================== //
+// ------------- writer -------------- //
+// =================================== //
+
+/**
+ * Records may cross buffers, so the writes are always of whole buffers.
+ */
+static void append(struct trace *t, const uint8_t *rec, size_t len)
+{
+	struct writer *w = &t->w;
+	if(w->len + len > TRACE_BUFFER) {
+		const size_t part = TRACE_BUFFER - w->len;
+		memcpy(w->buffer[w->active] + w->len, rec, part);
+		w->len = TRACE_BUFFER;
+		writer_swap(w);
+		rec += part;
+		len -= part;
+	}
+
+	memcpy(w->buffer[w->active] + w->len, rec, len);
+	w->len += len;
+}
+
+static int open_file(const char *path)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0666);
+	if(fd == -1 && O_DIRECT != 0 && errno == EINVAL)
+		fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	return fd;
+}
+
+struct trace *trace_open(struct sim *s, const char *path)
+{
+	struct trace *t = (struct trace *) calloc(1, sizeof(struct trace));
+	if(t == NULL)
+		return NULL;
+
+	const int fd = open_file(path);
+	if(fd == -1 || !writer_init(&t->w, fd, TRACE_BUFFER, TRACE_ALIGN)) {
+		if(fd != -1)
+			close(fd);
+		free(t);
+		return NULL;
+	}
+
+	t->sim = s;
+	t->flags = flags_of(s);
+
+	uint8_t header[TRACE_HEADER];
+	uint8_t *p = header;
+	memcpy(p, TRACE_MAGIC, 4);
+	p = put(p + 4, TRACE_VERSION, 1);
+	p = put(p, s->checksum, 4);
+	p = put(p, s->pc, 2);
+	p = put(p, t->flags, 1);
+	memcpy(p, s->reg, SIM_REGS);
+	memcpy(p + SIM_REGS, s->scratchpad, SIM_SCRATCHPAD);
+	p += SIM_REGS + SIM_SCRATCHPAD;
+	p = put(p, s->cycles, 8);
+	put(p, s->instructions, 8);
+	append(t, header, sizeof(header));
+	return t;
+}
+
+bool trace_close(struct trace *t)
+{
+	const bool ok = writer_close(&t->w);
+	free(t);
+	return ok;
+}
+
+// =================================== //
+// ------------ recording ------------ //
+// =================================== //
+
+/**
+ * Encodes the instruction from the state before (reg) and after it.
+ */
+static void record(struct trace *t, uint16_t pc, const uint8_t *reg, bool interrupt)
+{
+	const struct sim *s = t->sim;
+	const struct sim_instr *ins = &s->rom[pc];
+	uint8_t rec[TRACE_RECORD_MAX];
+	uint8_t *p = rec + 1;
+	uint8_t what = interrupt? TRACE_INTERRUPT : 0;
+
+	if(s->pc != ((pc + 1) & PC_MASK)) {
+		// signed distance within the program, zigzag encoded
+		int delta = (s->pc - pc - 1) & PC_MASK;
+		if(delta >= SIM_PROGRAM_LEN / 2)
+			delta -= SIM_PROGRAM_LEN;
+		unsigned v = delta < 0? 2 * -delta - 1 : 2 * delta;
+		what |= TRACE_JUMP;
+		for(; v >= 0x80; v >>= 7)
+			*p++ = v | 0x80;
+		*p++ = v;
+	}
+
+	if(memcmp(reg, s->reg, SIM_REGS)) {
+		int i = 0;
+		while(reg[i] == s->reg[i])
+			i += 1;
+		what |= TRACE_REG;
+		*p++ = i;
+		*p++ = s->reg[i];
+	}
+
+	const uint8_t flags = flags_of(s);
+	if(flags != t->flags) {
+		what |= TRACE_FLAGS;
+		*p++ = flags;
+		t->flags = flags;
+	}
+
+	const bool rr = ins->op == S_INPUT_RR || ins->op == S_OUTPUT_RR || ins->op == S_STORE_RR;
+	const uint8_t operand = rr? reg[ins->y] : ins->y;
+
+	switch(ins->op) {
+	case S_INPUT_RR:
+	case S_INPUT_RK:
+		what |= TRACE_INPUT;
+		*p++ = operand;
+		*p++ = s->reg[ins->x];
+		break;
+	case S_OUTPUT_RR:
+	case S_OUTPUT_RK:
+		what |= TRACE_OUTPUT;
+		*p++ = operand;
+		*p++ = reg[ins->x];
+		break;
+	case S_STORE_RR:
+	case S_STORE_RK:
+		what |= TRACE_STORE;
+		*p++ = operand & (SIM_SCRATCHPAD - 1);
+		*p++ = reg[ins->x];
+		break;
+	default:
+		break;
+	}
+
+	rec[0] = what;
+	append(t, rec, p - rec);
+}
+
+static void acknowledged(struct sim *s, uint64_t end, void *ctx)
+{
+	(void) s;
+	(void) end;
+	((struct trace *) ctx)->acked = true;
+}
+
+static void after(struct sim *s, const struct step *st, void *ctx)
+{
+	(void) s;
+	struct trace *t = (struct trace *) ctx;
+	record(t, st->address, st->reg, st->ack || t->acked);
+	t->acked = false;
+}
+
+bool trace_observe(struct trace *t, struct stepper *st)
+{
+	const struct step_observer o = {.acknowledged = &acknowledged, .after = &after, .ctx = t};
+	return step_observe(st, &o);
+}
+
+enum sim_status trace_run(struct trace *t, uint64_t instructions)
+{
+	struct stepper st;
+	step_init(&st, t->sim);
+	trace_observe(t, &st);
+	return step_run(&st, instructions);
+}
+
+// =================================== //
+// ------------- reader -------------- //
+// =================================== //
+
+#define READER_BUFFER (64 * 1024)
+
+struct trace_reader {
+	FILE *f;
+	struct trace_state state;
+	bool error;
+	uint8_t buf[READER_BUFFER];
+	size_t pos;
+	size_t len;
+};
+
+/**
+ * @return the next byte or -1 at the end of the file
+ */
+static int next_byte(struct trace_reader *r)
+{
+	if(r->pos == r->len) {
+		r->len = fread(r->buf, 1, sizeof(r->buf), r->f);
+		r->pos = 0;
+		if(r->len == 0)
+			return -1;
+	}
+
+	return r->buf[r->pos++];
+}
+
+/**
+ * Reads the operand of a record, the end of the file is an error.
+ */
+static uint8_t operand(struct trace_reader *r)
+{
+	const int c = next_byte(r);
+	if(c == -1)
+		r->error = true;
+	return c;
+}
+
+struct trace_reader *trace_reader_open(const char *path)
+{
+	struct trace_reader *r = (struct trace_reader *) calloc(1, sizeof(struct trace_reader));
+	if(r == NULL)
+		return NULL;
+
+	uint8_t header[TRACE_HEADER];
+	r->f = fopen(path, "rb");
+	if(r->f == NULL || fread(header, 1, sizeof(header), r->f) != sizeof(header)
+			|| memcmp(header, TRACE_MAGIC, 4) || header[4] != TRACE_VERSION) {
+		trace_reader_close(r);
+		return NULL;
+	}
+
+	const uint8_t *p = header + 5;
+	struct trace_state *st = &r->state;
+	st->checksum = get(p, 4);
+	st->pc = get(p + 4, 2) & PC_MASK;
+	st->flags = p[6];
+	memcpy(st->reg, p + 7, SIM_REGS);
+	memcpy(st->scratchpad, p + 7 + SIM_REGS, SIM_SCRATCHPAD);
+	p += 7 + SIM_REGS + SIM_SCRATCHPAD;
+	st->cycles = get(p, 8);
+	st->instructions = get(p + 8, 8);
+	return r;
+}
+
+bool trace_reader_next(struct trace_reader *r, struct trace_record *rec)
+{
+	const int what = next_byte(r);
+	if(what == -1 || r->error)
+		return false;
+	if(what & ~(TRACE_JUMP | TRACE_REG | TRACE_FLAGS | TRACE_INPUT | TRACE_OUTPUT
+				| TRACE_STORE | TRACE_INTERRUPT)) {
+		r->error = true;
+		return false;
+	}
+
+	struct trace_state *st = &r->state;
+	memset(rec, 0, sizeof(*rec));
+	rec->what = what;
+	rec->pc = st->pc;
+	rec->cycle = st->cycles;
+	if(what & TRACE_INTERRUPT) {
+		rec->pc = SIM_VECTOR;
+		rec->cycle += SIM_CYCLES_PER_INSTR;
+	}
+
+	int delta = 0;
+	if(what & TRACE_JUMP) {
+		unsigned v = 0;
+		uint8_t b;
+		int shift = 0;
+		do {
+			b = operand(r);
+			v |= (unsigned) (b & 0x7F) << shift;
+			shift += 7;
+		} while((b & 0x80) && shift < 21);
+		delta = v & 1? -(int) ((v + 1) / 2) : (int) (v / 2);
+	}
+
+	if(what & TRACE_REG) {
+		rec->reg = operand(r) % SIM_REGS;
+		rec->value = operand(r);
+		st->reg[rec->reg] = rec->value;
+	}
+
+	if(what & TRACE_FLAGS)
+		st->flags = operand(r);
+	rec->flags = st->flags;
+
+	if(what & (TRACE_INPUT | TRACE_OUTPUT)) {
+		rec->port = operand(r);
+		rec->data = operand(r);
+	}
+
+	if(what & TRACE_STORE) {
+		rec->address = operand(r) % SIM_SCRATCHPAD;
+		rec->stored = operand(r);
+		st->scratchpad[rec->address] = rec->stored;
+	}
+
+	st->pc = (rec->pc + 1 + delta) & PC_MASK;
+	st->cycles = rec->cycle + SIM_CYCLES_PER_INSTR;
+	st->instructions += 1;
+	return !r->error;
+}
+
+const struct trace_state *trace_reader_state(const struct trace_reader *r)
+{
+	return &r->state;
+}
+
+bool trace_reader_error(const struct trace_reader *r)
+{
+	return r->error || ferror(r->f);
+}
+
+void trace_reader_close(struct trace_reader *r)
+{
+	if(r == NULL)
+		return;
+
+	if(r->f != NULL)
+		fclose(r->f);
+	free(r);
+}
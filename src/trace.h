@@ -0,0 +1,142 @@
+/**
+ * trace.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "sim.h"
+#include "step.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Execution trace of retired instructions in a compact binary format.
+ * The file starts by the state of the processor, then each instruction
+ * is a record of what it changed: the header byte of TRACE_* bits followed
+ * by their operands in the order of the bits. A sequential instruction that
+ * changes one register and the flags takes 4 bytes.
+ *
+ *   header: "PTRC" version:8 checksum:32 pc:16 flags:8 reg:8[16]
+ *           scratchpad:8[64] cycles:64 instructions:64 (little endian)
+ *   TRACE_JUMP       next pc - (pc + 1) modulo 1024, zigzag varint
+ *   TRACE_REG        register:8 value:8
+ *   TRACE_FLAGS      Z | C << 1 | IE << 2
+ *   TRACE_INPUT      port:8 value:8
+ *   TRACE_OUTPUT     port:8 value:8
+ *   TRACE_STORE      address:8 value:8
+ *   TRACE_INTERRUPT  the interrupt was acknowledged before the instruction
+ *
+ * Records are written to a buffer, full buffers are written by a background
+ * thread while the simulation fills the other one (see writer.h). The file
+ * is opened with O_DIRECT where the file system supports it.
+ */
+
+#define TRACE_JUMP 0x01
+#define TRACE_REG 0x02
+#define TRACE_FLAGS 0x04
+#define TRACE_INPUT 0x08
+#define TRACE_OUTPUT 0x10
+#define TRACE_STORE 0x20
+#define TRACE_INTERRUPT 0x40
+
+#define TRACE_FLAG_ZERO 0x01
+#define TRACE_FLAG_CARRY 0x02
+#define TRACE_FLAG_IE 0x04
+
+#define TRACE_BUFFER (1 << 20)
+
+struct trace;
+
+/**
+ * Creates the file and writes the current state of the simulator.
+ * @return NULL on error
+ */
+struct trace *trace_open(struct sim *s, const char *path);
+
+/**
+ * Records the instructions executed by the stepper (see step.h), an interrupt
+ * acknowledged by the host is recorded with the next instruction.
+ * @return false when it has too many observers
+ */
+bool trace_observe(struct trace *t, struct stepper *st);
+
+/**
+ * Executes the instructions like sim_run and records them, the trace alone.
+ */
+enum sim_status trace_run(struct trace *t, uint64_t instructions);
+
+/**
+ * Writes the rest of the records and closes the file.
+ * @return false when anything was not written
+ */
+bool trace_close(struct trace *t);
+
+// =================================== //
+// ------------- reader -------------- //
+// =================================== //
+
+/**
+ * State of the processor while reading, the header at the beginning.
+ */
+struct trace_state {
+	uint32_t checksum;
+	uint16_t pc;	// of the next instruction
+	uint8_t flags;	// TRACE_FLAG_*
+	uint8_t reg[SIM_REGS];
+	uint8_t scratchpad[SIM_SCRATCHPAD];
+	uint64_t cycles;
+	uint64_t instructions;
+};
+
+struct trace_record {
+	uint8_t what;	// TRACE_* bits
+	uint16_t pc;	// of the instruction
+	uint64_t cycle;	// when the instruction started
+	uint8_t reg;	// TRACE_REG
+	uint8_t value;
+	uint8_t flags;	// after the instruction
+	uint8_t port;	// TRACE_INPUT or TRACE_OUTPUT
+	uint8_t data;
+	uint8_t address;	// TRACE_STORE
+	uint8_t stored;
+};
+
+struct trace_reader;
+
+/**
+ * @return NULL when the file can not be read or it is not a trace
+ */
+struct trace_reader *trace_reader_open(const char *path);
+
+/**
+ * Reads the next record and updates the state.
+ * @return false at the end or on error, see trace_reader_error
+ */
+bool trace_reader_next(struct trace_reader *r, struct trace_record *rec);
+
+const struct trace_state *trace_reader_state(const struct trace_reader *r);
+
+/**
+ * @return true when the file is truncated or invalid
+ */
+bool trace_reader_error(const struct trace_reader *r);
+
+void trace_reader_close(struct trace_reader *r);
+
+#endif
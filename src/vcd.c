@@ -0,0 +1,458 @@
+/**
+ * vcd.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "vcd.h"
+#include "writer.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define VCD_RECORD_MAX 1024	// text of a dump or of one instruction
+
+enum signal {
+	SIG_ADDRESS,
+	SIG_INSTRUCTION,
+	SIG_REG,
+	SIG_ZERO = SIG_REG + SIM_REGS,
+	SIG_CARRY,
+	SIG_IE,
+	SIG_PORT_ID,
+	SIG_IN_PORT,
+	SIG_OUT_PORT,
+	SIG_READ_STROBE,
+	SIG_WRITE_STROBE,
+	SIG_INTERRUPT,
+	SIG_INTERRUPT_ACK,
+	SIG_COUNT
+};
+
+static const char *names[SIG_COUNT] = {
+	[SIG_ADDRESS] = "address",
+	[SIG_INSTRUCTION] = "instruction",
+	[SIG_ZERO] = "zero",
+	[SIG_CARRY] = "carry",
+	[SIG_IE] = "ie",
+	[SIG_PORT_ID] = "port_id",
+	[SIG_IN_PORT] = "in_port",
+	[SIG_OUT_PORT] = "out_port",
+	[SIG_READ_STROBE] = "read_strobe",
+	[SIG_WRITE_STROBE] = "write_strobe",
+	[SIG_INTERRUPT] = "interrupt",
+	[SIG_INTERRUPT_ACK] = "interrupt_ack"
+};
+
+static unsigned width(int sig)
+{
+	if(sig == SIG_ADDRESS)
+		return 10;
+	if(sig == SIG_INSTRUCTION)
+		return 18;
+	if(sig < SIG_ZERO || sig == SIG_PORT_ID || sig == SIG_IN_PORT || sig == SIG_OUT_PORT)
+		return 8;
+	return 1;
+}
+
+struct vcd {
+	struct sim *sim;
+	unsigned period;
+	struct vcd_trigger start;
+	struct vcd_trigger stop;
+	bool recording;
+	bool dumped;	// $dumpvars was written
+	bool fired;	// the start at the cycle
+	uint64_t time;	// cycle of the last time stamp
+	bool stamped;
+	uint32_t value[SIG_COUNT];	// the last written
+	struct writer w;
+};
+
+// =================================== //
+// ------------- writer -------------- //
+// =================================== //
+
+/**
+ * Makes room for VCD_RECORD_MAX characters.
+ */
+static void reserve(struct vcd *v)
+{
+	if(v->w.len + VCD_RECORD_MAX > VCD_BUFFER)
+		writer_swap(&v->w);
+}
+
+static void put_char(struct vcd *v, char c)
+{
+	v->w.buffer[v->w.active][v->w.len++] = c;
+}
+
+static void put_str(struct vcd *v, const char *str)
+{
+	const size_t len = strlen(str);
+	memcpy(v->w.buffer[v->w.active] + v->w.len, str, len);
+	v->w.len += len;
+}
+
+static void put_dec(struct vcd *v, uint64_t n)
+{
+	char digits[20];
+	int len = 0;
+	do {
+		digits[len++] = '0' + n % 10;
+		n /= 10;
+	} while(n > 0);
+
+	while(len > 0)
+		put_char(v, digits[--len]);
+}
+
+static char id(int sig)
+{
+	return '!' + sig;
+}
+
+// =================================== //
+// ------------- changes ------------- //
+// =================================== //
+
+static void stamp(struct vcd *v, uint64_t cycle)
+{
+	if(v->stamped && v->time == cycle)
+		return;
+
+	put_char(v, '#');
+	put_dec(v, cycle * v->period);
+	put_char(v, '\n');
+	v->time = cycle;
+	v->stamped = true;
+}
+
+static void put_value(struct vcd *v, int sig, uint32_t value)
+{
+	const unsigned bits = width(sig);
+	if(bits == 1)
+		put_char(v, '0' + (value & 1));
+	else {
+		// leading zeros are not written
+		int msb = bits - 1;
+		while(msb > 0 && !(value >> msb & 1))
+			msb -= 1;
+		put_char(v, 'b');
+		for(; msb >= 0; msb--)
+			put_char(v, '0' + (value >> msb & 1));
+		put_char(v, ' ');
+	}
+
+	put_char(v, id(sig));
+	put_char(v, '\n');
+}
+
+static void change(struct vcd *v, uint64_t cycle, int sig, uint32_t value)
+{
+	if(v->value[sig] == value)
+		return;
+
+	stamp(v, cycle);
+	put_value(v, sig, value);
+	v->value[sig] = value;
+}
+
+/**
+ * Values of the processor, the ports keep the last ones.
+ */
+static void sample(struct vcd *v)
+{
+	const struct sim *s = v->sim;
+	v->value[SIG_ADDRESS] = s->pc;
+	v->value[SIG_INSTRUCTION] = s->code[s->pc];
+	for(int i = 0; i < SIM_REGS; i++)
+		v->value[SIG_REG + i] = s->reg[i];
+	v->value[SIG_ZERO] = sim_zero(s);
+	v->value[SIG_CARRY] = sim_carry(s);
+	v->value[SIG_IE] = s->ie;
+	v->value[SIG_INTERRUPT] = s->irq;
+	v->value[SIG_READ_STROBE] = 0;
+	v->value[SIG_WRITE_STROBE] = 0;
+	v->value[SIG_INTERRUPT_ACK] = 0;
+}
+
+static void dump_on(struct vcd *v, uint64_t cycle)
+{
+	reserve(v);
+	stamp(v, cycle);
+	put_str(v, v->dumped? "$dumpon\n" : "$dumpvars\n");
+	sample(v);
+	for(int sig = 0; sig < SIG_COUNT; sig++)
+		put_value(v, sig, v->value[sig]);
+	put_str(v, "$end\n");
+
+	v->dumped = true;
+	v->recording = true;
+	if(v->start.event == VCD_CYCLE)
+		v->fired = true;
+}
+
+static void dump_off(struct vcd *v, uint64_t cycle)
+{
+	reserve(v);
+	stamp(v, cycle);
+	put_str(v, "$dumpoff\n");
+	for(int sig = 0; sig < SIG_COUNT; sig++) {
+		put_str(v, width(sig) == 1? "x" : "bx ");
+		put_char(v, id(sig));
+		put_char(v, '\n');
+	}
+	put_str(v, "$end\n");
+	v->recording = false;
+}
+
+static void header(struct vcd *v)
+{
+	put_str(v, "$version Pico Simulator $end\n$timescale 1 ns $end\n$scope module kcpsm3 $end\n");
+	for(int sig = 0; sig < SIG_COUNT; sig++) {
+		char name[32];
+		if(sig >= SIG_REG && sig < SIG_ZERO)
+			snprintf(name, sizeof(name), "s%X", sig - SIG_REG);
+		else
+			snprintf(name, sizeof(name), "%s", names[sig]);
+
+		char line[64];
+		if(width(sig) == 1)
+			snprintf(line, sizeof(line), "$var wire 1 %c %s $end\n", id(sig), name);
+		else
+			snprintf(line, sizeof(line), "$var %s %u %c %s [%u:0] $end\n",
+					sig >= SIG_REG && sig < SIG_ZERO? "reg" : "wire",
+					width(sig), id(sig), name, width(sig) - 1);
+		put_str(v, line);
+	}
+	put_str(v, "$upscope $end\n$enddefinitions $end\n");
+}
+
+// =================================== //
+// ------------ recording ------------ //
+// =================================== //
+
+struct vcd *vcd_open(struct sim *s, const char *path, unsigned period,
+		const struct vcd_trigger *start, const struct vcd_trigger *stop)
+{
+	struct vcd *v = (struct vcd *) calloc(1, sizeof(struct vcd));
+	if(v == NULL)
+		return NULL;
+
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if(fd == -1 || !writer_init(&v->w, fd, VCD_BUFFER, 0)) {
+		if(fd != -1)
+			close(fd);
+		free(v);
+		return NULL;
+	}
+
+	v->sim = s;
+	v->period = period;
+	v->start = *start;
+	v->stop = *stop;
+	header(v);
+	if(v->start.event == VCD_NONE)
+		dump_on(v, s->cycles);
+	return v;
+}
+
+bool vcd_close(struct vcd *v)
+{
+	reserve(v);
+	if(v->recording) {
+		// the end of the last instruction
+		stamp(v, v->sim->cycles);
+	}
+
+	const bool ok = writer_close(&v->w);
+	free(v);
+	return ok;
+}
+
+/**
+ * @return true when the instruction at the address accessing the port
+ * (or none) fires the trigger
+ */
+static bool fires(const struct vcd_trigger *t, uint16_t address, int input, int output)
+{
+	switch(t->event) {
+	case VCD_ADDRESS:
+		return t->value == address;
+	case VCD_INPUT:
+		return t->value == input;
+	case VCD_OUTPUT:
+		return t->value == output;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Port of INPUT and of OUTPUT of the instruction, -1 for none.
+ */
+static void ports_of(const struct sim *s, const struct step *st, int *input, int *output)
+{
+	const struct sim_instr *ins = &s->rom[st->address];
+	const bool rr = ins->op == S_INPUT_RR || ins->op == S_OUTPUT_RR;
+	const uint8_t port = rr? st->reg[ins->y] : ins->y;
+	*input = ins->op == S_INPUT_RR || ins->op == S_INPUT_RK? port : -1;
+	*output = ins->op == S_OUTPUT_RR || ins->op == S_OUTPUT_RK? port : -1;
+}
+
+/**
+ * Only the instructions that can fire the start trigger are observed
+ * while not recording.
+ */
+static uint64_t unobserved(struct sim *s, void *ctx)
+{
+	struct vcd *v = (struct vcd *) ctx;
+	const bool watched = v->start.event == VCD_ADDRESS
+		|| v->start.event == VCD_INPUT || v->start.event == VCD_OUTPUT;
+
+	if(!v->recording && v->start.event == VCD_CYCLE && !v->fired
+			&& s->cycles >= v->start.cycle)
+		dump_on(v, s->cycles);
+
+	if(v->recording || watched)
+		return 0;
+	// nothing is recorded until the cycle of the start trigger
+	if(v->start.event == VCD_CYCLE && !v->fired)
+		return (v->start.cycle - s->cycles + SIM_CYCLES_PER_INSTR - 1) / SIM_CYCLES_PER_INSTR;
+	return UINT64_MAX;
+}
+
+/**
+ * The interrupt was raised after the last instruction.
+ */
+static void acknowledged(struct sim *s, uint64_t end, void *ctx)
+{
+	struct vcd *v = (struct vcd *) ctx;
+	if(!v->recording)
+		return;
+
+	reserve(v);
+	change(v, end, SIG_INTERRUPT, 1);
+	change(v, end + 1, SIG_INTERRUPT_ACK, 1);
+	change(v, s->cycles, SIG_INTERRUPT_ACK, 0);
+	change(v, s->cycles, SIG_IE, s->ie);
+}
+
+static void before(struct sim *s, const struct step *st, void *ctx)
+{
+	struct vcd *v = (struct vcd *) ctx;
+	int input, output;
+	ports_of(s, st, &input, &output);
+
+	if(!v->recording && v->start.event != VCD_CYCLE && fires(&v->start, st->address, input, output))
+		dump_on(v, st->cycle);
+	if(v->recording && v->stop.event == VCD_CYCLE && st->cycle >= v->stop.cycle)
+		dump_off(v, st->cycle);
+}
+
+static void after(struct sim *s, const struct step *st, void *ctx)
+{
+	struct vcd *v = (struct vcd *) ctx;
+	if(!v->recording)
+		return;
+
+	const struct sim_instr *ins = &s->rom[st->address];
+	const uint64_t begin = st->begin;
+	int input, output;
+	ports_of(s, st, &input, &output);
+
+	reserve(v);
+	change(v, st->cycle, SIG_INTERRUPT, st->irq);
+	if(st->ack) {
+		change(v, st->cycle + 1, SIG_INTERRUPT_ACK, 1);
+		change(v, begin, SIG_INTERRUPT_ACK, 0);
+		change(v, begin, SIG_IE, 0);
+	}
+
+	change(v, begin, SIG_ADDRESS, st->address);
+	change(v, begin, SIG_INSTRUCTION, s->code[st->address]);
+	if(input >= 0 || output >= 0) {
+		change(v, begin, SIG_PORT_ID, input >= 0? input : output);
+		if(output >= 0)
+			change(v, begin, SIG_OUT_PORT, st->reg[ins->x]);
+		else
+			change(v, begin + 1, SIG_IN_PORT, s->reg[ins->x]);
+		const int strobe = input >= 0? SIG_READ_STROBE : SIG_WRITE_STROBE;
+		change(v, begin + 1, strobe, 1);
+		change(v, begin + 2, strobe, 0);
+	}
+
+	for(int i = 0; i < SIM_REGS; i++)
+		change(v, s->cycles, SIG_REG + i, s->reg[i]);
+	change(v, s->cycles, SIG_ZERO, sim_zero(s));
+	change(v, s->cycles, SIG_CARRY, sim_carry(s));
+	change(v, s->cycles, SIG_IE, s->ie);
+
+	if(v->stop.event != VCD_CYCLE && fires(&v->stop, st->address, input, output))
+		dump_off(v, s->cycles);
+}
+
+bool vcd_observe(struct vcd *v, struct stepper *st)
+{
+	const struct step_observer o = {.unobserved = &unobserved, .acknowledged = &acknowledged,
+		.before = &before, .after = &after, .ctx = v};
+	return step_observe(st, &o);
+}
+
+bool vcd_parse_trigger(const char *text, struct vcd_trigger *t)
+{
+	memset(t, 0, sizeof(struct vcd_trigger));
+	if(*text == '\0')
+		return true;
+
+	int base = 16;
+	unsigned long long max = SIM_PROGRAM_LEN - 1;
+	t->event = VCD_ADDRESS;
+	if(!strncmp(text, "in", 2)) {
+		t->event = VCD_INPUT;
+		max = 0xFF;
+		text += 2;
+	}
+	else if(!strncmp(text, "out", 3)) {
+		t->event = VCD_OUTPUT;
+		max = 0xFF;
+		text += 3;
+	}
+	else if(*text == '@') {
+		t->event = VCD_CYCLE;
+		base = 10;
+		max = UINT64_MAX;
+		text += 1;
+	}
+
+	char *end;
+	errno = 0;
+	const unsigned long long value = strtoull(text, &end, base);
+	if(*text == '\0' || *end != '\0' || errno != 0 || value > max)
+		return false;
+
+	if(t->event == VCD_CYCLE)
+		t->cycle = value;
+	else
+		t->value = value;
+	return true;
+}
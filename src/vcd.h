@@ -0,0 +1,96 @@
+/**
+ * vcd.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _VCD_H
+#define _VCD_H
+
+#include "sim.h"
+#include "step.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Waveforms of the simulation in the Value Change Dump format (IEEE 1364)
+ * for GTKWave and other viewers. The signals are named like the ports
+ * of the KCPSM3 macro (address, instruction, port_id, in_port, out_port,
+ * read_strobe, write_strobe, interrupt, interrupt_ack), so they can be shown
+ * next to the RTL, plus the registers s0-sF and the flags zero, carry and
+ * ie. An instruction starts at its cycle, the strobes and interrupt_ack are
+ * high in its second cycle and the registers and flags change at its end.
+ * Only the changed signals are written.
+ *
+ * The text is formatted to a buffer, full buffers are written by a background
+ * thread while the simulation fills the other one (see writer.h).
+ *
+ * Recording can be limited by triggers. The start trigger fires before the
+ * instruction at the address, reading or writing the port, or starting at
+ * the cycle or later. The stop trigger fires after such an instruction
+ * (at the cycle: before it). Between them the signals are dumped off
+ * ($dumpoff), the start trigger is armed again after the stop, except
+ * for a cycle.
+ */
+
+#define VCD_BUFFER (1 << 20)
+#define VCD_PERIOD_NS 20	// of the clock, 50 MHz
+
+enum vcd_event {
+	VCD_NONE,	// the recording starts at once or never stops
+	VCD_ADDRESS,
+	VCD_INPUT,
+	VCD_OUTPUT,
+	VCD_CYCLE
+};
+
+struct vcd_trigger {
+	uint8_t event;
+	uint16_t value;	// address or port
+	uint64_t cycle;
+};
+
+struct vcd;
+
+/**
+ * Creates the file and writes the declarations of the signals.
+ * @param period of the clock in nanoseconds
+ * @return NULL on error
+ */
+struct vcd *vcd_open(struct sim *s, const char *path, unsigned period,
+		const struct vcd_trigger *start, const struct vcd_trigger *stop);
+
+/**
+ * Records the instructions executed by the stepper (see step.h). An interrupt
+ * acknowledged by the host (see sched_run) is recorded before the next
+ * instruction.
+ * @return false when it has too many observers
+ */
+bool vcd_observe(struct vcd *v, struct stepper *st);
+
+/**
+ * Writes the rest and closes the file.
+ * @return false when anything was not written
+ */
+bool vcd_close(struct vcd *v);
+
+/**
+ * Parses the trigger: <address> or in<port> or out<port> (hexadecimal),
+ * @<cycle> (decimal) or an empty string for VCD_NONE.
+ */
+bool vcd_parse_trigger(const char *text, struct vcd_trigger *t);
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * writer.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#define _GNU_SOURCE	// O_DIRECT
+
+#include "writer.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef O_DIRECT
+	#define O_DIRECT 0
+#endif
+
+/**
+ * The last write may be shorter than a block, it is done without O_DIRECT.
+ */
+static bool write_all(const struct writer *w, const uint8_t *buf, size_t len)
+{
+	if(w->align != 0 && len % w->align != 0 && O_DIRECT != 0) {
+		const int fl = fcntl(w->fd, F_GETFL);
+		if(fl == -1 || fcntl(w->fd, F_SETFL, fl & ~O_DIRECT) == -1)
+			return false;
+	}
+
+	while(len > 0) {
+		const ssize_t n = write(w->fd, buf, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return false;
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+static void *thread(void *arg)
+{
+	struct writer *w = (struct writer *) arg;
+	pthread_mutex_lock(&w->lock);
+
+	for(;;) {
+		while(!w->full && !w->closing)
+			pthread_cond_wait(&w->cond, &w->lock);
+		if(!w->full)
+			break;
+
+		const uint8_t *buf = w->buffer[!w->active];
+		const size_t len = w->full_len;
+		pthread_mutex_unlock(&w->lock);
+		const bool written = write_all(w, buf, len);
+		pthread_mutex_lock(&w->lock);
+
+		w->failed |= !written;
+		w->full = false;
+		pthread_cond_broadcast(&w->cond);
+	}
+
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+static void *allocate(size_t size, size_t align)
+{
+	void *buf = NULL;
+	if(align == 0)
+		return malloc(size);
+	return posix_memalign(&buf, align, size) == 0? buf : NULL;
+}
+
+bool writer_init(struct writer *w, int fd, size_t size, size_t align)
+{
+	w->buffer[0] = (uint8_t *) allocate(size, align);
+	w->buffer[1] = (uint8_t *) allocate(size, align);
+	w->active = 0;
+	w->len = 0;
+	w->size = size;
+	w->fd = fd;
+	w->align = align;
+	w->full = false;
+	w->closing = false;
+	w->failed = false;
+
+	if(w->buffer[0] == NULL || w->buffer[1] == NULL) {
+		free(w->buffer[0]);
+		free(w->buffer[1]);
+		return false;
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	if(pthread_create(&w->thread, NULL, &thread, w) != 0) {
+		pthread_mutex_destroy(&w->lock);
+		pthread_cond_destroy(&w->cond);
+		free(w->buffer[0]);
+		free(w->buffer[1]);
+		return false;
+	}
+
+	return true;
+}
+
+void writer_swap(struct writer *w)
+{
+	pthread_mutex_lock(&w->lock);
+	while(w->full)
+		pthread_cond_wait(&w->cond, &w->lock);
+
+	w->full = true;
+	w->full_len = w->len;
+	w->active = !w->active;
+	w->len = 0;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+bool writer_close(struct writer *w)
+{
+	if(w->len > 0)
+		writer_swap(w);
+
+	pthread_mutex_lock(&w->lock);
+	w->closing = true;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	const bool closed = close(w->fd) == 0;
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->cond);
+	free(w->buffer[0]);
+	free(w->buffer[1]);
+	return !w->failed && closed;
+}
@@ -0,0 +1,75 @@
+/**
+ * writer.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _WRITER_H
+#define _WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/**
+ * Double-buffered writer of a file produced sequentially by the simulation.
+ * The simulation fills the active buffer directly (buffer[active] up to len),
+ * writer_swap passes it to a background thread, which writes it while
+ * the simulation fills the other one. The simulation waits only when
+ * the thread has not written the previous buffer yet.
+ *
+ * With an alignment the buffers are aligned for a file opened with O_DIRECT,
+ * the last write, shorter than a block, is done without O_DIRECT.
+ */
+
+struct writer {
+	uint8_t *buffer[2];
+	int active;
+	size_t len;	// of buffer[active]
+	size_t size;	// of each buffer
+
+	int fd;
+	size_t align;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool full;	// buffer[!active] waits for the thread
+	size_t full_len;
+	bool closing;
+	bool failed;
+};
+
+/**
+ * Allocates the buffers (aligned to align, 0 for no alignment) and starts
+ * the thread writing to fd. The writer owns fd when it succeeds.
+ * @return false on error
+ */
+bool writer_init(struct writer *w, int fd, size_t size, size_t align);
+
+/**
+ * Passes the active buffer to the thread, waits while it writes the other one.
+ */
+void writer_swap(struct writer *w);
+
+/**
+ * Writes the rest of the active buffer, stops the thread, closes the file
+ * and frees the buffers.
+ * @return false when a write or the close failed
+ */
+bool writer_close(struct writer *w);
+
+#endif
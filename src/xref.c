@@ -0,0 +1,54 @@
+/**
+ * xref.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#include "pico.h"
+#include "xref.h"
+#include "scanner.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define XREF_INIT_SIZE 4
+
+bool xref_append(struct pico *p, struct stab_data *data, enum xref_kind kind)
+{
+	struct xref *xref = data->xref;
+	if(xref == NULL || xref->len == xref->size) {
+		const size_t size = xref == NULL? XREF_INIT_SIZE : 2 * xref->size;
+		xref = (struct xref *) realloc(xref, 
+				sizeof(struct xref) + size * sizeof(struct xref_site));
+		if(xref == NULL)
+			return error(p, "Memory allocation error");
+
+		if(data->xref == NULL)
+			xref->len = 0;
+		xref->size = size;
+		data->xref = xref;
+	}
+
+	struct xref_site *site = &xref->site[xref->len++];
+	site->lineno = p->lineno;
+	site->addr = p->address;
+	site->kind = kind;
+	return true;
+}
+
+void xref_free(struct xref *xref)
+{
+	free(xref);
+}
@@ -0,0 +1,68 @@
+/**
+ * xref.h
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+#ifndef _XREF_H
+#define _XREF_H
+
+#include "pico.h"
+#include <stdbool.h>
+
+struct stab_data;
+
+/**
+ * How the symbol appears at the site.
+ */
+enum xref_kind {
+	X_DEFINE = 'D',	// label, CONSTANT or the new name of NAMEREG
+	X_USE = 'U',	// operand of an instruction
+	X_RENAME = 'R'	// the old name of NAMEREG
+};
+
+struct xref_site {
+	int lineno;
+	progaddr_t addr;
+	enum xref_kind kind;
+};
+
+/**
+ * Sites of one symbol in order of appearance.
+ */
+struct xref {
+	size_t len;
+	size_t size;
+	struct xref_site site[];
+};
+
+/**
+ * Appends the site of the symbol at the current line and address.
+ */
+bool xref_append(struct pico *p, struct stab_data *data, enum xref_kind kind);
+
+/**
+ * Records the site when the cross-referencing is enabled.
+ */
+static inline bool xref_record(struct pico *p, struct stab_data *data,
+		enum xref_kind kind)
+{
+	return !p->xref || xref_append(p, data, kind);
+}
+
+void xref_free(struct xref *xref);
+
+#endif
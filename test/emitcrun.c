@@ -0,0 +1,179 @@
+/**
+ * emitcrun.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+/**
+ * Runs a program translated by 'pico -c' (the function given by -DRUN)
+ * and prints the values written by OUTPUT like picosim:
+ *   ./emitcrun <hexfile> [instructions [events]]
+ * The budget ends at the cycle of the given instructions like in picosim
+ * (acknowledged interrupts take their slots).
+ * The HEX file is loaded too as the translated code falls back
+ * to the interpreter when the budget ends inside a block.
+ *
+ * The events have the format of picosim -e (irq, in and stop lines). Unlike
+ * the scheduler, which runs single instructions while the interrupt is set,
+ * they are applied between runs of the translated function, so it takes
+ * the interrupt itself (eg. at once after RETURNI ENABLE) and INPUT reads
+ * the values by the callback.
+ */
+
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EVENTS_MAX 1024
+
+enum sim_status RUN(struct sim *s, uint64_t instructions);
+
+struct event {
+	uint64_t cycle;
+	char kind;	// 'i'rq, i'n', 's'top
+	uint8_t port;
+	uint8_t value;
+};
+
+static struct event events[EVENTS_MAX];
+static size_t events_len;
+static uint8_t ports[256];
+
+static void print_output(struct sim *s, uint8_t port, uint8_t value, void *ctx)
+{
+	(void) ctx;
+	printf("%llu %.2X %.2X\n", (unsigned long long) s->cycles, port, value);
+}
+
+static uint8_t read_input(struct sim *s, uint8_t port, void *ctx)
+{
+	(void) s;
+	(void) ctx;
+	return ports[port];
+}
+
+static bool read_events(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return false;
+
+	char line[256];
+	while(fgets(line, sizeof(line), f) != NULL) {
+		unsigned long long cycle;
+		char what[8];
+		unsigned a = 0;
+		unsigned b = 0;
+		int len;
+
+		if(line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		if(events_len == EVENTS_MAX || sscanf(line, "%llu %7s %n", &cycle, what, &len) != 2
+				|| (events_len > 0 && cycle < events[events_len - 1].cycle))
+			break;
+
+		struct event *e = &events[events_len];
+		if(!strcmp(what, "irq") && sscanf(line + len, "%u", &a) == 1)
+			e->kind = 'i';
+		else if(!strcmp(what, "in") && sscanf(line + len, "%x %x", &a, &b) == 2)
+			e->kind = 'n';
+		else if(!strcmp(what, "stop"))
+			e->kind = 's';
+		else
+			break;
+
+		e->cycle = cycle;
+		e->port = e->kind == 'n'? a : 0;
+		e->value = e->kind == 'n'? b : a;
+		events_len += 1;
+	}
+
+	const bool result = feof(f) && !ferror(f);
+	fclose(f);
+	return result;
+}
+
+/**
+ * Runs the program until the cycle, applying the events at their cycles.
+ */
+static enum sim_status run_events(struct sim *s, uint64_t cycles)
+{
+	size_t next = 0;
+
+	for(;;) {
+		for(; next < events_len && events[next].cycle <= s->cycles; next++) {
+			const struct event *e = &events[next];
+			if(e->kind == 'i')
+				s->irq = e->value;
+			else if(e->kind == 'n')
+				ports[e->port] = e->value;
+			else
+				return SIM_STOPPED;
+		}
+
+		if(s->cycles >= cycles)
+			return SIM_BUDGET;
+
+		// the pending interrupt takes a slot before the next instruction
+		const uint64_t busy = s->cycles + (s->ie && s->irq? SIM_CYCLES_PER_INSTR : 0);
+		const uint64_t until = next < events_len && events[next].cycle < cycles?
+			events[next].cycle : cycles;
+		const uint64_t n = until > busy?
+			(until - busy + SIM_CYCLES_PER_INSTR - 1) / SIM_CYCLES_PER_INSTR : 0;
+
+		if(n == 0) {
+			sim_acknowledge(s);	// the event follows the slot
+			continue;
+		}
+
+		const enum sim_status status = RUN(s, n);
+		if(status != SIM_BUDGET)
+			return status;
+	}
+}
+
+int main(int argc, char *argv[argc])
+{
+	if(argc < 2) {
+		fprintf(stderr, "Usage: %s <hexfile> [instructions [events]]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	code_t code[SIM_PROGRAM_LEN];
+	progaddr_t len;
+	if(!sim_read_hex(argv[1], code, &len))
+		return EXIT_FAILURE;
+
+	if(argc > 3 && !read_events(argv[3])) {
+		fprintf(stderr, "Can not read the events '%s'\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+
+	struct sim *s = (struct sim *) calloc(1, sizeof(struct sim));
+	if(s == NULL || !sim_load(s, code, len))
+		return EXIT_FAILURE;
+
+	s->io.input = &read_input;
+	s->io.output = &print_output;
+	const uint64_t instructions = argc > 2? strtoull(argv[2], NULL, 0) : 1000000;
+	const enum sim_status status = run_events(s, SIM_CYCLES_PER_INSTR * instructions);
+	fprintf(stderr, "%llu instructions, %llu cycles, pc %.3X\n",
+			(unsigned long long) s->instructions, (unsigned long long) s->cycles, s->pc);
+
+	free(s);
+	return status == SIM_INVALID? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,770 @@
+/**
+ * picotest.c
+ * Author: Jan Viktorin
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+ */
+
+/**
+ * Test driver. Assembles every <test>.in in the test directory by the
+ * assembler library on a pool of threads and compares the result with
+ * <test>.out in memory. When <test>.sim exists, the program is simulated
+ * (by the interpreter, by the JIT, with the outputs logged by the port models
+ * and once more continuing from a snapshot taken in the middle) and the values
+ * written by OUTPUT are compared with it. The lanes of the batch simulator
+ * read different values by INPUT, each is compared with the interpreter
+ * reading the same values.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pico.h"
+#include "pc.h"
+#include "buffer.h"
+#include "stab.h"
+#include "output.h"
+#include "assembler.h"
+#include "isa.h"
+#include "sim.h"
+#include "jit.h"
+#include "batch.h"
+#include "snapshot.h"
+#include "ports.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#define PROGRAM "Pico Assembler test driver"
+#define USAGE "[-j<threads>] [-d<testdir>] [-h] [test...]"
+
+#define TEST_NAME_MAX 64
+#define MSG_MAX 128
+#define SIM_BUDGET 1000000
+#define SIM_OUTPUTS_MAX 1024
+#define SIM_LANES 35	// the last group of the batch is not full
+
+enum result {
+	R_SUCCESS, R_FAILED, R_SKIPPED
+};
+
+struct test {
+	// must be the first member, see error()
+	struct pico p;
+	char name[TEST_NAME_MAX];
+	enum result result;
+	double ms;
+	char msg[MSG_MAX];
+};
+
+struct pool {
+	struct test *tests;
+	size_t len;
+	size_t next;
+	const char *dir;
+	pthread_mutex_t lock;
+};
+
+static void help(char *pname)
+{
+	printf("Program '%s'\n", PROGRAM);
+	#ifdef SHORTCUTS_EXTENSION
+	printf("*Compiled with SHORTCUTS_EXTENSION\n");
+	#endif
+	printf("Usage: %s %s\n", pname, USAGE);
+	printf(	"\t-j<threads> Number of threads, default is number of CPUs\n"
+				"\t-d<testdir> Directory with tests, default is '.'\n"
+				"\t-h          Prints this help\n"
+				"\ttest...     Names of tests to run, default are all *.in\n");
+}
+
+/**
+ * Keeps the first error of the test.
+ */
+bool error(struct pico *p, char *msg)
+{
+	if(p == NULL) {
+		fprintf(stderr, "%s\n", msg);
+		return false;
+	}
+
+	struct test *t = (struct test *) p;
+	if(t->msg[0] == '\0')
+		snprintf(t->msg, MSG_MAX, "[l.%d] %s", p->lineno, msg);
+	return false;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * Tests named <target> or <target>_* are assembled for that target.
+ */
+static const struct isa *test_target(const char *name)
+{
+	char target[TEST_NAME_MAX];
+	size_t len = strcspn(name, "_");
+	memcpy(target, name, len);
+	target[len] = '\0';
+
+	const struct isa *isa = isa_find(target);
+	return isa == NULL? isa_default() : isa;
+}
+
+static bool test_skip(const char *name)
+{
+	#ifdef SHORTCUTS_EXTENSION
+	(void) name;
+	return false;
+	#else
+	return !strncmp(name, "extension", strlen("extension"));
+	#endif
+}
+
+/**
+ * Reads the expected result.
+ * @return number of instructions or -1 on error
+ */
+static long read_golden(const char *path, code_t *golden, progaddr_t len)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return -1;
+
+	long i = 0;
+	unsigned int code;
+	while(i < (long) len && fscanf(f, "%x", &code) == 1)
+		golden[i++] = code;
+
+	fclose(f);
+	return i;
+}
+
+static void compare(struct test *t, const code_t *code, progaddr_t len,
+		const char *golden_path)
+{
+	code_t *golden = (code_t *) calloc(len, sizeof(code_t));
+	if(golden == NULL) {
+		snprintf(t->msg, MSG_MAX, "Memory allocation error");
+		return;
+	}
+
+	long golden_len = read_golden(golden_path, golden, len);
+	if(golden_len < 0) {
+		snprintf(t->msg, MSG_MAX, "Can not read %s", golden_path);
+		free(golden);
+		return;
+	}
+
+	for(progaddr_t i = 0; i < len; i++) {
+		if(code[i] != golden[i]) {
+			snprintf(t->msg, MSG_MAX, "first difference at %.3X: %.5X, expected %.5X",
+					i, code[i], golden[i]);
+			free(golden);
+			return;
+		}
+	}
+
+	if(golden_len != (long) len)
+		snprintf(t->msg, MSG_MAX, "expected %ld instructions, got %u", golden_len, len);
+	else
+		t->result = R_SUCCESS;
+
+	free(golden);
+}
+
+struct sim_output {
+	unsigned long long cycle;
+	unsigned int port;
+	unsigned int value;
+};
+
+struct sim_trace {
+	struct sim_output entry[SIM_OUTPUTS_MAX];
+	size_t len;
+	size_t expected;
+	unsigned lane;	// of the batch simulator, the values read by INPUT
+	unsigned reads;
+};
+
+static void record_output(struct sim *s, uint8_t port, uint8_t value, void *ctx)
+{
+	struct sim_trace *trace = (struct sim_trace *) ctx;
+	struct sim_output *e = &trace->entry[trace->len++];
+	e->cycle = s->cycles;
+	e->port = port;
+	e->value = value;
+
+	if(trace->len == trace->expected)
+		sim_stop(s);
+}
+
+/**
+ * The n-th value read by INPUT in the lane, the lanes read different values.
+ */
+static uint8_t lane_input(unsigned lane, unsigned n, uint8_t port)
+{
+	return (uint8_t) (lane * 29 + n * 7 + port);
+}
+
+static uint8_t read_input(struct sim *s, uint8_t port, void *ctx)
+{
+	(void) s;
+	struct sim_trace *trace = (struct sim_trace *) ctx;
+	return lane_input(trace->lane, trace->reads++, port);
+}
+
+/**
+ * Reads <cycle> <port> <value> lines, the format of picosim.
+ * @return number of lines or -1 on error
+ */
+static long read_sim_golden(FILE *f, struct sim_output *golden)
+{
+	long i = 0;
+	while(i < SIM_OUTPUTS_MAX && fscanf(f, "%llu %x %x", &golden[i].cycle,
+				&golden[i].port, &golden[i].value) == 3)
+		i += 1;
+
+	return i;
+}
+
+struct batch_trace {
+	const struct sim_trace *lane;	// outputs of the interpreter for each lane
+	size_t len[SIM_LANES];
+	unsigned reads[SIM_LANES];
+	char *msg;	// the first difference
+};
+
+static uint8_t check_input(struct batch *b, unsigned lane, uint8_t port, void *ctx)
+{
+	(void) b;
+	struct batch_trace *trace = (struct batch_trace *) ctx;
+	return lane_input(lane, trace->reads[lane]++, port);
+}
+
+static void check_output(struct batch *b, unsigned lane, uint8_t port,
+		uint8_t value, void *ctx)
+{
+	struct batch_trace *trace = (struct batch_trace *) ctx;
+	const struct sim_trace *expected = &trace->lane[lane];
+	const size_t i = trace->len[lane]++;
+	const unsigned long long cycle = batch_cycles(b, lane);
+
+	if(i >= expected->len) {
+		if(trace->msg[0] == '\0')
+			snprintf(trace->msg, MSG_MAX, "batch: lane %u: unexpected output %llu %.2X %.2X",
+					lane, cycle, port, value);
+		batch_stop(b, lane);
+		return;
+	}
+
+	const struct sim_output *g = &expected->entry[i];
+	if(g->cycle != cycle || g->port != port || g->value != value) {
+		if(trace->msg[0] == '\0')
+			snprintf(trace->msg, MSG_MAX, "batch: lane %u: output %zu differs: %llu %.2X %.2X, "
+					"expected %llu %.2X %.2X", lane, i, cycle, port, value,
+					g->cycle, g->port, g->value);
+		batch_stop(b, lane);
+	}
+
+	if(trace->len[lane] == expected->len)
+		batch_stop(b, lane);
+}
+
+/**
+ * Runs SIM_LANES instances of the program by the batch simulator, each lane
+ * is compared with the interpreter reading the same values.
+ * @return false when a lane differs (t->msg is set)
+ */
+static bool simulate_batch(struct test *t, struct sim *s, const code_t *code, progaddr_t len)
+{
+	struct sim_trace *lanes = (struct sim_trace *) calloc(SIM_LANES, sizeof(struct sim_trace));
+	struct batch *b = batch_init(code, len, SIM_LANES);
+	if(lanes == NULL || b == NULL) {
+		snprintf(t->msg, MSG_MAX, "Memory allocation error");
+		free(lanes);
+		batch_destroy(b);
+		return false;
+	}
+
+	const struct sim_io saved = s->io;
+	for(unsigned lane = 0; lane < SIM_LANES; lane++) {
+		lanes[lane].lane = lane;
+		lanes[lane].expected = SIM_OUTPUTS_MAX;
+		s->io.input = &read_input;
+		s->io.output = &record_output;
+		s->io.ctx = &lanes[lane];
+		sim_reset(s);
+		sim_run(s, SIM_BUDGET);
+	}
+	s->io = saved;
+
+	struct batch_trace trace = {.lane = lanes, .msg = t->msg};
+	const struct batch_io io = {.input = &check_input, .output = &check_output, .ctx = &trace};
+	batch_set_io(b, &io);
+	t->msg[0] = '\0';
+	batch_run(b, SIM_BUDGET);
+
+	for(unsigned lane = 0; lane < SIM_LANES && t->msg[0] == '\0'; lane++) {
+		if(trace.len[lane] != lanes[lane].len)
+			snprintf(t->msg, MSG_MAX, "batch: lane %u: expected %zu outputs, got %zu",
+					lane, lanes[lane].len, trace.len[lane]);
+	}
+
+	batch_destroy(b);
+	free(lanes);
+	return t->msg[0] == '\0';
+}
+
+/**
+ * Receives the log of the port models.
+ */
+static void record_log(struct sim *s, struct ports *p, enum port_dir dir,
+		uint8_t port, enum port_event event, void *ctx)
+{
+	(void) dir;
+	(void) port;
+	struct sim_trace *trace = (struct sim_trace *) ctx;
+
+	for(uint32_t i = 0; i < p->log_len && trace->len < trace->expected; i++) {
+		struct sim_output *e = &trace->entry[trace->len++];
+		e->cycle = p->log[i].cycle;
+		e->port = p->log[i].port;
+		e->value = p->log[i].value;
+	}
+
+	if(event == PORT_LOG_FULL && trace->len == trace->expected)
+		sim_stop(s);
+}
+
+/**
+ * Compares the recorded outputs with the golden ones.
+ */
+static bool check_trace(struct test *t, const char *engine, const struct sim_trace *trace,
+		const struct sim_output *golden)
+{
+	for(size_t i = 0; i < trace->len; i++) {
+		const struct sim_output *a = &trace->entry[i];
+		const struct sim_output *b = &golden[i];
+		if(a->cycle != b->cycle || a->port != b->port || a->value != b->value) {
+			snprintf(t->msg, MSG_MAX, "%s: output %zu differs: %llu %.2X %.2X, "
+					"expected %llu %.2X %.2X", engine, i, a->cycle, a->port,
+					a->value, b->cycle, b->port, b->value);
+			return false;
+		}
+	}
+
+	if(trace->len != trace->expected) {
+		snprintf(t->msg, MSG_MAX, "%s: expected %zu outputs, got %zu",
+				engine, trace->expected, trace->len);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Stops after a half of the outputs and saves the state with the number
+ * of outputs to a file. The simulation continues, then it is reset and
+ * continues again from the file.
+ */
+static bool simulate_snapshot(struct test *t, struct sim *s, struct sim_trace *trace,
+		const struct sim_output *golden)
+{
+	const size_t expected = trace->expected;
+	sim_reset(s);
+	trace->len = 0;
+	trace->expected = expected / 2;
+	if(trace->expected > 0)
+		sim_run(s, SIM_BUDGET);
+	trace->expected = expected;
+
+	FILE *f = tmpfile();
+	if(f == NULL) {
+		snprintf(t->msg, MSG_MAX, "Can not create a temporary file");
+		return false;
+	}
+
+	struct snapshot snap;
+	snapshot_save(s, &snap);
+	const uint32_t outputs = trace->len;
+	const uint64_t left = SIM_BUDGET - s->instructions;
+	bool result = snapshot_write(f, &snap, &outputs, sizeof(outputs));
+
+	if(result) {
+		sim_run(s, left);
+		result = check_trace(t, "snapshot", trace, golden);
+	}
+
+	uint32_t restored = 0;
+	if(result) {
+		sim_reset(s);
+		uint32_t len = sizeof(restored);
+		rewind(f);
+		result = snapshot_read(f, &snap, &restored, &len) && snapshot_restore(s, &snap)
+			&& len == sizeof(restored) && restored == outputs;
+		if(!result)
+			snprintf(t->msg, MSG_MAX, "snapshot: can not restore");
+	}
+
+	if(result) {
+		trace->len = restored;
+		sim_run(s, left);
+		result = check_trace(t, "restored snapshot", trace, golden);
+	}
+
+	fclose(f);
+	return result;
+}
+
+/**
+ * Records the trace of the simulation to <test>.trc and compares
+ * the outputs read back from it.
+ */
+static bool simulate_trace(struct test *t, struct sim *s, struct sim_trace *trace,
+		const struct sim_output *golden, const char *golden_path)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%.*s.trc", (int) (strlen(golden_path) - 4), golden_path);
+	// the messages name the file without the directory
+	const char *file = strrchr(path, '/');
+	file = file != NULL? file + 1 : path;
+
+	sim_reset(s);
+	trace->len = 0;
+	struct trace *tr = trace_open(s, path);
+	if(tr == NULL) {
+		snprintf(t->msg, MSG_MAX, "trace: can not create %.80s", file);
+		return false;
+	}
+
+	trace_run(tr, SIM_BUDGET);
+	const size_t recorded = trace->len;
+	struct trace_reader *r = NULL;
+	if(!trace_close(tr) || (r = trace_reader_open(path)) == NULL) {
+		snprintf(t->msg, MSG_MAX, "trace: can not write %.80s", file);
+		remove(path);
+		return false;
+	}
+
+	// the outputs of the callback are replaced by those of the trace
+	struct trace_record rec;
+	trace->len = 0;
+	while(trace->len < recorded && trace_reader_next(r, &rec)) {
+		if(!(rec.what & TRACE_OUTPUT))
+			continue;
+
+		struct sim_output *e = &trace->entry[trace->len++];
+		e->cycle = rec.cycle + SIM_CYCLES_PER_INSTR;
+		e->port = rec.port;
+		e->value = rec.data;
+	}
+
+	const bool failed = trace_reader_error(r);
+	trace_reader_close(r);
+	remove(path);
+	if(failed) {
+		snprintf(t->msg, MSG_MAX, "trace: %.80s is invalid", file);
+		return false;
+	}
+
+	return check_trace(t, "trace", trace, golden);
+}
+
+static void simulate(struct test *t, const code_t *code, progaddr_t len,
+		const char *golden_path)
+{
+	FILE *f = fopen(golden_path, "r");
+	if(f == NULL)
+		return;
+
+	t->result = R_FAILED;
+	struct sim *s = (struct sim *) calloc(1, sizeof(struct sim));
+	struct sim_trace *trace = (struct sim_trace *) calloc(1, sizeof(struct sim_trace));
+	struct sim_output *golden = (struct sim_output *) 
+			calloc(SIM_OUTPUTS_MAX, sizeof(struct sim_output));
+	struct jit *j = NULL;
+	struct ports *ports = NULL;
+
+	if(s == NULL || trace == NULL || golden == NULL) {
+		snprintf(t->msg, MSG_MAX, "Memory allocation error");
+		goto cleanup;
+	}
+
+	trace->expected = read_sim_golden(f, golden);
+	if(!sim_load(s, code, len)) {
+		snprintf(t->msg, MSG_MAX, "Can not simulate the program");
+		goto cleanup;
+	}
+
+	s->io.output = &record_output;
+	s->io.ctx = trace;
+
+	j = jit_init(s);
+	ports = ports_init(&record_log, trace);
+	if(j == NULL || ports == NULL) {
+		snprintf(t->msg, MSG_MAX, "Memory allocation error");
+		goto cleanup;
+	}
+
+	for(int i = 0; i < PORTS; i++)
+		ports_log(ports, i);
+
+	static const char *engine[] = {"interpreter", "JIT", "port models"};
+	for(int e = 0; e < 3; e++) {
+		sim_reset(s);
+		trace->len = 0;
+		if(e == 0)
+			sim_run(s, SIM_BUDGET);
+		else if(e == 1)
+			jit_run(j, SIM_BUDGET);
+		else {
+			ports_attach(ports, s);
+			sim_run(s, SIM_BUDGET);
+			ports_flush(s, ports);
+			ports_detach(ports, s);
+		}
+
+		if(!check_trace(t, engine[e], trace, golden))
+			goto cleanup;
+	}
+
+	if(!simulate_snapshot(t, s, trace, golden))
+		goto cleanup;
+
+	if(!simulate_trace(t, s, trace, golden, golden_path))
+		goto cleanup;
+
+	if(!simulate_batch(t, s, code, len))
+		goto cleanup;
+
+	t->result = R_SUCCESS;
+
+cleanup:
+	fclose(f);
+	jit_destroy(j);
+	ports_destroy(ports);
+	free(golden);
+	free(trace);
+	free(s);
+}
+
+static void run_test(struct test *t, const char *dir)
+{
+	const double start = now_ms();
+	t->result = R_FAILED;
+
+	if(test_skip(t->name)) {
+		t->result = R_SKIPPED;
+		snprintf(t->msg, MSG_MAX, "needs SHORTCUTS_EXTENSION");
+		return;
+	}
+
+	char src[PATH_MAX];
+	char golden[PATH_MAX];
+	char sim_golden[PATH_MAX];
+	snprintf(src, sizeof(src), "%s/%s.in", dir, t->name);
+	snprintf(golden, sizeof(golden), "%s/%s.out", dir, t->name);
+	snprintf(sim_golden, sizeof(sim_golden), "%s/%s.sim", dir, t->name);
+
+	struct token tok = {.type = T_UNKNOWN, .lineno = -1};
+	struct pico *p = &t->p;
+	p->tok = &tok;
+	p->lineno = 1;
+
+	p->stab = stab_init();
+	if(p->stab == NULL) {
+		snprintf(t->msg, MSG_MAX, "Memory allocation error");
+		return;
+	}
+
+	if(assembler_setup(p, test_target(t->name))
+			&& buffer_init(p, src)
+			&& output_init_memory(p)) {
+		if(assembler_run(p)) {
+			progaddr_t len;
+			const code_t *code = output_image(p, &len);
+			compare(t, code, len, golden);
+			if(t->result == R_SUCCESS)
+				simulate(t, code, len, sim_golden);
+		}
+	}
+
+	buffer_destroy(p);
+	stab_destroy(p->stab);
+	output_destroy(p);
+	t->ms = now_ms() - start;
+}
+
+static void *worker(void *arg)
+{
+	struct pool *pool = (struct pool *) arg;
+
+	while(1) {
+		pthread_mutex_lock(&pool->lock);
+		const size_t i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if(i >= pool->len)
+			break;
+
+		run_test(&pool->tests[i], pool->dir);
+	}
+
+	return NULL;
+}
+
+static int cmp_test(const void *a, const void *b)
+{
+	return strcmp(((const struct test *) a)->name, ((const struct test *) b)->name);
+}
+
+/**
+ * Collects names of all *.in files in the directory.
+ */
+static struct test *find_tests(const char *dir, size_t *len)
+{
+	DIR *d = opendir(dir);
+	if(d == NULL) {
+		fprintf(stderr, "Can not open the test directory '%s'\n", dir);
+		return NULL;
+	}
+
+	size_t size = 32;
+	struct test *tests = (struct test *) calloc(size, sizeof(struct test));
+	*len = 0;
+
+	struct dirent *e;
+	while(tests != NULL && (e = readdir(d)) != NULL) {
+		const size_t namelen = strlen(e->d_name);
+		if(namelen < 4 || strcmp(e->d_name + namelen - 3, ".in"))
+			continue;
+		if(namelen - 3 >= TEST_NAME_MAX)
+			continue;
+
+		if(*len == size) {
+			struct test *more = (struct test *)
+					realloc(tests, 2 * size * sizeof(struct test));
+			if(more == NULL) {
+				free(tests);
+				tests = NULL;
+				break;
+			}
+			memset(more + size, 0, size * sizeof(struct test));
+			tests = more;
+			size *= 2;
+		}
+
+		memcpy(tests[*len].name, e->d_name, namelen - 3);
+		*len += 1;
+	}
+
+	closedir(d);
+	if(tests == NULL)
+		fprintf(stderr, "Memory allocation error\n");
+	else
+		qsort(tests, *len, sizeof(struct test), &cmp_test);
+	return tests;
+}
+
+int main(int argc, char *argv[argc])
+{
+	const char *dir = ".";
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	opterr = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "hj:d:")) != -1) {
+		switch(opt) {
+		case 'h':
+			help(argv[0]);
+			return EXIT_SUCCESS;
+		case 'j':
+			threads = atol(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case '?':
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(threads < 1)
+		threads = 1;
+
+	struct pool pool = {.tests = NULL, .len = 0, .next = 0, .dir = dir};
+	if(optind < argc) {
+		pool.len = argc - optind;
+		pool.tests = (struct test *) calloc(pool.len, sizeof(struct test));
+		for(size_t i = 0; pool.tests != NULL && i < pool.len; i++)
+			snprintf(pool.tests[i].name, TEST_NAME_MAX, "%s", argv[optind + i]);
+	}
+	else
+		pool.tests = find_tests(dir, &pool.len);
+
+	if(pool.tests == NULL)
+		return EXIT_FAILURE;
+
+	if((size_t) threads > pool.len)
+		threads = pool.len > 0? pool.len : 1;
+
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_t tid[threads];
+	long started = 0;
+	for(; started < threads; started++) {
+		if(pthread_create(&tid[started], NULL, &worker, &pool))
+			break;
+	}
+
+	if(started == 0)
+		worker(&pool);
+	for(long i = 0; i < started; i++)
+		pthread_join(tid[i], NULL);
+	pthread_mutex_destroy(&pool.lock);
+
+	static const char *results[] = {"SUCCESS", "FAILED", "SKIPPED"};
+	size_t count[3] = {0, 0, 0};
+
+	for(size_t i = 0; i < pool.len; i++) {
+		const struct test *t = &pool.tests[i];
+		count[t->result] += 1;
+		printf("==== %-16s == [%s] == %8.3f ms", t->name, results[t->result], t->ms);
+		if(t->result != R_SUCCESS)
+			printf(" %s", t->msg);
+		putchar('\n');
+	}
+
+	#ifdef SHORTCUTS_EXTENSION
+	const char *ext = "enabled";
+	#else
+	const char *ext = "disabled";
+	#endif
+	printf("%zu passed, %zu failed, %zu skipped (extensions %s, %ld threads)\n",
+			count[R_SUCCESS], count[R_FAILED], count[R_SKIPPED], ext, started);
+
+	free(pool.tests);
+	return count[R_FAILED] == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}